@@ -36,6 +36,7 @@ NOTE:   String length must be evenly divisible by 16byte (str_len % 16 == 0)
 #include <stdint.h>
 #include <string.h> // CBC mode, for memset
 #include "aes.h"
+#include "aes_hw.h"
 
 /*****************************************************************************/
 /* Defines:                                                                  */
@@ -74,16 +75,11 @@ NOTE:   String length must be evenly divisible by 16byte (str_len % 16 == 0)
 /*****************************************************************************/
 // state - array holding the intermediate results during decryption.
 typedef uint8_t state_t[4][4];
-static state_t* state;
-
-// The array that stores the round keys.
-static uint8_t RoundKey[keyExpSize];
-
-// The Key input to the AES Program
-static const uint8_t* Key;
 
 #if defined(CBC) && CBC
-  // Initial Vector used only for CBC mode
+  // Round keys and Initial Vector kept between calls of the legacy CBC API,
+  // which allows passing key/iv as 0 to continue a previous stream.
+  static struct AES_ctx CbcCtx;
   static uint8_t* Iv;
 #endif
 
@@ -162,7 +158,7 @@ static uint8_t getSBoxInvert(uint8_t num)
 }
 
 // This function produces Nb(Nr+1) round keys. The round keys are used in each round to decrypt the states. 
-static void KeyExpansion(void)
+static void KeyExpansion(uint8_t* RoundKey, const uint8_t* Key)
 {
   uint32_t i, k;
   uint8_t tempa[4]; // Used for the column/row operations
@@ -235,7 +231,7 @@ static void KeyExpansion(void)
 
 // This function adds the round key to state.
 // The round key is added to the state by an XOR function.
-static void AddRoundKey(uint8_t round)
+static void AddRoundKey(uint8_t round, state_t* state, const uint8_t* RoundKey)
 {
   uint8_t i,j;
   for(i=0;i<4;++i)
@@ -249,7 +245,7 @@ static void AddRoundKey(uint8_t round)
 
 // The SubBytes Function Substitutes the values in the
 // state matrix with values in an S-box.
-static void SubBytes(void)
+static void SubBytes(state_t* state)
 {
   uint8_t i, j;
   for(i = 0; i < 4; ++i)
@@ -264,7 +260,7 @@ static void SubBytes(void)
 // The ShiftRows() function shifts the rows in the state to the left.
 // Each row is shifted with different offset.
 // Offset = Row number. So the first row is not shifted.
-static void ShiftRows(void)
+static void ShiftRows(state_t* state)
 {
   uint8_t temp;
 
@@ -298,7 +294,7 @@ static uint8_t xtime(uint8_t x)
 }
 
 // MixColumns function mixes the columns of the state matrix
-static void MixColumns(void)
+static void MixColumns(state_t* state)
 {
   uint8_t i;
   uint8_t Tmp,Tm,t;
@@ -336,7 +332,7 @@ static uint8_t Multiply(uint8_t x, uint8_t y)
 // MixColumns function mixes the columns of the state matrix.
 // The method used to multiply may be difficult to understand for the inexperienced.
 // Please use the references to gain more information.
-static void InvMixColumns(void)
+static void InvMixColumns(state_t* state)
 {
   int i;
   uint8_t a,b,c,d;
@@ -357,7 +353,7 @@ static void InvMixColumns(void)
 
 // The SubBytes Function Substitutes the values in the
 // state matrix with values in an S-box.
-static void InvSubBytes(void)
+static void InvSubBytes(state_t* state)
 {
   uint8_t i,j;
   for(i=0;i<4;++i)
@@ -369,7 +365,7 @@ static void InvSubBytes(void)
   }
 }
 
-static void InvShiftRows(void)
+static void InvShiftRows(state_t* state)
 {
   uint8_t temp;
 
@@ -399,87 +395,181 @@ static void InvShiftRows(void)
 
 
 // Cipher is the main function that encrypts the PlainText.
-static void Cipher(void)
+static void Cipher(state_t* state, const uint8_t* RoundKey)
 {
   uint8_t round = 0;
 
   // Add the First round key to the state before starting the rounds.
-  AddRoundKey(0); 
+  AddRoundKey(0, state, RoundKey); 
   
   // There will be Nr rounds.
   // The first Nr-1 rounds are identical.
   // These Nr-1 rounds are executed in the loop below.
   for(round = 1; round < Nr; ++round)
   {
-    SubBytes();
-    ShiftRows();
-    MixColumns();
-    AddRoundKey(round);
+    SubBytes(state);
+    ShiftRows(state);
+    MixColumns(state);
+    AddRoundKey(round, state, RoundKey);
   }
   
   // The last round is given below.
   // The MixColumns function is not here in the last round.
-  SubBytes();
-  ShiftRows();
-  AddRoundKey(Nr);
+  SubBytes(state);
+  ShiftRows(state);
+  AddRoundKey(Nr, state, RoundKey);
 }
 
-static void InvCipher(void)
+static void InvCipher(state_t* state, const uint8_t* RoundKey)
 {
   uint8_t round=0;
 
   // Add the First round key to the state before starting the rounds.
-  AddRoundKey(Nr); 
+  AddRoundKey(Nr, state, RoundKey); 
 
   // There will be Nr rounds.
   // The first Nr-1 rounds are identical.
   // These Nr-1 rounds are executed in the loop below.
   for(round=Nr-1;round>0;round--)
   {
-    InvShiftRows();
-    InvSubBytes();
-    AddRoundKey(round);
-    InvMixColumns();
+    InvShiftRows(state);
+    InvSubBytes(state);
+    AddRoundKey(round, state, RoundKey);
+    InvMixColumns(state);
   }
   
   // The last round is given below.
   // The MixColumns function is not here in the last round.
-  InvShiftRows();
-  InvSubBytes();
-  AddRoundKey(0);
+  InvShiftRows(state);
+  InvSubBytes(state);
+  AddRoundKey(0, state, RoundKey);
 }
 
 
 /*****************************************************************************/
 /* Public functions:                                                         */
 /*****************************************************************************/
+void AES_init_ctx(struct AES_ctx* ctx, const uint8_t* key)
+{
+  KeyExpansion(ctx->RoundKey, key);
+}
+
+static void SoftwareEncrypt(const struct AES_ctx* ctx, uint8_t* buf)
+{
+  Cipher((state_t*)buf, ctx->RoundKey);
+}
+
+static void SoftwareEncryptMulti(const struct AES_ctx* const* ctx, uint8_t* buf, uint32_t blocks)
+{
+  uint32_t i;
+  for(i = 0; i < blocks; ++i)
+  {
+    Cipher((state_t*)(buf + BLOCKLEN * i), ctx[i]->RoundKey);
+  }
+}
+
+static void ResolveEncrypt(const struct AES_ctx* ctx, uint8_t* buf);
+static void ResolveEncryptMulti(const struct AES_ctx* const* ctx, uint8_t* buf, uint32_t blocks);
+
+// Selected block encrypt. Resolution is idempotent, so racing threads at
+// most probe the CPU twice and store the same pointers.
+static volatile aes_block_fn EncryptBlock = ResolveEncrypt;
+static volatile aes_multi_fn EncryptMulti = ResolveEncryptMulti;
+static volatile int Backend = -1;
+static int ForceSoftware = 0;
+
+static void SelectBackend(void)
+{
+  aes_block_fn fn = SoftwareEncrypt;
+  aes_multi_fn multi = SoftwareEncryptMulti;
+  int id = AES_BACKEND_SOFTWARE;
+
+  if(!ForceSoftware)
+  {
+    id = aes_hw_detect(&fn, &multi);
+  }
+  Backend = id;
+  EncryptMulti = multi;
+  EncryptBlock = fn;
+}
+
+static void ResolveEncrypt(const struct AES_ctx* ctx, uint8_t* buf)
+{
+  SelectBackend();
+  EncryptBlock(ctx, buf);
+}
+
+static void ResolveEncryptMulti(const struct AES_ctx* const* ctx, uint8_t* buf, uint32_t blocks)
+{
+  SelectBackend();
+  EncryptMulti(ctx, buf, blocks);
+}
+
+int AES_backend(void)
+{
+  if(Backend < 0)
+  {
+    SelectBackend();
+  }
+  return Backend;
+}
+
+const char* AES_backend_name(void)
+{
+  switch(AES_backend())
+  {
+    case AES_BACKEND_AESNI: return "AES-NI";
+    case AES_BACKEND_ARMCE: return "ARMv8 CE";
+    default:                return "software";
+  }
+}
+
+void AES_force_software(int set)
+{
+  ForceSoftware = set;
+  SelectBackend();
+}
+
 #if defined(ECB) && ECB
 
 
+void AES_ECB_encrypt_ctx(const struct AES_ctx* ctx, uint8_t* buf)
+{
+  // The next function call encrypts the PlainText with the Key using AES algorithm.
+  EncryptBlock(ctx, buf);
+}
+
+void AES_ECB_encrypt_multi_ctx(const struct AES_ctx* const* ctx, uint8_t* buf, uint32_t blocks)
+{
+  EncryptMulti(ctx, buf, blocks);
+}
+
+void AES_ECB_decrypt_ctx(const struct AES_ctx* ctx, uint8_t* buf)
+{
+  InvCipher((state_t*)buf, ctx->RoundKey);
+}
+
 void AES_ECB_encrypt(const uint8_t* input, const uint8_t* key, uint8_t* output, const uint32_t length)
 {
+  struct AES_ctx ctx;
+
   // Copy input to output, and work in-memory on output
   memcpy(output, input, length);
-  state = (state_t*)output;
-
-  Key = key;
-  KeyExpansion();
 
-  // The next function call encrypts the PlainText with the Key using AES algorithm.
-  Cipher();
+  AES_init_ctx(&ctx, key);
+  AES_ECB_encrypt_ctx(&ctx, output);
 }
 
 void AES_ECB_decrypt(const uint8_t* input, const uint8_t* key, uint8_t *output, const uint32_t length)
 {
+  struct AES_ctx ctx;
+
   // Copy input to output, and work in-memory on output
   memcpy(output, input, length);
-  state = (state_t*)output;
-
-  // The KeyExpansion routine must be called before encryption.
-  Key = key;
-  KeyExpansion();
 
-  InvCipher();
+  // The KeyExpansion routine must be called before decryption.
+  AES_init_ctx(&ctx, key);
+  AES_ECB_decrypt_ctx(&ctx, output);
 }
 
 
@@ -509,8 +599,7 @@ void AES_CBC_encrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, co
   // Skip the key expansion if key is passed as 0
   if(0 != key)
   {
-    Key = key;
-    KeyExpansion();
+    AES_init_ctx(&CbcCtx, key);
   }
 
   if(iv != 0)
@@ -522,8 +611,7 @@ void AES_CBC_encrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, co
   {
     XorWithIv(input);
     memcpy(output, input, BLOCKLEN);
-    state = (state_t*)output;
-    Cipher();
+    Cipher((state_t*)output, CbcCtx.RoundKey);
     Iv = output;
     input += BLOCKLEN;
     output += BLOCKLEN;
@@ -533,8 +621,7 @@ void AES_CBC_encrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, co
   if(extra)
   {
     memcpy(output, input, extra);
-    state = (state_t*)output;
-    Cipher();
+    Cipher((state_t*)output, CbcCtx.RoundKey);
   }
 }
 
@@ -546,8 +633,7 @@ void AES_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, co
   // Skip the key expansion if key is passed as 0
   if(0 != key)
   {
-    Key = key;
-    KeyExpansion();
+    AES_init_ctx(&CbcCtx, key);
   }
 
   // If iv is passed as 0, we continue to encrypt without re-setting the Iv
@@ -559,8 +645,7 @@ void AES_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, co
   for(i = 0; i < length; i += BLOCKLEN)
   {
     memcpy(output, input, BLOCKLEN);
-    state = (state_t*)output;
-    InvCipher();
+    InvCipher((state_t*)output, CbcCtx.RoundKey);
     XorWithIv(output);
     Iv = input;
     input += BLOCKLEN;
@@ -570,8 +655,7 @@ void AES_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, co
   if(extra)
   {
     memcpy(output, input, extra);
-    state = (state_t*)output;
-    InvCipher();
+    InvCipher((state_t*)output, CbcCtx.RoundKey);
   }
 }
 
@@ -20,8 +20,39 @@
 
 #define AES128
 
+#define AES_BLOCKLEN 16 // Block length in bytes, AES is 128b block only
+#define AES_keyExpSize 176
+
+// Expanded key schedule. Build it once with AES_init_ctx() and reuse it for
+// any number of blocks; the ctx functions keep no other state and are safe
+// to call from several threads on distinct buffers.
+struct AES_ctx
+{
+  uint8_t RoundKey[AES_keyExpSize];
+};
+
+void AES_init_ctx(struct AES_ctx* ctx, const uint8_t* key);
+
+// Block cipher implementation used by the ctx API, chosen on first use by
+// CPU feature detection. The software one is always available.
+#define AES_BACKEND_SOFTWARE 0
+#define AES_BACKEND_AESNI    1
+#define AES_BACKEND_ARMCE    2
+
+int AES_backend(void);
+const char* AES_backend_name(void);
+// Force software backend (set != 0) or return to autodetection (0).
+void AES_force_software(int set);
+
 #if defined(ECB) && ECB
 
+// buf is a single 16-byte block, processed in place
+void AES_ECB_encrypt_ctx(const struct AES_ctx* ctx, uint8_t* buf);
+void AES_ECB_decrypt_ctx(const struct AES_ctx* ctx, uint8_t* buf);
+// Encrypt blocks consecutive blocks of buf in place, block i by ctx[i].
+// Independent blocks are interleaved by hardware backends.
+void AES_ECB_encrypt_multi_ctx(const struct AES_ctx* const* ctx, uint8_t* buf, uint32_t blocks);
+
 void AES_ECB_encrypt(const uint8_t* input, const uint8_t* key, uint8_t *output, const uint32_t length);
 void AES_ECB_decrypt(const uint8_t* input, const uint8_t* key, uint8_t *output, const uint32_t length);
 
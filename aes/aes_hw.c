@@ -0,0 +1,179 @@
+/*
+
+Hardware AES-128 block encryption for the context API in aes.c.
+
+AES-NI is used on x86_64 and the ARMv8 Crypto Extensions on aarch64, both
+selected at runtime after checking the CPU. The expanded key in struct
+AES_ctx has the standard FIPS-197 byte layout, which is exactly what both
+instruction sets expect, so the key schedule is shared with the software
+implementation and only the block function differs.
+
+Only encryption is accelerated: LoRaWAN payload decryption (CTR) and the
+MIC (CMAC) both run the cipher forward.
+
+*/
+
+
+/*****************************************************************************/
+/* Includes:                                                                 */
+/*****************************************************************************/
+#include <stdint.h>
+#include <string.h>
+#include "aes.h"
+#include "aes_hw.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <wmmintrin.h>
+  #define AES_HW_AESNI 1
+#elif defined(__aarch64__)
+  #include <arm_neon.h>
+  #include <sys/auxv.h>
+  #ifndef HWCAP_AES
+    #define HWCAP_AES (1 << 3)
+  #endif
+  #define AES_HW_ARMCE 1
+#endif
+
+
+/*****************************************************************************/
+/* Private functions:                                                        */
+/*****************************************************************************/
+#if defined(AES_HW_AESNI)
+
+__attribute__((target("aes,sse2")))
+static void aes_encrypt_aesni(const struct AES_ctx* ctx, uint8_t* buf)
+{
+  const __m128i* rk = (const __m128i*)ctx->RoundKey;
+  __m128i s = _mm_loadu_si128((const __m128i*)buf);
+  int round;
+
+  s = _mm_xor_si128(s, _mm_loadu_si128(rk));
+  for(round = 1; round < 10; ++round)
+  {
+    s = _mm_aesenc_si128(s, _mm_loadu_si128(rk + round));
+  }
+  s = _mm_aesenclast_si128(s, _mm_loadu_si128(rk + 10));
+  _mm_storeu_si128((__m128i*)buf, s);
+}
+
+// Four independent blocks per iteration hide the AESENC latency
+__attribute__((target("aes,sse2")))
+static void aes_encrypt_multi_aesni(const struct AES_ctx* const* ctx, uint8_t* buf, uint32_t blocks)
+{
+  uint32_t i = 0;
+  int round;
+
+  for(; i + 4 <= blocks; i += 4)
+  {
+    const __m128i* k0 = (const __m128i*)ctx[i]->RoundKey;
+    const __m128i* k1 = (const __m128i*)ctx[i + 1]->RoundKey;
+    const __m128i* k2 = (const __m128i*)ctx[i + 2]->RoundKey;
+    const __m128i* k3 = (const __m128i*)ctx[i + 3]->RoundKey;
+    __m128i* b = (__m128i*)(buf + 16 * i);
+    __m128i s0 = _mm_xor_si128(_mm_loadu_si128(b), _mm_loadu_si128(k0));
+    __m128i s1 = _mm_xor_si128(_mm_loadu_si128(b + 1), _mm_loadu_si128(k1));
+    __m128i s2 = _mm_xor_si128(_mm_loadu_si128(b + 2), _mm_loadu_si128(k2));
+    __m128i s3 = _mm_xor_si128(_mm_loadu_si128(b + 3), _mm_loadu_si128(k3));
+
+    for(round = 1; round < 10; ++round)
+    {
+      s0 = _mm_aesenc_si128(s0, _mm_loadu_si128(k0 + round));
+      s1 = _mm_aesenc_si128(s1, _mm_loadu_si128(k1 + round));
+      s2 = _mm_aesenc_si128(s2, _mm_loadu_si128(k2 + round));
+      s3 = _mm_aesenc_si128(s3, _mm_loadu_si128(k3 + round));
+    }
+    _mm_storeu_si128(b, _mm_aesenclast_si128(s0, _mm_loadu_si128(k0 + 10)));
+    _mm_storeu_si128(b + 1, _mm_aesenclast_si128(s1, _mm_loadu_si128(k1 + 10)));
+    _mm_storeu_si128(b + 2, _mm_aesenclast_si128(s2, _mm_loadu_si128(k2 + 10)));
+    _mm_storeu_si128(b + 3, _mm_aesenclast_si128(s3, _mm_loadu_si128(k3 + 10)));
+  }
+  for(; i < blocks; ++i)
+  {
+    aes_encrypt_aesni(ctx[i], buf + 16 * i);
+  }
+}
+
+#elif defined(AES_HW_ARMCE)
+
+__attribute__((target("+crypto")))
+static void aes_encrypt_armce(const struct AES_ctx* ctx, uint8_t* buf)
+{
+  const uint8_t* rk = ctx->RoundKey;
+  uint8x16_t s = vld1q_u8(buf);
+  int round;
+
+  // AESE does AddRoundKey + SubBytes + ShiftRows, AESMC the MixColumns
+  for(round = 0; round < 9; ++round)
+  {
+    s = vaesmcq_u8(vaeseq_u8(s, vld1q_u8(rk + 16 * round)));
+  }
+  s = vaeseq_u8(s, vld1q_u8(rk + 16 * 9));
+  s = veorq_u8(s, vld1q_u8(rk + 16 * 10));
+  vst1q_u8(buf, s);
+}
+
+// Four independent blocks per iteration keep the AESE/AESMC pipes busy
+__attribute__((target("+crypto")))
+static void aes_encrypt_multi_armce(const struct AES_ctx* const* ctx, uint8_t* buf, uint32_t blocks)
+{
+  uint32_t i = 0;
+  int round;
+
+  for(; i + 4 <= blocks; i += 4)
+  {
+    const uint8_t* k0 = ctx[i]->RoundKey;
+    const uint8_t* k1 = ctx[i + 1]->RoundKey;
+    const uint8_t* k2 = ctx[i + 2]->RoundKey;
+    const uint8_t* k3 = ctx[i + 3]->RoundKey;
+    uint8_t* b = buf + 16 * i;
+    uint8x16_t s0 = vld1q_u8(b);
+    uint8x16_t s1 = vld1q_u8(b + 16);
+    uint8x16_t s2 = vld1q_u8(b + 32);
+    uint8x16_t s3 = vld1q_u8(b + 48);
+
+    for(round = 0; round < 9; ++round)
+    {
+      s0 = vaesmcq_u8(vaeseq_u8(s0, vld1q_u8(k0 + 16 * round)));
+      s1 = vaesmcq_u8(vaeseq_u8(s1, vld1q_u8(k1 + 16 * round)));
+      s2 = vaesmcq_u8(vaeseq_u8(s2, vld1q_u8(k2 + 16 * round)));
+      s3 = vaesmcq_u8(vaeseq_u8(s3, vld1q_u8(k3 + 16 * round)));
+    }
+    vst1q_u8(b, veorq_u8(vaeseq_u8(s0, vld1q_u8(k0 + 16 * 9)), vld1q_u8(k0 + 16 * 10)));
+    vst1q_u8(b + 16, veorq_u8(vaeseq_u8(s1, vld1q_u8(k1 + 16 * 9)), vld1q_u8(k1 + 16 * 10)));
+    vst1q_u8(b + 32, veorq_u8(vaeseq_u8(s2, vld1q_u8(k2 + 16 * 9)), vld1q_u8(k2 + 16 * 10)));
+    vst1q_u8(b + 48, veorq_u8(vaeseq_u8(s3, vld1q_u8(k3 + 16 * 9)), vld1q_u8(k3 + 16 * 10)));
+  }
+  for(; i < blocks; ++i)
+  {
+    aes_encrypt_armce(ctx[i], buf + 16 * i);
+  }
+}
+
+#endif
+
+
+/*****************************************************************************/
+/* Public functions:                                                         */
+/*****************************************************************************/
+int aes_hw_detect(aes_block_fn* encrypt, aes_multi_fn* multi)
+{
+#if defined(AES_HW_AESNI)
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("aes"))
+  {
+    *encrypt = aes_encrypt_aesni;
+    *multi = aes_encrypt_multi_aesni;
+    return AES_BACKEND_AESNI;
+  }
+#elif defined(AES_HW_ARMCE)
+  if(getauxval(AT_HWCAP) & HWCAP_AES)
+  {
+    *encrypt = aes_encrypt_armce;
+    *multi = aes_encrypt_multi_armce;
+    return AES_BACKEND_ARMCE;
+  }
+#endif
+  (void)encrypt;
+  (void)multi;
+  return AES_BACKEND_SOFTWARE;
+}
@@ -0,0 +1,17 @@
+#ifndef _AES_HW_H_
+#define _AES_HW_H_
+
+#include <stdint.h>
+#include "aes.h"
+
+// Block function signature shared by all backends, in place on 16 bytes
+typedef void (*aes_block_fn)(const struct AES_ctx* ctx, uint8_t* buf);
+// Multi block signature, block i of buf is encrypted by ctx[i]
+typedef void (*aes_multi_fn)(const struct AES_ctx* const* ctx, uint8_t* buf, uint32_t blocks);
+
+// Probe CPU, store accelerated block encrypt in *encrypt and *multi and
+// return its AES_BACKEND_* id. Returns AES_BACKEND_SOFTWARE and leaves both
+// untouched if no supported instructions are available.
+int aes_hw_detect(aes_block_fn* encrypt, aes_multi_fn* multi);
+
+#endif //_AES_HW_H_
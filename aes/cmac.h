@@ -0,0 +1,21 @@
+#ifndef _CMAC_H_
+#define _CMAC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "aes.h"
+
+// AES-CMAC (RFC 4493) over the context based AES-128 API. The subkeys are
+// derived once in AES_CMAC_init(), so a context can be kept per key and
+// reused for any number of messages.
+struct AES_CMAC_ctx
+{
+  struct AES_ctx aes;
+  uint8_t K1[AES_BLOCKLEN];
+  uint8_t K2[AES_BLOCKLEN];
+};
+
+void AES_CMAC_init(struct AES_CMAC_ctx* ctx, const uint8_t* key);
+void AES_CMAC(const struct AES_CMAC_ctx* ctx, const uint8_t* msg, size_t length, uint8_t* mac);
+
+#endif //_CMAC_H_
@@ -0,0 +1,164 @@
+/**
+ * \file counter_store.c
+ * \brief Persistent packet counters of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "counter_store.h"
+
+/** 
+ * CounterStore
+ * Count log file is opened once at startup and mapped to memory. Counters 
+ * are updated by atomic increments directly in mapped page, so hot path 
+ * does no file I/O. Page is written back by msync on configured interval 
+ * and at shutdown, counters survive module restart.
+ */
+
+static int cs_fd = -1;
+static struct counterLOG *cs_map = NULL;
+static int cs_interval = CS_DEFAULT_SYNC;
+static time_t cs_last_sync = 0;
+
+static time_t cs_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/** 
+ * Open or create count log file and map it to memory.
+ * file          - Path to count log file
+ * sync_interval - Flush interval in seconds, 0 flush at shutdown only
+ */
+int cs_open(const char *file, int sync_interval) {
+    struct stat st;
+
+    cs_fd = open(file, O_RDWR | O_CREAT, 0644);
+    if (cs_fd < 0) {
+        printf("ERROR: failed to open file '%s'\n", file);
+        return -1;
+    }
+
+    if (fstat(cs_fd, &st) != 0 || (st.st_size < (off_t) sizeof (struct counterLOG) && ftruncate(cs_fd, sizeof (struct counterLOG)) != 0)) {
+        printf("ERROR: failed to resize file '%s'\n", file);
+        close(cs_fd);
+        cs_fd = -1;
+        return -1;
+    }
+    if (st.st_size == 0)
+        printf("INFO: creating count log binary file '%s'\n", file);
+
+    cs_map = (struct counterLOG*) mmap(NULL, sizeof (struct counterLOG), PROT_READ | PROT_WRITE, MAP_SHARED, cs_fd, 0);
+    if (cs_map == MAP_FAILED) {
+        printf("ERROR: failed to map file '%s'\n", file);
+        close(cs_fd);
+        cs_fd = -1;
+        cs_map = NULL;
+        return -1;
+    }
+
+    cs_interval = sync_interval;
+    cs_last_sync = cs_now();
+
+    printf("INFO: cnt_pkt_log: %d\tcnt_bad_pkt_log: %d\tcnt_all_pkt_log: %d\n", cs_map->cnt_pkt_log, cs_map->cnt_bad_pkt_log, cs_map->cnt_all_pkt_log);
+
+    return 0;
+}
+
+/** 
+ * Count received packet, safe to call from any thread.
+ * crc_ok - Packet CRC status is STAT_CRC_OK
+ */
+void cs_count(bool crc_ok) {
+    if (cs_map == NULL)
+        return;
+
+    __atomic_fetch_add(crc_ok ? &cs_map->cnt_pkt_log : &cs_map->cnt_bad_pkt_log, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cs_map->cnt_all_pkt_log, 1, __ATOMIC_RELAXED);
+}
+
+/** 
+ * Schedule write back of mapped counters if flush interval elapsed.
+ */
+void cs_sync(void) {
+    time_t now;
+
+    if (cs_map == NULL || cs_interval <= 0)
+        return;
+
+    now = cs_now();
+    if (now - cs_last_sync < cs_interval)
+        return;
+
+    msync(cs_map, sizeof (struct counterLOG), MS_ASYNC);
+    cs_last_sync = now;
+}
+
+/** 
+ * The cs_get() return mapped counters, NULL if count log is disabled.
+ */
+struct counterLOG *cs_get(void) {
+    return cs_map;
+}
+
+/** 
+ * Flush counters to disk and release count log file.
+ */
+void cs_close(void) {
+    if (cs_map != NULL) {
+        msync(cs_map, sizeof (struct counterLOG), MS_SYNC);
+        munmap(cs_map, sizeof (struct counterLOG));
+        cs_map = NULL;
+    }
+    if (cs_fd >= 0) {
+        close(cs_fd);
+        cs_fd = -1;
+    }
+}
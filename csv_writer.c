@@ -0,0 +1,314 @@
+/**
+ * \file csv_writer.c
+ * \brief Buffered CSV writer of LoRaWAN packet logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "csv_writer.h"
+
+/** 
+ * CsvWriter
+ * Rows are appended to the current chunk without locking. Chunk is handed 
+ * over when full, after flush_rows rows or when its first row is older 
+ * than flush_ms (checked by cw_tick). Writer thread takes all ready chunks, 
+ * writes them by one writev and runs fdatasync when sync is set. Chunk 
+ * counters run freely, caller waits only when all chunks are in flight.
+ */
+
+static void *cw_thread(void *arg) {
+    struct cw_writer *w = (struct cw_writer *) arg;
+    struct iovec iov[CW_CHUNKS];
+    uint32_t start, end, i;
+    int cnt, first;
+    ssize_t nb;
+
+    pthread_mutex_lock(&w->lock);
+    while (1) {
+        while (!w->stop && w->done == w->fill)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (w->done == w->fill)
+            break;
+        start = w->done;
+        end = w->fill;
+        pthread_mutex_unlock(&w->lock);
+
+        cnt = 0;
+        for (i = start; i != end; i++) {
+            iov[cnt].iov_base = w->chunk[i % CW_CHUNKS];
+            iov[cnt].iov_len = w->len[i % CW_CHUNKS];
+            cnt++;
+        }
+
+        /* continue after partial write */
+        first = 0;
+        while (first < cnt) {
+            nb = writev(w->fd, &iov[first], cnt - first);
+            if (nb < 0) {
+                if (errno == EINTR)
+                    continue;
+                w->error = errno;
+                break;
+            }
+            while (first < cnt && (size_t) nb >= iov[first].iov_len)
+                nb -= iov[first++].iov_len;
+            if (first < cnt) {
+                iov[first].iov_base = (char *) iov[first].iov_base + nb;
+                iov[first].iov_len -= nb;
+            }
+        }
+        if (w->sync && fdatasync(w->fd) != 0)
+            w->error = errno;
+
+        pthread_mutex_lock(&w->lock);
+        w->done = end;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return NULL;
+}
+
+/** 
+ * Hand current chunk to writer thread and wait for free chunk if needed.
+ */
+static void cw_handoff(struct cw_writer *w) {
+    pthread_mutex_lock(&w->lock);
+    w->fill++;
+    pthread_cond_broadcast(&w->cond);
+    while (w->fill - w->done >= CW_CHUNKS)
+        pthread_cond_wait(&w->cond, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+
+    w->len[w->fill % CW_CHUNKS] = 0;
+    w->rows = 0;
+}
+
+/** 
+ * Initialization writer and start writer thread. Return 0 on success, -1 on error.
+ * w          - An pointer to writer
+ * fd         - Open file descriptor, owned by writer until cw_close
+ * flush_rows - Flush after this number of rows, 0 disable
+ * flush_ms   - Flush rows older than this number of milliseconds, 0 disable
+ * sync       - Run fdatasync after each write
+ */
+int cw_open(struct cw_writer *w, int fd, uint32_t flush_rows, uint32_t flush_ms, bool sync) {
+    int i;
+
+    memset(w, 0, sizeof (struct cw_writer));
+    w->fd = fd;
+    w->flush_rows = flush_rows;
+    w->flush_ms = flush_ms;
+    w->sync = sync;
+    for (i = 0; i < CW_CHUNKS; i++) {
+        w->chunk[i] = (char *) malloc(CW_CHUNK_SIZE);
+        if (w->chunk[i] == NULL) {
+            while (i-- > 0)
+                free(w->chunk[i]);
+            return -1;
+        }
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    if (pthread_create(&w->tid, NULL, cw_thread, w) != 0) {
+        for (i = 0; i < CW_CHUNKS; i++)
+            free(w->chunk[i]);
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->cond);
+        return -1;
+    }
+
+    return 0;
+}
+
+/** 
+ * Write pending rows, stop writer thread and close file. Return 0 on 
+ * success, -1 if any write failed.
+ * w - An pointer to writer
+ */
+int cw_close(struct cw_writer *w) {
+    int i;
+
+    cw_flush(w);
+    pthread_mutex_lock(&w->lock);
+    w->stop = true;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->tid, NULL);
+
+    for (i = 0; i < CW_CHUNKS; i++)
+        free(w->chunk[i]);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    close(w->fd);
+
+    return (w->error != 0) ? -1 : 0;
+}
+
+/** 
+ * The cw_row_begin() return position for new row, at least CW_LINE_MAX 
+ * bytes are available.
+ * w - An pointer to writer
+ */
+char *cw_row_begin(struct cw_writer *w) {
+    if (w->len[w->fill % CW_CHUNKS] + CW_LINE_MAX > CW_CHUNK_SIZE)
+        cw_handoff(w);
+    return w->chunk[w->fill % CW_CHUNKS] + w->len[w->fill % CW_CHUNKS];
+}
+
+/** 
+ * Commit row started by cw_row_begin() and apply row threshold.
+ * w   - An pointer to writer
+ * end - Position after last character of row
+ */
+void cw_row_end(struct cw_writer *w, char *end) {
+    uint32_t cur = w->fill % CW_CHUNKS;
+
+    w->len[cur] = end - w->chunk[cur];
+    if (w->rows++ == 0 && w->flush_ms > 0)
+        clock_gettime(CLOCK_MONOTONIC, &w->first);
+    if (w->flush_rows > 0 && w->rows >= w->flush_rows)
+        cw_flush(w);
+}
+
+/** 
+ * Hand pending rows to writer thread.
+ * w - An pointer to writer
+ */
+void cw_flush(struct cw_writer *w) {
+    if (w->len[w->fill % CW_CHUNKS] > 0)
+        cw_handoff(w);
+}
+
+/** 
+ * Apply time threshold, called periodically by main loop.
+ * w - An pointer to writer
+ */
+void cw_tick(struct cw_writer *w) {
+    struct timespec now;
+    int64_t age_ms;
+
+    if (w->rows == 0 || w->flush_ms == 0)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    age_ms = (int64_t) (now.tv_sec - w->first.tv_sec) * 1000 + (now.tv_nsec - w->first.tv_nsec) / 1000000;
+    if (age_ms >= w->flush_ms)
+        cw_flush(w);
+}
+
+/**
+ * Field formatting, every function writes at p and returns position after
+ * the written characters, no terminating null character is written.
+ */
+char *cw_put_str(char *p, const char *s) {
+    while (*s)
+        *p++ = *s++;
+    return p;
+}
+
+/** Unsigned decimal right aligned to width by spaces, as %<width>u */
+char *cw_put_uint(char *p, uint32_t v, int width) {
+    char tmp[10];
+    int n = 0;
+
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (width-- > n)
+        *p++ = ' ';
+    while (n)
+        *p++ = tmp[--n];
+    return p;
+}
+
+/** Signed decimal, as %i */
+char *cw_put_int(char *p, int32_t v) {
+    if (v < 0) {
+        *p++ = '-';
+        return cw_put_uint(p, -(uint32_t) v, 0);
+    }
+    return cw_put_uint(p, (uint32_t) v, 0);
+}
+
+/** Upper case hexadecimal on 8 digits, as %08X */
+char *cw_put_hex32(char *p, uint32_t v) {
+    static const char digits[] = "0123456789ABCDEF";
+    int i;
+
+    for (i = 7; i >= 0; i--)
+        p[7 - i] = digits[(v >> (4 * i)) & 0xF];
+    return p + 8;
+}
+
+/** 
+ * Fixed point with sign, as %+<width>.<decimals>f. Rounding is done by 
+ * rint() in current rounding mode, same as printf for values of packets.
+ */
+char *cw_put_fixed(char *p, double v, int decimals, int width) {
+    char tmp[32];
+    char *t = tmp;
+    uint64_t x, frac;
+    uint32_t scale = 1;
+    int i, n;
+
+    for (i = 0; i < decimals; i++)
+        scale *= 10;
+    *t++ = signbit(v) ? '-' : '+';
+    x = (uint64_t) rint(fabs(v) * scale);
+    t = cw_put_uint(t, (uint32_t) (x / scale), 0);
+    if (decimals > 0) {
+        *t++ = '.';
+        for (i = decimals - 1, frac = x % scale; i >= 0; i--, frac /= 10)
+            t[i] = '0' + frac % 10;
+        t += decimals;
+    }
+    n = t - tmp;
+    while (width-- > n)
+        *p++ = ' ';
+    memcpy(p, tmp, n);
+    return p + n;
+}
@@ -0,0 +1,111 @@
+/**
+ * \file csv_writer.h
+ * \brief Buffered CSV writer of LoRaWAN packet logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifndef CSV_WRITER_H
+#define CSV_WRITER_H
+
+/** Buffer chunks, a full chunk or a flush hands chunks to writer thread */
+#define CW_CHUNK_SIZE (64 * 1024)
+#define CW_CHUNKS 8
+
+/** Space reserved for one row, rows must not be longer */
+#define CW_LINE_MAX 4096
+
+/** Default durability, flush by time only and no fdatasync */
+#define CW_DEFAULT_ROWS 0
+#define CW_DEFAULT_MS 1000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** 
+     * Define structure for buffered writer. Rows are formatted by caller 
+     * thread into current chunk, writer thread writes ready chunks by 
+     * single writev and optionally syncs them.
+     */
+    struct cw_writer {
+        int fd;
+        uint32_t flush_rows;
+        uint32_t flush_ms;
+        bool sync;
+        char *chunk[CW_CHUNKS];
+        size_t len[CW_CHUNKS];
+        uint32_t fill;
+        uint32_t done;
+        uint32_t rows;
+        struct timespec first;
+        bool stop;
+        int error;
+        pthread_t tid;
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+    };
+
+    int cw_open(struct cw_writer *w, int fd, uint32_t flush_rows, uint32_t flush_ms, bool sync);
+    int cw_close(struct cw_writer *w);
+
+    char *cw_row_begin(struct cw_writer *w);
+    void cw_row_end(struct cw_writer *w, char *end);
+    void cw_flush(struct cw_writer *w);
+    void cw_tick(struct cw_writer *w);
+
+    char *cw_put_str(char *p, const char *s);
+    char *cw_put_uint(char *p, uint32_t v, int width);
+    char *cw_put_int(char *p, int32_t v);
+    char *cw_put_hex32(char *p, uint32_t v);
+    char *cw_put_fixed(char *p, double v, int decimals, int width);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CSV_WRITER_H */
@@ -0,0 +1,332 @@
+/**
+ * \file dedup.c
+ * \brief Duplicate suppression of uplinks heard by several concentrators or channels.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lora_packet.h"
+#include "dedup.h"
+#include "metrics.h"
+
+/**
+ * Dedup
+ * Uplink heard by several concentrators, or by neighbouring channels of 
+ * one concentrator, is exported once. Key is DevAddr, FCnt and MIC of data 
+ * frames, hash of PHY payload for other frames. First copy opens window, 
+ * copies arriving within it only update best copy (RSSI, then SNR) and 
+ * gateway list; best copy is exported when window ends. Window is equal 
+ * for all uplinks, so pending uplinks expire in arrival order and are kept 
+ * in FIFO ring; open addressing hash table maps key to ring position. When 
+ * ring is full oldest uplink is exported before its window ends. Packets 
+ * with CRC error are exported at once. Best copies are kept in own slab 
+ * sized for a full ring of short uplinks, uplink not fitting there is 
+ * exported at once as well. Single thread only.
+ */
+
+/** Define structure for hash table slot, idx is ring position + 1, 0 marks empty slot */
+struct dd_slot {
+    uint64_t key;
+    uint32_t idx;
+};
+
+#define DD_SLOTS (2 * DD_MAX_PENDING)
+
+static struct dd_entry *dd_ring = NULL;
+static uint32_t dd_head = 0;
+static uint32_t dd_tail = 0;
+static struct dd_slot *dd_slots = NULL;
+static uint64_t dd_window_us = 0;
+static struct dd_counters dd_cnt;
+static struct pk_slab dd_slab;
+
+static inline uint64_t dd_mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+/** 
+ * Key of uplink, equal for every copy of the same frame.
+ */
+static uint64_t dd_key(const struct pk_pkt *p) {
+    struct lr_frame frame;
+    uint64_t h = 0xcbf29ce484222325ULL; /* FNV-1a */
+    uint16_t i;
+
+    if (lr_parse_frame(p->payload, p->size, &frame) == 0 && frame.cls.kind == LR_KIND_DATA)
+        return dd_mix(dd_mix(((uint64_t) frame.dev_addr << 32) | frame.fcnt) ^ frame.mic);
+    for (i = 0; i < p->size; i++) {
+        h ^= p->payload[i];
+        h *= 0x100000001b3ULL;
+    }
+    return dd_mix(h);
+}
+
+/** 
+ * Find slot of key or first empty slot where key belongs.
+ */
+static struct dd_slot *dd_find_slot(uint64_t key) {
+    uint32_t i = (uint32_t) key & (DD_SLOTS - 1);
+
+    while (dd_slots[i].idx != 0 && dd_slots[i].key != key)
+        i = (i + 1) & (DD_SLOTS - 1);
+    return &dd_slots[i];
+}
+
+/** 
+ * Delete slot by backward shift, following entries of the same probe run 
+ * are moved up so no tombstones are needed.
+ */
+static void dd_delete_slot(uint32_t i) {
+    uint32_t j = i, k;
+
+    for (;;) {
+        j = (j + 1) & (DD_SLOTS - 1);
+        if (dd_slots[j].idx == 0)
+            break;
+        k = (uint32_t) dd_slots[j].key & (DD_SLOTS - 1);
+        /* entry stays if its home lies cyclically in (i, j] */
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        dd_slots[i] = dd_slots[j];
+        i = j;
+    }
+    dd_slots[i].idx = 0;
+}
+
+/** 
+ * Remove oldest pending uplink and export its best copy.
+ */
+static int dd_pop(dd_emit_fn emit) {
+    struct dd_entry *e = &dd_ring[dd_head & (DD_MAX_PENDING - 1)];
+    int err;
+
+    dd_delete_slot((uint32_t) (dd_find_slot(e->key) - dd_slots));
+    dd_head++;
+    dd_cnt.emitted++;
+    err = emit(e);
+    pk_free(e->pkt);
+    return err;
+}
+
+/** 
+ * Export copy without window.
+ */
+static int dd_emit_once(const struct pk_pkt *p, int board, uint64_t gw_id, dd_emit_fn emit) {
+    struct dd_entry once;
+
+    memset(&once, 0, sizeof once);
+    once.pkt = (struct pk_pkt*) p;
+    once.board = board;
+    once.copies = 1;
+    once.nb_gw = 1;
+    once.gw[0] = gw_id;
+    dd_cnt.emitted++;
+    return emit(&once);
+}
+
+/** 
+ * Allocate pending ring and hash table. Return 0 on success, -1 on 
+ * allocation failure.
+ * window_ms - Time copies of uplink are collected, in milliseconds
+ */
+int dd_init(uint32_t window_ms) {
+    dd_ring = (struct dd_entry *) malloc(DD_MAX_PENDING * sizeof (struct dd_entry));
+    dd_slots = (struct dd_slot *) calloc(DD_SLOTS, sizeof (struct dd_slot));
+    if (dd_ring == NULL || dd_slots == NULL || pk_init(&dd_slab, DD_MAX_PENDING) != 0) {
+        dd_free();
+        return -1;
+    }
+    dd_head = dd_tail = 0;
+    dd_window_us = (uint64_t) window_ms * 1000;
+    memset(&dd_cnt, 0, sizeof dd_cnt);
+    return 0;
+}
+
+/** 
+ * Release memory, pending uplinks are lost, see dd_flush().
+ */
+void dd_free(void) {
+    free(dd_ring);
+    free(dd_slots);
+    pk_destroy(&dd_slab);
+    dd_ring = NULL;
+    dd_slots = NULL;
+}
+
+/** 
+ * Offer received copy of uplink. New uplink opens window, duplicate only 
+ * updates pending one, expired uplinks are exported first. Return nonzero 
+ * result of emit, 0 otherwise.
+ * p      - An pointer to packet, copied
+ * board  - Concentrator index of the copy
+ * gw_id  - Gateway ID of the concentrator
+ * now_us - Monotonic time in microseconds
+ * emit   - Export callback
+ */
+int dd_offer(const struct pk_pkt *p, int board, uint64_t gw_id, uint64_t now_us, dd_emit_fn emit) {
+    struct dd_entry *e;
+    struct pk_pkt *best;
+    struct dd_slot *slot;
+    uint64_t key;
+    uint8_t g;
+    int err;
+
+    dd_cnt.offered++;
+    if ((err = dd_expire(now_us, emit)) != 0)
+        return err;
+
+    if (p->status != STAT_CRC_OK)
+        return dd_emit_once(p, board, gw_id, emit);
+
+    key = dd_key(p);
+    slot = dd_find_slot(key);
+    if (slot->idx != 0) {
+        e = &dd_ring[slot->idx - 1];
+        e->copies++;
+        for (g = 0; g < e->nb_gw && e->gw[g] != gw_id; g++)
+            ;
+        if (g == e->nb_gw && g < DD_MAX_GW)
+            e->gw[e->nb_gw++] = gw_id;
+        if ((p->rssi > e->pkt->rssi || (p->rssi == e->pkt->rssi && p->snr > e->pkt->snr))
+                && (best = pk_dup(&dd_slab, p)) != NULL) {
+            pk_free(e->pkt);
+            e->pkt = best;
+            e->board = board;
+        }
+        dd_cnt.suppressed++;
+        return 0;
+    }
+
+    /* ring full, oldest uplink leaves before its window ends */
+    if (dd_tail - dd_head == DD_MAX_PENDING) {
+        dd_cnt.forced++;
+        MT_INC(dedup_forced);
+        if ((err = dd_pop(emit)) != 0)
+            return err;
+        slot = dd_find_slot(key);
+    }
+
+    best = pk_dup(&dd_slab, p);
+    if (best == NULL) {
+        dd_cnt.slab_full++;
+        MT_INC(dedup_slab_full);
+        return dd_emit_once(p, board, gw_id, emit);
+    }
+
+    e = &dd_ring[dd_tail & (DD_MAX_PENDING - 1)];
+    e->key = key;
+    e->first_us = now_us;
+    e->pkt = best;
+    e->board = board;
+    e->copies = 1;
+    e->nb_gw = 1;
+    e->gw[0] = gw_id;
+    slot->key = key;
+    slot->idx = (dd_tail & (DD_MAX_PENDING - 1)) + 1;
+    dd_tail++;
+    return 0;
+}
+
+/** 
+ * Export uplinks whose window ended. Return nonzero result of emit, 0 
+ * otherwise.
+ * now_us - Monotonic time in microseconds
+ * emit   - Export callback
+ */
+int dd_expire(uint64_t now_us, dd_emit_fn emit) {
+    int err;
+
+    while (dd_head != dd_tail && dd_ring[dd_head & (DD_MAX_PENDING - 1)].first_us + dd_window_us <= now_us) {
+        if ((err = dd_pop(emit)) != 0)
+            return err;
+    }
+    return 0;
+}
+
+/** 
+ * Export all pending uplinks, used at exit. Return nonzero result of emit, 
+ * 0 otherwise.
+ * emit - Export callback
+ */
+int dd_flush(dd_emit_fn emit) {
+    int err;
+
+    while (dd_head != dd_tail) {
+        if ((err = dd_pop(emit)) != 0)
+            return err;
+    }
+    return 0;
+}
+
+/** 
+ * Format gateway list of uplink as hex IDs separated by comma.
+ * e   - An pointer to uplink
+ * buf - An pointer to buffer of DD_GW_LIST_LEN characters
+ */
+char *dd_gw_list(const struct dd_entry *e, char *buf) {
+    static const char digits[] = "0123456789ABCDEF";
+    char *q = buf;
+    uint8_t g;
+    int i;
+
+    for (g = 0; g < e->nb_gw; g++) {
+        if (g > 0)
+            *q++ = ',';
+        for (i = 60; i >= 0; i -= 4)
+            *q++ = digits[(e->gw[g] >> i) & 0xF];
+    }
+    *q = '\0';
+    return buf;
+}
+
+/** 
+ * Copy duplicate suppression statistics.
+ * c - An pointer to counters
+ */
+void dd_get_counters(struct dd_counters *c) {
+    *c = dd_cnt;
+}
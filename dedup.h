@@ -0,0 +1,110 @@
+/**
+ * \file dedup.h
+ * \brief Duplicate suppression of uplinks heard by several concentrators or channels.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "libloragw/inc/loragw_hal.h"
+#include "multi_board.h"
+#include "pkt_slab.h"
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+/** Maximum number of uplinks waiting for end of their window, power of two */
+#define DD_MAX_PENDING 4096
+
+/** Maximum number of gateways listed for one uplink */
+#define DD_MAX_GW (MB_MAX_BOARDS + 1)
+
+/** Length of gateway list text, 16 hex digits and separator per gateway */
+#define DD_GW_LIST_LEN (DD_MAX_GW * 17)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** 
+     * Define structure for uplink waiting in window, best copy by RSSI then 
+     * SNR is kept in slab of the window together with every gateway which 
+     * received it.
+     */
+    struct dd_entry {
+        uint64_t key;
+        uint64_t first_us;
+        struct pk_pkt *pkt;
+        int board;
+        uint32_t copies;
+        uint8_t nb_gw;
+        uint64_t gw[DD_MAX_GW];
+    };
+
+    /** Define structure for duplicate suppression statistics */
+    struct dd_counters {
+        uint64_t offered;
+        uint64_t suppressed;
+        uint64_t emitted;
+        uint64_t forced; /* emitted before end of window, pending ring full */
+        uint64_t slab_full; /* emitted at once, no slab buffer left for window */
+    };
+
+    /** Callback exporting best copy of uplink, nonzero return stops the caller */
+    typedef int (*dd_emit_fn)(const struct dd_entry *e);
+
+    int dd_init(uint32_t window_ms);
+    void dd_free(void);
+
+    int dd_offer(const struct pk_pkt *p, int board, uint64_t gw_id, uint64_t now_us, dd_emit_fn emit);
+    int dd_expire(uint64_t now_us, dd_emit_fn emit);
+    int dd_flush(dd_emit_fn emit);
+
+    char *dd_gw_list(const struct dd_entry *e, char *buf);
+    void dd_get_counters(struct dd_counters *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEDUP_H */
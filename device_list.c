@@ -46,37 +46,435 @@
 #include <stdint.h>
 #include <math.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "device_list.h"
 
-/** Define structure for BlackList */
-struct dl_device {
-    uint64_t DEV_ADDR;
-    double BASE_RSSI;
-    struct dl_device *next;
-};
-
-struct dl_device *head = NULL;
-struct dl_device *current = NULL;
-
 /** 
  * DeviceList
  * Information is retrieved from incoming physical payload (PHYPayload) by 
  * parsing and revers octets. Device address DEV_ADDR and base received 
  * signal strength Indicator BASE_RSSI.
+ *
+ * Devices are kept in open addressing hash table with linear probing. Slot 
+ * holds DevAddr inline next to index of device record, so a lookup usually 
+ * touches a single cache line. Records live in fixed size chunks of a pool, 
+ * pointers returned by dl_get_device() stay valid when the table grows,
+ * until the device is evicted. Table is doubled when load factor exceeds
+ * DL_MAX_LOAD percent.
+ *
+ * Memory is bounded by optional entry cap enforced by CLOCK replacement on
+ * insert, idle devices are expired incrementally by dl_expire().
  */
 
-void dl_insert_device(uint64_t dev_addr, double base_rssi) {
+/** Define structure for hash table slot, idx is pool index + 1, 0 marks empty slot */
+struct dl_slot {
+    uint64_t key;
+    uint32_t idx;
+};
+
+static struct dl_slot *dl_slots = NULL;
+static uint32_t dl_mask = 0;
+static uint32_t dl_used = 0;
+
+/* pool of records, dl_top records were ever handed out, freed ones are stacked */
+static struct dl_device **dl_chunks = NULL;
+static uint32_t dl_chunks_cnt = 0;
+static uint32_t dl_top = 0;
+static uint32_t *dl_freelist = NULL;
+static uint32_t dl_free_cnt = 0;
+static uint32_t dl_free_size = 0;
+
+/* memory budget and eviction state */
+static uint32_t dl_cap = 0;
+static uint32_t dl_idle_timeout = 0;
+static uint32_t dl_clock_hand = 0;
+static uint32_t dl_idle_hand = 0;
+static uint64_t dl_evicted_idle = 0;
+static uint64_t dl_evicted_cap = 0;
+
+static inline uint32_t dl_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t) key;
+}
+
+static inline struct dl_device *dl_pool_at(uint32_t idx) {
+    return &dl_chunks[idx >> DL_CHUNK_BITS][idx & (DL_CHUNK_SIZE - 1)];
+}
+
+/** 
+ * Take free record from pool, reuse evicted one first, allocate new chunk 
+ * when needed. Return pool index or -1 on allocation failure.
+ */
+static int64_t dl_pool_alloc() {
+    uint32_t chunk;
+
+    if (dl_free_cnt > 0)
+        return dl_freelist[--dl_free_cnt];
+
+    chunk = dl_top >> DL_CHUNK_BITS;
+    if (chunk >= dl_chunks_cnt) {
+        struct dl_device **tmp = (struct dl_device**) realloc(dl_chunks, (chunk + 1) * sizeof *dl_chunks);
+        if (tmp == NULL)
+            return -1;
+        dl_chunks = tmp;
+        dl_chunks[chunk] = (struct dl_device*) malloc(DL_CHUNK_SIZE * sizeof (struct dl_device));
+        if (dl_chunks[chunk] == NULL)
+            return -1;
+        dl_chunks_cnt = chunk + 1;
+    }
+    return dl_top++;
+}
+
+/** 
+ * Return record to pool for reuse by next insert.
+ */
+static void dl_pool_release(uint32_t idx) {
+    dl_pool_at(idx)->used = false;
+    if (dl_free_cnt == dl_free_size) {
+        uint32_t size = dl_free_size ? 2 * dl_free_size : DL_CHUNK_SIZE;
+        uint32_t *tmp = (uint32_t*) realloc(dl_freelist, size * sizeof *dl_freelist);
+        if (tmp == NULL)
+            return; /* record stays unused in pool until dl_clear() */
+        dl_freelist = tmp;
+        dl_free_size = size;
+    }
+    dl_freelist[dl_free_cnt++] = idx;
+}
+
+/** 
+ * Find slot of key or first empty slot where key belongs.
+ */
+static struct dl_slot *dl_find_slot(struct dl_slot *slots, uint32_t mask, uint64_t key) {
+    uint32_t i = dl_hash(key) & mask;
+
+    while (slots[i].idx != 0 && slots[i].key != key)
+        i = (i + 1) & mask;
+    return &slots[i];
+}
+
+/** 
+ * Delete slot by backward shift, following entries of the same probe run 
+ * are moved up so no tombstones are needed.
+ */
+static void dl_delete_slot(uint32_t i) {
+    uint32_t j = i, k;
+
+    for (;;) {
+        j = (j + 1) & dl_mask;
+        if (dl_slots[j].idx == 0)
+            break;
+        k = dl_hash(dl_slots[j].key) & dl_mask;
+        /* entry stays if its home lies cyclically in (i, j] */
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        dl_slots[i] = dl_slots[j];
+        i = j;
+    }
+    dl_slots[i].idx = 0;
+}
+
+/** 
+ * Remove device of pool index from table and release its record.
+ */
+static void dl_evict(uint32_t idx) {
+    struct dl_slot *slot = dl_find_slot(dl_slots, dl_mask, dl_pool_at(idx)->DEV_ADDR);
+
+    dl_delete_slot((uint32_t) (slot - dl_slots));
+    dl_pool_release(idx);
+    dl_used--;
+}
+
+/** 
+ * CLOCK replacement, hand clears reference bits until it meets record not 
+ * used since last pass. Terminates within two rounds of the pool.
+ */
+static void dl_clock_evict() {
+    struct dl_device *dev;
+
+    while (dl_used > 0) {
+        if (dl_clock_hand >= dl_top)
+            dl_clock_hand = 0;
+        dev = dl_pool_at(dl_clock_hand);
+        if (dev->used) {
+            if (!dev->ref) {
+                dl_evict(dl_clock_hand++);
+                dl_evicted_cap++;
+                return;
+            }
+            dev->ref = false;
+        }
+        dl_clock_hand++;
+    }
+}
+
+/** 
+ * Rehash all devices to table of given size (power of two).
+ */
+static int dl_resize(uint32_t size) {
+    struct dl_slot *slots = (struct dl_slot*) calloc(size, sizeof *slots);
+    uint32_t i;
+
+    if (slots == NULL)
+        return -1;
+    if (dl_slots != NULL) {
+        for (i = 0; i <= dl_mask; i++)
+            if (dl_slots[i].idx != 0)
+                *dl_find_slot(slots, size - 1, dl_slots[i].key) = dl_slots[i];
+        free(dl_slots);
+    }
+    dl_slots = slots;
+    dl_mask = size - 1;
+    return 0;
+}
+
+/** 
+ * Return device record, create and zero new one if DevAddr is unknown. When 
+ * the table is full, a not recently used device is evicted first.
+ * created - set to true when record was created by this call
+ */
+static struct dl_device *dl_lookup_or_add(uint64_t dev_addr, bool *created) {
+    struct dl_slot *slot;
+    struct dl_device *add;
+    int64_t idx;
+
+    *created = false;
+    if (dl_used > 0) {
+        slot = dl_find_slot(dl_slots, dl_mask, dev_addr);
+        if (slot->idx != 0) {
+            add = dl_pool_at(slot->idx - 1);
+            add->ref = true;
+            return add;
+        }
+    }
 
-    struct dl_device *add = (struct dl_device*) malloc(sizeof (struct dl_device));
+    if (dl_cap > 0 && dl_used >= dl_cap)
+        dl_clock_evict();
 
+    if (dl_slots == NULL || (uint64_t) (dl_used + 1) * 100 > (uint64_t) (dl_mask + 1) * DL_MAX_LOAD) {
+        if (dl_resize(dl_slots == NULL ? DL_INIT_SIZE : 2 * (dl_mask + 1)) != 0)
+            return NULL;
+    }
+
+    idx = dl_pool_alloc();
+    if (idx < 0)
+        return NULL;
+    add = dl_pool_at((uint32_t) idx);
+    memset(add, 0, sizeof *add);
     add->DEV_ADDR = dev_addr;
-    add->BASE_RSSI = base_rssi;
-    add->next = head;
-    head = add;
+    add->used = true;
+    add->ref = true;
+
+    slot = dl_find_slot(dl_slots, dl_mask, dev_addr);
+    slot->key = dev_addr;
+    slot->idx = (uint32_t) idx + 1;
+    dl_used++;
+    *created = true;
+    return add;
 }
 
+/** 
+ * Set memory budget, zero disables the limit.
+ * max_entries  - maximum number of tracked devices
+ * max_bytes    - maximum memory of records and hash table, converted to entries
+ * idle_timeout - seconds without uplink after which device is evicted
+ */
+void dl_set_limits(uint32_t max_entries, uint64_t max_bytes, uint32_t idle_timeout) {
+    uint64_t cap = max_entries;
+
+    /* every entry costs a record and 100 / DL_MAX_LOAD hash slots */
+    if (max_bytes > 0) {
+        uint64_t per = sizeof (struct dl_device) + (sizeof (struct dl_slot) * 100 + DL_MAX_LOAD - 1) / DL_MAX_LOAD;
+        uint64_t by_bytes = max_bytes / per;
+        if (by_bytes == 0)
+            by_bytes = 1;
+        if (cap == 0 || by_bytes < cap)
+            cap = by_bytes;
+    }
+    dl_cap = (cap > UINT32_MAX) ? UINT32_MAX : (uint32_t) cap;
+    dl_idle_timeout = idle_timeout;
+
+    while (dl_cap > 0 && dl_used > dl_cap)
+        dl_clock_evict();
+}
+
+/** 
+ * Amortized idle eviction, examine at most DL_IDLE_SCAN records from where 
+ * the previous call stopped. Called on every device update, so the whole 
+ * pool is swept gradually without a full pass in RX path.
+ */
+void dl_expire(uint64_t now) {
+    struct dl_device *dev;
+    uint32_t n;
+
+    if (dl_idle_timeout == 0 || dl_used == 0)
+        return;
+    for (n = 0; n < DL_IDLE_SCAN; n++) {
+        if (dl_idle_hand >= dl_top)
+            dl_idle_hand = 0;
+        dev = dl_pool_at(dl_idle_hand);
+        if (dev->used && dev->last_seen + dl_idle_timeout < now) {
+            dl_evict(dl_idle_hand);
+            dl_evicted_idle++;
+        }
+        dl_idle_hand++;
+    }
+}
+
+/** 
+ * Remove single device, return 1 if it was present.
+ */
+uint8_t dl_remove_device(uint64_t dev_addr) {
+    struct dl_slot *slot;
+
+    if (dl_used == 0)
+        return 0;
+    slot = dl_find_slot(dl_slots, dl_mask, dev_addr);
+    if (slot->idx == 0)
+        return 0;
+    dl_evict(slot->idx - 1);
+    return 1;
+}
+
+/** 
+ * Fill occupancy and eviction counters.
+ */
+void dl_get_counters(struct dl_counters *c) {
+    c->entries = dl_used;
+    c->limit = dl_cap;
+    c->slots = dl_slots ? dl_mask + 1 : 0;
+    c->bytes = (uint64_t) dl_chunks_cnt * DL_CHUNK_SIZE * sizeof (struct dl_device)
+            + (uint64_t) c->slots * sizeof (struct dl_slot) + (uint64_t) dl_free_size * sizeof (uint32_t);
+    c->evicted_idle = dl_evicted_idle;
+    c->evicted_cap = dl_evicted_cap;
+}
+
+void dl_insert_device(uint64_t dev_addr, double base_rssi) {
+    bool created;
+    struct dl_device *dev = dl_lookup_or_add(dev_addr, &created);
+
+    /* known device only gets new base RSSI */
+    if (dev != NULL)
+        dev->BASE_RSSI = base_rssi;
+}
+
+/** 
+ * Welford online mean and variance, EWMA and extremes, O(1) per sample.
+ */
+void dl_stat_update(struct dl_stat *s, double x) {
+    double delta;
+
+    if (s->n == 0) {
+        s->ewma = s->min = s->max = x;
+    } else {
+        s->ewma += DL_EWMA_ALPHA * (x - s->ewma);
+        if (x < s->min)
+            s->min = x;
+        if (x > s->max)
+            s->max = x;
+    }
+    s->n++;
+    delta = x - s->mean;
+    s->mean += delta / s->n;
+    s->m2 += delta * (x - s->mean);
+}
+
+/** 
+ * Sample variance of metric, 0 until two samples are seen.
+ */
+double dl_stat_variance(const struct dl_stat *s) {
+    return (s->n > 1) ? s->m2 / (s->n - 1) : 0.0;
+}
+
+/** 
+ * Account received uplink to device statistics, first RSSI becomes the base 
+ * RSSI of new device. FCnt steps count lost frames, repeated counter counts 
+ * retransmissions and backward or too large step is taken as device reset.
+ * Return device record or NULL on allocation failure.
+ */
+struct dl_device* dl_update_device(uint64_t dev_addr, double rssi, double snr, uint16_t fcnt, uint64_t now) {
+    bool created;
+    struct dl_device *dev;
+    uint16_t step;
+
+    /* expire before lookup, so returned record cannot be evicted under us */
+    dl_expire(now);
+    dev = dl_lookup_or_add(dev_addr, &created);
+    if (dev == NULL)
+        return NULL;
+    if (created)
+        dev->BASE_RSSI = rssi;
+
+    dl_stat_update(&dev->rssi, rssi);
+    dl_stat_update(&dev->snr, snr);
+    dev->last_seen = now;
+
+    if (dev->has_fcnt) {
+        step = (uint16_t) (fcnt - dev->last_fcnt);
+        if (step == 0) {
+            dev->fcnt_repeat++;
+            dev->last_gap = 0;
+        } else if (step <= DL_MAX_FCNT_GAP) {
+            dev->last_gap = step - 1;
+            dev->fcnt_lost += dev->last_gap;
+        } else {
+            dev->fcnt_reset++;
+            dev->last_gap = 0;
+        }
+    }
+    dev->last_fcnt = fcnt;
+    dev->has_fcnt = true;
+    return dev;
+}
+
+/** 
+ * Remove all devices, allocated table and pool are kept for reuse.
+ */
+void dl_clear() {
+    if (dl_slots != NULL)
+        memset(dl_slots, 0, (dl_mask + 1) * sizeof *dl_slots);
+    dl_used = 0;
+    dl_top = 0;
+    dl_free_cnt = 0;
+    dl_clock_hand = 0;
+    dl_idle_hand = 0;
+}
+
+/** 
+ * Remove all devices and release memory.
+ */
+void dl_free() {
+    uint32_t i;
+
+    for (i = 0; i < dl_chunks_cnt; i++)
+        free(dl_chunks[i]);
+    free(dl_chunks);
+    free(dl_slots);
+    free(dl_freelist);
+    dl_chunks = NULL;
+    dl_chunks_cnt = 0;
+    dl_slots = NULL;
+    dl_freelist = NULL;
+    dl_free_size = 0;
+    dl_mask = 0;
+    dl_clear();
+}
+
+uint32_t dl_count() {
+    return dl_used;
+}
+
+/** 
+ * Clear device list, kept for compatibility, returns 0.
+ */
 uint8_t dl_is_empty() {
-    head = NULL;
+    dl_clear();
     return 0;
 }
 
@@ -87,18 +485,195 @@ uint8_t dl_is_exist(uint64_t dev_addr) {
 }
 
 struct dl_device* dl_get_device(uint64_t dev_addr) {
+    struct dl_slot *slot;
+    struct dl_device *dev;
 
-    struct dl_device* current = head;
+    if (dl_used == 0)
+        return NULL;
 
-    if (head == NULL)
+    slot = dl_find_slot(dl_slots, dl_mask, dev_addr);
+    if (slot->idx == 0)
         return NULL;
+    dev = dl_pool_at(slot->idx - 1);
+    dev->ref = true;
+    return dev;
+}
 
-    while (current->DEV_ADDR != dev_addr) {
-        if (current->next == NULL)
-            return NULL;
-        else
-            current = current->next;
+/** 
+ * DeviceSnapshot
+ * Device table is persisted the same way as count log, file is mapped to 
+ * memory and written back by msync. Snapshot is header followed by packed 
+ * array of device records. It is built in temporary file and renamed over 
+ * the previous one, so a crash during write never leaves a torn snapshot. 
+ * Loading maps the file read only and inserts records into a table sized 
+ * up front, no rehash happens during warm start.
+ */
+
+static char dl_snap_file[256] = "";
+static int dl_snap_interval = 0;
+static time_t dl_snap_last = 0;
+
+static time_t dl_snap_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/** 
+ * Write all live devices to snapshot file, return number of written devices 
+ * or -1 on error.
+ */
+int dl_snapshot_save(const char *file) {
+    char tmp[sizeof dl_snap_file + 8];
+    struct dl_snap_header *hdr;
+    struct dl_device *rec, *dev;
+    size_t size;
+    uint32_t i, n = 0;
+    void *map;
+    int fd;
+
+    snprintf(tmp, sizeof tmp, "%s.tmp", file);
+    size = sizeof *hdr + (size_t) dl_used * sizeof *rec;
+
+    fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("ERROR: failed to open file '%s'\n", tmp);
+        return -1;
+    }
+    if (ftruncate(fd, size) != 0) {
+        printf("ERROR: failed to resize file '%s'\n", tmp);
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        printf("ERROR: failed to map file '%s'\n", tmp);
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+
+    hdr = (struct dl_snap_header*) map;
+    rec = (struct dl_device*) (hdr + 1);
+    for (i = 0; i < dl_top; i++) {
+        dev = dl_pool_at(i);
+        if (dev->used)
+            rec[n++] = *dev;
+    }
+    memcpy(hdr->magic, DL_SNAP_MAGIC, sizeof hdr->magic);
+    hdr->version = DL_SNAP_VERSION;
+    hdr->rec_size = sizeof *rec;
+    hdr->count = n;
+    hdr->reserved = 0;
+    hdr->created = (uint64_t) time(NULL);
+
+    msync(map, size, MS_SYNC);
+    munmap(map, size);
+    close(fd);
+
+    if (rename(tmp, file) != 0) {
+        printf("ERROR: failed to replace file '%s'\n", file);
+        unlink(tmp);
+        return -1;
+    }
+    return (int) n;
+}
+
+/** 
+ * Load devices from snapshot file into table, return number of loaded 
+ * devices, 0 if file does not exist and -1 if it is invalid.
+ */
+int dl_snapshot_load(const char *file) {
+    const struct dl_snap_header *hdr;
+    const struct dl_device *rec;
+    struct dl_device *dev;
+    struct stat st;
+    uint32_t i, size;
+    bool created;
+    void *map;
+    int fd;
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof *hdr) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    hdr = (const struct dl_snap_header*) map;
+    if (memcmp(hdr->magic, DL_SNAP_MAGIC, sizeof hdr->magic) != 0 || hdr->version != DL_SNAP_VERSION
+            || hdr->rec_size != sizeof *rec || (uint64_t) st.st_size < sizeof *hdr + (uint64_t) hdr->count * sizeof *rec) {
+        printf("ERROR: invalid device snapshot '%s'\n", file);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    /* size table for all records at once */
+    for (size = DL_INIT_SIZE; (uint64_t) (dl_used + hdr->count) * 100 > (uint64_t) size * DL_MAX_LOAD; size *= 2)
+        ;
+    if (size > dl_mask + 1 || dl_slots == NULL)
+        dl_resize(size);
+
+    rec = (const struct dl_device*) (hdr + 1);
+    for (i = 0; i < hdr->count; i++) {
+        dev = dl_lookup_or_add(rec[i].DEV_ADDR, &created);
+        if (dev == NULL)
+            break;
+        *dev = rec[i];
+        dev->used = true;
+        dev->ref = false;
     }
+    munmap(map, st.st_size);
+    return (int) i;
+}
+
+/** 
+ * Open snapshot, warm start table from it and enable periodic write back.
+ * file     - Path to snapshot file
+ * interval - Write back interval in seconds, 0 at shutdown only
+ */
+int dl_snapshot_open(const char *file, int interval) {
+    int n;
+
+    snprintf(dl_snap_file, sizeof dl_snap_file, "%s", file);
+    dl_snap_interval = interval;
+    dl_snap_last = dl_snap_now();
+
+    n = dl_snapshot_load(file);
+    if (n > 0)
+        printf("INFO: loaded %d devices from snapshot '%s'\n", n, file);
+    return n;
+}
 
-    return current;
-}
\ No newline at end of file
+/** 
+ * Write snapshot if interval elapsed, call from thread owning the table.
+ */
+void dl_snapshot_sync(void) {
+    time_t now;
+
+    if (dl_snap_file[0] == '\0' || dl_snap_interval <= 0)
+        return;
+
+    now = dl_snap_now();
+    if (now - dl_snap_last < dl_snap_interval)
+        return;
+
+    dl_snapshot_save(dl_snap_file);
+    dl_snap_last = now;
+}
+
+/** 
+ * Write final snapshot and disable periodic write back.
+ */
+void dl_snapshot_close(void) {
+    if (dl_snap_file[0] == '\0')
+        return;
+    dl_snapshot_save(dl_snap_file);
+    dl_snap_file[0] = '\0';
+}
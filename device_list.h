@@ -47,17 +47,106 @@
 #include <string.h>
 #include <stdbool.h>
 #include <math.h>
+#include "duty_cycle.h"
 
 #ifndef BLACK_LIST_H
 #define BLACK_LIST_H
 
+/** Initial hash table size and maximum load in percent before it doubles */
+#define DL_INIT_SIZE 1024
+#define DL_MAX_LOAD 70
+
+/** Weight of newest sample in exponentially weighted moving average */
+#define DL_EWMA_ALPHA 0.125
+
+/** FCnt step above this is taken as counter reset instead of lost frames */
+#define DL_MAX_FCNT_GAP 16384
+
+/** Records examined by one amortized idle eviction step */
+#define DL_IDLE_SCAN 4
+
+/** Snapshot file identification and layout version */
+#define DL_SNAP_MAGIC "LRDEVSNP"
+#define DL_SNAP_VERSION 2
+#define DL_SNAP_DEFAULT_SYNC 300
+
+/** Device records are allocated in chunks of 2^DL_CHUNK_BITS */
+#define DL_CHUNK_BITS 10
+#define DL_CHUNK_SIZE (1u << DL_CHUNK_BITS)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+    /** Define structure for running statistics of one signal metric */
+    struct dl_stat {
+        uint32_t n;
+        double mean;
+        double m2;
+        double ewma;
+        double min;
+        double max;
+    };
+
+    /** Define structure for DeviceList */
+    struct dl_device {
+        uint64_t DEV_ADDR;
+        double BASE_RSSI;
+        struct dl_stat rssi;
+        struct dl_stat snr;
+        uint64_t last_seen;
+        uint16_t last_fcnt;
+        bool has_fcnt;
+        uint16_t last_gap;
+        uint32_t fcnt_lost;
+        uint32_t fcnt_repeat;
+        uint32_t fcnt_reset;
+        struct dc_window airtime;
+        bool duty_violation;
+        bool used; /* record holds live device */
+        bool ref; /* CLOCK reference bit, set on every access */
+    };
+
+    /** Define structure for occupancy and eviction counters */
+    struct dl_counters {
+        uint32_t entries;
+        uint32_t limit;
+        uint32_t slots;
+        uint64_t bytes;
+        uint64_t evicted_idle;
+        uint64_t evicted_cap;
+    };
+
+    /** Define structure for snapshot header, followed by count device records */
+    struct dl_snap_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t rec_size;
+        uint32_t count;
+        uint32_t reserved;
+        uint64_t created;
+    };
+
     void dl_insert_device(uint64_t dev_addr, double base_rssi);
+    struct dl_device* dl_update_device(uint64_t dev_addr, double rssi, double snr, uint16_t fcnt, uint64_t now);
+    void dl_stat_update(struct dl_stat *s, double x);
+    double dl_stat_variance(const struct dl_stat *s);
     struct dl_device* dl_get_device(uint64_t dev_addr);
+    uint8_t dl_is_exist(uint64_t dev_addr);
     uint8_t dl_is_empty();
+    void dl_clear();
+    void dl_free();
+    uint32_t dl_count();
+    uint8_t dl_remove_device(uint64_t dev_addr);
+    void dl_set_limits(uint32_t max_entries, uint64_t max_bytes, uint32_t idle_timeout);
+    void dl_expire(uint64_t now);
+    void dl_get_counters(struct dl_counters *c);
+
+    int dl_snapshot_save(const char *file);
+    int dl_snapshot_load(const char *file);
+    int dl_snapshot_open(const char *file, int interval);
+    void dl_snapshot_sync(void);
+    void dl_snapshot_close(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,316 @@
+/**
+ * \file downlink.c
+ * \brief Downlink requests of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "parson.h"
+#include "json_arena.h"
+#include "downlink.h"
+
+/** 
+ * Downlink
+ * Downlink requests come as datagrams to Unix socket, one Semtech packet 
+ * forwarder txpk object per datagram, either bare or wrapped in 
+ * {"txpk":{...}}. Socket is non-blocking and drained by the thread driving 
+ * the concentrator, so no locking is needed. Each datagram is parsed in 
+ * arena which is dropped at once afterwards.
+ */
+
+static int dn_fd = -1;
+static char dn_path[sizeof ((struct sockaddr_un *) 0)->sun_path];
+static struct dn_counters dn_cnt;
+static struct ja_arena dn_arena = {NULL, DN_ARENA_CHUNK, 0};
+
+/** 
+ * Open datagram socket. Return 0 on success, -1 on error.
+ * path - Path of Unix socket, stale socket file is replaced
+ */
+int dn_open(const char *path) {
+    struct sockaddr_un sun;
+
+    if (strlen(path) >= sizeof sun.sun_path)
+        return -1;
+    memset(&sun, 0, sizeof sun);
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path);
+    unlink(path);
+    dn_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (dn_fd < 0)
+        return -1;
+    if (bind(dn_fd, (struct sockaddr *) &sun, sizeof sun) != 0) {
+        close(dn_fd);
+        dn_fd = -1;
+        return -1;
+    }
+    strcpy(dn_path, path);
+    return 0;
+}
+
+/** Value of base64 character, -1 for character outside alphabet */
+static int dn_b64_value(char c) {
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+    return -1;
+}
+
+/** 
+ * The dn_b64_decode() return number of decoded bytes, -1 when input is not 
+ * base64 or does not fit.
+ */
+static int dn_b64_decode(const char *in, uint8_t *out, size_t max) {
+    uint32_t acc = 0;
+    size_t len = 0;
+    int bits = 0, v;
+
+    for (; *in != '\0' && *in != '='; in++) {
+        v = dn_b64_value(*in);
+        if (v < 0)
+            return -1;
+        acc = (acc << 6) | (uint32_t) v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (len == max)
+                return -1;
+            out[len++] = (uint8_t) (acc >> bits);
+        }
+    }
+    return (int) len;
+}
+
+/** Parse LoRa datarate "SFxBWy", return false when it is not valid */
+static bool dn_parse_lora_dr(const char *str, struct lgw_pkt_tx_s *pkt) {
+    unsigned int sf, bw;
+
+    if (str == NULL || sscanf(str, "SF%2uBW%3u", &sf, &bw) != 2)
+        return false;
+    switch (sf) {
+        case 7: pkt->datarate = DR_LORA_SF7;
+            break;
+        case 8: pkt->datarate = DR_LORA_SF8;
+            break;
+        case 9: pkt->datarate = DR_LORA_SF9;
+            break;
+        case 10: pkt->datarate = DR_LORA_SF10;
+            break;
+        case 11: pkt->datarate = DR_LORA_SF11;
+            break;
+        case 12: pkt->datarate = DR_LORA_SF12;
+            break;
+        default: return false;
+    }
+    switch (bw) {
+        case 125: pkt->bandwidth = BW_125KHZ;
+            break;
+        case 250: pkt->bandwidth = BW_250KHZ;
+            break;
+        case 500: pkt->bandwidth = BW_500KHZ;
+            break;
+        default: return false;
+    }
+    return true;
+}
+
+/** Parse LoRa coding rate, return false when it is not valid */
+static bool dn_parse_cr(const char *str, struct lgw_pkt_tx_s *pkt) {
+    if (str == NULL)
+        return false;
+    if (strcmp(str, "4/5") == 0)
+        pkt->coderate = CR_LORA_4_5;
+    else if (strcmp(str, "4/6") == 0 || strcmp(str, "2/3") == 0)
+        pkt->coderate = CR_LORA_4_6;
+    else if (strcmp(str, "4/7") == 0)
+        pkt->coderate = CR_LORA_4_7;
+    else if (strcmp(str, "4/8") == 0 || strcmp(str, "1/2") == 0)
+        pkt->coderate = CR_LORA_4_8;
+    else
+        return false;
+    return true;
+}
+
+/** The dn_get_bool() return value of boolean field, false when missing */
+static bool dn_get_bool(JSON_Object *obj, const char *name) {
+    return json_object_get_boolean(obj, name) == 1;
+}
+
+/** The dn_has_number() return true when numeric field is present */
+static bool dn_has_number(JSON_Object *obj, const char *name) {
+    return json_value_get_type(json_object_get_value(obj, name)) == JSONNumber;
+}
+
+/** 
+ * Decode txpk object into downlink. Return DN_PACKET, DN_MALFORMED when 
+ * mandatory field is missing or invalid.
+ * json - An pointer to nul terminated datagram
+ * pkt  - An pointer to downlink to fill
+ */
+int dn_parse(const char *json, struct lgw_pkt_tx_s *pkt) {
+    JSON_Value *root_val;
+    JSON_Object *txpk, *wrap;
+    const char *str;
+    double freq;
+    int len, ret = DN_MALFORMED;
+
+    ja_begin(&dn_arena);
+    root_val = json_parse_string(json);
+    ja_end();
+    wrap = json_value_get_object(root_val);
+    txpk = json_object_get_object(wrap, "txpk");
+    if (txpk == NULL)
+        txpk = wrap;
+    if (txpk == NULL)
+        goto done;
+
+    memset(pkt, 0, sizeof *pkt);
+    if (dn_get_bool(txpk, "imme")) {
+        pkt->tx_mode = IMMEDIATE;
+    } else if (dn_has_number(txpk, "tmst")) {
+        pkt->tx_mode = TIMESTAMPED;
+        pkt->count_us = (uint32_t) json_object_get_number(txpk, "tmst");
+    } else {
+        goto done;
+    }
+
+    freq = json_object_get_number(txpk, "freq");
+    if (freq <= 0.0)
+        goto done;
+    pkt->freq_hz = (uint32_t) llround(freq * 1e6);
+    pkt->rf_chain = (uint8_t) json_object_get_number(txpk, "rfch");
+    pkt->rf_power = (int8_t) json_object_get_number(txpk, "powe");
+    pkt->preamble = (uint16_t) json_object_get_number(txpk, "prea");
+    pkt->no_crc = dn_get_bool(txpk, "ncrc");
+
+    str = json_object_get_string(txpk, "modu");
+    if (str != NULL && strcmp(str, "LORA") == 0) {
+        pkt->modulation = MOD_LORA;
+        if (!dn_parse_lora_dr(json_object_get_string(txpk, "datr"), pkt)
+                || !dn_parse_cr(json_object_get_string(txpk, "codr"), pkt))
+            goto done;
+        pkt->invert_pol = dn_get_bool(txpk, "ipol");
+    } else if (str != NULL && strcmp(str, "FSK") == 0) {
+        pkt->modulation = MOD_FSK;
+        pkt->datarate = (uint32_t) json_object_get_number(txpk, "datr");
+        if (!IS_FSK_DR(pkt->datarate))
+            goto done;
+        pkt->f_dev = (uint8_t) (json_object_get_number(txpk, "fdev") / 1000.0);
+    } else {
+        goto done;
+    }
+
+    str = json_object_get_string(txpk, "data");
+    len = (str != NULL) ? dn_b64_decode(str, pkt->payload, sizeof pkt->payload) : -1;
+    if (len < 0)
+        goto done;
+    if (dn_has_number(txpk, "size")
+            && (int) json_object_get_number(txpk, "size") != len)
+        goto done;
+    pkt->size = (uint16_t) len;
+    ret = DN_PACKET;
+
+done:
+    ja_reset(&dn_arena);
+    return ret;
+}
+
+/** 
+ * Read next waiting datagram. Return DN_PACKET with downlink filled, 
+ * DN_MALFORMED when datagram was dropped, DN_NONE when socket is drained.
+ * pkt - An pointer to downlink to fill
+ */
+int dn_read(struct lgw_pkt_tx_s *pkt) {
+    char buf[DN_DATAGRAM_SIZE];
+    ssize_t len;
+    int ret;
+
+    if (dn_fd < 0)
+        return DN_NONE;
+    len = recv(dn_fd, buf, sizeof buf - 1, MSG_TRUNC);
+    if (len < 0)
+        return DN_NONE;
+    dn_cnt.received++;
+    if ((size_t) len >= sizeof buf) {
+        dn_cnt.malformed++;
+        return DN_MALFORMED;
+    }
+    buf[len] = '\0';
+    ret = dn_parse(buf, pkt);
+    if (ret != DN_PACKET)
+        dn_cnt.malformed++;
+    return ret;
+}
+
+/** 
+ * The dn_get_counters() return counters of downlink source.
+ */
+const struct dn_counters *dn_get_counters(void) {
+    return &dn_cnt;
+}
+
+/** 
+ * Close datagram socket and remove its file.
+ */
+void dn_close(void) {
+    if (dn_fd < 0)
+        return;
+    close(dn_fd);
+    unlink(dn_path);
+    dn_fd = -1;
+    ja_free(&dn_arena);
+}
@@ -0,0 +1,90 @@
+/**
+ * \file downlink.h
+ * \brief Downlink requests of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "libloragw/inc/loragw_hal.h"
+
+#ifndef DOWNLINK_H
+#define DOWNLINK_H
+
+/** Largest accepted datagram, txpk with 256 B payload in base64 fits */
+#define DN_DATAGRAM_SIZE 2048
+
+/** Arena chunk for parsing one datagram */
+#define DN_ARENA_CHUNK 8192
+
+/** 
+ * Define read results:
+ *   DN_NONE      - no datagram is waiting
+ *   DN_PACKET    - downlink was decoded
+ *   DN_MALFORMED - datagram was dropped, it is not valid txpk
+ */
+#define DN_NONE 0
+#define DN_PACKET 1
+#define DN_MALFORMED -1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** Define structure for downlink source counters */
+    struct dn_counters {
+        uint64_t received;
+        uint64_t malformed;
+    };
+
+    int dn_open(const char *path);
+    int dn_read(struct lgw_pkt_tx_s *pkt);
+    int dn_parse(const char *json, struct lgw_pkt_tx_s *pkt);
+    const struct dn_counters *dn_get_counters(void);
+    void dn_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DOWNLINK_H */
@@ -0,0 +1,176 @@
+/**
+ * \file duty_cycle.c
+ * \brief Duty cycle accounting of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "duty_cycle.h"
+
+/** 
+ * DutyCycle
+ * Airtime is accumulated in sliding windows split into DC_BUCKETS ring 
+ * buckets of DC_BUCKET_SEC seconds. Window keeps running total, adding a 
+ * packet and querying utilization only clear buckets which fell out of the 
+ * window since last access, so both are O(1) amortized. Windows are kept 
+ * per device (in device registry), per channel frequency and per SF.
+ */
+
+static double dc_limit = 1.0;
+static uint64_t dc_violation_cnt = 0;
+static struct dc_channel dc_channels[DC_MAX_CHANNELS];
+static size_t dc_channels_cnt = 0;
+static struct dc_window dc_sf[DC_SF_NB];
+
+/** 
+ * Move window to bucket of now, drop airtime of expired buckets.
+ */
+static void dc_advance(struct dc_window *w, uint64_t now) {
+    uint64_t epoch = now / DC_BUCKET_SEC, e;
+    uint32_t idx;
+
+    if (epoch <= w->epoch)
+        return;
+    if (epoch - w->epoch >= DC_BUCKETS) {
+        memset(w->bucket_us, 0, sizeof w->bucket_us);
+        w->total_us = 0;
+    } else {
+        for (e = w->epoch + 1; e <= epoch; e++) {
+            idx = e % DC_BUCKETS;
+            w->total_us -= w->bucket_us[idx];
+            w->bucket_us[idx] = 0;
+        }
+    }
+    w->epoch = epoch;
+}
+
+/** 
+ * Set regulatory duty cycle limit in percent and reset channel state.
+ */
+void dc_init(double limit) {
+    dc_limit = limit;
+    dc_violation_cnt = 0;
+    dc_channels_cnt = 0;
+    memset(dc_channels, 0, sizeof dc_channels);
+    memset(dc_sf, 0, sizeof dc_sf);
+}
+
+void dc_window_add(struct dc_window *w, uint32_t airtime_us, uint64_t now) {
+    dc_advance(w, now);
+    w->bucket_us[w->epoch % DC_BUCKETS] += airtime_us;
+    w->total_us += airtime_us;
+}
+
+/** 
+ * Airtime in window as percent of window length.
+ */
+double dc_window_utilization(struct dc_window *w, uint64_t now) {
+    dc_advance(w, now);
+    return (double) w->total_us / (DC_WINDOW_SEC * 1e6) * 100.0;
+}
+
+/** 
+ * Find channel by frequency, new frequency takes next free entry. Return 
+ * NULL when all entries are taken.
+ */
+static struct dc_channel *dc_channel(uint32_t freq_hz) {
+    size_t i;
+
+    for (i = 0; i < dc_channels_cnt; i++)
+        if (dc_channels[i].freq_hz == freq_hz)
+            return &dc_channels[i];
+    if (dc_channels_cnt == DC_MAX_CHANNELS)
+        return NULL;
+    dc_channels[dc_channels_cnt].freq_hz = freq_hz;
+    return &dc_channels[dc_channels_cnt++];
+}
+
+/** 
+ * Account packet airtime to channel and SF, return channel utilization 
+ * in percent.
+ */
+double dc_count_channel(uint32_t freq_hz, uint8_t sf_slot, uint32_t airtime_us, uint64_t now) {
+    struct dc_channel *ch = dc_channel(freq_hz);
+
+    if (sf_slot < DC_SF_NB)
+        dc_window_add(&dc_sf[sf_slot], airtime_us, now);
+    if (ch == NULL)
+        return 0.0;
+    ch->packets++;
+    dc_window_add(&ch->win, airtime_us, now);
+    return dc_window_utilization(&ch->win, now);
+}
+
+/** 
+ * Account packet airtime to device window, return device duty cycle in 
+ * percent. violation is set when device exceeds regulatory limit.
+ */
+double dc_count_device(struct dc_window *w, uint32_t airtime_us, uint64_t now, bool *violation) {
+    double duty;
+
+    dc_window_add(w, airtime_us, now);
+    duty = dc_window_utilization(w, now);
+    *violation = (dc_limit > 0.0 && duty > dc_limit);
+    if (*violation)
+        dc_violation_cnt++;
+    return duty;
+}
+
+struct dc_channel *dc_get_channels(size_t *count) {
+    *count = dc_channels_cnt;
+    return dc_channels;
+}
+
+double dc_sf_utilization(uint8_t sf_slot, uint64_t now) {
+    if (sf_slot >= DC_SF_NB)
+        return 0.0;
+    return dc_window_utilization(&dc_sf[sf_slot], now);
+}
+
+/** 
+ * Number of packets sent by devices over duty cycle limit.
+ */
+uint64_t dc_violations() {
+    return dc_violation_cnt;
+}
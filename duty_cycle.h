@@ -0,0 +1,98 @@
+/**
+ * \file duty_cycle.h
+ * \brief Duty cycle accounting of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#ifndef DUTY_CYCLE_H
+#define DUTY_CYCLE_H
+
+/** Sliding window of DC_BUCKETS buckets, one hour as in ETSI EN 300 220 */
+#define DC_BUCKETS 12
+#define DC_BUCKET_SEC 300
+#define DC_WINDOW_SEC (DC_BUCKETS * DC_BUCKET_SEC)
+
+/** Maximum number of tracked channel frequencies */
+#define DC_MAX_CHANNELS 64
+
+/** Spreading factor slots, SF7 - SF12 and FSK */
+#define DC_SF_NB 7
+#define DC_SF_FSK 6
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** Define structure for ring bucketed airtime window */
+    struct dc_window {
+        uint64_t epoch;
+        uint64_t total_us;
+        uint32_t bucket_us[DC_BUCKETS];
+    };
+
+    /** Define structure for channel utilization */
+    struct dc_channel {
+        uint32_t freq_hz;
+        uint64_t packets;
+        struct dc_window win;
+    };
+
+    void dc_init(double limit);
+    void dc_window_add(struct dc_window *w, uint32_t airtime_us, uint64_t now);
+    double dc_window_utilization(struct dc_window *w, uint64_t now);
+
+    double dc_count_channel(uint32_t freq_hz, uint8_t sf_slot, uint32_t airtime_us, uint64_t now);
+    double dc_count_device(struct dc_window *w, uint32_t airtime_us, uint64_t now, bool *violation);
+
+    struct dc_channel *dc_get_channels(size_t *count);
+    double dc_sf_utilization(uint8_t sf_slot, uint64_t now);
+    uint64_t dc_violations();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DUTY_CYCLE_H */
@@ -10,6 +10,18 @@ char *ur_field_names_static[] = {
    "SF",
    "SIZE",
    "PHY_PAYLOAD",
+   "PHY_PAYLOAD_BIN",
+   "MIC_STATUS",
+   "DEV_ADDR",
+   "BASE_RSSI",
+   "VARIANCE",
+   "DUTY_CYCLE",
+   "CH_UTIL",
+   "DUTY_VIOLATION",
+   "RX_TIME",
+   "GW_ID",
+   "GW_LIST",
+   "COPIES",
 };
 short ur_field_sizes_static[] = {
    8, /* RSSI */
@@ -19,6 +31,18 @@ short ur_field_sizes_static[] = {
    4, /* SF */
    4, /* SIZE */
    -1, /* PHY_PAYLOAD */
+   -1, /* PHY_PAYLOAD_BIN */
+   1, /* MIC_STATUS */
+   -1, /* DEV_ADDR */
+   8, /* BASE_RSSI */
+   8, /* VARIANCE */
+   8, /* DUTY_CYCLE */
+   8, /* CH_UTIL */
+   1, /* DUTY_VIOLATION */
+   8, /* RX_TIME */
+   8, /* GW_ID */
+   -1, /* GW_LIST */
+   4, /* COPIES */
 };
 ur_field_type_t ur_field_types_static[] = {
    UR_TYPE_DOUBLE, /* RSSI */
@@ -28,6 +52,18 @@ ur_field_type_t ur_field_types_static[] = {
    UR_TYPE_UINT32, /* SF */
    UR_TYPE_UINT32, /* SIZE */
    UR_TYPE_STRING, /* PHY_PAYLOAD */
+   UR_TYPE_BYTES, /* PHY_PAYLOAD_BIN */
+   UR_TYPE_UINT8, /* MIC_STATUS */
+   UR_TYPE_STRING, /* DEV_ADDR */
+   UR_TYPE_DOUBLE, /* BASE_RSSI */
+   UR_TYPE_DOUBLE, /* VARIANCE */
+   UR_TYPE_DOUBLE, /* DUTY_CYCLE */
+   UR_TYPE_DOUBLE, /* CH_UTIL */
+   UR_TYPE_UINT8, /* DUTY_VIOLATION */
+   UR_TYPE_TIME, /* RX_TIME */
+   UR_TYPE_UINT64, /* GW_ID */
+   UR_TYPE_STRING, /* GW_LIST */
+   UR_TYPE_UINT32, /* COPIES */
 };
-ur_static_field_specs_t UR_FIELD_SPECS_STATIC = {ur_field_names_static, ur_field_sizes_static, ur_field_types_static, 7};
-ur_field_specs_t ur_field_specs = {ur_field_names_static, ur_field_sizes_static, ur_field_types_static, 7, 7, 7, NULL, UR_UNINITIALIZED};
+ur_static_field_specs_t UR_FIELD_SPECS_STATIC = {ur_field_names_static, ur_field_sizes_static, ur_field_types_static, 19};
+ur_field_specs_t ur_field_specs = {ur_field_names_static, ur_field_sizes_static, ur_field_types_static, 19, 19, 19, NULL, UR_UNINITIALIZED};
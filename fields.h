@@ -18,6 +18,30 @@
 #define F_SIZE_T   uint32_t
 #define F_PHY_PAYLOAD   6
 #define F_PHY_PAYLOAD_T   char
+#define F_PHY_PAYLOAD_BIN   7
+#define F_PHY_PAYLOAD_BIN_T   char
+#define F_MIC_STATUS   8
+#define F_MIC_STATUS_T   uint8_t
+#define F_DEV_ADDR   9
+#define F_DEV_ADDR_T   char
+#define F_BASE_RSSI   10
+#define F_BASE_RSSI_T   double
+#define F_VARIANCE   11
+#define F_VARIANCE_T   double
+#define F_DUTY_CYCLE   12
+#define F_DUTY_CYCLE_T   double
+#define F_CH_UTIL   13
+#define F_CH_UTIL_T   double
+#define F_DUTY_VIOLATION   14
+#define F_DUTY_VIOLATION_T   uint8_t
+#define F_RX_TIME   15
+#define F_RX_TIME_T   ur_time_t
+#define F_GW_ID   16
+#define F_GW_ID_T   uint64_t
+#define F_GW_LIST   17
+#define F_GW_LIST_T   char
+#define F_COPIES   18
+#define F_COPIES_T   uint32_t
 
 extern uint16_t ur_last_id;
 extern ur_static_field_specs_t UR_FIELD_SPECS_STATIC;
@@ -0,0 +1,253 @@
+/**
+ * \file gps_ref.c
+ * \brief GPS time reference of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include "libloragw/inc/loragw_hal.h"
+#include "gps_ref.h"
+
+#define MSG(args...) fprintf(stderr,"cesnet_pkt_analyzer: " args)
+
+/**
+ * GpsReference
+ * GPS thread parses the serial stream and publishes each time solution, 
+ * fetch thread latches the concentrator counter of matching PPS and keeps 
+ * time reference, any thread converts counters to UTC. Both records are 
+ * published by seqlock, writer is always a single thread and readers copy 
+ * the record until sequence is even and unchanged, so neither side takes a 
+ * lock or issues a syscall.
+ */
+struct gr_fix {
+    struct timespec utc;
+    struct timespec gps;
+};
+
+static uint32_t fix_seq = 0;
+static uint64_t fix_count = 0;
+static struct gr_fix fix;
+
+static uint32_t ref_seq = 0;
+static bool ref_valid = false;
+static struct tref ref;
+
+/* owned by fetch thread */
+static struct tref ref_work;
+static uint64_t fix_seen = 0;
+static uint64_t sync_count = 0;
+
+static int gps_fd = -1;
+static int gps_stop = 0;
+static pthread_t gps_tid;
+
+/**
+ * Seqlock helpers, odd sequence marks record being written.
+ */
+static void gr_write_begin(uint32_t *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void gr_write_end(uint32_t *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+static uint32_t gr_read_begin(const uint32_t *seq) {
+    uint32_t s;
+
+    while ((s = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1)
+        ;
+    return s;
+}
+
+static bool gr_read_retry(const uint32_t *seq, uint32_t s) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != s;
+}
+
+/**
+ * Publish time solution of last parsed message.
+ */
+static void gr_publish_fix(void) {
+    struct gr_fix f;
+
+    if (lgw_gps_get(&f.utc, &f.gps, NULL, NULL) != LGW_GPS_SUCCESS)
+        return;
+
+    gr_write_begin(&fix_seq);
+    fix = f;
+    gr_write_end(&fix_seq);
+    __atomic_store_n(&fix_count, fix_count + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * GPS thread, feed serial stream to incremental parser as it is read. Time 
+ * solution comes with UBX NAV-TIMEGPS, sent once per PPS.
+ */
+static void *gr_thread(void *arg) {
+    char buff[64];
+    struct lgw_gps_stream st;
+    struct pollfd pfd = {gps_fd, POLLIN, 0};
+    size_t off, used;
+    ssize_t nb;
+
+    (void) arg;
+
+    lgw_gps_stream_init(&st);
+    while (!__atomic_load_n(&gps_stop, __ATOMIC_ACQUIRE)) {
+        if (poll(&pfd, 1, GR_POLL_MS) <= 0)
+            continue;
+        nb = read(gps_fd, buff, sizeof buff);
+        if (nb <= 0)
+            continue;
+
+        for (off = 0; off < (size_t) nb; off += used) {
+            if (lgw_gps_stream_feed(&st, buff + off, nb - off, &used) == UBX_NAV_TIMEGPS)
+                gr_publish_fix();
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Open GPS serial port and start GPS thread. Return 0 on success, -1 on error.
+ * tty - Path of serial device
+ */
+int gr_start(const char *tty) {
+    if (lgw_gps_enable((char *) tty, GR_DEFAULT_FAMILY, 0, &gps_fd) != LGW_GPS_SUCCESS) {
+        MSG("WARNING: GPS %s could not be opened\n", tty);
+        gps_fd = -1;
+        return -1;
+    }
+    memset(&ref_work, 0, sizeof ref_work);
+    __atomic_store_n(&gps_stop, 0, __ATOMIC_RELEASE);
+    if (pthread_create(&gps_tid, NULL, gr_thread, NULL) != 0) {
+        MSG("WARNING: GPS thread could not be created\n");
+        lgw_gps_disable(gps_fd);
+        gps_fd = -1;
+        return -1;
+    }
+    MSG("INFO: GPS %s enabled, waiting for time reference\n", tty);
+    return 0;
+}
+
+/**
+ * Stop GPS thread and close serial port.
+ */
+void gr_stop(void) {
+    if (gps_fd < 0)
+        return;
+    __atomic_store_n(&gps_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(gps_tid, NULL);
+    lgw_gps_disable(gps_fd);
+    gps_fd = -1;
+}
+
+/**
+ * Fetch thread side, called between the receive calls. On new time solution 
+ * read the counter latched by last PPS and update the time reference, 
+ * otherwise only one atomic load.
+ */
+void gr_sync(void) {
+    struct gr_fix f;
+    uint64_t count = __atomic_load_n(&fix_count, __ATOMIC_ACQUIRE);
+    uint32_t s, trig;
+
+    if (count == fix_seen)
+        return;
+    fix_seen = count;
+
+    do {
+        s = gr_read_begin(&fix_seq);
+        f = fix;
+    } while (gr_read_retry(&fix_seq, s));
+
+    if (lgw_get_trigcnt(&trig) != LGW_HAL_SUCCESS)
+        return;
+    if (lgw_gps_sync(&ref_work, trig, f.utc, f.gps) != LGW_GPS_SUCCESS)
+        return;
+
+    gr_write_begin(&ref_seq);
+    ref = ref_work;
+    ref_valid = true;
+    gr_write_end(&ref_seq);
+
+    if (sync_count++ == 0)
+        MSG("INFO: GPS time reference acquired\n");
+}
+
+/**
+ * Convert concentrator counter to UTC. Return false without valid reference 
+ * near the counter.
+ * count_us - Internal concentrator counter of packet
+ * utc      - An pointer to store UTC time
+ */
+bool gr_cnt2utc(uint32_t count_us, struct timespec *utc) {
+    struct tref r;
+    bool valid;
+    int32_t age;
+    uint32_t s;
+
+    do {
+        s = gr_read_begin(&ref_seq);
+        r = ref;
+        valid = ref_valid;
+    } while (gr_read_retry(&ref_seq, s));
+
+    if (!valid)
+        return false;
+    age = (int32_t) (count_us - r.count_us);
+    if (age > GR_MAX_AGE_US || age < -GR_MAX_AGE_US)
+        return false;
+    return lgw_cnt2utc(r, count_us, utc) == LGW_GPS_SUCCESS;
+}
+
+/**
+ * The gr_sync_count() return number of time reference updates.
+ */
+uint64_t gr_sync_count(void) {
+    return sync_count;
+}
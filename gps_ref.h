@@ -0,0 +1,79 @@
+/**
+ * \file gps_ref.h
+ * \brief GPS time reference of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "libloragw/inc/loragw_gps.h"
+
+#ifndef GPS_REF_H
+#define GPS_REF_H
+
+/** GPS module family passed to lgw_gps_enable */
+#define GR_DEFAULT_FAMILY "ubx7"
+
+/** Reference is used for counters within this distance from its sync point */
+#define GR_MAX_AGE_US 30000000
+
+/** Poll timeout of serial port, bounds the stop latency of GPS thread */
+#define GR_POLL_MS 200
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int gr_start(const char *tty);
+    void gr_stop(void);
+
+    void gr_sync(void);
+    bool gr_cnt2utc(uint32_t count_us, struct timespec *utc);
+    uint64_t gr_sync_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GPS_REF_H */
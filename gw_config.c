@@ -0,0 +1,576 @@
+/**
+ * \file gw_config.c
+ * \brief Concentrator configuration of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "parson.h"
+#include "json_arena.h"
+#include "gw_config.h"
+
+#define MSG(args...) fprintf(stderr,"cesnet_pkt_analyzer: " args)
+
+/** Arena of parsed configuration documents, chunk kept between reloads */
+static struct ja_arena gc_arena = {NULL, JA_DEFAULT_CHUNK, 0};
+
+/**
+ * Section helpers
+ * Sections are looked up once and their members read directly, without
+ * composing dotted paths for every parameter.
+ */
+static bool gc_get_bool(const JSON_Object *obj, const char *name) {
+    JSON_Value *val = json_object_get_value(obj, name);
+    if (json_value_get_type(val) == JSONBoolean)
+        return (bool) json_value_get_boolean(val);
+    return false;
+}
+
+static void gc_parse_board(struct gc_config *cfg, const JSON_Object *conf) {
+    struct lgw_conf_board_s *board = &cfg->board;
+    JSON_Value *val;
+
+    memset(board, 0, sizeof *board);
+    val = json_object_get_value(conf, "lorawan_public");
+    if (json_value_get_type(val) == JSONBoolean) {
+        board->lorawan_public = (bool) json_value_get_boolean(val);
+    } else {
+        MSG("WARNING: Data type for lorawan_public seems wrong, please check\n");
+    }
+    val = json_object_get_value(conf, "clksrc");
+    if (json_value_get_type(val) == JSONNumber) {
+        board->clksrc = (uint8_t) json_value_get_number(val);
+    } else {
+        MSG("WARNING: Data type for clksrc seems wrong, please check\n");
+    }
+    MSG("INFO: lorawan_public %d, clksrc %d\n", board->lorawan_public, board->clksrc);
+    cfg->board_set = true;
+}
+
+static void gc_parse_cal(struct gc_config *cfg, const JSON_Object *conf) {
+    JSON_Value *val;
+    const char *str;
+
+    str = json_object_get_string(conf, "calibration_cache");
+    if (str == NULL)
+        return;
+    memset(&cfg->cal, 0, sizeof cfg->cal);
+    cfg->cal_sensor[0] = '\0';
+    cfg->cal_set = false;
+    if (strlen(str) >= sizeof cfg->cal.file) {
+        MSG("WARNING: calibration cache path %s too long, cache disabled\n", str);
+        return;
+    }
+    strcpy(cfg->cal.file, str);
+    val = json_object_get_value(conf, "calibration_max_age");
+    cfg->cal.max_age = (json_value_get_type(val) == JSONNumber) ? (uint32_t) json_value_get_number(val) : GC_CAL_MAX_AGE;
+    str = json_object_get_string(conf, "calibration_temp_sensor");
+    if (str != NULL && strlen(str) < sizeof cfg->cal_sensor)
+        strcpy(cfg->cal_sensor, str);
+    val = json_object_get_value(conf, "calibration_temp_step");
+    cfg->cal_temp_step = (json_value_get_type(val) == JSONNumber && json_value_get_number(val) > 0) ? json_value_get_number(val) : GC_CAL_TEMP_STEP;
+    cfg->cal_set = true;
+    MSG("INFO: calibration cache %s, max age %u s, temperature sensor %s\n", cfg->cal.file, cfg->cal.max_age, cfg->cal_sensor[0] ? cfg->cal_sensor : "(none)");
+}
+
+/**
+ * Temperature band of the board from sensor in millidegrees (thermal zone 
+ * format), band 0 without sensor. Return -1 if the sensor cannot be read.
+ */
+static int gc_temp_band(const struct gc_config *cfg, int16_t *band) {
+    FILE *f;
+    long mdeg;
+    int ok;
+
+    *band = 0;
+    if (cfg->cal_sensor[0] == '\0')
+        return 0;
+    f = fopen(cfg->cal_sensor, "r");
+    if (f == NULL)
+        return -1;
+    ok = fscanf(f, "%ld", &mdeg);
+    fclose(f);
+    if (ok != 1)
+        return -1;
+    *band = (int16_t) floor(mdeg / 1000.0 / cfg->cal_temp_step);
+    return 0;
+}
+
+static void gc_parse_realtime(struct gc_config *cfg, const JSON_Object *conf) {
+    struct rt_conf *rt = &cfg->rt;
+    const JSON_Object *sec;
+    JSON_Value *val;
+
+    sec = json_object_get_object(conf, "realtime");
+    if (sec == NULL)
+        return;
+    rt_init(rt);
+    rt->enable = gc_get_bool(sec, "enable");
+    val = json_object_get_value(sec, "cpu");
+    if (json_value_get_type(val) == JSONNumber)
+        rt->cpu = (int) json_value_get_number(val);
+    val = json_object_get_value(sec, "priority");
+    if (json_value_get_type(val) == JSONNumber)
+        rt->priority = (int) json_value_get_number(val);
+    val = json_object_get_value(sec, "lock_memory");
+    if (json_value_get_type(val) == JSONBoolean)
+        rt->lock_memory = (bool) json_value_get_boolean(val);
+    val = json_object_get_value(sec, "latency_threshold_us");
+    if (json_value_get_type(val) == JSONNumber)
+        rt->threshold_us = (uint32_t) json_value_get_number(val);
+    if (rt->priority < 0 || rt->priority > 99) {
+        MSG("WARNING: realtime priority %d out of range 0 - 99, using %d\n", rt->priority, RT_DEFAULT_PRIORITY);
+        rt->priority = RT_DEFAULT_PRIORITY;
+    }
+    MSG("INFO: realtime profile %s, CPU %d, priority %d, lock memory %d, latency threshold %u us\n", rt->enable ? "enabled" : "disabled", rt->cpu, rt->priority, rt->lock_memory, rt->threshold_us);
+}
+
+static void gc_parse_radio(struct gc_config *cfg, const JSON_Object *conf, int i) {
+    struct lgw_conf_rxrf_s *rf = &cfg->rf[i];
+    char name[16];
+    const JSON_Object *sec;
+    const char *str;
+
+    snprintf(name, sizeof name, "radio_%i", i);
+    sec = json_object_get_object(conf, name);
+    if (sec == NULL) {
+        MSG("INFO: no configuration for radio %i\n", i);
+        return;
+    }
+    memset(rf, 0, sizeof *rf);
+    cfg->rf_set[i] = true;
+    rf->enable = gc_get_bool(sec, "enable");
+    if (rf->enable == false) {
+        MSG("INFO: radio %i disabled\n", i);
+        return;
+    }
+    rf->freq_hz = (uint32_t) json_object_get_number(sec, "freq");
+    rf->rssi_offset = (float) json_object_get_number(sec, "rssi_offset");
+    str = json_object_get_string(sec, "type");
+    if (str != NULL && !strncmp(str, "SX1255", 6)) {
+        rf->type = LGW_RADIO_TYPE_SX1255;
+    } else if (str != NULL && !strncmp(str, "SX1257", 6)) {
+        rf->type = LGW_RADIO_TYPE_SX1257;
+    } else {
+        MSG("WARNING: invalid radio type: %s (should be SX1255 or SX1257)\n", str ? str : "(none)");
+    }
+    rf->tx_enable = gc_get_bool(sec, "tx_enable");
+    MSG("INFO: radio %i enabled (type %s), center frequency %u, RSSI offset %f, tx enabled %d\n", i, str ? str : "(none)", rf->freq_hz, rf->rssi_offset, rf->tx_enable);
+}
+
+static void gc_parse_txlut(struct gc_config *cfg, const JSON_Object *conf) {
+    struct lgw_tx_gain_s *g;
+    const JSON_Object *sec;
+    JSON_Value *val;
+    char name[16];
+    int i;
+
+    /* same tx_lut_0 .. tx_lut_15 objects as the packet forwarder */
+    memset(&cfg->txlut, 0, sizeof cfg->txlut);
+    for (i = 0; i < TX_GAIN_LUT_SIZE_MAX; i++) {
+        snprintf(name, sizeof name, "tx_lut_%i", i);
+        sec = json_object_get_object(conf, name);
+        if (sec == NULL)
+            continue;
+        g = &cfg->txlut.lut[cfg->txlut.size++];
+        g->pa_gain = (uint8_t) json_object_get_number(sec, "pa_gain");
+        g->mix_gain = (uint8_t) json_object_get_number(sec, "mix_gain");
+        g->rf_power = (int8_t) json_object_get_number(sec, "rf_power");
+        g->dig_gain = (uint8_t) json_object_get_number(sec, "dig_gain");
+        val = json_object_get_value(sec, "dac_gain");
+        g->dac_gain = (json_value_get_type(val) == JSONNumber) ? (uint8_t) json_value_get_number(val) : 3;
+    }
+    if (cfg->txlut.size > 0) {
+        cfg->txlut_set = true;
+        MSG("INFO: configured %u TX gain LUT entries\n", cfg->txlut.size);
+    }
+}
+
+static void gc_parse_multisf(struct gc_config *cfg, const JSON_Object *conf, int i) {
+    struct lgw_conf_rxif_s *ifc = &cfg->ifc[i];
+    char name[24];
+    const JSON_Object *sec;
+
+    snprintf(name, sizeof name, "chan_multiSF_%i", i);
+    sec = json_object_get_object(conf, name);
+    if (sec == NULL) {
+        MSG("INFO: no configuration for LoRa multi-SF channel %i\n", i);
+        return;
+    }
+    memset(ifc, 0, sizeof *ifc);
+    cfg->if_set[i] = true;
+    ifc->enable = gc_get_bool(sec, "enable");
+    if (ifc->enable == false) {
+        MSG("INFO: LoRa multi-SF channel %i disabled\n", i);
+        return;
+    }
+    ifc->rf_chain = (uint32_t) json_object_get_number(sec, "radio");
+    ifc->freq_hz = (int32_t) json_object_get_number(sec, "if");
+    // TODO: handle individual SF enabling and disabling (spread_factor)
+    MSG("INFO: LoRa multi-SF channel %i enabled, radio %i selected, IF %i Hz, 125 kHz bandwidth, SF 7 to 12\n", i, ifc->rf_chain, ifc->freq_hz);
+}
+
+static void gc_parse_lora_std(struct gc_config *cfg, const JSON_Object *conf) {
+    struct lgw_conf_rxif_s *ifc = &cfg->ifc[GC_IF_LORA_STD];
+    const JSON_Object *sec;
+    uint32_t sf, bw;
+
+    sec = json_object_get_object(conf, "chan_Lora_std");
+    if (sec == NULL) {
+        MSG("INFO: no configuration for LoRa standard channel\n");
+        return;
+    }
+    memset(ifc, 0, sizeof *ifc);
+    cfg->if_set[GC_IF_LORA_STD] = true;
+    ifc->enable = gc_get_bool(sec, "enable");
+    if (ifc->enable == false) {
+        MSG("INFO: LoRa standard channel disabled\n");
+        return;
+    }
+    ifc->rf_chain = (uint32_t) json_object_get_number(sec, "radio");
+    ifc->freq_hz = (int32_t) json_object_get_number(sec, "if");
+    bw = (uint32_t) json_object_get_number(sec, "bandwidth");
+    switch (bw) {
+        case 500000: ifc->bandwidth = BW_500KHZ;
+            break;
+        case 250000: ifc->bandwidth = BW_250KHZ;
+            break;
+        case 125000: ifc->bandwidth = BW_125KHZ;
+            break;
+        default: ifc->bandwidth = BW_UNDEFINED;
+    }
+    sf = (uint32_t) json_object_get_number(sec, "spread_factor");
+    switch (sf) {
+        case 7: ifc->datarate = DR_LORA_SF7;
+            break;
+        case 8: ifc->datarate = DR_LORA_SF8;
+            break;
+        case 9: ifc->datarate = DR_LORA_SF9;
+            break;
+        case 10: ifc->datarate = DR_LORA_SF10;
+            break;
+        case 11: ifc->datarate = DR_LORA_SF11;
+            break;
+        case 12: ifc->datarate = DR_LORA_SF12;
+            break;
+        default: ifc->datarate = DR_UNDEFINED;
+    }
+    MSG("INFO: LoRa standard channel enabled, radio %i selected, IF %i Hz, %u Hz bandwidth, SF %u\n", ifc->rf_chain, ifc->freq_hz, bw, sf);
+}
+
+static void gc_parse_fsk(struct gc_config *cfg, const JSON_Object *conf) {
+    struct lgw_conf_rxif_s *ifc = &cfg->ifc[GC_IF_FSK];
+    const JSON_Object *sec;
+    uint32_t bw;
+
+    sec = json_object_get_object(conf, "chan_FSK");
+    if (sec == NULL) {
+        MSG("INFO: no configuration for FSK channel\n");
+        return;
+    }
+    memset(ifc, 0, sizeof *ifc);
+    cfg->if_set[GC_IF_FSK] = true;
+    ifc->enable = gc_get_bool(sec, "enable");
+    if (ifc->enable == false) {
+        MSG("INFO: FSK channel disabled\n");
+        return;
+    }
+    ifc->rf_chain = (uint32_t) json_object_get_number(sec, "radio");
+    ifc->freq_hz = (int32_t) json_object_get_number(sec, "if");
+    bw = (uint32_t) json_object_get_number(sec, "bandwidth");
+    if (bw <= 7800) ifc->bandwidth = BW_7K8HZ;
+    else if (bw <= 15600) ifc->bandwidth = BW_15K6HZ;
+    else if (bw <= 31200) ifc->bandwidth = BW_31K2HZ;
+    else if (bw <= 62500) ifc->bandwidth = BW_62K5HZ;
+    else if (bw <= 125000) ifc->bandwidth = BW_125KHZ;
+    else if (bw <= 250000) ifc->bandwidth = BW_250KHZ;
+    else if (bw <= 500000) ifc->bandwidth = BW_500KHZ;
+    else ifc->bandwidth = BW_UNDEFINED;
+    ifc->datarate = (uint32_t) json_object_get_number(sec, "datarate");
+    MSG("INFO: FSK channel enabled, radio %i selected, IF %i Hz, %u Hz bandwidth, %u bps datarate\n", ifc->rf_chain, ifc->freq_hz, bw, ifc->datarate);
+}
+
+static void gc_parse_filter(struct gc_config *cfg, const JSON_Object *conf) {
+    static const char *mtypes[8] = {"JoinRequest", "JoinAccept", "UnconfirmedDataUp", "UnconfirmedDataDown",
+        "ConfirmedDataUp", "ConfirmedDataDown", "RFU", "Proprietary"};
+    struct pf_rules *r = &cfg->filter;
+    const JSON_Array *arr;
+    JSON_Value *val;
+    const char *str;
+    unsigned int prefix, len;
+    size_t i;
+    int t;
+
+    pf_rules_init(r);
+    cfg->filter_set = true;
+    r->crc_ok_only = gc_get_bool(conf, "crc_ok_only");
+    val = json_object_get_value(conf, "min_rssi");
+    if (json_value_get_type(val) == JSONNumber) {
+        r->rssi_set = true;
+        r->min_rssi = (float) json_value_get_number(val);
+    }
+    val = json_object_get_value(conf, "min_snr");
+    if (json_value_get_type(val) == JSONNumber) {
+        r->snr_set = true;
+        r->min_snr = (float) json_value_get_number(val);
+    }
+    arr = json_object_get_array(conf, "mtypes");
+    if (arr != NULL) {
+        r->mtype_mask = 0;
+        for (i = 0; i < json_array_get_count(arr); i++) {
+            str = json_array_get_string(arr, i);
+            for (t = 0; t < 8 && (str == NULL || strcmp(str, mtypes[t]) != 0); t++)
+                ;
+            if (t < 8)
+                r->mtype_mask |= 1 << t;
+            else
+                MSG("WARNING: unknown MType %s in filter_conf ignored\n", str ? str : "(none)");
+        }
+    }
+    arr = json_object_get_array(conf, "netids");
+    for (i = 0; arr != NULL && i < json_array_get_count(arr); i++) {
+        str = json_array_get_string(arr, i);
+        if (str == NULL || sscanf(str, "%x", &prefix) != 1 || pf_add_netid(r, prefix & 0xFFFFFF) != 0)
+            MSG("WARNING: NetID %s in filter_conf ignored\n", str ? str : "(none)");
+    }
+    arr = json_object_get_array(conf, "devaddr_prefixes");
+    for (i = 0; arr != NULL && i < json_array_get_count(arr); i++) {
+        str = json_array_get_string(arr, i);
+        if (str == NULL || sscanf(str, "%x/%u", &prefix, &len) != 2 || len > 32 || pf_add_prefix(r, prefix, (uint8_t) len) != 0)
+            MSG("WARNING: DevAddr prefix %s in filter_conf ignored\n", str ? str : "(none)");
+    }
+    MSG("INFO: packet filter CRC OK only %d, MType mask 0x%02X, %u DevAddr prefixes\n", r->crc_ok_only, r->mtype_mask, r->nb_prefix);
+}
+
+void gc_init(struct gc_config *cfg) {
+    memset(cfg, 0, sizeof *cfg);
+    rt_init(&cfg->rt);
+}
+
+int gc_load_file(struct gc_config *cfg, const char *conf_file) {
+    JSON_Value *root_val;
+    JSON_Object *root, *conf;
+    const char *str;
+    unsigned long long ull = 0;
+    int i;
+
+    /* one parse serves all sections, document lives in arena and is dropped at once */
+    ja_begin(&gc_arena);
+    root_val = json_parse_file_with_comments(conf_file);
+    ja_end();
+    root = json_value_get_object(root_val);
+    if (root == NULL) {
+        MSG("ERROR: %s id not a valid JSON file\n", conf_file);
+        ja_reset(&gc_arena);
+        return -1;
+    }
+
+    conf = json_object_get_object(root, "SX1301_conf");
+    if (conf == NULL) {
+        MSG("INFO: %s does not contain a JSON object named SX1301_conf\n", conf_file);
+    } else {
+        MSG("INFO: %s does contain a JSON object named SX1301_conf, parsing SX1301 parameters\n", conf_file);
+        gc_parse_board(cfg, conf);
+        gc_parse_cal(cfg, conf);
+        gc_parse_txlut(cfg, conf);
+        for (i = 0; i < LGW_RF_CHAIN_NB; ++i)
+            gc_parse_radio(cfg, conf, i);
+        for (i = 0; i < LGW_MULTI_NB; ++i)
+            gc_parse_multisf(cfg, conf, i);
+        gc_parse_lora_std(cfg, conf);
+        gc_parse_fsk(cfg, conf);
+    }
+
+    conf = json_object_get_object(root, "gateway_conf");
+    if (conf == NULL) {
+        MSG("INFO: %s does not contain a JSON object named gateway_conf\n", conf_file);
+    } else {
+        MSG("INFO: %s does contain a JSON object named gateway_conf, parsing gateway parameters\n", conf_file);
+        /* getting network parameters (only those necessary for the packet logger) */
+        str = json_object_get_string(conf, "gateway_ID");
+        if (str != NULL) {
+            sscanf(str, "%llx", &ull);
+            cfg->gateway_id = ull;
+            cfg->gateway_set = true;
+            MSG("INFO: gateway MAC address is configured to %016llX\n", ull);
+        }
+        gc_parse_realtime(cfg, conf);
+    }
+
+    conf = json_object_get_object(root, "filter_conf");
+    if (conf != NULL) {
+        MSG("INFO: %s does contain a JSON object named filter_conf, parsing packet filter\n", conf_file);
+        gc_parse_filter(cfg, conf);
+    }
+
+    ja_reset(&gc_arena);
+    cfg->files++;
+    return 0;
+}
+
+int gc_load(struct gc_config *cfg, const char *global_file, const char *local_file, const char *debug_file) {
+    if (access(debug_file, R_OK) == 0) {
+        /* if there is a debug conf, parse only the debug conf */
+        MSG("INFO: found debug configuration file %s, other configuration files will be ignored\n", debug_file);
+        if (gc_load_file(cfg, debug_file) != 0)
+            return -1;
+    } else if (access(global_file, R_OK) == 0) {
+        /* if there is a global conf, parse it and then try to parse local conf  */
+        MSG("INFO: found global configuration file %s, trying to parse it\n", global_file);
+        if (gc_load_file(cfg, global_file) != 0)
+            return -1;
+        if (access(local_file, R_OK) == 0) {
+            MSG("INFO: found local configuration file %s, trying to parse it\n", local_file);
+            if (gc_load_file(cfg, local_file) != 0)
+                return -1;
+        }
+    } else if (access(local_file, R_OK) == 0) {
+        /* if there is only a local conf, parse it and that's all */
+        MSG("INFO: found local configuration file %s, trying to parse it\n", local_file);
+        if (gc_load_file(cfg, local_file) != 0)
+            return -1;
+    }
+    return cfg->files;
+}
+
+int gc_apply(const struct gc_config *cfg) {
+    struct lgw_conf_cal_s cal;
+    int i, failed = 0;
+
+    if (cfg->board_set && lgw_board_setconf(cfg->board) != LGW_HAL_SUCCESS) {
+        MSG("WARNING: Failed to configure board\n");
+        failed++;
+    }
+    /* cache disabled (empty file) unless configured, temperature band is read on every start */
+    memset(&cal, 0, sizeof cal);
+    if (cfg->cal_set) {
+        cal = cfg->cal;
+        if (gc_temp_band(cfg, &cal.temp_band) != 0) {
+            MSG("WARNING: failed to read temperature from %s, calibration cache not used\n", cfg->cal_sensor);
+            cal.file[0] = '\0';
+        }
+    }
+    if (lgw_cal_setconf(cal) != LGW_HAL_SUCCESS) {
+        MSG("WARNING: Failed to configure calibration cache\n");
+        failed++;
+    }
+    if (cfg->txlut_set && lgw_txgain_setconf((struct lgw_tx_gain_lut_s *) &cfg->txlut) != LGW_HAL_SUCCESS) {
+        MSG("WARNING: invalid TX gain LUT\n");
+        failed++;
+    }
+    for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
+        if (cfg->rf_set[i] && lgw_rxrf_setconf(i, cfg->rf[i]) != LGW_HAL_SUCCESS) {
+            MSG("WARNING: invalid configuration for radio %i\n", i);
+            failed++;
+        }
+    }
+    for (i = 0; i < LGW_IF_CHAIN_NB; ++i) {
+        if (cfg->if_set[i] && lgw_rxif_setconf(i, cfg->ifc[i]) != LGW_HAL_SUCCESS) {
+            if (i == GC_IF_LORA_STD)
+                MSG("WARNING: invalid configuration for LoRa standard channel\n");
+            else if (i == GC_IF_FSK)
+                MSG("WARNING: invalid configuration for FSK channel\n");
+            else
+                MSG("WARNING: invalid configuration for LoRa multi-SF channel %i\n", i);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/**
+ * Restart concentrator with new configuration, firmware is loaded again by
+ * lgw_start(), calibration too unless restored from calibration cache.
+ */
+static int gc_restart(const struct gc_config *cfg) {
+    lgw_stop();
+    gc_apply(cfg);
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        MSG("ERROR: failed to restart the concentrator\n");
+        return -1;
+    }
+    MSG("INFO: concentrator restarted with new configuration\n");
+    return GC_RELOAD_RESTART;
+}
+
+int gc_update(struct gc_config *cur, const struct gc_config *next) {
+    struct lgw_conf_rxif_s ifc;
+    int i, ret = GC_RELOAD_NONE;
+
+    /* radio setup and calibration depend on board and RF chains */
+    if (cur->board_set != next->board_set || memcmp(&cur->board, &next->board, sizeof next->board) != 0
+            || memcmp(cur->rf_set, next->rf_set, sizeof next->rf_set) != 0
+            || memcmp(cur->rf, next->rf, sizeof next->rf) != 0) {
+        MSG("INFO: board or RF chain configuration changed, full restart needed\n");
+        ret = gc_restart(next);
+    } else {
+        for (i = 0; i < LGW_IF_CHAIN_NB; ++i) {
+            if (cur->if_set[i] == next->if_set[i] && memcmp(&cur->ifc[i], &next->ifc[i], sizeof ifc) == 0)
+                continue;
+            /* section removed from files, disable the chain */
+            memset(&ifc, 0, sizeof ifc);
+            if (next->if_set[i])
+                ifc = next->ifc[i];
+            if (lgw_rxif_reconf(i, ifc) != LGW_HAL_SUCCESS) {
+                MSG("INFO: IF chain %i cannot be changed live, full restart needed\n", i);
+                ret = gc_restart(next);
+                break;
+            }
+            MSG("INFO: IF chain %i reconfigured\n", i);
+            ret = GC_RELOAD_LIVE;
+        }
+        /* TX gains are read by lgw_send(), they apply to next downlink */
+        if ((ret == GC_RELOAD_NONE || ret == GC_RELOAD_LIVE) && next->txlut_set
+                && (!cur->txlut_set || memcmp(&cur->txlut, &next->txlut, sizeof next->txlut) != 0)) {
+            if (lgw_txgain_setconf((struct lgw_tx_gain_lut_s *) &next->txlut) == LGW_HAL_SUCCESS) {
+                MSG("INFO: TX gain LUT reconfigured\n");
+                ret = GC_RELOAD_LIVE;
+            } else {
+                MSG("WARNING: invalid TX gain LUT, previous one kept\n");
+            }
+        }
+    }
+    if (ret >= 0)
+        memcpy(cur, next, sizeof *cur);
+    return ret;
+}
@@ -0,0 +1,127 @@
+/**
+ * \file gw_config.h
+ * \brief Concentrator configuration of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "libloragw/inc/loragw_hal.h"
+#include "pkt_filter.h"
+#include "rt_profile.h"
+
+#ifndef GW_CONFIG_H
+#define GW_CONFIG_H
+
+/** IF chain indexes of the single SF channels, after the LGW_MULTI_NB multi-SF ones */
+#define GC_IF_LORA_STD 8
+#define GC_IF_FSK 9
+
+/** Result of gc_update() */
+#define GC_RELOAD_NONE 0
+#define GC_RELOAD_LIVE 1
+#define GC_RELOAD_RESTART 2
+
+/** Default calibration cache settings, results expire after a day, temperature bands of 10 degC */
+#define GC_CAL_MAX_AGE 86400
+#define GC_CAL_TEMP_STEP 10.0
+
+/**
+ * Concentrator configuration
+ * Merged content of the JSON configuration files. Every section found in a
+ * file replaces the section loaded from a previous file, flag _set marks
+ * sections defined by at least one file. Nothing is sent to the HAL until
+ * gc_apply().
+ */
+struct gc_config {
+    bool board_set;
+    struct lgw_conf_board_s board;
+    bool rf_set[LGW_RF_CHAIN_NB];
+    struct lgw_conf_rxrf_s rf[LGW_RF_CHAIN_NB];
+    bool if_set[LGW_IF_CHAIN_NB];
+    struct lgw_conf_rxif_s ifc[LGW_IF_CHAIN_NB];
+    bool gateway_set;
+    uint64_t gateway_id;
+    bool filter_set;
+    struct pf_rules filter;
+    struct rt_conf rt;
+    bool cal_set;
+    struct lgw_conf_cal_s cal;
+    char cal_sensor[LGW_CAL_FILE_MAX];
+    double cal_temp_step;
+    bool txlut_set;
+    struct lgw_tx_gain_lut_s txlut;
+    int files;
+};
+
+/**
+ * Clear configuration
+ */
+void gc_init(struct gc_config *cfg);
+
+/**
+ * Parse one JSON file and overlay its SX1301_conf, gateway_conf and
+ * filter_conf sections on cfg. Return 0 on success, -1 if the file is not a valid JSON file.
+ */
+int gc_load_file(struct gc_config *cfg, const char *conf_file);
+
+/**
+ * Load configuration files in the packet forwarder order: debug file alone
+ * if present, otherwise global file overlaid by local file. Return number
+ * of files loaded, 0 if none was found, -1 on parse error.
+ */
+int gc_load(struct gc_config *cfg, const char *global_file, const char *local_file, const char *debug_file);
+
+/**
+ * Submit configuration to the HAL, must be called before lgw_start().
+ * Return number of sections rejected by the HAL.
+ */
+int gc_apply(const struct gc_config *cfg);
+
+/**
+ * Bring running concentrator from configuration cur to next. Changed IF
+ * chains are reprogrammed in place, board or RF chain changes (and IF
+ * changes the HAL refuses live) restart the concentrator. On success cur
+ * holds next. Return GC_RELOAD_NONE, GC_RELOAD_LIVE, GC_RELOAD_RESTART or
+ * -1 if the concentrator failed to restart.
+ */
+int gc_update(struct gc_config *cur, const struct gc_config *next);
+
+#endif /* GW_CONFIG_H */
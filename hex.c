@@ -0,0 +1,268 @@
+/**
+ * \file hex.c
+ * \brief Hexadecimal encoding of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "hex.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define HX_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HX_NEON 1
+#endif
+
+/** 
+ * HexEncoder
+ * Encode binary data to hexadecimal string in one pass. Full 16 byte chunks 
+ * are encoded by SSE2/NEON where available, remaining bytes by lookup table 
+ * of two character digit pairs. Output is written directly to caller 
+ * buffer of at least 2 * len + 1 bytes and terminated by '\0'.
+ * Decoding works the same way in opposite direction, 32 character chunks 
+ * by SIMD and the rest by 256 entry digit table.
+ */
+
+#define HX_PAIR(x) x "0" x "1" x "2" x "3" x "4" x "5" x "6" x "7" x "8" x "9" x "A" x "B" x "C" x "D" x "E" x "F"
+#define HX_PAIR_LOWER(x) x "0" x "1" x "2" x "3" x "4" x "5" x "6" x "7" x "8" x "9" x "a" x "b" x "c" x "d" x "e" x "f"
+
+static const char hx_table[513] =
+        HX_PAIR("0") HX_PAIR("1") HX_PAIR("2") HX_PAIR("3") HX_PAIR("4") HX_PAIR("5") HX_PAIR("6") HX_PAIR("7")
+        HX_PAIR("8") HX_PAIR("9") HX_PAIR("A") HX_PAIR("B") HX_PAIR("C") HX_PAIR("D") HX_PAIR("E") HX_PAIR("F");
+
+static const char hx_table_lower[513] =
+        HX_PAIR_LOWER("0") HX_PAIR_LOWER("1") HX_PAIR_LOWER("2") HX_PAIR_LOWER("3") HX_PAIR_LOWER("4") HX_PAIR_LOWER("5") HX_PAIR_LOWER("6") HX_PAIR_LOWER("7")
+        HX_PAIR_LOWER("8") HX_PAIR_LOWER("9") HX_PAIR_LOWER("a") HX_PAIR_LOWER("b") HX_PAIR_LOWER("c") HX_PAIR_LOWER("d") HX_PAIR_LOWER("e") HX_PAIR_LOWER("f");
+
+#define HX_D(c) [c] = (c) - '0'
+#define HX_U(c) [c] = (c) - 'A' + 10
+#define HX_L(c) [c] = (c) - 'a' + 10
+
+const uint8_t hx_digit[256] = {
+    HX_D('0'), HX_D('1'), HX_D('2'), HX_D('3'), HX_D('4'), HX_D('5'), HX_D('6'), HX_D('7'), HX_D('8'), HX_D('9'),
+    HX_U('A'), HX_U('B'), HX_U('C'), HX_U('D'), HX_U('E'), HX_U('F'),
+    HX_L('a'), HX_L('b'), HX_L('c'), HX_L('d'), HX_L('e'), HX_L('f')
+};
+
+/** 
+ * Encode full 16 byte chunks, return number of consumed input bytes.
+ * letter - Distance between '9' + 1 and first letter digit ('A' or 'a')
+ */
+static size_t hx_encode_simd(char *out, const uint8_t *in, size_t len, uint8_t letter) {
+    size_t i = 0;
+
+#if defined(HX_SSE2)
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i alpha = _mm_set1_epi8((char) letter);
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (in + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+        __m128i lo = _mm_and_si128(v, mask);
+
+        /* digit + '0', plus letter offset for digits above 9 */
+        hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), alpha));
+        lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), alpha));
+
+        _mm_storeu_si128((__m128i*) (out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*) (out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#elif defined(HX_NEON)
+    const uint8x16_t mask = vdupq_n_u8(0x0f);
+    const uint8x16_t nine = vdupq_n_u8(9);
+    const uint8x16_t zero = vdupq_n_u8('0');
+    const uint8x16_t alpha = vdupq_n_u8(letter);
+
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(in + i);
+        uint8x16x2_t r;
+
+        r.val[0] = vshrq_n_u8(v, 4);
+        r.val[1] = vandq_u8(v, mask);
+        r.val[0] = vaddq_u8(vaddq_u8(r.val[0], zero), vandq_u8(vcgtq_u8(r.val[0], nine), alpha));
+        r.val[1] = vaddq_u8(vaddq_u8(r.val[1], zero), vandq_u8(vcgtq_u8(r.val[1], nine), alpha));
+
+        /* interleaving store, high digit first */
+        vst2q_u8((uint8_t*) (out + 2 * i), r);
+    }
+#else
+    (void) out;
+    (void) in;
+    (void) len;
+    (void) letter;
+#endif
+
+    return i;
+}
+
+static size_t hx_encode_table(char *out, const uint8_t *in, size_t len, const char *table, uint8_t letter) {
+    size_t i = hx_encode_simd(out, in, len, letter);
+
+    for (; i < len; i++) {
+        memcpy(out + 2 * i, table + 2 * in[i], 2);
+    }
+    out[2 * len] = '\0';
+
+    return 2 * len;
+}
+
+/** 
+ * The hx_encode() encode binary data to upper case hexadecimal string, 
+ * return length of string.
+ * out - An pointer to output buffer, at least 2 * len + 1 bytes
+ * in  - An pointer to binary data
+ * len - Length of binary data
+ */
+size_t hx_encode(char *out, const uint8_t *in, size_t len) {
+    return hx_encode_table(out, in, len, hx_table, 'A' - '9' - 1);
+}
+
+/** 
+ * The hx_encode_lower() encode binary data to lower case hexadecimal string, 
+ * return length of string.
+ * out - An pointer to output buffer, at least 2 * len + 1 bytes
+ * in  - An pointer to binary data
+ * len - Length of binary data
+ */
+size_t hx_encode_lower(char *out, const uint8_t *in, size_t len) {
+    return hx_encode_table(out, in, len, hx_table_lower, 'a' - '9' - 1);
+}
+
+#if defined(HX_SSE2)
+
+/** Convert 16 hexadecimal characters to nibbles, mark invalid characters in bad */
+static __m128i hx_nibble_sse2(__m128i v, __m128i *bad) {
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i l = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_d = _mm_cmpeq_epi8(_mm_subs_epu8(d, _mm_set1_epi8(9)), _mm_setzero_si128());
+    __m128i is_l = _mm_cmpeq_epi8(_mm_subs_epu8(l, _mm_set1_epi8(5)), _mm_setzero_si128());
+
+    *bad = _mm_or_si128(*bad, _mm_andnot_si128(_mm_or_si128(is_d, is_l), _mm_set1_epi8(-1)));
+
+    return _mm_or_si128(_mm_and_si128(d, is_d), _mm_and_si128(_mm_add_epi8(l, _mm_set1_epi8(10)), is_l));
+}
+
+/** Join character pairs of 16 bit lanes to bytes in low half of lane */
+static __m128i hx_pair_sse2(__m128i n) {
+    return _mm_or_si128(_mm_and_si128(_mm_slli_epi16(n, 4), _mm_set1_epi16(0x00f0)), _mm_srli_epi16(n, 8));
+}
+
+#elif defined(HX_NEON)
+
+/** Convert 16 hexadecimal characters to nibbles, mark invalid characters in bad */
+static uint8x16_t hx_nibble_neon(uint8x16_t v, uint8x16_t *bad) {
+    uint8x16_t d = vsubq_u8(v, vdupq_n_u8('0'));
+    uint8x16_t l = vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t is_d = vcleq_u8(d, vdupq_n_u8(9));
+    uint8x16_t is_l = vcleq_u8(l, vdupq_n_u8(5));
+
+    *bad = vorrq_u8(*bad, vmvnq_u8(vorrq_u8(is_d, is_l)));
+
+    return vorrq_u8(vandq_u8(d, is_d), vandq_u8(vaddq_u8(l, vdupq_n_u8(10)), is_l));
+}
+
+#endif
+
+/** 
+ * Decode full 32 character chunks, return number of produced bytes. Stop 
+ * at first chunk with invalid character, table path handles it.
+ */
+static size_t hx_decode_simd(uint8_t *out, const char *in, size_t len) {
+    size_t i = 0;
+
+#if defined(HX_SSE2)
+    for (; i + 16 <= len; i += 16) {
+        __m128i bad = _mm_setzero_si128();
+        __m128i a = hx_nibble_sse2(_mm_loadu_si128((const __m128i*) (in + 2 * i)), &bad);
+        __m128i b = hx_nibble_sse2(_mm_loadu_si128((const __m128i*) (in + 2 * i + 16)), &bad);
+
+        if (_mm_movemask_epi8(bad) != 0)
+            break;
+
+        _mm_storeu_si128((__m128i*) (out + i), _mm_packus_epi16(hx_pair_sse2(a), hx_pair_sse2(b)));
+    }
+#elif defined(HX_NEON)
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t bad = vdupq_n_u8(0);
+        /* deinterleaving load, high digits in val[0] */
+        uint8x16x2_t v = vld2q_u8((const uint8_t*) (in + 2 * i));
+        uint8x16_t hi = hx_nibble_neon(v.val[0], &bad);
+        uint8x16_t lo = hx_nibble_neon(v.val[1], &bad);
+        uint64x2_t bad64 = vreinterpretq_u64_u8(bad);
+
+        if ((vgetq_lane_u64(bad64, 0) | vgetq_lane_u64(bad64, 1)) != 0)
+            break;
+
+        vst1q_u8(out + i, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    }
+#else
+    (void) out;
+    (void) in;
+    (void) len;
+#endif
+
+    return i;
+}
+
+/** 
+ * The hx_decode() decode hexadecimal string to binary data, return number 
+ * of bytes. Characters other than hexadecimal digits are decoded as 0.
+ * out - An pointer to output buffer, at least len / 2 bytes
+ * in  - An pointer to hexadecimal string
+ * len - Number of characters to decode, odd last character is ignored
+ */
+size_t hx_decode(uint8_t *out, const char *in, size_t len) {
+    size_t i, size = len / 2;
+
+    i = hx_decode_simd(out, in, size);
+    for (; i < size; i++) {
+        out[i] = (uint8_t) ((hx_digit[(uint8_t) in[2 * i]] << 4) | hx_digit[(uint8_t) in[2 * i + 1]]);
+    }
+
+    return size;
+}
@@ -0,0 +1,361 @@
+/**
+ * \file jit_queue.c
+ * \brief Just-in-time downlink queue of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lora_packet.h"
+#include "jit_queue.h"
+
+/** 
+ * JitQueue
+ * Concentrator has one TX buffer, a downlink programmed into it replaces 
+ * the previous one. Downlinks are therefore kept in the host until their 
+ * slot comes and programmed one at a time JQ_LEAD_US before the slot, 
+ * after the previous one was emitted. Slot overlap including JQ_MARGIN_US 
+ * and duty cycle budget of the channel are checked on enqueue, so a join 
+ * storm fills the queue instead of overwriting the TX buffer. Times are 
+ * concentrator counter values, compared by signed difference across the 
+ * counter wrap. Single thread only, the one driving the concentrator.
+ */
+
+static const char *jq_names[JQ_RESULTS] = {"queued", "queue full", "too late", "too early", "overlap", "duty cycle", "invalid"};
+
+/** 
+ * Compare counter values, true when a is before b.
+ */
+static inline bool jq_before(uint32_t a, uint32_t b) {
+    return (int32_t) (a - b) < 0;
+}
+
+/** 
+ * Initialization of empty queue.
+ * q          - An pointer to queue
+ * duty_limit - TX duty cycle limit of channel in percent, 0 unlimited
+ */
+void jq_init(struct jq_queue *q, double duty_limit) {
+    uint16_t i;
+
+    memset(q, 0, sizeof *q);
+    for (i = 0; i < JQ_SIZE; i++)
+        q->free[i] = JQ_SIZE - 1 - i;
+    q->free_cnt = JQ_SIZE;
+    q->duty_limit = duty_limit;
+}
+
+/** 
+ * The jq_airtime_us() return airtime of downlink in microseconds. LoRa 
+ * uses airtime table, CRC is taken as present so the slot is never short.
+ * pkt - An pointer to downlink
+ */
+uint32_t jq_airtime_us(const struct lgw_pkt_tx_s *pkt) {
+    uint32_t sf, bw, cr;
+
+    if (pkt->modulation != MOD_LORA)
+        return lgw_time_on_air((struct lgw_pkt_tx_s*) pkt) * 1000;
+
+    switch (pkt->datarate) {
+        case DR_LORA_SF7: sf = 7;
+            break;
+        case DR_LORA_SF8: sf = 8;
+            break;
+        case DR_LORA_SF9: sf = 9;
+            break;
+        case DR_LORA_SF10: sf = 10;
+            break;
+        case DR_LORA_SF11: sf = 11;
+            break;
+        case DR_LORA_SF12: sf = 12;
+            break;
+        default: return 0;
+    }
+    switch (pkt->bandwidth) {
+        case BW_500KHZ: bw = 500;
+            break;
+        case BW_250KHZ: bw = 250;
+            break;
+        case BW_125KHZ: bw = 125;
+            break;
+        default: return 0;
+    }
+    cr = (pkt->coderate >= CR_LORA_4_5 && pkt->coderate <= CR_LORA_4_8) ? pkt->coderate + 4 : 5;
+
+    return lr_airtime_us(pkt->size, !pkt->no_header, (sf >= 11 && bw == 125), sf, cr,
+            (pkt->preamble != 0) ? pkt->preamble : JQ_PREAMBLE, bw);
+}
+
+/** 
+ * The jq_collides() return true when slot overlaps queued or emitting 
+ * downlink, margin included on both sides.
+ */
+static bool jq_collides(const struct jq_queue *q, uint32_t start, uint32_t airtime, uint32_t *after) {
+    const struct jq_entry *e;
+    uint16_t i;
+
+    if (q->tx_busy && jq_before(start, q->tx_end_us + JQ_MARGIN_US)) {
+        *after = q->tx_end_us + JQ_MARGIN_US;
+        return true;
+    }
+    for (i = 0; i < q->count; i++) {
+        e = &q->pool[q->heap[i].idx];
+        if (jq_before(start, e->start_us + e->airtime_us + JQ_MARGIN_US)
+                && jq_before(e->start_us, start + airtime + JQ_MARGIN_US)) {
+            *after = e->start_us + e->airtime_us + JQ_MARGIN_US;
+            return true;
+        }
+    }
+    return false;
+}
+
+/** 
+ * The jq_channel() return TX window of channel, NULL when all are taken.
+ */
+static struct jq_channel *jq_channel(struct jq_queue *q, uint32_t freq_hz) {
+    uint32_t i;
+
+    for (i = 0; i < q->ch_cnt; i++)
+        if (q->ch[i].freq_hz == freq_hz)
+            return &q->ch[i];
+    if (q->ch_cnt == JQ_CHANNELS)
+        return NULL;
+    memset(&q->ch[q->ch_cnt], 0, sizeof q->ch[0]);
+    q->ch[q->ch_cnt].freq_hz = freq_hz;
+    return &q->ch[q->ch_cnt++];
+}
+
+/** 
+ * The jq_duty_ok() return true when airtime fits duty cycle budget of 
+ * channel, emitted and queued downlinks of the channel counted.
+ */
+static bool jq_duty_ok(struct jq_queue *q, uint32_t freq_hz, uint32_t airtime, uint64_t now) {
+    struct jq_channel *ch;
+    uint64_t used = airtime;
+    uint16_t i;
+
+    if (q->duty_limit <= 0.0)
+        return true;
+    ch = jq_channel(q, freq_hz);
+    if (ch == NULL)
+        return false;
+    dc_window_add(&ch->win, 0, now); /* rotate out old buckets */
+    used += ch->win.total_us;
+    for (i = 0; i < q->count; i++)
+        if (q->pool[q->heap[i].idx].pkt.freq_hz == freq_hz)
+            used += q->pool[q->heap[i].idx].airtime_us;
+    return used <= q->duty_limit / 100.0 * DC_WINDOW_SEC * 1e6;
+}
+
+static void jq_sift_up(struct jq_queue *q, uint16_t i) {
+    struct jq_slot s = q->heap[i];
+    uint16_t parent;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!jq_before(s.start_us, q->heap[parent].start_us))
+            break;
+        q->heap[i] = q->heap[parent];
+        i = parent;
+    }
+    q->heap[i] = s;
+}
+
+static void jq_sift_down(struct jq_queue *q, uint16_t i) {
+    struct jq_slot s = q->heap[i];
+    uint16_t child;
+
+    while ((child = 2 * i + 1) < q->count) {
+        if (child + 1 < q->count && jq_before(q->heap[child + 1].start_us, q->heap[child].start_us))
+            child++;
+        if (!jq_before(q->heap[child].start_us, s.start_us))
+            break;
+        q->heap[i] = q->heap[child];
+        i = child;
+    }
+    q->heap[i] = s;
+}
+
+/** 
+ * Remove nearest downlink from heap, its pool entry stays valid until 
+ * next enqueue.
+ */
+static struct jq_entry *jq_pop(struct jq_queue *q) {
+    uint16_t idx = q->heap[0].idx;
+
+    q->heap[0] = q->heap[--q->count];
+    if (q->count > 0)
+        jq_sift_down(q, 0);
+    q->free[q->free_cnt++] = idx;
+    return &q->pool[idx];
+}
+
+/** 
+ * Queue downlink. Immediate downlink gets first free slot JQ_LEAD_US from 
+ * now and is sent as timestamped. Return JQ_OK or reason of rejection.
+ * q      - An pointer to queue
+ * pkt    - An pointer to downlink, copied
+ * now_us - Current concentrator counter
+ * now    - Current time in seconds, for duty cycle window
+ */
+int jq_enqueue(struct jq_queue *q, const struct lgw_pkt_tx_s *pkt, uint32_t now_us, uint64_t now) {
+    struct jq_entry *e;
+    uint32_t start, airtime, after;
+    uint16_t idx, tries;
+    int ret = JQ_OK;
+
+    if (q->tx_busy && !jq_before(now_us, q->tx_end_us))
+        q->tx_busy = false;
+
+    airtime = jq_airtime_us(pkt);
+    if (airtime == 0 || (pkt->tx_mode != IMMEDIATE && pkt->tx_mode != TIMESTAMPED)) {
+        ret = JQ_INVALID;
+    } else if (q->count == JQ_SIZE) {
+        ret = JQ_FULL;
+    } else if (pkt->tx_mode == IMMEDIATE) {
+        start = now_us + JQ_LEAD_US;
+        for (tries = 0; tries <= q->count && jq_collides(q, start, airtime, &after); tries++)
+            start = after;
+        if ((int32_t) (start - now_us) > JQ_MAX_AHEAD_US)
+            ret = JQ_TOO_EARLY;
+    } else {
+        start = pkt->count_us;
+        if ((int32_t) (start - now_us) < JQ_MIN_LEAD_US)
+            ret = JQ_TOO_LATE;
+        else if ((int32_t) (start - now_us) > JQ_MAX_AHEAD_US)
+            ret = JQ_TOO_EARLY;
+        else if (jq_collides(q, start, airtime, &after))
+            ret = JQ_OVERLAP;
+    }
+    if (ret == JQ_OK && !jq_duty_ok(q, pkt->freq_hz, airtime, now))
+        ret = JQ_DUTY;
+
+    q->cnt.rejected[ret]++;
+    if (ret != JQ_OK)
+        return ret;
+
+    idx = q->free[--q->free_cnt];
+    e = &q->pool[idx];
+    e->pkt = *pkt;
+    e->pkt.tx_mode = TIMESTAMPED;
+    e->pkt.count_us = start;
+    e->start_us = start;
+    e->airtime_us = airtime;
+    q->heap[q->count].start_us = start;
+    q->heap[q->count].idx = idx;
+    jq_sift_up(q, q->count++);
+    if (q->count > q->cnt.high_water)
+        q->cnt.high_water = q->count;
+    return JQ_OK;
+}
+
+/** 
+ * Program nearest downlink when its slot is within JQ_LEAD_US and TX 
+ * buffer is free, drop downlinks whose slot can no longer be reached. 
+ * Return lgw_send() result of programmed downlink, LGW_HAL_SUCCESS when 
+ * none was due.
+ * q      - An pointer to queue
+ * now_us - Current concentrator counter
+ * now    - Current time in seconds, for duty cycle window
+ * send   - Callback programming concentrator
+ */
+int jq_poll(struct jq_queue *q, uint32_t now_us, uint64_t now, jq_send_fn send) {
+    struct jq_entry *e;
+    struct jq_channel *ch;
+    int ret;
+
+    if (q->tx_busy && !jq_before(now_us, q->tx_end_us))
+        q->tx_busy = false;
+
+    while (q->count > 0 && !jq_before(now_us + JQ_LEAD_US, q->heap[0].start_us)) {
+        if ((int32_t) (q->heap[0].start_us - now_us) < JQ_MIN_LEAD_US) {
+            jq_pop(q);
+            q->cnt.missed++;
+            continue;
+        }
+        if (q->tx_busy)
+            break;
+
+        e = jq_pop(q);
+        ret = send(&e->pkt);
+        if (ret == LGW_HAL_SUCCESS) {
+            q->cnt.sent++;
+            q->tx_busy = true;
+            q->tx_end_us = e->start_us + e->airtime_us;
+            ch = (q->duty_limit > 0.0) ? jq_channel(q, e->pkt.freq_hz) : NULL;
+            if (ch != NULL)
+                dc_window_add(&ch->win, e->airtime_us, now);
+        } else if (ret == LGW_LBT_ISSUE) {
+            q->cnt.lbt_busy++;
+        } else {
+            q->cnt.failed++;
+        }
+        return ret;
+    }
+    return LGW_HAL_SUCCESS;
+}
+
+/** 
+ * The jq_wait_us() return time until queue needs next jq_poll(), nearest 
+ * downlink is due JQ_LEAD_US before its slot but not before TX buffer is 
+ * free. UINT32_MAX when queue is empty.
+ * q      - An pointer to queue
+ * now_us - Current concentrator counter
+ */
+uint32_t jq_wait_us(const struct jq_queue *q, uint32_t now_us) {
+    uint32_t due;
+
+    if (q->count == 0)
+        return UINT32_MAX;
+    due = q->heap[0].start_us - JQ_LEAD_US;
+    if (q->tx_busy && jq_before(due, q->tx_end_us))
+        due = q->tx_end_us;
+    return jq_before(now_us, due) ? due - now_us : 0;
+}
+
+/** 
+ * The jq_result_name() return description of enqueue result.
+ */
+const char *jq_result_name(int result) {
+    return (result >= 0 && result < JQ_RESULTS) ? jq_names[result] : "unknown";
+}
@@ -0,0 +1,168 @@
+/**
+ * \file jit_queue.h
+ * \brief Just-in-time downlink queue of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "libloragw/inc/loragw_hal.h"
+#include "duty_cycle.h"
+
+#ifndef JIT_QUEUE_H
+#define JIT_QUEUE_H
+
+/** Downlinks waiting for their slot */
+#define JQ_SIZE 256
+
+/** Downlink is programmed into concentrator this long before its slot */
+#define JQ_LEAD_US 30000
+
+/** Programming later than this before the slot misses it, TX start delay and SPI load */
+#define JQ_MIN_LEAD_US 2500
+
+/** Gap kept after end of downlink, next one is programmed once TX buffer is free */
+#define JQ_MARGIN_US 4000
+
+/** Latest accepted slot ahead of the counter, RX2 of join accept opens after 6 s */
+#define JQ_MAX_AHEAD_US 10000000
+
+/** Channels with own TX duty cycle window */
+#define JQ_CHANNELS 16
+
+/** Preamble symbols of LoRa downlink not setting its own, as HAL does */
+#define JQ_PREAMBLE 8
+
+/** 
+ * Define enqueue results:
+ *   JQ_OK        - queued
+ *   JQ_FULL      - queue is full
+ *   JQ_TOO_LATE  - slot starts sooner than JQ_MIN_LEAD_US
+ *   JQ_TOO_EARLY - slot starts later than JQ_MAX_AHEAD_US
+ *   JQ_OVERLAP   - airtime collides with queued or emitting downlink
+ *   JQ_DUTY      - duty cycle budget of channel is exhausted
+ *   JQ_INVALID   - unsupported TX mode or modulation
+ */
+#define JQ_OK 0
+#define JQ_FULL 1
+#define JQ_TOO_LATE 2
+#define JQ_TOO_EARLY 3
+#define JQ_OVERLAP 4
+#define JQ_DUTY 5
+#define JQ_INVALID 6
+#define JQ_RESULTS 7
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** Define structure for queued downlink, slot is [start_us, start_us + airtime_us) */
+    struct jq_entry {
+        struct lgw_pkt_tx_s pkt;
+        uint32_t start_us;
+        uint32_t airtime_us;
+    };
+
+    /** Define structure for heap slot, ordered by start relative to counter wrap */
+    struct jq_slot {
+        uint32_t start_us;
+        uint16_t idx;
+    };
+
+    /** Define structure for TX airtime of one channel */
+    struct jq_channel {
+        uint32_t freq_hz;
+        struct dc_window win;
+    };
+
+    /** Define structure for downlink counters */
+    struct jq_counters {
+        uint64_t rejected[JQ_RESULTS]; /* by enqueue result, JQ_OK counts queued */
+        uint64_t sent;
+        uint64_t missed;
+        uint64_t lbt_busy;
+        uint64_t failed;
+        uint32_t high_water;
+    };
+
+    /** Callback programming downlink into concentrator, returns lgw_send() result */
+    typedef int (*jq_send_fn)(const struct lgw_pkt_tx_s *pkt);
+
+    /** 
+     * Define structure for just-in-time queue. Downlinks wait in binary heap 
+     * keyed by slot start and only the nearest one is programmed into the 
+     * single TX buffer of the concentrator, just before its slot.
+     */
+    struct jq_queue {
+        struct jq_entry pool[JQ_SIZE];
+        uint16_t free[JQ_SIZE];
+        uint16_t free_cnt;
+        struct jq_slot heap[JQ_SIZE];
+        uint16_t count;
+        bool tx_busy;
+        uint32_t tx_end_us;
+        double duty_limit;
+        struct jq_channel ch[JQ_CHANNELS];
+        uint32_t ch_cnt;
+        struct jq_counters cnt;
+    };
+
+    void jq_init(struct jq_queue *q, double duty_limit);
+    uint32_t jq_airtime_us(const struct lgw_pkt_tx_s *pkt);
+    int jq_enqueue(struct jq_queue *q, const struct lgw_pkt_tx_s *pkt, uint32_t now_us, uint64_t now);
+    int jq_poll(struct jq_queue *q, uint32_t now_us, uint64_t now, jq_send_fn send);
+    uint32_t jq_wait_us(const struct jq_queue *q, uint32_t now_us);
+    const char *jq_result_name(int result);
+
+    /** 
+     * The jq_count() return number of downlinks waiting in queue.
+     */
+    static inline uint16_t jq_count(const struct jq_queue *q) {
+        return q->count;
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JIT_QUEUE_H */
@@ -0,0 +1,418 @@
+/**
+ * \file join_session.c
+ * \brief OTAA session keys learned from join exchanges.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "join_session.h"
+
+/** 
+ * JoinSession
+ * Session keys of OTAA devices are learned from join exchanges. A join 
+ * request whose MIC verifies by the provisioned AppKey of its DevEUI waits 
+ * in a short ring, the next join accept is decrypted by AppKey of pending 
+ * requests newest first until its MIC verifies. NwkSKey and AppSKey are 
+ * derived from AppNonce, NetID and DevNonce once, expanded and stored in 
+ * open addressing table by DevAddr, so data frames need one hash probe 
+ * sequence and no key derivation. All state is owned by the thread 
+ * exporting packets, no locking is needed.
+ */
+
+/** 
+ * AppKey store sorted by DevEUI, replaced as a whole by js_load().
+ */
+static struct js_appkey *js_keys = NULL;
+static size_t js_keys_cnt = 0;
+
+/** Pending join requests, ring overwritten oldest first */
+struct js_pending {
+    const struct js_appkey *key;
+    uint16_t dev_nonce;
+    uint64_t seen;
+};
+static struct js_pending js_pending[JS_PENDING];
+static uint32_t js_pending_head = 0;
+
+/** 
+ * Session table, linear probing with backward shift deletion. Slots hold 
+ * DevAddr next to pool index, so probing touches no session record. Pool 
+ * is allocated by first js_load(), unused processes pay nothing for it.
+ */
+struct js_slot {
+    uint32_t dev_addr;
+    uint32_t idx; /* pool index + 1, 0 empty */
+};
+static struct js_slot js_table[JS_TABLE_SIZE];
+static struct js_session *js_pool = NULL;
+static uint32_t js_free[JS_MAX_SESSIONS];
+static uint32_t js_free_cnt = 0;
+static uint32_t js_sessions = 0;
+static uint64_t js_seq = 0;
+
+static struct js_counters js_cnt;
+
+static int js_cmp(const void *a, const void *b) {
+    uint64_t x = ((const struct js_appkey*) a)->dev_eui;
+    uint64_t y = ((const struct js_appkey*) b)->dev_eui;
+    return (x > y) - (x < y);
+}
+
+/** 
+ * Fold DevAddr to home slot. NwkID sits in the top bits, so both halves 
+ * are mixed in.
+ */
+static inline uint32_t js_slot(uint32_t dev_addr) {
+    return (dev_addr * 0x9E3779B1u) >> (32 - JS_TABLE_BITS);
+}
+
+/** 
+ * Load AppKeys of OTAA devices from text file. Every non empty line not 
+ * starting by '#' holds DevEUI (16 hex digits, most significant first) 
+ * followed by AppKey (32 hex digits). Pending join requests refer to the 
+ * previous store and are dropped, learned sessions stay valid. Return 
+ * number of loaded devices or -1 on error.
+ */
+int js_load(const char *file) {
+    FILE *f;
+    char line[256], eui[32], key[48];
+    struct js_appkey *keys = NULL, *tmp;
+    size_t cnt = 0, size = 0;
+    unsigned long nr = 0;
+    uint8_t e[8];
+    int i;
+
+    if (js_pool == NULL) {
+        js_pool = (struct js_session*) calloc(JS_MAX_SESSIONS, sizeof *js_pool);
+        if (js_pool == NULL)
+            return -1;
+        js_clear();
+    }
+
+    f = fopen(file, "r");
+    if (f == NULL)
+        return -1;
+
+    while (fgets(line, sizeof line, f) != NULL) {
+        nr++;
+        if (line[0] == '#' || sscanf(line, "%31s %47s", eui, key) != 2)
+            continue;
+
+        if (cnt == size) {
+            size = size ? 2 * size : 64;
+            tmp = (struct js_appkey*) realloc(keys, size * sizeof *keys);
+            if (tmp == NULL) {
+                free(keys);
+                fclose(f);
+                return -1;
+            }
+            keys = tmp;
+        }
+
+        struct js_appkey *k = &keys[cnt];
+        if (sk_parse_hex(e, eui, sizeof e) != 0 || sk_parse_hex(k->app_key, key, SK_KEY_SIZE) != 0) {
+            fprintf(stderr, "Warning: Invalid AppKey entry on line %lu of %s.\n", nr, file);
+            continue;
+        }
+        k->dev_eui = 0;
+        for (i = 0; i < 8; i++)
+            k->dev_eui = k->dev_eui << 8 | e[i];
+        AES_CMAC_init(&k->cmac, k->app_key);
+        AES_init_ctx(&k->aes, k->app_key);
+        cnt++;
+    }
+    fclose(f);
+
+    qsort(keys, cnt, sizeof *keys, js_cmp);
+
+    memset(js_pending, 0, sizeof js_pending);
+    free(js_keys);
+    js_keys = keys;
+    js_keys_cnt = cnt;
+    return (int) cnt;
+}
+
+size_t js_count() {
+    return js_keys_cnt;
+}
+
+/** 
+ * Release AppKey store and all learned sessions.
+ */
+void js_unload() {
+    free(js_keys);
+    js_keys = NULL;
+    js_keys_cnt = 0;
+    free(js_pool);
+    js_pool = NULL;
+    memset(js_table, 0, sizeof js_table);
+    js_sessions = 0;
+}
+
+static const struct js_appkey* js_find_key(uint64_t dev_eui) {
+    struct js_appkey key;
+
+    if (js_keys_cnt == 0)
+        return NULL;
+    key.dev_eui = dev_eui;
+    return (const struct js_appkey*) bsearch(&key, js_keys, js_keys_cnt, sizeof key, js_cmp);
+}
+
+/** 
+ * Remember join request of provisioned device with valid MIC.
+ * frame - An pointer to parsed join request
+ * now   - Current time in seconds
+ */
+void js_join_request(const struct lr_frame *frame, uint64_t now) {
+    const struct js_appkey *key;
+    uint8_t mac[AES_BLOCKLEN];
+    uint32_t i;
+
+    js_cnt.requests++;
+    key = js_find_key(frame->dev_eui);
+    if (key == NULL) {
+        js_cnt.unknown++;
+        return;
+    }
+
+    AES_CMAC(&key->cmac, frame->phy, LR_JOIN_REQUEST_SIZE - LR_MIC_SIZE, mac);
+    if (memcmp(mac, frame->phy + LR_JOIN_REQUEST_SIZE - LR_MIC_SIZE, LR_MIC_SIZE) != 0) {
+        js_cnt.request_mic_invalid++;
+        return;
+    }
+
+    /* copies received by several gateways refresh the same entry */
+    for (i = 0; i < JS_PENDING; i++) {
+        struct js_pending *p = &js_pending[i];
+        if (p->key == key && p->dev_nonce == frame->dev_nonce) {
+            p->seen = now;
+            return;
+        }
+    }
+
+    js_pending[js_pending_head].key = key;
+    js_pending[js_pending_head].dev_nonce = frame->dev_nonce;
+    js_pending[js_pending_head].seen = now;
+    js_pending_head = (js_pending_head + 1) % JS_PENDING;
+}
+
+/** 
+ * Derive session key, type 0x01 gives NwkSKey and 0x02 AppSKey.
+ * acc - An pointer to decrypted join accept starting by AppNonce
+ */
+static void js_derive(uint8_t *out, const struct js_appkey *key, uint8_t type, const uint8_t *acc, uint16_t dev_nonce) {
+    memset(out, 0, SK_KEY_SIZE);
+    out[0] = type;
+    memcpy(out + 1, acc, 6); /* AppNonce and NetID */
+    out[7] = (uint8_t) dev_nonce;
+    out[8] = (uint8_t) (dev_nonce >> 8);
+    AES_ECB_encrypt_ctx(&key->aes, out);
+}
+
+/** 
+ * Remove session from slot, return its record to pool and shift following 
+ * entries of the probe sequence back, so lookups need no tombstones.
+ */
+static void js_delete(uint32_t i) {
+    uint32_t j = i, home;
+
+    js_pool[js_table[i].idx - 1].used = false;
+    js_free[js_free_cnt++] = js_table[i].idx - 1;
+    js_sessions--;
+    for (;;) {
+        js_table[i].idx = 0;
+        for (;;) {
+            j = (j + 1) & (JS_TABLE_SIZE - 1);
+            if (js_table[j].idx == 0)
+                return;
+            home = js_slot(js_table[j].dev_addr);
+            /* entry stays when its home lies cyclically in (i, j] */
+            if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+                continue;
+            break;
+        }
+        js_table[i] = js_table[j];
+        i = j;
+    }
+}
+
+/** 
+ * Return slot of DevAddr or the empty slot ending its probe sequence.
+ */
+static uint32_t js_probe(uint32_t dev_addr) {
+    uint32_t i = js_slot(dev_addr);
+
+    while (js_table[i].idx != 0 && js_table[i].dev_addr != dev_addr)
+        i = (i + 1) & (JS_TABLE_SIZE - 1);
+    return i;
+}
+
+/** 
+ * Store session, drop previous session of the same device under another 
+ * DevAddr and evict the oldest one when the pool is full. Joins are rare, 
+ * so the linear scans are paid here instead of by data frames.
+ */
+static const struct sk_device* js_store(uint64_t dev_eui, uint32_t dev_addr, const uint8_t *nwk, const uint8_t *app) {
+    uint32_t i, oldest = JS_TABLE_SIZE;
+    struct js_session *s;
+
+    for (i = 0; i < JS_TABLE_SIZE; i++) {
+        if (js_table[i].idx != 0 && js_table[i].dev_addr != dev_addr
+                && js_pool[js_table[i].idx - 1].dev_eui == dev_eui) {
+            js_delete(i);
+            break;
+        }
+    }
+
+    i = js_probe(dev_addr);
+    if (js_table[i].idx == 0 && js_free_cnt == 0) {
+        for (i = 0; i < JS_TABLE_SIZE; i++)
+            if (js_table[i].idx != 0 && (oldest == JS_TABLE_SIZE
+                    || js_pool[js_table[i].idx - 1].seq < js_pool[js_table[oldest].idx - 1].seq))
+                oldest = i;
+        js_delete(oldest);
+        js_cnt.evicted++;
+        i = js_probe(dev_addr);
+    }
+
+    if (js_table[i].idx == 0) {
+        js_table[i].dev_addr = dev_addr;
+        js_table[i].idx = js_free[--js_free_cnt] + 1;
+        js_sessions++;
+    }
+
+    s = &js_pool[js_table[i].idx - 1];
+    s->used = true;
+    s->dev_eui = dev_eui;
+    s->seq = ++js_seq;
+    s->keys.dev_addr = dev_addr;
+    memcpy(s->keys.nwk_skey, nwk, SK_KEY_SIZE);
+    memcpy(s->keys.app_skey, app, SK_KEY_SIZE);
+    AES_CMAC_init(&s->keys.nwk, nwk);
+    AES_init_ctx(&s->keys.app, app);
+    return &s->keys;
+}
+
+/** 
+ * Pair join accept with pending join request and learn session of device.
+ * Return learned session or NULL when no pending request matches.
+ * frame - An pointer to parsed join accept, fields are still encrypted
+ * now   - Current time in seconds
+ */
+const struct sk_device* js_join_accept(const struct lr_frame *frame, uint64_t now) {
+    uint8_t msg[LR_JOIN_ACCEPT_CFLIST_SIZE], mac[AES_BLOCKLEN];
+    uint8_t nwk[SK_KEY_SIZE], app[SK_KEY_SIZE];
+    size_t len, b;
+    uint32_t n, i, dev_addr;
+    const struct js_pending *p;
+    const struct sk_device *dev;
+
+    if (frame->size != LR_JOIN_ACCEPT_SIZE && frame->size != LR_JOIN_ACCEPT_CFLIST_SIZE)
+        return NULL;
+    js_cnt.accepts++;
+    len = frame->size - LR_MHDR_SIZE;
+
+    for (n = 1; n <= JS_PENDING; n++) {
+        i = (js_pending_head + JS_PENDING - n) % JS_PENDING;
+        p = &js_pending[i];
+        if (p->key == NULL || now - p->seen > JS_ACCEPT_WINDOW)
+            continue;
+
+        /* network server encrypts join accept by AES decrypt, so encrypt reverts it */
+        msg[0] = frame->phy[0];
+        memcpy(msg + LR_MHDR_SIZE, frame->phy + LR_MHDR_SIZE, len);
+        for (b = 0; b < len; b += AES_BLOCKLEN)
+            AES_ECB_encrypt_ctx(&p->key->aes, msg + LR_MHDR_SIZE + b);
+
+        AES_CMAC(&p->key->cmac, msg, frame->size - LR_MIC_SIZE, mac);
+        if (memcmp(mac, msg + frame->size - LR_MIC_SIZE, LR_MIC_SIZE) != 0)
+            continue;
+
+        js_derive(nwk, p->key, 0x01, msg + LR_MHDR_SIZE, p->dev_nonce);
+        js_derive(app, p->key, 0x02, msg + LR_MHDR_SIZE, p->dev_nonce);
+        dev_addr = (uint32_t) msg[7] | (uint32_t) msg[8] << 8 | (uint32_t) msg[9] << 16 | (uint32_t) msg[10] << 24;
+        dev = js_store(p->key->dev_eui, dev_addr, nwk, app);
+        js_pending[i].key = NULL;
+        return dev;
+    }
+
+    js_cnt.unmatched++;
+    return NULL;
+}
+
+/** 
+ * Return session learned for DevAddr or NULL if device did not join.
+ */
+const struct sk_device* js_find(uint32_t dev_addr) {
+    uint32_t i;
+
+    if (js_sessions == 0)
+        return NULL;
+    i = js_probe(dev_addr);
+    return js_table[i].idx != 0 ? &js_pool[js_table[i].idx - 1].keys : NULL;
+}
+
+void js_get_counters(struct js_counters *c) {
+    *c = js_cnt;
+    c->sessions = js_sessions;
+}
+
+/** 
+ * Forget all pending join requests and learned sessions.
+ */
+void js_clear() {
+    uint32_t i;
+
+    memset(js_pending, 0, sizeof js_pending);
+    memset(js_table, 0, sizeof js_table);
+    js_pending_head = 0;
+    js_sessions = 0;
+    if (js_pool == NULL)
+        return;
+    for (i = 0; i < JS_MAX_SESSIONS; i++) {
+        js_pool[i].used = false;
+        js_free[i] = JS_MAX_SESSIONS - 1 - i;
+    }
+    js_free_cnt = JS_MAX_SESSIONS;
+}
@@ -0,0 +1,113 @@
+/**
+ * \file join_session.h
+ * \brief OTAA session keys learned from join exchanges.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "aes/aes.h"
+#include "aes/cmac.h"
+#include "lora_packet.h"
+#include "session_keys.h"
+
+#ifndef JOIN_SESSION_H
+#define JOIN_SESSION_H
+
+/** Join requests waiting for their join accept */
+#define JS_PENDING 64
+
+/** Join accept is matched to requests not older than this, in seconds (RX2 of join is 6 s) */
+#define JS_ACCEPT_WINDOW 10
+
+/** Session table of 2^JS_TABLE_BITS slots, at most half of them used */
+#define JS_TABLE_BITS 13
+#define JS_TABLE_SIZE (1u << JS_TABLE_BITS)
+#define JS_MAX_SESSIONS (JS_TABLE_SIZE / 2)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** Provisioned OTAA device with AppKey expanded at load time */
+    struct js_appkey {
+        uint64_t dev_eui;
+        uint8_t app_key[SK_KEY_SIZE];
+        struct AES_CMAC_ctx cmac;
+        struct AES_ctx aes;
+    };
+
+    /** Session derived from one join exchange, keyed by DevAddr */
+    struct js_session {
+        struct sk_device keys;
+        uint64_t dev_eui;
+        uint64_t seq; /* join order, oldest session is evicted first */
+        bool used;
+    };
+
+    /** Define structure for join exchange counters */
+    struct js_counters {
+        uint64_t requests;
+        uint64_t unknown;
+        uint64_t request_mic_invalid;
+        uint64_t accepts;
+        uint64_t unmatched;
+        uint64_t evicted;
+        uint32_t sessions;
+    };
+
+    int js_load(const char *file);
+    size_t js_count();
+    void js_unload();
+
+    void js_join_request(const struct lr_frame *frame, uint64_t now);
+    const struct sk_device* js_join_accept(const struct lr_frame *frame, uint64_t now);
+    const struct sk_device* js_find(uint32_t dev_addr);
+    void js_get_counters(struct js_counters *c);
+    void js_clear();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JOIN_SESSION_H */
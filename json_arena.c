@@ -0,0 +1,191 @@
+/**
+ * \file json_arena.c
+ * \brief Arena allocator for parson, whole JSON document in one region.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "parson.h"
+#include "json_arena.h"
+
+/**
+ * JsonArena
+ * Between ja_begin() and ja_end() every parson allocation of the calling 
+ * thread is bumped from the arena and parson frees are no-ops, so parsing 
+ * a document or building one for output costs a few pointer increments 
+ * per value. Values are dropped together by ja_reset() instead of 
+ * json_value_free(). Reset merges chunks into one of their total size, 
+ * after the first documents the arena is a single region and reset only 
+ * rewinds it. Parson keeps growing arrays by copy, the abandoned copies 
+ * stay in the arena until reset. Values created in arena mode must not 
+ * outlive the reset, other threads keep using malloc and free.
+ */
+
+static __thread struct ja_arena *ja_current = NULL;
+static int ja_hooked = 0;
+
+static struct ja_chunk *ja_chunk_new(size_t size) {
+    struct ja_chunk *c = (struct ja_chunk *) malloc(sizeof (struct ja_chunk) + size);
+
+    if (c == NULL)
+        return NULL;
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+static void *ja_malloc_hook(size_t size) {
+    return (ja_current != NULL) ? ja_alloc(ja_current, size) : malloc(size);
+}
+
+static void ja_free_hook(void *ptr) {
+    if (ja_current == NULL)
+        free(ptr);
+}
+
+/** 
+ * Initialize empty arena, first chunk is allocated on first use.
+ * a          - An pointer to arena
+ * chunk_size - Size of first chunk, 0 for JA_DEFAULT_CHUNK
+ */
+void ja_init(struct ja_arena *a, size_t chunk_size) {
+    a->head = NULL;
+    a->chunk_size = (chunk_size > 0) ? chunk_size : JA_DEFAULT_CHUNK;
+    a->allocs = 0;
+}
+
+/** 
+ * Allocate from arena, new chunk at least twice the previous one is added 
+ * when current is full. Return NULL on allocation failure.
+ * a    - An pointer to arena
+ * size - Size in bytes
+ */
+void *ja_alloc(struct ja_arena *a, size_t size) {
+    struct ja_chunk *c = a->head;
+    size_t need = (size + JA_ALIGN - 1) & ~((size_t) JA_ALIGN - 1);
+    size_t grow;
+    void *p;
+
+    if (c == NULL || c->size - c->used < need) {
+        grow = (c != NULL) ? 2 * c->size : a->chunk_size;
+        c = ja_chunk_new((grow > need) ? grow : need);
+        if (c == NULL)
+            return NULL;
+        c->next = a->head;
+        a->head = c;
+    }
+    p = c->data + c->used;
+    c->used += need;
+    a->allocs++;
+    return p;
+}
+
+/** 
+ * Drop every allocation. Several chunks are replaced by one of their 
+ * total size, so next document of similar size fits in single region.
+ * a - An pointer to arena
+ */
+void ja_reset(struct ja_arena *a) {
+    struct ja_chunk *c, *next;
+    size_t total = 0;
+
+    if (a->head == NULL)
+        return;
+    if (a->head->next != NULL) {
+        for (c = a->head; c != NULL; c = next) {
+            next = c->next;
+            total += c->size;
+            free(c);
+        }
+        a->head = ja_chunk_new(total);
+        if (a->head == NULL)
+            return;
+    }
+    a->head->used = 0;
+    a->allocs = 0;
+}
+
+/** 
+ * Release all chunks of arena.
+ * a - An pointer to arena
+ */
+void ja_free(struct ja_arena *a) {
+    struct ja_chunk *c, *next;
+
+    for (c = a->head; c != NULL; c = next) {
+        next = c->next;
+        free(c);
+    }
+    a->head = NULL;
+    a->allocs = 0;
+}
+
+/** 
+ * The ja_used() return bytes allocated since last reset.
+ * a - An pointer to arena
+ */
+size_t ja_used(const struct ja_arena *a) {
+    const struct ja_chunk *c;
+    size_t used = 0;
+
+    for (c = a->head; c != NULL; c = c->next)
+        used += c->used;
+    return used;
+}
+
+/** 
+ * Route parson allocations of calling thread to arena until ja_end().
+ * a - An pointer to arena
+ */
+void ja_begin(struct ja_arena *a) {
+    /* hooks are installed once, they fall back to malloc outside arena mode */
+    if (__atomic_exchange_n(&ja_hooked, 1, __ATOMIC_ACQ_REL) == 0)
+        json_set_allocation_functions(ja_malloc_hook, ja_free_hook);
+    ja_current = a;
+}
+
+/** 
+ * Return parson allocations of calling thread to malloc and free.
+ */
+void ja_end(void) {
+    ja_current = NULL;
+}
@@ -0,0 +1,88 @@
+/**
+ * \file json_arena.h
+ * \brief Arena allocator for parson, whole JSON document in one region.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+/** Default size of first arena chunk, fits usual configuration file */
+#define JA_DEFAULT_CHUNK 65536
+
+/** Alignment of every allocation */
+#define JA_ALIGN 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** Define structure for arena chunk, allocations are bumped from data */
+    struct ja_chunk {
+        struct ja_chunk *next;
+        size_t size;
+        size_t used;
+        unsigned char data[] __attribute__((aligned(JA_ALIGN)));
+    };
+
+    /** Define structure for arena, chunks are kept newest first */
+    struct ja_arena {
+        struct ja_chunk *head;
+        size_t chunk_size;
+        uint64_t allocs;
+    };
+
+    void ja_init(struct ja_arena *a, size_t chunk_size);
+    void *ja_alloc(struct ja_arena *a, size_t size);
+    void ja_reset(struct ja_arena *a);
+    void ja_free(struct ja_arena *a);
+    size_t ja_used(const struct ja_arena *a);
+
+    void ja_begin(struct ja_arena *a);
+    void ja_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSON_ARENA_H */
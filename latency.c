@@ -0,0 +1,225 @@
+/**
+ * \file latency.c
+ * \brief Latency histograms of packet path of LoRaWAN logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "latency.h"
+
+/** 
+ * Latency
+ * HDR style histograms, values below 2^LT_SUB_BITS ns have own bucket, 
+ * every higher power of two is split to 2^LT_SUB_BITS linear buckets. 
+ * Dwell and fetch are written by fetch loop, queue, convert and send by 
+ * thread exporting packets, so counters are updated by plain relaxed 
+ * stores without read-modify-write. Fetch stamps are passed in the order 
+ * of packets through single-producer/single-consumer FIFO.
+ */
+
+static struct lt_hist lt_hist[LT_STAGES];
+
+static const char *lt_names[LT_STAGES] = {"dwell", "fetch", "queue", "convert", "send"};
+
+static uint64_t lt_fifo[LT_FIFO_SIZE];
+static uint32_t lt_fifo_head = 0;
+static uint32_t lt_fifo_tail = 0;
+
+static inline uint32_t lt_bucket(uint64_t ns) {
+    int e;
+
+    if (ns < (1u << LT_SUB_BITS))
+        return (uint32_t) ns;
+    e = 63 - __builtin_clzll(ns);
+    if (e > LT_MAX_BITS)
+        return LT_BUCKETS - 1;
+    return ((e - LT_SUB_BITS + 1) << LT_SUB_BITS) + ((ns >> (e - LT_SUB_BITS)) & ((1u << LT_SUB_BITS) - 1));
+}
+
+/** 
+ * The lt_bucket_high() return highest value counted in bucket.
+ * b - Bucket index
+ */
+uint64_t lt_bucket_high(uint32_t b) {
+    uint32_t group = b >> LT_SUB_BITS;
+    uint32_t sub = b & ((1u << LT_SUB_BITS) - 1);
+    int shift;
+
+    if (group == 0)
+        return b;
+    shift = group - 1;
+    return (((uint64_t) (1u << LT_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+/** 
+ * Add sample to stage histogram, called by single writer thread of stage.
+ * stage - Stage index
+ * ns    - Duration in ns
+ */
+void lt_record(int stage, uint64_t ns) {
+    struct lt_hist *h = &lt_hist[stage];
+    uint32_t b = lt_bucket(ns);
+
+    __atomic_store_n(&h->bucket[b], h->bucket[b] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum_ns, h->sum_ns + ns, __ATOMIC_RELAXED);
+    if (ns > h->max_ns)
+        __atomic_store_n(&h->max_ns, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+}
+
+/** 
+ * Record duration of non-empty fetch and remember fetch time of its packets.
+ * start_ns - Monotonic time before fetch
+ * nb_pkt   - Number of fetched packets
+ */
+void lt_record_fetch(uint64_t start_ns, int nb_pkt) {
+    uint64_t now = lt_now();
+    int i;
+
+    if (nb_pkt <= 0)
+        return;
+    lt_record(LT_STAGE_FETCH, now - start_ns);
+    for (i = 0; i < nb_pkt; i++)
+        lt_push_fetch(now);
+}
+
+/** 
+ * Record wait of oldest packet between fetch and export.
+ * now_ns - Monotonic time at start of export
+ */
+void lt_record_queue(uint64_t now_ns) {
+    uint64_t fetch_ns = lt_pop_fetch();
+
+    if (fetch_ns != 0)
+        lt_record(LT_STAGE_QUEUE, now_ns - fetch_ns);
+}
+
+/** 
+ * Remember fetch time of packet, stamp is dropped if FIFO is full.
+ * ns - Monotonic time of fetch
+ */
+void lt_push_fetch(uint64_t ns) {
+    uint32_t head = lt_fifo_head;
+
+    if (head - __atomic_load_n(&lt_fifo_tail, __ATOMIC_ACQUIRE) >= LT_FIFO_SIZE)
+        return;
+    lt_fifo[head % LT_FIFO_SIZE] = ns;
+    __atomic_store_n(&lt_fifo_head, head + 1, __ATOMIC_RELEASE);
+}
+
+/** 
+ * The lt_pop_fetch() return fetch time of oldest packet, 0 if none.
+ */
+uint64_t lt_pop_fetch(void) {
+    uint32_t tail = lt_fifo_tail;
+    uint64_t ns;
+
+    if (tail == __atomic_load_n(&lt_fifo_head, __ATOMIC_ACQUIRE))
+        return 0;
+    ns = lt_fifo[tail % LT_FIFO_SIZE];
+    __atomic_store_n(&lt_fifo_tail, tail + 1, __ATOMIC_RELEASE);
+    return ns;
+}
+
+/** 
+ * The lt_percentile() return upper bound of bucket holding percentile, 
+ * never more than maximum seen.
+ * stage - Stage index
+ * pct   - Percentile 0 - 100
+ */
+uint64_t lt_percentile(int stage, double pct) {
+    const struct lt_hist *h = &lt_hist[stage];
+    uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+    uint64_t max_ns = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+    uint64_t rank, seen = 0, high;
+    uint32_t b;
+
+    if (count == 0)
+        return 0;
+    rank = (uint64_t) (pct / 100.0 * count);
+    if (rank == 0)
+        rank = 1;
+    for (b = 0; b < LT_BUCKETS; b++) {
+        seen += __atomic_load_n(&h->bucket[b], __ATOMIC_RELAXED);
+        if (seen >= rank)
+            break;
+    }
+    high = (b < LT_BUCKETS) ? lt_bucket_high(b) : max_ns;
+    return (high < max_ns) ? high : max_ns;
+}
+
+/** 
+ * The lt_get() return histogram of stage, counters are read by relaxed loads.
+ * stage - Stage index
+ */
+const struct lt_hist *lt_get(int stage) {
+    return &lt_hist[stage];
+}
+
+/** 
+ * The lt_name() return name of stage.
+ * stage - Stage index
+ */
+const char *lt_name(int stage) {
+    return lt_names[stage];
+}
+
+/** 
+ * Print one line per stage with count, mean, percentiles and maximum in us.
+ * f - An pointer to output stream
+ */
+void lt_dump(FILE *f) {
+    const struct lt_hist *h;
+    uint64_t count;
+    int s;
+
+    for (s = 0; s < LT_STAGES; s++) {
+        h = &lt_hist[s];
+        count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+        fprintf(f, "latency stage=%s count=%llu mean_us=%.1f p50_us=%.1f p90_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f\n",
+                lt_names[s], (unsigned long long) count,
+                count ? __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED) / 1000.0 / count : 0.0,
+                lt_percentile(s, 50.0) / 1000.0, lt_percentile(s, 90.0) / 1000.0,
+                lt_percentile(s, 99.0) / 1000.0, lt_percentile(s, 99.9) / 1000.0,
+                __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED) / 1000.0);
+    }
+}
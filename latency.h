@@ -0,0 +1,130 @@
+/**
+ * \file latency.h
+ * \brief Latency histograms of packet path of LoRaWAN logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+/** 
+ * Define packet path stages:
+ *   0 - Dwell      concentrator count_us to ps_receive() return
+ *   1 - Fetch      duration of non-empty ps_receive()
+ *   2 - Queue      ps_receive() return to start of export
+ *   3 - Convert    parse, statistics and encoding before trap_send()
+ *   4 - Send       duration of trap_send()
+ */
+#define LT_STAGE_DWELL 0
+#define LT_STAGE_FETCH 1
+#define LT_STAGE_QUEUE 2
+#define LT_STAGE_CONVERT 3
+#define LT_STAGE_SEND 4
+#define LT_STAGES 5
+
+/** Log-linear buckets, 16 per power of two (6.25 % resolution) up to 2^40 ns */
+#define LT_SUB_BITS 4
+#define LT_MAX_BITS 40
+#define LT_BUCKETS ((LT_MAX_BITS - LT_SUB_BITS + 2) << LT_SUB_BITS)
+
+/** Fetch stamps in flight, one per descriptor held out of packet source */
+#define LT_FIFO_SIZE 256
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** 
+     * Define structure for stage histogram. Every stage has single writer 
+     * thread, reader sees relaxed snapshot which may be one sample behind.
+     */
+    struct lt_hist {
+        uint64_t count;
+        uint64_t sum_ns;
+        uint64_t max_ns;
+        uint64_t bucket[LT_BUCKETS];
+    };
+
+    /** 
+     * The lt_now() return monotonic time in ns.
+     */
+    static inline uint64_t lt_now(void) {
+        struct timespec t;
+
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+    }
+
+    void lt_record(int stage, uint64_t ns);
+    void lt_record_fetch(uint64_t start_ns, int nb_pkt);
+    void lt_record_queue(uint64_t now_ns);
+    void lt_push_fetch(uint64_t ns);
+    uint64_t lt_pop_fetch(void);
+    uint64_t lt_percentile(int stage, double pct);
+    uint64_t lt_bucket_high(uint32_t b);
+    const struct lt_hist *lt_get(int stage);
+    const char *lt_name(int stage);
+    void lt_dump(FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** Instrumentation points, removed entirely without LATENCY_STATS */
+#ifdef LATENCY_STATS
+#define LT_STAMP(var) uint64_t var = lt_now()
+#define LT_RECORD(stage, start) lt_record((stage), lt_now() - (start))
+#define LT_FETCH(start, nb_pkt) lt_record_fetch((start), (nb_pkt))
+#define LT_QUEUE(now) lt_record_queue(now)
+#else
+#define LT_STAMP(var)
+#define LT_RECORD(stage, start)
+#define LT_FETCH(start, nb_pkt)
+#define LT_QUEUE(now)
+#endif
+
+#endif /* LATENCY_H */
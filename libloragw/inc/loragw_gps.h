@@ -83,6 +83,28 @@ enum gps_msg {
     UBX_NAV_TIMEUTC  /*!> UTC Time Solution */
 };
 
+#define LGW_GPS_STREAM_BUF      96  /* longest NMEA sentence (82 char) + margin */
+#define LGW_GPS_STREAM_FIELDS   20  /* most fields indexed in a NMEA sentence */
+
+/**
+@struct lgw_gps_stream
+@brief State of the incremental NMEA/UBX parser, bytes may be fed in chunks of any size
+*/
+struct lgw_gps_stream {
+    uint8_t     state;      /*!> position in the current frame */
+    uint8_t     ck_a;       /*!> running checksum (NMEA XOR, UBX Fletcher A) */
+    uint8_t     ck_b;       /*!> running checksum (UBX Fletcher B) */
+    uint8_t     cnt;        /*!> bytes received of the current header/checksum */
+    uint8_t     ubx_class;  /*!> UBX message class */
+    uint8_t     ubx_id;     /*!> UBX message ID */
+    uint16_t    ubx_size;   /*!> UBX payload length */
+    uint16_t    len;        /*!> bytes stored in buff */
+    uint8_t     nb_field;   /*!> number of NMEA fields indexed */
+    uint8_t     field[LGW_GPS_STREAM_FIELDS]; /*!> offset of NMEA fields in buff, separators are replaced by null char */
+    char        ck_rcv[2];  /*!> NMEA checksum characters */
+    char        buff[LGW_GPS_STREAM_BUF]; /*!> NMEA sentence (without '$') or payload of UBX message of interest */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
@@ -144,6 +166,29 @@ lock must be acquired before calling either function.
 */
 enum gps_msg lgw_parse_ubx(const char* serial_buff, size_t buff_size, size_t *msg_size);
 
+/**
+@brief Reset the state of an incremental GPS stream parser
+
+@param stream pointer to the parser state
+*/
+void lgw_gps_stream_init(struct lgw_gps_stream *stream);
+
+/**
+@brief Feed bytes read from the GPS tty to the incremental parser
+
+@param stream pointer to the parser state
+@param data pointer to the received bytes
+@param size number of received bytes
+@param used number of bytes consumed, less than size when a frame ends before the end of the data
+@return type of the frame that was completed, INCOMPLETE if all the bytes were consumed before the end of a frame
+
+Only RMC and GGA sentences and UBX NAV-TIMEGPS messages are indexed, and only
+the fields used by lgw_gps_get are converted. The checksum is computed as
+bytes arrive. The results are stored in the same global set of variables as
+lgw_parse_nmea and lgw_parse_ubx, so the same locking rules apply.
+*/
+enum gps_msg lgw_gps_stream_feed(struct lgw_gps_stream *stream, const char *data, size_t size, size_t *used);
+
 /**
 @brief Get the GPS solution (space & time) for the concentrator
 
@@ -61,6 +61,7 @@ Maintainer: Sylvain Miermont
 /* to use array parameters, declare a local const and use 'if_chain' as index */
 #define LGW_IF_CHAIN_NB     10    /* number of IF+modem RX chains */
 #define LGW_PKT_FIFO_SIZE   16    /* depth of the RX packet FIFO */
+#define LGW_RX_RING_SIZE    256    /* number of packet descriptors owned by the HAL for lgw_receive_ring, power of 2 */
 #define LGW_DATABUFF_SIZE   1024    /* size in bytes of the RX data buffer (contains payload & metadata) */
 #define LGW_REF_BW          125000    /* typical bandwidth of data channel */
 #define LGW_MULTI_NB        8    /* number of LoRa 'multi SF' chains */
@@ -155,6 +156,10 @@ Maintainer: Sylvain Miermont
 /* LBT constants */
 #define LBT_CHANNEL_FREQ_NB 8 /* Number of LBT channels */
 
+/* calibration cache */
+#define LGW_CAL_FILE_MAX    128 /* maximum length of calibration cache file path */
+#define LGW_CAL_CACHE_NB    8 /* number of calibration results kept in one cache file */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
@@ -200,6 +205,16 @@ struct lgw_conf_lbt_s {
     int8_t                      rssi_offset;        /*!> RSSI offset to be applied to SX127x RSSI values */
 };
 
+/**
+@struct lgw_conf_cal_s
+@brief Configuration structure for calibration cache
+*/
+struct lgw_conf_cal_s {
+    char        file[LGW_CAL_FILE_MAX]; /*!> file keeping calibration results between starts, empty to always calibrate */
+    uint32_t    max_age;                /*!> age of results in seconds after which board is calibrated again, 0 for no limit */
+    int16_t     temp_band;              /*!> temperature band of the board given by caller, results of another band are not reused */
+};
+
 /**
 @struct lgw_conf_rxrf_s
 @brief Configuration structure for a RF chain
@@ -297,6 +312,13 @@ struct lgw_tx_gain_lut_s {
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
+/*
+Configuration and state of the HAL are thread-local: each thread going through
+_setconf, lgw_start, lgw_receive and lgw_stop drives its own concentrator,
+selected by lgw_spi_set_path before lgw_start. Several boards are driven in
+parallel by one thread each, the GPS functions stay process-wide.
+*/
+
 /**
 @brief Configure the gateway board
 @param conf structure containing the configuration parameters
@@ -311,6 +333,17 @@ int lgw_board_setconf(struct lgw_conf_board_s conf);
 */
 int lgw_lbt_setconf(struct lgw_conf_lbt_s conf);
 
+/**
+@brief Configure the calibration cache
+@param conf structure containing the configuration parameters
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+Results of a successful calibration are stored in conf.file keyed by SPI device,
+radio types, RX/TX settings, clock source, firmware version and temperature band.
+lgw_start restores matching results instead of running the calibration firmware.
+*/
+int lgw_cal_setconf(struct lgw_conf_cal_s conf);
+
 /**
 @brief Configure an RF chain (must configure before start)
 @param rf_chain number of the RF chain to configure [0, LGW_RF_CHAIN_NB - 1]
@@ -327,6 +360,19 @@ int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf);
 */
 int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf);
 
+/**
+@brief Reconfigure an IF chain + modem while the concentrator is running
+@param if_chain number of the IF chain + modem to configure [0, LGW_IF_CHAIN_NB - 1]
+@param conf structure containing the configuration parameters
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+Only registers of the IF chain are rewritten, firmware and calibration are
+kept. Moving a LoRa multi-SF channel to another RF chain is refused because
+the radio mapping is owned by the AGC firmware, use lgw_stop()/lgw_start().
+If the concentrator is stopped, this is equivalent to lgw_rxif_setconf().
+*/
+int lgw_rxif_reconf(uint8_t if_chain, struct lgw_conf_rxif_s conf);
+
 /**
 @brief Configure the Tx gain LUT
 @param pointer to structure defining the LUT
@@ -340,6 +386,12 @@ int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf);
 */
 int lgw_start(void);
 
+/**
+@brief Tell how the last lgw_start obtained calibration results
+@return true if they were restored from the calibration cache, false if the board was calibrated
+*/
+bool lgw_cal_restored(void);
+
 /**
 @brief Stop the LoRa concentrator and disconnect it
 @return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
@@ -354,6 +406,52 @@ int lgw_stop(void);
 */
 int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
 
+/**
+@brief A non-blocking function that will fetch up to 'max_pkt' packets into packet descriptors owned by the HAL, without copying them
+@param max_pkt maximum number of packet that must be retrieved (equal to the size of the array of pointers)
+@param pkt_ptr pointer to an array of pointers that will receive the address of each packet descriptor
+@return LGW_HAL_ERROR id the operation failed, else the number of packets retrieved
+
+Descriptors stay valid until given back with lgw_rx_release, in the order they
+were handed out. Fewer packets than available are retrieved when less than
+'max_pkt' descriptors are free, the others wait in the concentrator FIFO.
+*/
+int lgw_receive_ring(uint8_t max_pkt, struct lgw_pkt_rx_s **pkt_ptr);
+
+/**
+@brief Give back the oldest packet descriptors retrieved by lgw_receive_ring
+@param nb_pkt number of descriptors released
+@return LGW_HAL_ERROR if more descriptors are released than held, LGW_HAL_SUCCESS else
+
+Releases the ring of the calling thread, another thread must use lgw_rx_release_ring.
+*/
+int lgw_rx_release(uint8_t nb_pkt);
+
+/**
+@brief Tell how many packets were dropped while fetching because of an invalid IF chain
+@return number of dropped packets since the calling thread started, FIFO kept being read past them
+*/
+uint32_t lgw_rx_invalid(void);
+
+/**
+@brief Handle on the packet descriptor ring of the calling thread
+@return ring handle, valid as long as the thread runs
+
+Each thread driving a concentrator owns a ring, the handle lets a single
+other thread give descriptors back with lgw_rx_release_ring.
+*/
+void *lgw_rx_ring_get(void);
+
+/**
+@brief Give back the oldest packet descriptors of a ring retrieved by lgw_receive_ring
+@param ring handle returned by lgw_rx_ring_get in the receiving thread
+@param nb_pkt number of descriptors released
+@return LGW_HAL_ERROR if more descriptors are released than held, LGW_HAL_SUCCESS else
+
+May be called from another thread than lgw_receive_ring, as long as there is one releasing thread per ring.
+*/
+int lgw_rx_release_ring(void *ring, uint8_t nb_pkt);
+
 /**
 @brief Schedule a packet to be send immediately or after a delay depending on tx_mode
 @param pkt_data structure containing the data and metadata for the packet to send
@@ -401,6 +499,13 @@ int lgw_abort_tx(void);
 */
 int lgw_get_trigcnt(uint32_t* trig_cnt_us);
 
+/**
+@brief Return current value of internal counter, PPS latch is disabled for the read and restored
+@param inst_cnt_us pointer to receive timestamp value
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_get_instcnt(uint32_t* inst_cnt_us);
+
 /**
 @brief Allow user to check the version/options of the library once compiled
 @return pointer on a human-readable null terminated string
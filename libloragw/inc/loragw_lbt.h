@@ -30,6 +30,9 @@ Maintainer: Michael Coracin
 #define LGW_LBT_SUCCESS 0
 #define LGW_LBT_ERROR -1
 
+#define LGW_LBT_REFRESH_US 10000    /* cadence of channel timestamp reads from the receive path */
+#define LGW_LBT_MAX_AGE_US 20000    /* older channel timestamps are read again before TX admission */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
@@ -52,6 +55,13 @@ int lbt_setup(void);
 */
 int lbt_start(void);
 
+/**
+@brief Read last free time of all LBT channels in one SPI message and cache it
+@param max_age_us cached timestamps younger than this are kept without SPI access
+@return LGW_LBT_ERROR id the operation failed, LGW_LBT_SUCCESS else
+*/
+int lbt_refresh(uint32_t max_age_us);
+
 /**
 @brief Configure the concentrator for LBT feature
 @param pkt_data pointer to downlink packet to be trabsmitted
@@ -47,6 +47,20 @@ struct lgw_reg_s {
 int reg_w_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, struct lgw_reg_s r, int32_t reg_value);
 int reg_r_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, struct lgw_reg_s r, int32_t *reg_value);
 
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_reg_seg
+@brief One burst access of a multi-register transfer
+*/
+struct lgw_reg_seg {
+    uint16_t    register_id;    /*!< register number in the data structure describing registers */
+    uint8_t     write;          /*!< 1 for burst write, 0 for burst read */
+    uint8_t     *data;          /*!< data sent or received */
+    uint16_t    size;           /*!< size of the transfer, in byte(s) */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
@@ -455,6 +469,33 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size);
 */
 int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size);
 
+/**
+@brief Start deferring writes of configuration registers
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Modem configuration registers are kept in a host shadow: writes of unchanged
+values are skipped and, between lgw_reg_batch_begin and lgw_reg_batch_end,
+changed bytes are only marked and written at the end, contiguous bytes in
+one burst. Any other register access writes the pending bytes first.
+*/
+int lgw_reg_batch_begin(void);
+
+/**
+@brief Write deferred configuration registers and stop deferring
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_batch_end(void);
+
+/**
+@brief LoRa concentrator register burst reads and writes in one SPI transfer
+@param seg array of register accesses, executed in order
+@param nb_seg number of register accesses [1, LGW_SPI_MSG_MAX]
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Registers must be byte-aligned and all on the same page (or on every page).
+*/
+int lgw_reg_xfer(const struct lgw_reg_seg *seg, int nb_seg);
+
 
 #endif
 
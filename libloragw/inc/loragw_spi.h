@@ -43,6 +43,33 @@ Maintainer: Sylvain Miermont
 #define LGW_SPI_MUX_TARGET_EEPROM   0x2
 #define LGW_SPI_MUX_TARGET_SX127X   0x3
 
+#define LGW_SPI_MSG_MAX     32      /* max number of register accesses queued in one lgw_spi_msg */
+#define LGW_SPI_PATH_MAX    64      /* max length of spidev device path, terminating zero included */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_spi_msg
+@brief Queue of register accesses submitted together by lgw_spi_msg_submit
+
+Every access is a regular SPI transaction (command + data, own chip select
+cycle). Accesses are built with lgw_spi_msg_w/r/wb/rb and only sent to
+the device by lgw_spi_msg_submit, in as few ioctls as the SPI buffer allows.
+*/
+struct lgw_spi_msg {
+    uint8_t     spi_mux_mode;       /*!< SPI mux mode of all accesses */
+    uint8_t     spi_mux_target;     /*!< SPI mux target of all accesses */
+    int         nb;                 /*!< number of queued accesses */
+    struct {
+        uint8_t     command[2];     /*!< mux header and read/write + address byte */
+        uint8_t     write;          /*!< 1 for write access, 0 for read access */
+        uint8_t     value;          /*!< data of single-byte write */
+        uint8_t     *data;          /*!< data sent or received */
+        uint16_t    size;           /*!< size of the data, in byte(s) */
+    } acc[LGW_SPI_MSG_MAX];
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
@@ -54,6 +81,21 @@ Maintainer: Sylvain Miermont
 
 int lgw_spi_open(void **spi_target_ptr);
 
+/**
+@brief Select the spidev device opened by lgw_spi_open in the calling thread
+@param path device path, /dev/spidev0.0 when never set
+@return status of operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+Must be called before lgw_start, each thread driving a concentrator selects its own.
+*/
+int lgw_spi_set_path(const char *path);
+
+/**
+@brief Get the spidev device opened by lgw_spi_open in the calling thread
+@return device path
+*/
+const char *lgw_spi_get_path(void);
+
 /**
 @brief LoRa concentrator SPI close
 @param spi_target generic pointer to SPI target (implementation dependant)
@@ -100,6 +142,73 @@ int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
 */
 int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
 
+/**
+@brief Set the largest SPI message, bursts and queued accesses are split to fit
+@param size message size in byte(s) (commands included), 0 to use spidev bufsiz
+@return status of operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+lgw_spi_open does the spidev lookup. If bufsiz cannot be read, bursts are
+split in LGW_BURST_CHUNK data bytes as before.
+*/
+int lgw_spi_set_chunk(uint16_t size);
+
+/**
+@brief Current largest SPI message, in byte(s)
+*/
+uint16_t lgw_spi_get_chunk(void);
+
+/**
+@brief Start an empty queue of register accesses
+@param msg queue to initialize
+*/
+void lgw_spi_msg_init(struct lgw_spi_msg *msg, uint8_t spi_mux_mode, uint8_t spi_mux_target);
+
+/**
+@brief Queue a single-byte write
+@param msg queue of register accesses
+@param address 7-bit register address
+@param data data byte to write (copied)
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR if full)
+*/
+int lgw_spi_msg_w(struct lgw_spi_msg *msg, uint8_t address, uint8_t data);
+
+/**
+@brief Queue a single-byte read
+@param msg queue of register accesses
+@param address 7-bit register address
+@param data pointer to byte that will be written after submit
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR if full)
+*/
+int lgw_spi_msg_r(struct lgw_spi_msg *msg, uint8_t address, uint8_t *data);
+
+/**
+@brief Queue a burst write, split in chunks like lgw_spi_wb
+@param msg queue of register accesses
+@param address 7-bit register address
+@param data pointer to byte array, must stay valid until submit
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR if full)
+*/
+int lgw_spi_msg_wb(struct lgw_spi_msg *msg, uint8_t address, uint8_t *data, uint16_t size);
+
+/**
+@brief Queue a burst read, split in chunks like lgw_spi_rb
+@param msg queue of register accesses
+@param address 7-bit register address
+@param data pointer to byte array that will be written after submit
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR if full)
+*/
+int lgw_spi_msg_rb(struct lgw_spi_msg *msg, uint8_t address, uint8_t *data, uint16_t size);
+
+/**
+@brief Execute queued register accesses in order and empty the queue
+@param spi_target generic pointer to SPI target (implementation dependant)
+@param msg queue of register accesses
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_msg_submit(void *spi_target, struct lgw_spi_msg *msg);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -96,13 +96,13 @@ const struct lgw_reg_s fpga_regs[LGW_FPGA_TOTALREGS] = {
 /* -------------------------------------------------------------------------- */
 /* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
 
-extern void *lgw_spi_target; /*! generic pointer to the SPI device */
-extern uint8_t lgw_spi_mux_mode; /*! current SPI mux mode used */
+extern __thread void *lgw_spi_target; /*! generic pointer to the SPI device */
+extern __thread uint8_t lgw_spi_mux_mode; /*! current SPI mux mode used */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
-static bool tx_notch_support = false;
-static uint8_t tx_notch_offset;
+static __thread bool tx_notch_support = false;
+static __thread uint8_t tx_notch_offset;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
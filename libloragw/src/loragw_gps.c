@@ -59,6 +59,21 @@ Maintainer: Michael Coracin
 
 #define UBX_MSG_NAVTIMEGPS_LEN  16
 
+/* incremental stream parser */
+#define STREAM_IDLE         0   /* waiting for a frame start */
+#define STREAM_NMEA         1   /* storing a sentence of interest */
+#define STREAM_NMEA_SKIP    2   /* sentence of no interest, waiting for its end */
+#define STREAM_NMEA_CK      3   /* receiving the 2 checksum characters */
+#define STREAM_NMEA_END     4   /* waiting for <LF> */
+#define STREAM_UBX_SYNC     5   /* waiting for the second UBX sync char */
+#define STREAM_UBX_HEAD     6   /* receiving class, ID and length */
+#define STREAM_UBX_DATA     7   /* receiving the payload */
+#define STREAM_UBX_CK       8   /* receiving the 2 checksum bytes */
+
+#define UBX_SYNC_CHAR_2         0x62
+#define UBX_NAVTIMEGPS_SIZE     16  /* payload length of NAV-TIMEGPS */
+#define UBX_STREAM_MAX_SIZE     512 /* longer UBX frame lengths are considered corrupted */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
@@ -103,6 +118,16 @@ static bool match_label(const char *s, char *label, int size, char wildcard);
 
 static int str_chop(char *s, int buff_size, char separator, int *idx_ary, int max_idx);
 
+static void ubx_nav_timegps(const char *payload);
+
+static int hexchar_to_nibble(char c);
+
+static bool dec_short(const char *s, int n, short *v);
+
+static bool dec_double(const char *s, double *v);
+
+static enum gps_msg stream_nmea_done(struct lgw_gps_stream *st);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -248,6 +273,173 @@ int str_chop(char *s, int buff_size, char separator, int *idx_ary, int max_idx)
     return j;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Extract GPS time from the payload of a UBX NAV-TIMEGPS message
+*/
+static void ubx_nav_timegps(const char *payload) {
+    bool valid; /* iTOW, fTOW and week validity */
+
+    valid = payload[11] & 0x3; /* towValid, weekValid */
+    if (valid) {
+        /* Warning: payload byte ordering is Little Endian */
+        gps_iTOW =  (uint8_t)payload[0];
+        gps_iTOW |= (uint8_t)payload[1] << 8;
+        gps_iTOW |= (uint8_t)payload[2] << 16;
+        gps_iTOW |= (uint8_t)payload[3] << 24; /* GPS time of week, in ms */
+
+        gps_fTOW =  (uint8_t)payload[4];
+        gps_fTOW |= (uint8_t)payload[5] << 8;
+        gps_fTOW |= (uint8_t)payload[6] << 16;
+        gps_fTOW |= (uint8_t)payload[7] << 24; /* Fractional part of iTOW, in ns */
+
+        gps_week =  (uint8_t)payload[8];
+        gps_week |= (uint8_t)payload[9] << 8; /* GPS week number */
+
+        gps_time_ok = true;
+    } else {
+        gps_time_ok = false;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Return value of an hexadecimal character, a negative value if it is not one
+(so that the checksum comparison fails)
+*/
+static int hexchar_to_nibble(char c) {
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    } else if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    } else if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    } else {
+        return -256;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Convert exactly n decimal digits
+Return true if all characters are digits
+*/
+static bool dec_short(const char *s, int n, short *v) {
+    int i;
+    short x = 0;
+
+    for (i = 0; i < n; ++i) {
+        if ((s[i] < '0') || (s[i] > '9')) {
+            return false;
+        }
+        x = x * 10 + (s[i] - '0');
+    }
+    *v = x;
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Convert a decimal number with optional fractional part (eg. NMEA minutes)
+Return true if at least one digit was found
+*/
+static bool dec_double(const char *s, double *v) {
+    double x = 0.0, scale = 1.0;
+    bool digit = false;
+
+    for (; (*s >= '0') && (*s <= '9'); ++s) {
+        x = x * 10.0 + (*s - '0');
+        digit = true;
+    }
+    if (*s == '.') {
+        for (++s; (*s >= '0') && (*s <= '9'); ++s) {
+            scale /= 10.0;
+            x += (*s - '0') * scale;
+            digit = true;
+        }
+    }
+    if (digit) {
+        *v = x;
+    }
+    return digit;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Convert the fields of interest of a complete sentence with valid checksum
+The fields are null-terminated strings in the parser buffer
+*/
+static enum gps_msg stream_nmea_done(struct lgw_gps_stream *st) {
+    const char *f;
+    short x;
+    double frac, scale;
+    bool time_ok, date_ok, neg;
+
+    if (st->buff[4] == 'C') { /* G?RMC */
+        /* $xxRMC,time,status,lat,NS,long,EW,spd,cog,date,mv,mvEW,posMode*cs<CR><LF> */
+        if (st->nb_field != 13) {
+            DEBUG_MSG("Warning: invalid RMC sentence (number of fields)\n");
+            return IGNORED;
+        }
+        gps_mod = st->buff[st->field[12]];
+        if ((gps_mod != 'N') && (gps_mod != 'A') && (gps_mod != 'D')) {
+            gps_mod = 'N';
+        }
+        /* hhmmss.sss, fraction is limited to 3 digits */
+        f = &st->buff[st->field[1]];
+        time_ok = dec_short(f, 2, &gps_hou) && dec_short(f+2, 2, &gps_min) && dec_short(f+4, 2, &gps_sec) && (f[6] == '.') && (f[7] >= '0') && (f[7] <= '9');
+        if (time_ok) {
+            frac = 0.0;
+            scale = 1.0;
+            for (f += 7, x = 0; (x < 3) && (*f >= '0') && (*f <= '9'); ++f, ++x) {
+                scale /= 10.0;
+                frac += (*f - '0') * scale;
+            }
+            gps_fra = (float)frac;
+        }
+        /* ddmmyy */
+        f = &st->buff[st->field[9]];
+        date_ok = dec_short(f, 2, &gps_day) && dec_short(f+2, 2, &gps_mon) && dec_short(f+4, 2, &gps_yea);
+        gps_time_ok = time_ok && date_ok && ((gps_mod == 'A') || (gps_mod == 'D'));
+        return NMEA_RMC;
+    } else { /* G?GGA */
+        /* $xxGGA,time,lat,NS,long,EW,quality,numSV,HDOP,alt,M,sep,M,diffAge,diffStation*cs<CR><LF> */
+        if (st->nb_field != 15) {
+            DEBUG_MSG("Warning: invalid GGA sentence (number of fields)\n");
+            return IGNORED;
+        }
+        f = &st->buff[st->field[7]];
+        if ((*f >= '0') && (*f <= '9')) {
+            for (x = 0; (*f >= '0') && (*f <= '9'); ++f) {
+                x = x * 10 + (*f - '0');
+            }
+            gps_sat = x;
+        }
+        gps_ola = st->buff[st->field[3]];
+        gps_olo = st->buff[st->field[5]];
+        gps_pos_ok = dec_short(&st->buff[st->field[2]], 2, &gps_dla) && dec_double(&st->buff[st->field[2]+2], &gps_mla);
+        gps_pos_ok = gps_pos_ok && dec_short(&st->buff[st->field[4]], 3, &gps_dlo) && dec_double(&st->buff[st->field[4]+3], &gps_mlo);
+        f = &st->buff[st->field[9]];
+        neg = (*f == '-');
+        f += neg ? 1 : 0;
+        if ((*f >= '0') && (*f <= '9')) {
+            for (x = 0; (*f >= '0') && (*f <= '9'); ++f) {
+                x = x * 10 + (*f - '0');
+            }
+            gps_alt = neg ? -x : x;
+        } else {
+            gps_pos_ok = false;
+        }
+        gps_pos_ok = gps_pos_ok && ((gps_ola == 'N') || (gps_ola == 'S')) && ((gps_olo == 'E') || (gps_olo == 'W'));
+        return NMEA_GGA;
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
@@ -391,7 +583,6 @@ int lgw_gps_disable(int fd) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 enum gps_msg lgw_parse_ubx(const char *serial_buff, size_t buff_size, size_t *msg_size) {
-    bool valid = 0;    /* iTOW, fTOW and week validity */
     unsigned int payload_length;
     uint8_t ck_a, ck_b;
     uint8_t ck_a_rcv, ck_b_rcv;
@@ -439,43 +630,7 @@ enum gps_msg lgw_parse_ubx(const char *serial_buff, size_t buff_size, size_t *ms
             if ((ck_a == ck_a_rcv) && (ck_b == ck_b_rcv)) {
                 /* Check for Class 0x01 (NAV) and ID 0x20 (NAV-TIMEGPS) */
                 if ((serial_buff[2] == 0x01) && (serial_buff[3] == 0x20)) {
-                    /* Check validity of information */
-                    valid = serial_buff[17] & 0x3; /* towValid, weekValid */
-                    if (valid) {
-                        /* Parse buffer to extract GPS time */
-                        /* Warning: payload byte ordering is Little Endian */
-                        gps_iTOW =  (uint8_t)serial_buff[6];
-                        gps_iTOW |= (uint8_t)serial_buff[7] << 8;
-                        gps_iTOW |= (uint8_t)serial_buff[8] << 16;
-                        gps_iTOW |= (uint8_t)serial_buff[9] << 24; /* GPS time of week, in ms */
-
-                        gps_fTOW =  (uint8_t)serial_buff[10];
-                        gps_fTOW |= (uint8_t)serial_buff[11] << 8;
-                        gps_fTOW |= (uint8_t)serial_buff[12] << 16;
-                        gps_fTOW |= (uint8_t)serial_buff[13] << 24; /* Fractional part of iTOW, in ns */
-
-                        gps_week =  (uint8_t)serial_buff[14];
-                        gps_week |= (uint8_t)serial_buff[15] << 8; /* GPS week number */
-
-                        gps_time_ok = true;
-#if 0
-                        /* For debug */
-                        {
-                            short ubx_gps_hou = 0; /* hours (0-23) */
-                            short ubx_gps_min = 0; /* minutes (0-59) */
-                            short ubx_gps_sec = 0; /* seconds (0-59) */
-
-                            /* Format GPS time in hh:mm:ss based on iTOW */
-                            ubx_gps_sec = (gps_iTOW / 1000) % 60;
-                            ubx_gps_min = (gps_iTOW / 1000 / 60) % 60;
-                            ubx_gps_hou = (gps_iTOW / 1000 / 60 / 60) % 24;
-                            printf("  GPS time = %02d:%02d:%02d\n", ubx_gps_hou, ubx_gps_min, ubx_gps_sec);
-                        }
-#endif
-                    } else { /* valid */
-                        gps_time_ok = false;
-                    }
-
+                    ubx_nav_timegps(&serial_buff[6]);
                     return UBX_NAV_TIMEGPS;
                 } else if ((serial_buff[2] == 0x05) && (serial_buff[3] == 0x00)) {
                     DEBUG_MSG("NOTE: UBX ACK-NAK received\n");
@@ -598,6 +753,196 @@ enum gps_msg lgw_parse_nmea(const char *serial_buff, int buff_size) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+void lgw_gps_stream_init(struct lgw_gps_stream *stream) {
+    if (stream != NULL) {
+        memset(stream, 0, sizeof *stream);
+        stream->state = STREAM_IDLE;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+enum gps_msg lgw_gps_stream_feed(struct lgw_gps_stream *stream, const char *data, size_t size, size_t *used) {
+    struct lgw_gps_stream *st = stream;
+    size_t i = 0;
+    char c;
+    uint8_t b;
+    int ck;
+
+    if ((stream == NULL) || (data == NULL) || (used == NULL)) {
+        return UNKNOWN;
+    }
+
+    while (i < size) {
+        c = data[i];
+        b = (uint8_t)c;
+        switch (st->state) {
+            case STREAM_IDLE:
+                ++i;
+                if (c == (char)LGW_GPS_NMEA_SYNC_CHAR) {
+                    st->state = STREAM_NMEA;
+                    st->ck_a = 0;
+                    st->len = 0;
+                    st->nb_field = 1;
+                    st->field[0] = 0;
+                } else if (b == LGW_GPS_UBX_SYNC_CHAR) {
+                    st->state = STREAM_UBX_SYNC;
+                }
+                break;
+
+            case STREAM_NMEA_SKIP:
+                ++i;
+                if (c == '\n') {
+                    st->state = STREAM_IDLE;
+                    *used = i;
+                    return IGNORED;
+                } else if ((b == LGW_GPS_UBX_SYNC_CHAR) || (c == '$')) {
+                    --i; /* truncated sentence, parse the byte again as a frame start */
+                    st->state = STREAM_IDLE;
+                }
+                break;
+
+            case STREAM_NMEA:
+                if ((b < 0x20) || (b > 0x7E) || (c == '$')) {
+                    /* truncated sentence, parse the byte again as a possible frame start */
+                    st->state = STREAM_IDLE;
+                    *used = i;
+                    return INVALID;
+                }
+                ++i;
+                if (c == '*') {
+                    st->buff[st->len] = '\0'; /* terminate last field */
+                    st->state = STREAM_NMEA_CK;
+                    st->cnt = 0;
+                    break;
+                }
+                st->ck_a ^= b;
+                if (st->len >= (LGW_GPS_STREAM_BUF - 1)) {
+                    DEBUG_MSG("Note: NMEA sentence too long for stream parser\n");
+                    st->state = STREAM_IDLE;
+                    *used = i;
+                    return INVALID;
+                }
+                if (c == ',') {
+                    if ((st->nb_field == 1) && !((st->len == 5) && (st->buff[0] == 'G') && ((memcmp(&st->buff[2], "RMC", 3) == 0) || (memcmp(&st->buff[2], "GGA", 3) == 0)))) {
+                        st->state = STREAM_NMEA_SKIP; /* only RMC and GGA are indexed */
+                        break;
+                    }
+                    if (st->nb_field >= LGW_GPS_STREAM_FIELDS) {
+                        st->state = STREAM_NMEA_SKIP;
+                        break;
+                    }
+                    st->buff[st->len++] = '\0'; /* field separator, index next field in place */
+                    st->field[st->nb_field++] = st->len;
+                } else {
+                    st->buff[st->len++] = c;
+                }
+                break;
+
+            case STREAM_NMEA_CK:
+                ++i;
+                st->ck_rcv[st->cnt++] = c;
+                if (st->cnt == 2) {
+                    st->state = STREAM_NMEA_END;
+                }
+                break;
+
+            case STREAM_NMEA_END:
+                if (c == '\r') {
+                    ++i;
+                    break;
+                }
+                st->state = STREAM_IDLE;
+                if (c != '\n') {
+                    *used = i;
+                    return INVALID;
+                }
+                ++i;
+                *used = i;
+                ck = hexchar_to_nibble(st->ck_rcv[0]) * 16 + hexchar_to_nibble(st->ck_rcv[1]);
+                if (ck != st->ck_a) {
+                    DEBUG_MSG("Warning: invalid NMEA sentence (bad checksum)\n");
+                    return INVALID;
+                }
+                return stream_nmea_done(st);
+
+            case STREAM_UBX_SYNC:
+                if (b != UBX_SYNC_CHAR_2) {
+                    st->state = STREAM_IDLE; /* parse the byte again as a possible frame start */
+                    break;
+                }
+                ++i;
+                st->state = STREAM_UBX_HEAD;
+                st->cnt = 0;
+                st->ck_a = 0;
+                st->ck_b = 0;
+                st->len = 0;
+                break;
+
+            case STREAM_UBX_HEAD:
+                ++i;
+                st->ck_a += b;
+                st->ck_b += st->ck_a;
+                switch (st->cnt++) {
+                    case 0: st->ubx_class = b; break;
+                    case 1: st->ubx_id = b; break;
+                    case 2: st->ubx_size = b; break;
+                    default:
+                        st->ubx_size |= (uint16_t)b << 8;
+                        if (st->ubx_size > UBX_STREAM_MAX_SIZE) {
+                            DEBUG_MSG("ERROR: UBX message is corrupted, length out of range\n");
+                            st->state = STREAM_IDLE;
+                            *used = i;
+                            return INVALID;
+                        }
+                        st->cnt = 0;
+                        st->state = (st->ubx_size > 0) ? STREAM_UBX_DATA : STREAM_UBX_CK;
+                }
+                break;
+
+            case STREAM_UBX_DATA:
+                ++i;
+                st->ck_a += b;
+                st->ck_b += st->ck_a;
+                /* only the payload of NAV-TIMEGPS is kept */
+                if ((st->ubx_class == 0x01) && (st->ubx_id == 0x20) && (st->ubx_size == UBX_NAVTIMEGPS_SIZE)) {
+                    st->buff[st->len] = c;
+                }
+                if (++st->len == st->ubx_size) {
+                    st->state = STREAM_UBX_CK;
+                    st->cnt = 0;
+                }
+                break;
+
+            case STREAM_UBX_CK:
+                ++i;
+                st->ck_rcv[st->cnt++] = c;
+                if (st->cnt < 2) {
+                    break;
+                }
+                st->state = STREAM_IDLE;
+                *used = i;
+                if (((uint8_t)st->ck_rcv[0] != st->ck_a) || ((uint8_t)st->ck_rcv[1] != st->ck_b)) {
+                    DEBUG_MSG("ERROR: UBX message is corrupted, checksum failed\n");
+                    return INVALID;
+                }
+                if ((st->ubx_class == 0x01) && (st->ubx_id == 0x20) && (st->ubx_size == UBX_NAVTIMEGPS_SIZE)) {
+                    ubx_nav_timegps(st->buff);
+                    return UBX_NAV_TIMEGPS;
+                }
+                return IGNORED;
+
+            default:
+                st->state = STREAM_IDLE;
+        }
+    }
+
+    *used = i;
+    return INCOMPLETE;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_gps_get(struct timespec *utc, struct timespec *gps_time, struct coord_s *loc, struct coord_s *err) {
     struct tm x;
     time_t y;
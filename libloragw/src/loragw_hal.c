@@ -17,11 +17,21 @@ Maintainer: Sylvain Miermont
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
 #include <stdio.h>      /* printf fprintf */
 #include <string.h>     /* memcpy */
 #include <math.h>       /* pow, cell */
+#include <time.h>       /* time */
+#include <fcntl.h>      /* open fcntl */
+#include <unistd.h>     /* pread pwrite fdatasync close */
 
 #include "loragw_reg.h"
 #include "loragw_hal.h"
@@ -107,36 +117,39 @@ The functions _start and _send then use that set to configure the hardware.
 
 Parameters validity and coherency is verified by the _setconf functions and
 the _start and _send functions assume they are valid.
+
+The set is thread-local: each thread configuring and starting the HAL drives
+its own concentrator (see lgw_spi_set_path), several boards run in parallel.
 */
 
-static bool lgw_is_started;
+static __thread bool lgw_is_started;
 
-static bool rf_enable[LGW_RF_CHAIN_NB];
-static uint32_t rf_rx_freq[LGW_RF_CHAIN_NB]; /* absolute, in Hz */
-static float rf_rssi_offset[LGW_RF_CHAIN_NB];
-static bool rf_tx_enable[LGW_RF_CHAIN_NB];
-static uint32_t rf_tx_notch_freq[LGW_RF_CHAIN_NB];
-static enum lgw_radio_type_e rf_radio_type[LGW_RF_CHAIN_NB];
+static __thread bool rf_enable[LGW_RF_CHAIN_NB];
+static __thread uint32_t rf_rx_freq[LGW_RF_CHAIN_NB]; /* absolute, in Hz */
+static __thread float rf_rssi_offset[LGW_RF_CHAIN_NB];
+static __thread bool rf_tx_enable[LGW_RF_CHAIN_NB];
+static __thread uint32_t rf_tx_notch_freq[LGW_RF_CHAIN_NB];
+static __thread enum lgw_radio_type_e rf_radio_type[LGW_RF_CHAIN_NB];
 
-static bool if_enable[LGW_IF_CHAIN_NB];
-static bool if_rf_chain[LGW_IF_CHAIN_NB]; /* for each IF, 0 -> radio A, 1 -> radio B */
-static int32_t if_freq[LGW_IF_CHAIN_NB]; /* relative to radio frequency, +/- in Hz */
+static __thread bool if_enable[LGW_IF_CHAIN_NB];
+static __thread bool if_rf_chain[LGW_IF_CHAIN_NB]; /* for each IF, 0 -> radio A, 1 -> radio B */
+static __thread int32_t if_freq[LGW_IF_CHAIN_NB]; /* relative to radio frequency, +/- in Hz */
 
-static uint8_t lora_multi_sfmask[LGW_MULTI_NB]; /* enables SF for LoRa 'multi' modems */
+static __thread uint8_t lora_multi_sfmask[LGW_MULTI_NB]; /* enables SF for LoRa 'multi' modems */
 
-static uint8_t lora_rx_bw; /* bandwidth setting for LoRa standalone modem */
-static uint8_t lora_rx_sf; /* spreading factor setting for LoRa standalone modem */
-static bool lora_rx_ppm_offset;
+static __thread uint8_t lora_rx_bw; /* bandwidth setting for LoRa standalone modem */
+static __thread uint8_t lora_rx_sf; /* spreading factor setting for LoRa standalone modem */
+static __thread bool lora_rx_ppm_offset;
 
-static uint8_t fsk_rx_bw; /* bandwidth setting of FSK modem */
-static uint32_t fsk_rx_dr; /* FSK modem datarate in bauds */
-static uint8_t fsk_sync_word_size = 3; /* default number of bytes for FSK sync word */
-static uint64_t fsk_sync_word= 0xC194C1; /* default FSK sync word (ALIGNED RIGHT, MSbit first) */
+static __thread uint8_t fsk_rx_bw; /* bandwidth setting of FSK modem */
+static __thread uint32_t fsk_rx_dr; /* FSK modem datarate in bauds */
+static __thread uint8_t fsk_sync_word_size = 3; /* default number of bytes for FSK sync word */
+static __thread uint64_t fsk_sync_word= 0xC194C1; /* default FSK sync word (ALIGNED RIGHT, MSbit first) */
 
-static bool lorawan_public = false;
-static uint8_t rf_clkout = 0;
+static __thread bool lorawan_public = false;
+static __thread uint8_t rf_clkout = 0;
 
-static struct lgw_tx_gain_lut_s txgain_lut = {
+static __thread struct lgw_tx_gain_lut_s txgain_lut = {
     .size = 2,
     .lut[0] = {
         .dig_gain = 0,
@@ -154,10 +167,71 @@ static struct lgw_tx_gain_lut_s txgain_lut = {
     }};
 
 /* TX I/Q imbalance coefficients for mixer gain = 8 to 15 */
-static int8_t cal_offset_a_i[8]; /* TX I offset for radio A */
-static int8_t cal_offset_a_q[8]; /* TX Q offset for radio A */
-static int8_t cal_offset_b_i[8]; /* TX I offset for radio B */
-static int8_t cal_offset_b_q[8]; /* TX Q offset for radio B */
+static __thread int8_t cal_offset_a_i[8]; /* TX I offset for radio A */
+static __thread int8_t cal_offset_a_q[8]; /* TX Q offset for radio A */
+static __thread int8_t cal_offset_b_i[8]; /* TX I offset for radio B */
+static __thread int8_t cal_offset_b_q[8]; /* TX Q offset for radio B */
+
+/*
+Calibration cache, results are stored with the settings they depend on and a
+start with the same settings restores them instead of running the calibration
+firmware. The file holds a table of LGW_CAL_CACHE_NB entries.
+*/
+#define CAL_CACHE_MAGIC     0x314C4143 /* "CAL1" */
+#define CAL_IQ_NB           5 /* RX IQ mismatch registers written by the calibration firmware */
+
+static const uint16_t cal_iq_reg[CAL_IQ_NB] = {LGW_IQ_MISMATCH_A_AMP_COEFF, LGW_IQ_MISMATCH_A_PHI_COEFF, LGW_IQ_MISMATCH_B_AMP_COEFF, LGW_IQ_MISMATCH_B_SEL_I, LGW_IQ_MISMATCH_B_PHI_COEFF};
+
+struct cal_key_s {
+    char        spi_path[LGW_SPI_PATH_MAX];
+    uint8_t     fw_version;
+    uint8_t     cal_cmd;
+    uint8_t     clksrc;
+    int16_t     temp_band;
+    uint32_t    rx_freq[LGW_RF_CHAIN_NB];
+    uint32_t    tx_notch_freq[LGW_RF_CHAIN_NB];
+};
+
+struct cal_entry_s {
+    uint32_t            magic;
+    struct cal_key_s    key;
+    int64_t             saved; /* UTC time of calibration, seconds */
+    int32_t             iq_mismatch[CAL_IQ_NB];
+    int8_t              offset[4][8]; /* TX I/Q offsets of radio A then radio B */
+};
+
+static __thread struct lgw_conf_cal_s cal_conf; /* empty file: cache disabled */
+static __thread bool cal_restored;
+
+static __thread uint32_t rx_invalid_chain; /* packets dropped by rx_fetch for invalid IF chain */
+
+/*
+Timestamp correction terms of LoRa packets, precomputed once because they only
+depend on the modem bandwidth, SF, PPM mode and payload length (size + 2 bytes
+of CRC when enabled); the coding rate is applied as a plain factor on receive.
+*/
+#define TS_BW_NB        4 /* 0: 'multi' modems, 1..3: stand-alone modem at 125/250/500 kHz */
+#define TS_SF_NB        7 /* SF6 to SF12 */
+#define TS_LEN_NB       258 /* 255 bytes of payload + 2 bytes of CRC */
+
+static int ts_table_state = 0; /* 0: empty, 1: being filled, 2: ready; shared by all threads */
+static const uint8_t ts_bw_pow[TS_BW_NB] = {1, 1, 2, 4};
+static uint32_t ts_delay_xy[TS_BW_NB][TS_SF_NB][2]; /* base + preamble delay, [1] when payload fits in first 8 symbols */
+static uint8_t ts_delay_sym[TS_SF_NB][2][TS_LEN_NB]; /* symbols of the last interleaving block, [ppm] */
+
+/*
+Packet descriptors handed out by lgw_receive_ring, payload is read straight
+into them. Indexes run freely and are masked on access; head is only written
+by the receiving thread, tail only by the releasing one. Each receiving
+thread owns a ring, released through the handle of lgw_rx_ring_get.
+*/
+struct rx_ring_s {
+    struct lgw_pkt_rx_s pkt[LGW_RX_RING_SIZE];
+    uint32_t head;
+    uint32_t tail;
+};
+
+static __thread struct rx_ring_s rx_ring;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
@@ -169,9 +243,289 @@ void lgw_constant_adjust(void);
 int32_t lgw_sf_getval(int x);
 int32_t lgw_bw_getval(int x);
 
+static void ts_table_init(void);
+
+static int cal_run(uint8_t cal_cmd, uint16_t cal_time, uint8_t *status);
+static uint8_t cal_expected_status(void);
+static void cal_key_make(struct cal_key_s *key, uint8_t cal_cmd);
+static int cal_cache_load(struct cal_entry_s *entry);
+static void cal_cache_save(struct cal_entry_s *entry);
+static void cal_apply(const struct cal_entry_s *entry);
+
+static int rx_fetch(uint8_t max_pkt, struct lgw_pkt_rx_s *const *slot);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+/* fill the timestamp correction tables, same arithmetic (unsigned) as the
+reference per-packet computation */
+static void ts_table_init(void) {
+    const uint8_t bw[TS_BW_NB] = {BW_125KHZ, BW_125KHZ, BW_250KHZ, BW_500KHZ};
+    const uint32_t delay_x[TS_BW_NB] = {114, 64, 32, 16};
+    const uint8_t dr[TS_SF_NB] = {DR_UNDEFINED, DR_LORA_SF7, DR_LORA_SF8, DR_LORA_SF9, DR_LORA_SF10, DR_LORA_SF11, DR_LORA_SF12};
+    uint32_t sf, ppm, len, pre;
+    int i, j;
+    int state = 0;
+
+    /* first caller fills the tables, concurrent lgw_start wait for it */
+    if (__atomic_compare_exchange_n(&ts_table_state, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE) == false) {
+        while (__atomic_load_n(&ts_table_state, __ATOMIC_ACQUIRE) != 2) {
+            wait_ms(1);
+        }
+        return;
+    }
+
+    for (i = 0; i < TS_BW_NB; ++i) {
+        for (j = 0; j < TS_SF_NB; ++j) {
+            sf = j + 6;
+            ppm = SET_PPM_ON(bw[i], dr[j]) ? 1 : 0;
+            pre = (1<<(sf-1)) * (sf+1);
+            ts_delay_xy[i][j][0] = delay_x[i] + (pre + ((4 - ppm) * (1<<(sf-4)))) / ts_bw_pow[i];
+            ts_delay_xy[i][j][1] = delay_x[i] + (pre + (3 * (1<<(sf-4)))) / ts_bw_pow[i];
+        }
+    }
+    for (j = 0; j < TS_SF_NB; ++j) {
+        sf = j + 6;
+        for (ppm = 0; ppm < 2; ++ppm) {
+            for (len = 0; len < TS_LEN_NB; ++len) {
+                ts_delay_sym[j][ppm][len] = (uint8_t)(((2*len - sf + 6) % (sf - 2*ppm)) + 1);
+            }
+        }
+    }
+    __atomic_store_n(&ts_table_state, 2, __ATOMIC_RELEASE);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* run the calibration firmware, RX IQ mismatch compensation is written to the
+concentrator by the MCU, TX DC offsets are read back from its RAM */
+static int cal_run(uint8_t cal_cmd, uint16_t cal_time, uint8_t *status) {
+    int i;
+    int32_t read_val;
+    uint8_t fw_version;
+    uint8_t cal_status;
+
+    /* Load the calibration firmware  */
+    load_firmware(MCU_AGC, cal_firmware, MCU_AGC_FW_BYTE);
+    lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL, 0); /* gives to AGC MCU the control of the radios */
+    lgw_reg_w(LGW_RADIO_SELECT, cal_cmd); /* send calibration configuration word */
+    lgw_reg_w(LGW_MCU_RST_1, 0);
+
+    /* Check firmware version */
+    lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, FW_VERSION_ADDR);
+    lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+    fw_version = (uint8_t)read_val;
+    if (fw_version != FW_VERSION_CAL) {
+        printf("ERROR: Version of calibration firmware not expected, actual:%d expected:%d\n", fw_version, FW_VERSION_CAL);
+        return LGW_HAL_ERROR;
+    }
+
+    lgw_reg_w(LGW_PAGE_REG, 3); /* Calibration will start on this condition as soon as MCU can talk to concentrator registers */
+    lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 0); /* Give control of concentrator registers to MCU */
+
+    /* Wait for calibration to end */
+    DEBUG_PRINTF("Note: calibration started (time: %u ms)\n", cal_time);
+    wait_ms(cal_time); /* Wait for end of calibration */
+    lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 1); /* Take back control */
+
+    /* Get calibration status */
+    lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
+    cal_status = (uint8_t)read_val;
+    *status = cal_status;
+    /*
+        bit 7: calibration finished
+        bit 0: could access SX1301 registers
+        bit 1: could access radio A registers
+        bit 2: could access radio B registers
+        bit 3: radio A RX image rejection successful
+        bit 4: radio B RX image rejection successful
+        bit 5: radio A TX DC Offset correction successful
+        bit 6: radio B TX DC Offset correction successful
+    */
+    if ((cal_status & 0x81) != 0x81) {
+        DEBUG_PRINTF("ERROR: CALIBRATION FAILURE (STATUS = %u)\n", cal_status);
+        return LGW_HAL_ERROR;
+    } else {
+        DEBUG_PRINTF("Note: calibration finished (status = %u)\n", cal_status);
+    }
+    if (rf_enable[0] && ((cal_status & 0x02) == 0)) {
+        DEBUG_MSG("WARNING: calibration could not access radio A\n");
+    }
+    if (rf_enable[1] && ((cal_status & 0x04) == 0)) {
+        DEBUG_MSG("WARNING: calibration could not access radio B\n");
+    }
+    if (rf_enable[0] && ((cal_status & 0x08) == 0)) {
+        DEBUG_MSG("WARNING: problem in calibration of radio A for image rejection\n");
+    }
+    if (rf_enable[1] && ((cal_status & 0x10) == 0)) {
+        DEBUG_MSG("WARNING: problem in calibration of radio B for image rejection\n");
+    }
+    if (rf_enable[0] && rf_tx_enable[0] && ((cal_status & 0x20) == 0)) {
+        DEBUG_MSG("WARNING: problem in calibration of radio A for TX DC offset\n");
+    }
+    if (rf_enable[1] && rf_tx_enable[1] && ((cal_status & 0x40) == 0)) {
+        DEBUG_MSG("WARNING: problem in calibration of radio B for TX DC offset\n");
+    }
+
+    /* Get TX DC offset values */
+    for(i=0; i<=7; ++i) {
+        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA0+i);
+        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+        cal_offset_a_i[i] = (int8_t)read_val;
+        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA8+i);
+        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+        cal_offset_a_q[i] = (int8_t)read_val;
+        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB0+i);
+        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+        cal_offset_b_i[i] = (int8_t)read_val;
+        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB8+i);
+        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+        cal_offset_b_q[i] = (int8_t)read_val;
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* calibration status bits expected for the enabled radios, see cal_run */
+static uint8_t cal_expected_status(void) {
+    uint8_t x = 0x81;
+
+    x |= rf_enable[0] ? 0x0A : 0x00;
+    x |= rf_enable[1] ? 0x14 : 0x00;
+    x |= (rf_enable[0] && rf_tx_enable[0]) ? 0x20 : 0x00;
+    x |= (rf_enable[1] && rf_tx_enable[1]) ? 0x40 : 0x00;
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* settings calibration results depend on, cal_cmd holds enabled radios, TX
+enables and radio type */
+static void cal_key_make(struct cal_key_s *key, uint8_t cal_cmd) {
+    int i;
+
+    memset(key, 0, sizeof *key);
+    strncpy(key->spi_path, lgw_spi_get_path(), sizeof key->spi_path - 1);
+    key->fw_version = FW_VERSION_CAL;
+    key->cal_cmd = cal_cmd;
+    key->clksrc = rf_clkout;
+    key->temp_band = cal_conf.temp_band;
+    for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
+        key->rx_freq[i] = rf_rx_freq[i];
+        key->tx_notch_freq[i] = rf_tx_notch_freq[i];
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* lock whole cache file, shared by the threads and processes driving boards */
+static int cal_cache_lock(int fd, short type) {
+    struct flock lk;
+
+    memset(&lk, 0, sizeof lk);
+    lk.l_type = type;
+    lk.l_whence = SEEK_SET;
+    return fcntl(fd, F_SETLKW, &lk);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* find results stored for entry->key, return 0 if found and not too old */
+static int cal_cache_load(struct cal_entry_s *entry) {
+    struct cal_entry_s table[LGW_CAL_CACHE_NB];
+    ssize_t nb;
+    time_t now;
+    int fd, i;
+
+    fd = open(cal_conf.file, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    cal_cache_lock(fd, F_RDLCK);
+    nb = pread(fd, table, sizeof table, 0);
+    close(fd);
+
+    now = time(NULL);
+    for (i = 0; (nb > 0) && (i < (int)(nb / (ssize_t)sizeof table[0])); ++i) {
+        if ((table[i].magic != CAL_CACHE_MAGIC) || (memcmp(&table[i].key, &entry->key, sizeof entry->key) != 0)) {
+            continue;
+        }
+        if ((now < table[i].saved) || ((cal_conf.max_age != 0) && (now - table[i].saved > (time_t)cal_conf.max_age))) {
+            DEBUG_MSG("Note: cached calibration results expired\n");
+            return -1;
+        }
+        *entry = table[i];
+        return 0;
+    }
+    return -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* store results of the calibration just run under entry->key, replacing the
+same key, a free slot or the oldest entry */
+static void cal_cache_save(struct cal_entry_s *entry) {
+    struct cal_entry_s table[LGW_CAL_CACHE_NB];
+    int32_t read_val;
+    ssize_t nb;
+    int fd, i, slot = -1;
+
+    entry->magic = CAL_CACHE_MAGIC;
+    entry->saved = time(NULL);
+    for (i = 0; i < CAL_IQ_NB; ++i) {
+        lgw_reg_r(cal_iq_reg[i], &read_val);
+        entry->iq_mismatch[i] = read_val;
+    }
+    memcpy(entry->offset[0], cal_offset_a_i, sizeof cal_offset_a_i);
+    memcpy(entry->offset[1], cal_offset_a_q, sizeof cal_offset_a_q);
+    memcpy(entry->offset[2], cal_offset_b_i, sizeof cal_offset_b_i);
+    memcpy(entry->offset[3], cal_offset_b_q, sizeof cal_offset_b_q);
+
+    fd = open(cal_conf.file, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        DEBUG_PRINTF("WARNING: failed to open calibration cache %s\n", cal_conf.file);
+        return;
+    }
+    cal_cache_lock(fd, F_WRLCK);
+    memset(table, 0, sizeof table);
+    nb = pread(fd, table, sizeof table, 0);
+    if (nb < 0) {
+        nb = 0;
+    }
+    for (i = 0; i < LGW_CAL_CACHE_NB; ++i) {
+        if ((table[i].magic == CAL_CACHE_MAGIC) && (memcmp(&table[i].key, &entry->key, sizeof entry->key) == 0)) {
+            slot = i;
+            break;
+        }
+        if ((slot < 0) || ((table[slot].magic == CAL_CACHE_MAGIC) && ((table[i].magic != CAL_CACHE_MAGIC) || (table[i].saved < table[slot].saved)))) {
+            slot = i;
+        }
+    }
+    if ((pwrite(fd, entry, sizeof *entry, slot * sizeof *entry) != (ssize_t)sizeof *entry) || (fdatasync(fd) != 0)) {
+        DEBUG_PRINTF("WARNING: failed to write calibration cache %s\n", cal_conf.file);
+    }
+    close(fd);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* put cached results where the calibration firmware would have left them */
+static void cal_apply(const struct cal_entry_s *entry) {
+    int i;
+
+    for (i = 0; i < CAL_IQ_NB; ++i) {
+        lgw_reg_w(cal_iq_reg[i], entry->iq_mismatch[i]);
+    }
+    memcpy(cal_offset_a_i, entry->offset[0], sizeof cal_offset_a_i);
+    memcpy(cal_offset_a_q, entry->offset[1], sizeof cal_offset_a_q);
+    memcpy(cal_offset_b_i, entry->offset[2], sizeof cal_offset_b_i);
+    memcpy(cal_offset_b_q, entry->offset[3], sizeof cal_offset_b_q);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* size is the firmware size in bytes (not 14b words) */
 int load_firmware(uint8_t target, uint8_t *firmware, uint16_t size) {
     int reg_rst;
@@ -451,6 +805,28 @@ int lgw_lbt_setconf(struct lgw_conf_lbt_s conf) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_cal_setconf(struct lgw_conf_cal_s conf) {
+
+    /* check if the concentrator is running */
+    if (lgw_is_started == true) {
+        DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+        return LGW_HAL_ERROR;
+    }
+
+    /* check input range (segfault prevention) */
+    if (memchr(conf.file, '\0', sizeof conf.file) == NULL) {
+        DEBUG_MSG("ERROR: CALIBRATION CACHE FILE NAME TOO LONG\n");
+        return LGW_HAL_ERROR;
+    }
+
+    cal_conf = conf;
+    DEBUG_PRINTF("Note: calibration cache configuration; file:%s, max_age:%u, temp_band:%d\n", cal_conf.file, cal_conf.max_age, cal_conf.temp_band);
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
 
     /* check if the concentrator is running */
@@ -492,16 +868,11 @@ int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
+/* check IF chain configuration and commit it to the internal state */
+static int rxif_commit(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
     int32_t bw_hz;
     uint32_t rf_rx_bandwidth;
 
-    /* check if the concentrator is running */
-    if (lgw_is_started == true) {
-        DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
-        return LGW_HAL_ERROR;
-    }
-
     /* check input range (segfault prevention) */
     if (if_chain >= LGW_IF_CHAIN_NB) {
         DEBUG_PRINTF("ERROR: %d NOT A VALID IF_CHAIN NUMBER\n", if_chain);
@@ -647,6 +1018,87 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
+    /* check if the concentrator is running */
+    if (lgw_is_started == true) {
+        DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+        return LGW_HAL_ERROR;
+    }
+
+    return rxif_commit(if_chain, conf);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxif_reconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
+    uint64_t fsk_sync_word_reg;
+    int reg_bw;
+
+    if (lgw_is_started == false) {
+        return lgw_rxif_setconf(if_chain, conf);
+    }
+
+    /* check input range (segfault prevention) */
+    if (if_chain >= LGW_IF_CHAIN_NB) {
+        DEBUG_PRINTF("ERROR: %d NOT A VALID IF_CHAIN NUMBER\n", if_chain);
+        return LGW_HAL_ERROR;
+    }
+
+    /* multi-SF radio mapping is loaded in the AGC firmware at start */
+    if ((if_chain < LGW_MULTI_NB) && (conf.enable == true) && (conf.rf_chain != if_rf_chain[if_chain])) {
+        DEBUG_PRINTF("ERROR: IF CHAIN %d CANNOT CHANGE RF CHAIN WHILE RUNNING\n", if_chain);
+        return LGW_HAL_ERROR;
+    }
+
+    if (rxif_commit(if_chain, conf) != LGW_HAL_SUCCESS) {
+        return LGW_HAL_ERROR;
+    }
+
+    /* rewrite registers of the IF chain, same sequence as lgw_start */
+    if (if_chain < LGW_MULTI_NB) {
+        lgw_reg_w(LGW_IF_FREQ_0 + if_chain, IF_HZ_TO_REG(if_freq[if_chain]));
+        lgw_reg_w(LGW_CORR0_DETECT_EN + if_chain, (if_enable[if_chain] == true) ? lora_multi_sfmask[if_chain] : 0);
+    } else if (if_chain == 8) {
+        lgw_reg_w(LGW_IF_FREQ_8, IF_HZ_TO_REG(if_freq[8]));
+        if (if_enable[8] == true) {
+            switch(lora_rx_bw) {
+                case BW_125KHZ: reg_bw = 0; break;
+                case BW_250KHZ: reg_bw = 1; break;
+                case BW_500KHZ: reg_bw = 2; break;
+                default:
+                    DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", lora_rx_bw);
+                    return LGW_HAL_ERROR;
+            }
+            lgw_reg_w(LGW_MBWSSF_MODEM_ENABLE, 0);
+            lgw_reg_w(LGW_MBWSSF_RADIO_SELECT, if_rf_chain[8]);
+            lgw_reg_w(LGW_MBWSSF_MODEM_BW, reg_bw);
+            lgw_reg_w(LGW_MBWSSF_RATE_SF, lgw_sf_getval(lora_rx_sf));
+            lgw_reg_w(LGW_MBWSSF_PPM_OFFSET, lora_rx_ppm_offset);
+            lgw_reg_w(LGW_MBWSSF_MODEM_ENABLE, 1);
+        } else {
+            lgw_reg_w(LGW_MBWSSF_MODEM_ENABLE, 0);
+        }
+    } else {
+        lgw_reg_w(LGW_IF_FREQ_9, IF_HZ_TO_REG(if_freq[9]));
+        lgw_reg_w(LGW_FSK_MODEM_ENABLE, 0);
+        lgw_reg_w(LGW_FSK_PSIZE, fsk_sync_word_size-1);
+        lgw_reg_w(LGW_FSK_TX_PSIZE, fsk_sync_word_size-1);
+        fsk_sync_word_reg = fsk_sync_word << (8 * (8 - fsk_sync_word_size));
+        lgw_reg_w(LGW_FSK_REF_PATTERN_LSB, (uint32_t)(0xFFFFFFFF & fsk_sync_word_reg));
+        lgw_reg_w(LGW_FSK_REF_PATTERN_MSB, (uint32_t)(0xFFFFFFFF & (fsk_sync_word_reg >> 32)));
+        if (if_enable[9] == true) {
+            lgw_reg_w(LGW_FSK_RADIO_SELECT, if_rf_chain[9]);
+            lgw_reg_w(LGW_FSK_BR_RATIO, LGW_XTAL_FREQU/fsk_rx_dr);
+            lgw_reg_w(LGW_FSK_CH_BW_EXPO, fsk_rx_bw);
+            lgw_reg_w(LGW_FSK_MODEM_ENABLE, 1);
+        }
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf) {
     int i;
 
@@ -704,6 +1156,7 @@ int lgw_start(void) {
     uint8_t cal_cmd;
     uint16_t cal_time;
     uint8_t cal_status;
+    struct cal_entry_s cal_entry;
 
     uint64_t fsk_sync_word_reg;
 
@@ -711,6 +1164,8 @@ int lgw_start(void) {
         DEBUG_MSG("Note: LoRa concentrator already started, restarting it now\n");
     }
 
+    ts_table_init();
+
     reg_stat = lgw_connect(false, rf_tx_notch_freq[rf_tx_enable[1]?1:0]);
     if (reg_stat == LGW_REG_ERROR) {
         DEBUG_MSG("ERROR: FAIL TO CONNECT BOARD\n");
@@ -801,82 +1256,28 @@ int lgw_start(void) {
     cal_cmd |= 0x00; /* Bit 6-7: Board type 0: ref, 1: FPGA, 3: board X */
     cal_time = 2300; /* measured between 2.1 and 2.2 sec, because 1 TX only */
 
-    /* Load the calibration firmware  */
-    load_firmware(MCU_AGC, cal_firmware, MCU_AGC_FW_BYTE);
-    lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL, 0); /* gives to AGC MCU the control of the radios */
-    lgw_reg_w(LGW_RADIO_SELECT, cal_cmd); /* send calibration configuration word */
-    lgw_reg_w(LGW_MCU_RST_1, 0);
-
-    /* Check firmware version */
-    lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, FW_VERSION_ADDR);
-    lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-    fw_version = (uint8_t)read_val;
-    if (fw_version != FW_VERSION_CAL) {
-        printf("ERROR: Version of calibration firmware not expected, actual:%d expected:%d\n", fw_version, FW_VERSION_CAL);
-        return -1;
-    }
-
-    lgw_reg_w(LGW_PAGE_REG, 3); /* Calibration will start on this condition as soon as MCU can talk to concentrator registers */
-    lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 0); /* Give control of concentrator registers to MCU */
-
-    /* Wait for calibration to end */
-    DEBUG_PRINTF("Note: calibration started (time: %u ms)\n", cal_time);
-    wait_ms(cal_time); /* Wait for end of calibration */
-    lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 1); /* Take back control */
-
-    /* Get calibration status */
-    lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-    cal_status = (uint8_t)read_val;
-    /*
-        bit 7: calibration finished
-        bit 0: could access SX1301 registers
-        bit 1: could access radio A registers
-        bit 2: could access radio B registers
-        bit 3: radio A RX image rejection successful
-        bit 4: radio B RX image rejection successful
-        bit 5: radio A TX DC Offset correction successful
-        bit 6: radio B TX DC Offset correction successful
-    */
-    if ((cal_status & 0x81) != 0x81) {
-        DEBUG_PRINTF("ERROR: CALIBRATION FAILURE (STATUS = %u)\n", cal_status);
-        return LGW_HAL_ERROR;
-    } else {
-        DEBUG_PRINTF("Note: calibration finished (status = %u)\n", cal_status);
-    }
-    if (rf_enable[0] && ((cal_status & 0x02) == 0)) {
-        DEBUG_MSG("WARNING: calibration could not access radio A\n");
-    }
-    if (rf_enable[1] && ((cal_status & 0x04) == 0)) {
-        DEBUG_MSG("WARNING: calibration could not access radio B\n");
-    }
-    if (rf_enable[0] && ((cal_status & 0x08) == 0)) {
-        DEBUG_MSG("WARNING: problem in calibration of radio A for image rejection\n");
-    }
-    if (rf_enable[1] && ((cal_status & 0x10) == 0)) {
-        DEBUG_MSG("WARNING: problem in calibration of radio B for image rejection\n");
-    }
-    if (rf_enable[0] && rf_tx_enable[0] && ((cal_status & 0x20) == 0)) {
-        DEBUG_MSG("WARNING: problem in calibration of radio A for TX DC offset\n");
+    /* reuse results of a previous calibration done with the same settings */
+    cal_restored = false;
+    if (cal_conf.file[0] != '\0') {
+        cal_key_make(&cal_entry.key, cal_cmd);
+        if (cal_cache_load(&cal_entry) == 0) {
+            DEBUG_MSG("Note: calibration results restored from cache\n");
+            cal_apply(&cal_entry);
+            cal_restored = true;
+        }
     }
-    if (rf_enable[1] && rf_tx_enable[1] && ((cal_status & 0x40) == 0)) {
-        DEBUG_MSG("WARNING: problem in calibration of radio B for TX DC offset\n");
+    if (cal_restored == false) {
+        if (cal_run(cal_cmd, cal_time, &cal_status) != LGW_HAL_SUCCESS) {
+            return LGW_HAL_ERROR;
+        }
+        if ((cal_conf.file[0] != '\0') && ((cal_status & cal_expected_status()) == cal_expected_status())) {
+            cal_cache_save(&cal_entry);
+        }
     }
 
-    /* Get TX DC offset values */
-    for(i=0; i<=7; ++i) {
-        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA0+i);
-        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-        cal_offset_a_i[i] = (int8_t)read_val;
-        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA8+i);
-        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-        cal_offset_a_q[i] = (int8_t)read_val;
-        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB0+i);
-        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-        cal_offset_b_i[i] = (int8_t)read_val;
-        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB8+i);
-        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-        cal_offset_b_q[i] = (int8_t)read_val;
-    }
+    /* constant and channel setup only touch configuration registers, write
+    them with as few SPI transfers as possible */
+    lgw_reg_batch_begin();
 
     /* load adjusted parameters */
     lgw_constant_adjust();
@@ -884,6 +1285,7 @@ int lgw_start(void) {
     /* Sanity check for RX frequency */
     if (rf_rx_freq[0] == 0) {
         DEBUG_MSG("ERROR: wrong configuration, rf_rx_freq[0] is not set\n");
+        lgw_reg_batch_end();
         return LGW_HAL_ERROR;
     }
 
@@ -940,6 +1342,7 @@ int lgw_start(void) {
             case BW_500KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW, 2); break;
             default:
                 DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", lora_rx_bw);
+                lgw_reg_batch_end();
                 return LGW_HAL_ERROR;
         }
         switch(lora_rx_sf) {
@@ -951,6 +1354,7 @@ int lgw_start(void) {
             case DR_LORA_SF12: lgw_reg_w(LGW_MBWSSF_RATE_SF, 12); break;
             default:
                 DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", lora_rx_sf);
+                lgw_reg_batch_end();
                 return LGW_HAL_ERROR;
         }
         lgw_reg_w(LGW_MBWSSF_PPM_OFFSET, lora_rx_ppm_offset); /* default 0 */
@@ -975,6 +1379,9 @@ int lgw_start(void) {
         lgw_reg_w(LGW_FSK_MODEM_ENABLE, 0);
     }
 
+    /* write deferred configuration before the firmwares take over */
+    lgw_reg_batch_end();
+
     /* Load firmware */
     load_firmware(MCU_ARB, arb_firmware, MCU_ARB_FW_BYTE);
     load_firmware(MCU_AGC, agc_firmware, MCU_AGC_FW_BYTE);
@@ -1090,6 +1497,18 @@ int lgw_start(void) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+bool lgw_cal_restored(void) {
+    return cal_restored;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_rx_invalid(void) {
+    return rx_invalid_chain;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_stop(void) {
     lgw_soft_reset();
     lgw_disconnect();
@@ -1100,82 +1519,108 @@ int lgw_stop(void) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
-    int nb_pkt_fetch; /* loop variable and return value */
+/* fetch up to max_pkt packets, payload and metadata of each one are read
+directly into the struct pointed by the matching slot */
+static int rx_fetch(uint8_t max_pkt, struct lgw_pkt_rx_s *const *slot) {
+    int nb_pkt_fetch; /* number of filled slots and return value */
+    int nb_pkt_read; /* loop variable, packets taken out of the FIFO */
     struct lgw_pkt_rx_s *p; /* pointer to the current structure in the struct array */
-    uint8_t buff[255+RX_METADATA_NB]; /* buffer to store the result of SPI read bursts */
+    uint8_t buff[RX_METADATA_NB]; /* buffer to store the metadata following the payload */
+    uint8_t fifo[5]; /* RX FIFO status of the current packet */
+    uint8_t fifo_next = 0; /* value written to advance the RX FIFO */
+    struct lgw_reg_seg seg[4]; /* payload and metadata read, FIFO advance and next FIFO status read */
+    int nb_seg; /* number of accesses in the transfer of the current packet */
     unsigned sz; /* size of the payload, uses to address metadata */
     int ifmod; /* type of if_chain/modem a packet was received by */
     int stat_fifo; /* the packet status as indicated in the FIFO */
     uint32_t raw_timestamp; /* timestamp when internal 'RX finished' was triggered */
-    uint32_t delay_x, delay_y, delay_z; /* temporary variable for timestamp offset calculation */
     uint32_t timestamp_correction; /* correction to account for processing delay */
-    uint32_t sf, cr, bw_pow, crc_en, ppm; /* used to calculate timestamp correction */
-
-    /* check if the concentrator is running */
-    if (lgw_is_started == false) {
-        DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE RECEIVING\n");
-        return LGW_HAL_ERROR;
-    }
-
-    /* check input variables */
-    if ((max_pkt <= 0) || (max_pkt > LGW_PKT_FIFO_SIZE)) {
-        DEBUG_PRINTF("ERROR: %d = INVALID MAX NUMBER OF PACKETS TO FETCH\n", max_pkt);
-        return LGW_HAL_ERROR;
+    uint32_t sf, cr, crc_en, ppm, len; /* used to calculate timestamp correction */
+    int ts_bw; /* index of the modem bandwidth in the timestamp correction tables */
+
+    /* fetch the RX FIFO data of the first packet, following ones come with the previous packet */
+    lgw_reg_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, fifo, 5);
+    /* 0:   number of packets available in RX data buffer */
+    /* 1,2: start address of the current packet in RX data buffer */
+    /* 3:   CRC status of the current packet */
+    /* 4:   size of the current packet payload in byte */
+
+    /* most polls find the FIFO empty, nothing else to do then */
+    if (fifo[0] == 0) {
+        return 0;
     }
-    CHECK_NULL(pkt_data);
-
-    /* Initialize buffer */
-    memset (buff, 0, sizeof buff);
 
-    /* iterate max_pkt times at most */
-    for (nb_pkt_fetch = 0; nb_pkt_fetch < max_pkt; ++nb_pkt_fetch) {
+    /* iterate max_pkt times at most, a dropped packet leaves its slot to the next one */
+    nb_pkt_fetch = 0;
+    for (nb_pkt_read = 0; nb_pkt_read < max_pkt; ++nb_pkt_read) {
 
         /* point to the proper struct in the struct array */
-        p = &pkt_data[nb_pkt_fetch];
-
-        /* fetch all the RX FIFO data */
-        lgw_reg_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, buff, 5);
-        /* 0:   number of packets available in RX data buffer */
-        /* 1,2: start address of the current packet in RX data buffer */
-        /* 3:   CRC status of the current packet */
-        /* 4:   size of the current packet payload in byte */
+        p = slot[nb_pkt_fetch];
 
         /* how many packets are in the RX buffer ? Break if zero */
-        if (buff[0] == 0) {
+        if (fifo[0] == 0) {
             break; /* no more packets to fetch, exit out of FOR loop */
         }
 
         /* sanity check */
-        if (buff[0] > LGW_PKT_FIFO_SIZE) {
-            DEBUG_PRINTF("WARNING: %u = INVALID NUMBER OF PACKETS TO FETCH, ABORTING\n", buff[0]);
+        if (fifo[0] > LGW_PKT_FIFO_SIZE) {
+            DEBUG_PRINTF("WARNING: %u = INVALID NUMBER OF PACKETS TO FETCH, ABORTING\n", fifo[0]);
             break;
         }
 
-        DEBUG_PRINTF("FIFO content: %x %x %x %x %x\n", buff[0], buff[1], buff[2], buff[3], buff[4]);
+        DEBUG_PRINTF("FIFO content: %x %x %x %x %x\n", fifo[0], fifo[1], fifo[2], fifo[3], fifo[4]);
 
-        p->size = buff[4];
+        p->size = fifo[4];
         sz = p->size;
-        stat_fifo = buff[3]; /* will be used later, need to save it before overwriting buff */
-
-        /* get payload + metadata */
-        lgw_reg_rb(LGW_RX_DATA_BUF_DATA, buff, sz+RX_METADATA_NB);
-
-        /* copy payload to result struct */
-        memcpy((void *)p->payload, (void *)buff, sz);
+        stat_fifo = fifo[3];
+
+        /* get payload then metadata (the data buffer address keeps running
+        between both reads), advance packet FIFO and, if another packet may be
+        fetched, get its RX FIFO data, all in one SPI transfer */
+        nb_seg = 0;
+        if (sz > 0) {
+            seg[nb_seg].register_id = LGW_RX_DATA_BUF_DATA;
+            seg[nb_seg].write = 0;
+            seg[nb_seg].data = p->payload;
+            seg[nb_seg].size = sz;
+            ++nb_seg;
+        }
+        seg[nb_seg].register_id = LGW_RX_DATA_BUF_DATA;
+        seg[nb_seg].write = 0;
+        seg[nb_seg].data = buff;
+        seg[nb_seg].size = RX_METADATA_NB;
+        ++nb_seg;
+        seg[nb_seg].register_id = LGW_RX_PACKET_DATA_FIFO_NUM_STORED;
+        seg[nb_seg].write = 1;
+        seg[nb_seg].data = &fifo_next;
+        seg[nb_seg].size = 1;
+        ++nb_seg;
+        if (nb_pkt_read + 1 < max_pkt) {
+            seg[nb_seg].register_id = LGW_RX_PACKET_DATA_FIFO_NUM_STORED;
+            seg[nb_seg].write = 0;
+            seg[nb_seg].data = fifo;
+            seg[nb_seg].size = 5;
+            ++nb_seg;
+        }
+        if (lgw_reg_xfer(seg, nb_seg) != LGW_REG_SUCCESS) {
+            DEBUG_MSG("ERROR: FAILED TO FETCH PACKET FROM RX FIFO\n");
+            break;
+        }
 
         /* process metadata */
-        p->if_chain = buff[sz+0];
+        p->if_chain = buff[0];
         if (p->if_chain >= LGW_IF_CHAIN_NB) {
-            DEBUG_PRINTF("WARNING: %u NOT A VALID IF_CHAIN NUMBER, ABORTING\n", p->if_chain);
-            break;
+            /* FIFO already advanced, drop the packet and keep fetching */
+            DEBUG_PRINTF("WARNING: %u NOT A VALID IF_CHAIN NUMBER, PACKET DROPPED\n", p->if_chain);
+            ++rx_invalid_chain;
+            continue;
         }
         ifmod = ifmod_config[p->if_chain];
         DEBUG_PRINTF("[%d %d]\n", p->if_chain, ifmod);
 
         p->rf_chain = (uint8_t)if_rf_chain[p->if_chain];
         p->freq_hz = (uint32_t)((int32_t)rf_rx_freq[p->rf_chain] + if_freq[p->if_chain]);
-        p->rssi = (float)buff[sz+5] + rf_rssi_offset[p->rf_chain];
+        p->rssi = (float)buff[5] + rf_rssi_offset[p->rf_chain];
 
         if ((ifmod == IF_LORA_MULTI) || (ifmod == IF_LORA_STD)) {
             DEBUG_MSG("Note: LoRa packet\n");
@@ -1197,15 +1642,15 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
                     crc_en = 0;
             }
             p->modulation = MOD_LORA;
-            p->snr = ((float)((int8_t)buff[sz+2]))/4;
-            p->snr_min = ((float)((int8_t)buff[sz+3]))/4;
-            p->snr_max = ((float)((int8_t)buff[sz+4]))/4;
+            p->snr = ((float)((int8_t)buff[2]))/4;
+            p->snr_min = ((float)((int8_t)buff[3]))/4;
+            p->snr_max = ((float)((int8_t)buff[4]))/4;
             if (ifmod == IF_LORA_MULTI) {
                 p->bandwidth = BW_125KHZ; /* fixed in hardware */
             } else {
                 p->bandwidth = lora_rx_bw; /* get the parameter from the config variable */
             }
-            sf = (buff[sz+1] >> 4) & 0x0F;
+            sf = (buff[1] >> 4) & 0x0F;
             switch (sf) {
                 case 7: p->datarate = DR_LORA_SF7; break;
                 case 8: p->datarate = DR_LORA_SF8; break;
@@ -1215,7 +1660,7 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
                 case 12: p->datarate = DR_LORA_SF12; break;
                 default: p->datarate = DR_UNDEFINED;
             }
-            cr = (buff[sz+1] >> 1) & 0x07;
+            cr = (buff[1] >> 1) & 0x07;
             switch (cr) {
                 case 1: p->coderate = CR_LORA_4_5; break;
                 case 2: p->coderate = CR_LORA_4_6; break;
@@ -1231,41 +1676,28 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
                 ppm = 0;
             }
 
-            /* timestamp correction code, base delay */
+            /* timestamp correction code, modem bandwidth */
             if (ifmod == IF_LORA_STD) { /* if packet was received on the stand-alone LoRa modem */
                 switch (lora_rx_bw) {
-                    case BW_125KHZ:
-                        delay_x = 64;
-                        bw_pow = 1;
-                        break;
-                    case BW_250KHZ:
-                        delay_x = 32;
-                        bw_pow = 2;
-                        break;
-                    case BW_500KHZ:
-                        delay_x = 16;
-                        bw_pow = 4;
-                        break;
+                    case BW_125KHZ: ts_bw = 1; break;
+                    case BW_250KHZ: ts_bw = 2; break;
+                    case BW_500KHZ: ts_bw = 3; break;
                     default:
                         DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", p->bandwidth);
-                        delay_x = 0;
-                        bw_pow = 0;
+                        ts_bw = -1;
                 }
             } else { /* packet was received on one of the sensor channels = 125kHz */
-                delay_x = 114;
-                bw_pow = 1;
+                ts_bw = 0;
             }
 
-            /* timestamp correction code, variable delay */
-            if ((sf >= 6) && (sf <= 12) && (bw_pow > 0)) {
-                if ((2*(sz + 2*crc_en) - (sf-7)) <= 0) { /* payload fits entirely in first 8 symbols */
-                    delay_y = ( ((1<<(sf-1)) * (sf+1)) + (3 * (1<<(sf-4))) ) / bw_pow;
-                    delay_z = 32 * (2*(sz+2*crc_en) + 5) / bw_pow;
+            /* timestamp correction code, base + variable delay from the tables */
+            if ((sf >= 6) && (sf <= 12) && (ts_bw >= 0)) {
+                len = sz + 2*crc_en;
+                if ((2*len - (sf-7)) == 0) { /* payload fits entirely in first 8 symbols */
+                    timestamp_correction = ts_delay_xy[ts_bw][sf-6][1] + 32 * (2*len + 5) / ts_bw_pow[ts_bw];
                 } else {
-                    delay_y = ( ((1<<(sf-1)) * (sf+1)) + ((4 - ppm) * (1<<(sf-4))) ) / bw_pow;
-                    delay_z = (16 + 4*cr) * (((2*(sz+2*crc_en)-sf+6) % (sf - 2*ppm)) + 1) / bw_pow;
+                    timestamp_correction = ts_delay_xy[ts_bw][sf-6][0] + (16 + 4*cr) * ts_delay_sym[sf-6][ppm][len] / ts_bw_pow[ts_bw];
                 }
-                timestamp_correction = delay_x + delay_y + delay_z;
             } else {
                 timestamp_correction = 0;
                 DEBUG_MSG("WARNING: invalid packet, no timestamp correction\n");
@@ -1317,12 +1749,10 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
             timestamp_correction = 0;
         }
 
-        raw_timestamp = (uint32_t)buff[sz+6] + ((uint32_t)buff[sz+7] << 8) + ((uint32_t)buff[sz+8] << 16) + ((uint32_t)buff[sz+9] << 24);
+        raw_timestamp = (uint32_t)buff[6] + ((uint32_t)buff[7] << 8) + ((uint32_t)buff[8] << 16) + ((uint32_t)buff[9] << 24);
         p->count_us = raw_timestamp - timestamp_correction;
-        p->crc = (uint16_t)buff[sz+10] + ((uint16_t)buff[sz+11] << 8);
-
-        /* advance packet FIFO */
-        lgw_reg_w(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, 0);
+        p->crc = (uint16_t)buff[10] + ((uint16_t)buff[11] << 8);
+        ++nb_pkt_fetch;
     }
 
     return nb_pkt_fetch;
@@ -1330,6 +1760,109 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+    struct lgw_pkt_rx_s *slot[LGW_PKT_FIFO_SIZE];
+    int i;
+
+    /* check if the concentrator is running */
+    if (lgw_is_started == false) {
+        DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE RECEIVING\n");
+        return LGW_HAL_ERROR;
+    }
+
+    /* check input variables */
+    if ((max_pkt <= 0) || (max_pkt > LGW_PKT_FIFO_SIZE)) {
+        DEBUG_PRINTF("ERROR: %d = INVALID MAX NUMBER OF PACKETS TO FETCH\n", max_pkt);
+        return LGW_HAL_ERROR;
+    }
+    CHECK_NULL(pkt_data);
+
+    for (i = 0; i < max_pkt; ++i) {
+        slot[i] = &pkt_data[i];
+    }
+
+    /* LBT channel timestamps are cached here on a cadence, not read by lgw_send */
+    lbt_refresh(LGW_LBT_REFRESH_US);
+
+    return rx_fetch(max_pkt, slot);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_receive_ring(uint8_t max_pkt, struct lgw_pkt_rx_s **pkt_ptr) {
+    uint32_t head = rx_ring.head;
+    uint32_t held;
+    int i, nb_pkt;
+
+    /* check if the concentrator is running */
+    if (lgw_is_started == false) {
+        DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE RECEIVING\n");
+        return LGW_HAL_ERROR;
+    }
+
+    /* check input variables */
+    if ((max_pkt <= 0) || (max_pkt > LGW_PKT_FIFO_SIZE)) {
+        DEBUG_PRINTF("ERROR: %d = INVALID MAX NUMBER OF PACKETS TO FETCH\n", max_pkt);
+        return LGW_HAL_ERROR;
+    }
+    CHECK_NULL(pkt_ptr);
+
+    /* packets stay in the concentrator FIFO while no descriptor is free */
+    held = head - __atomic_load_n(&rx_ring.tail, __ATOMIC_ACQUIRE);
+    if (held >= LGW_RX_RING_SIZE) {
+        return 0;
+    }
+    if (max_pkt > LGW_RX_RING_SIZE - held) {
+        max_pkt = LGW_RX_RING_SIZE - held;
+    }
+
+    for (i = 0; i < max_pkt; ++i) {
+        pkt_ptr[i] = &rx_ring.pkt[(head + i) & (LGW_RX_RING_SIZE - 1)];
+    }
+
+    lbt_refresh(LGW_LBT_REFRESH_US);
+
+    nb_pkt = rx_fetch(max_pkt, pkt_ptr);
+    if (nb_pkt > 0) {
+        __atomic_store_n(&rx_ring.head, head + nb_pkt, __ATOMIC_RELEASE);
+    }
+
+    return nb_pkt;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void *lgw_rx_ring_get(void) {
+    return &rx_ring;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rx_release_ring(void *ring, uint8_t nb_pkt) {
+    struct rx_ring_s *r = (struct rx_ring_s *)ring;
+    uint32_t tail;
+
+    CHECK_NULL(ring);
+    tail = r->tail;
+
+    if (nb_pkt > __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail) {
+        DEBUG_PRINTF("ERROR: %d = MORE PACKETS RELEASED THAN HELD\n", nb_pkt);
+        return LGW_HAL_ERROR;
+    }
+
+    __atomic_store_n(&r->tail, tail + nb_pkt, __ATOMIC_RELEASE);
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rx_release(uint8_t nb_pkt) {
+    return lgw_rx_release_ring(&rx_ring, nb_pkt);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_send(struct lgw_pkt_tx_s pkt_data) {
     int i, x;
     uint8_t buff[256+TX_METADATA_NB]; /* buffer to prepare the packet to send + metadata before SPI write burst */
@@ -1691,6 +2224,32 @@ int lgw_get_trigcnt(uint32_t* trig_cnt_us) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_get_instcnt(uint32_t* inst_cnt_us) {
+    int i;
+    int32_t gps_en = 0;
+    int32_t val;
+
+    /* counter register follows free running counter only while PPS latch is disabled */
+    i = lgw_reg_r(LGW_GPS_EN, &gps_en);
+    if ((i == LGW_REG_SUCCESS) && (gps_en != 0)) {
+        i = lgw_reg_w(LGW_GPS_EN, 0);
+    }
+    if (i == LGW_REG_SUCCESS) {
+        i = lgw_reg_r(LGW_TIMESTAMP, &val);
+    }
+    if (gps_en != 0) {
+        lgw_reg_w(LGW_GPS_EN, gps_en);
+    }
+    if (i == LGW_REG_SUCCESS) {
+        *inst_cnt_us = (uint32_t)val;
+        return LGW_HAL_SUCCESS;
+    } else {
+        return LGW_HAL_ERROR;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 const char* lgw_version_info() {
     return lgw_version_string;
 }
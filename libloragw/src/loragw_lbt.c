@@ -16,16 +16,26 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
 #include <stdio.h>      /* printf fprintf */
 #include <stdlib.h>     /* abs, labs, llabs */
 #include <string.h>     /* memset */
+#include <time.h>       /* clock_gettime */
 
 #include "loragw_radio.h"
 #include "loragw_aux.h"
 #include "loragw_lbt.h"
 #include "loragw_fpga.h"
+#include "loragw_reg.h"
+#include "loragw_spi.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -52,19 +62,25 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
 
-extern void *lgw_spi_target; /*! generic pointer to the SPI device */
-extern uint8_t lgw_spi_mux_mode; /*! current SPI mux mode used */
+extern __thread void *lgw_spi_target; /*! generic pointer to the SPI device */
+extern __thread uint8_t lgw_spi_mux_mode; /*! current SPI mux mode used */
 extern uint16_t lgw_i_tx_start_delay_us;
+extern const struct lgw_reg_s fpga_regs[LGW_FPGA_TOTALREGS];
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-static bool lbt_enable;
-static uint8_t lbt_nb_active_channel;
-static int8_t lbt_rssi_target_dBm;
-static int8_t lbt_rssi_offset_dB;
-static uint32_t lbt_start_freq;
-static struct lgw_conf_lbt_chan_s lbt_channel_cfg[LBT_CHANNEL_FREQ_NB];
+static __thread bool lbt_enable;
+static __thread uint8_t lbt_nb_active_channel;
+static __thread int8_t lbt_rssi_target_dBm;
+static __thread int8_t lbt_rssi_offset_dB;
+static __thread uint32_t lbt_start_freq;
+static __thread struct lgw_conf_lbt_chan_s lbt_channel_cfg[LBT_CHANNEL_FREQ_NB];
+
+/* last time each channel was seen free by the FPGA, as read on lbt_read_time */
+static __thread uint32_t lbt_free_time[LBT_CHANNEL_FREQ_NB];
+static __thread struct timespec lbt_read_time;
+static __thread bool lbt_read_valid;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
@@ -204,6 +220,8 @@ int lbt_setup(void) {
 int lbt_start(void) {
     int x;
 
+    lbt_read_valid = false;
+
     x = lgw_fpga_reg_w(LGW_FPGA_CTRL_FEATURE_START, 1);
     if (x != LGW_REG_SUCCESS) {
         DEBUG_MSG("ERROR: Failed to start LBT FSM\n");
@@ -215,9 +233,50 @@ int lbt_start(void) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lbt_refresh(uint32_t max_age_us) {
+    struct lgw_spi_msg msg;
+    struct timespec now;
+    uint8_t buf[LBT_CHANNEL_FREQ_NB][2];
+    int64_t age_us;
+    int i, x;
+
+    if (lbt_enable == false) {
+        return LGW_LBT_SUCCESS;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (lbt_read_valid == true) {
+        age_us = (int64_t)(now.tv_sec - lbt_read_time.tv_sec) * 1000000 + (now.tv_nsec - lbt_read_time.tv_nsec) / 1000;
+        if (age_us < (int64_t)max_age_us) {
+            return LGW_LBT_SUCCESS;
+        }
+    }
+
+    /* select and read back every channel in a single SPI message, LBT_TIMESTAMP_SELECT_CH is alone in its byte */
+    lgw_spi_msg_init(&msg, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA);
+    for (i=0; i<lbt_nb_active_channel; i++) {
+        lgw_spi_msg_w(&msg, fpga_regs[LGW_FPGA_LBT_TIMESTAMP_SELECT_CH].addr, (uint8_t)i);
+        lgw_spi_msg_rb(&msg, fpga_regs[LGW_FPGA_LBT_TIMESTAMP_CH].addr, buf[i], 2);
+    }
+    x = lgw_spi_msg_submit(lgw_spi_target, &msg);
+    if (x != LGW_SPI_SUCCESS) {
+        DEBUG_MSG("ERROR: Failed to read LBT channel timestamps\n");
+        lbt_read_valid = false;
+        return LGW_LBT_ERROR;
+    }
+
+    for (i=0; i<lbt_nb_active_channel; i++) {
+        lbt_free_time[i] = ((uint32_t)buf[i][0] | ((uint32_t)buf[i][1] << 8)) * 256; /* 16bits (1LSB = 256µs) */
+    }
+    lbt_read_time = now;
+    lbt_read_valid = true;
+
+    return LGW_LBT_SUCCESS;
+}
+
+
 int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay, bool * tx_allowed) {
     int i;
-    int32_t val;
     uint32_t tx_start_time = 0;
     uint32_t tx_end_time = 0;
     uint32_t delta_time = 0;
@@ -244,9 +303,6 @@ int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay,
             return LGW_LBT_SUCCESS;
         }
 
-        /* Get SX1301 time at last PPS */
-        lgw_get_trigcnt(&sx1301_time);
-
         DEBUG_MSG("################################\n");
         switch(pkt_data->tx_mode) {
             case TIMESTAMPED:
@@ -255,6 +311,8 @@ int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay,
                 break;
             case ON_GPS:
                 DEBUG_MSG("tx_mode                    = ON_GPS\n");
+                /* Get SX1301 time at last PPS */
+                lgw_get_trigcnt(&sx1301_time);
                 tx_start_time = (sx1301_time + (uint32_t)tx_start_delay + 1000000) & LBT_TIMESTAMP_MASK;
                 break;
             case IMMEDIATE:
@@ -301,16 +359,13 @@ int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay,
             /* Nothing to do for now */
         }
 
-        /* Get last time when selected channel was free */
-        if ((lbt_channel_decod_1 >= 0) && (lbt_channel_decod_2 >= 0)) {
-            lgw_fpga_reg_w(LGW_FPGA_LBT_TIMESTAMP_SELECT_CH, (int32_t)lbt_channel_decod_1);
-            lgw_fpga_reg_r(LGW_FPGA_LBT_TIMESTAMP_CH, &val);
-            lbt_time = lbt_time1 = (uint32_t)(val & 0x0000FFFF) * 256; /* 16bits (1LSB = 256µs) */
+        /* Get last time when selected channel was free, from cache unless it is too old */
+        /* an older value can only be earlier, so it never admits a TX the current one would reject */
+        if ((lbt_channel_decod_1 >= 0) && (lbt_channel_decod_2 >= 0) && (lbt_refresh(LGW_LBT_MAX_AGE_US) == LGW_LBT_SUCCESS)) {
+            lbt_time = lbt_time1 = lbt_free_time[lbt_channel_decod_1];
 
             if (lbt_channel_decod_1 != lbt_channel_decod_2 ) {
-                lgw_fpga_reg_w(LGW_FPGA_LBT_TIMESTAMP_SELECT_CH, (int32_t)lbt_channel_decod_2);
-                lgw_fpga_reg_r(LGW_FPGA_LBT_TIMESTAMP_CH, &val);
-                lbt_time2 = (uint32_t)(val & 0x0000FFFF) * 256; /* 16bits (1LSB = 256µs) */
+                lbt_time2 = lbt_free_time[lbt_channel_decod_2];
 
                 if (lbt_time2 < lbt_time1) {
                     lbt_time = lbt_time2;
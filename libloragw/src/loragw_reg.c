@@ -23,6 +23,7 @@ Maintainer: Sylvain Miermont
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
 #include <stdio.h>      /* printf fprintf */
+#include <string.h>     /* memset */
 
 #include "loragw_spi.h"
 #include "loragw_reg.h"
@@ -388,13 +389,19 @@ const struct lgw_reg_s loregs[LGW_TOTALREGS] = {
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-static int lgw_regpage = -1; /*! keep the value of the register page selected */
+static __thread int lgw_regpage = -1; /*! keep the value of the register page selected */
+
+/* shadow of the configuration registers, written only by the host */
+static __thread uint8_t reg_shadow[4][128]; /*! last value known to be in each byte */
+static __thread bool reg_shadow_valid[4][128]; /*! byte value is known */
+static __thread bool reg_shadow_dirty[4][128]; /*! byte written to shadow, not yet to concentrator */
+static __thread bool reg_batch = false; /*! writes of configuration registers are deferred */
 
 /* -------------------------------------------------------------------------- */
 /* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
 
-void *lgw_spi_target = NULL; /*! generic pointer to the SPI device */
-uint8_t lgw_spi_mux_mode = 0; /*! current SPI mux mode used */
+__thread void *lgw_spi_target = NULL; /*! generic pointer to the SPI device, one per thread */
+__thread uint8_t lgw_spi_mux_mode = 0; /*! current SPI mux mode used */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
@@ -407,6 +414,212 @@ int page_switch(uint8_t target) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/*
+Only modem and demodulator configuration bytes are shadowed: page 0 IF
+frequencies to decimation gain offsets and RSSI filter setup, page 1 MBWSSF
+and FSK setup. FIFO, data buffers, MCU control, radio select, gains driven
+by the AGC firmware, IQ mismatch and TX offsets written by the calibration
+firmware and TX trigger registers always go to the concentrator.
+*/
+static bool reg_cacheable(const struct lgw_reg_s *r) {
+    int last = r->addr + ((r->leng > 8) ? (r->leng + 7) / 8 : 1) - 1;
+
+    if (r->rdon == 1) {
+        return false;
+    }
+    switch (r->page) {
+        case 0:
+            return ((r->addr >= 36) && (last <= 104)) || ((r->addr >= 107) && (last <= 113));
+        case 1:
+            return (r->addr >= 43) && (last <= 84);
+        default:
+            return false;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* forget shadow content, the concentrator state is unknown */
+static void reg_cache_clear(void) {
+    memset(reg_shadow_valid, 0, sizeof reg_shadow_valid);
+    memset(reg_shadow_dirty, 0, sizeof reg_shadow_dirty);
+    reg_batch = false;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* after soft reset, bytes fully described by the register map hold defaults */
+static void reg_cache_reset(void) {
+    static __thread uint8_t mask[4][128];
+    static __thread uint8_t dflt[4][128];
+    static __thread bool init = false;
+    struct lgw_reg_s r;
+    int i, j, n;
+
+    if (init == false) {
+        for (i = 0; i < LGW_TOTALREGS; ++i) {
+            r = loregs[i];
+            if (reg_cacheable(&r) == false) {
+                continue;
+            }
+            if (r.leng <= 8) {
+                mask[r.page][r.addr] |= ((1 << r.leng) - 1) << r.offs;
+                dflt[r.page][r.addr] |= ((uint8_t)r.dflt & ((1 << r.leng) - 1)) << r.offs;
+            } else if ((r.leng % 8) == 0) {
+                n = r.leng / 8;
+                for (j = 0; j < n; ++j) {
+                    mask[r.page][r.addr + j] = 0xFF;
+                    dflt[r.page][r.addr + j] = (uint8_t)(r.dflt >> (8 * j));
+                }
+            }
+        }
+        init = true;
+    }
+
+    reg_cache_clear();
+    for (i = 0; i < 4; ++i) {
+        for (j = 0; j < 128; ++j) {
+            if (mask[i][j] == 0xFF) {
+                reg_shadow[i][j] = dflt[i][j];
+                reg_shadow_valid[i][j] = true;
+            }
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* write deferred bytes, contiguous ones in a single burst, all in one SPI message */
+static int reg_cache_flush(void) {
+    int spi_stat = LGW_SPI_SUCCESS;
+    struct lgw_spi_msg msg;
+    int i, j, start;
+
+    lgw_spi_msg_init(&msg, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301);
+    for (i = 0; i < 4; ++i) {
+        for (j = 0; j < 128; ++j) {
+            if (reg_shadow_dirty[i][j] == false) {
+                continue;
+            }
+            start = j;
+            while ((j < 128) && (reg_shadow_dirty[i][j] == true)) {
+                reg_shadow_dirty[i][j] = false;
+                ++j;
+            }
+            /* a page switch and a run take two slots */
+            if (msg.nb + 2 > LGW_SPI_MSG_MAX) {
+                spi_stat += lgw_spi_msg_submit(lgw_spi_target, &msg);
+            }
+            if (i != lgw_regpage) {
+                lgw_regpage = i;
+                lgw_spi_msg_w(&msg, PAGE_ADDR, (uint8_t)lgw_regpage);
+            }
+            if (j - start == 1) {
+                lgw_spi_msg_w(&msg, start, reg_shadow[i][start]);
+            } else {
+                lgw_spi_msg_wb(&msg, start, &reg_shadow[i][start], j - start);
+            }
+        }
+    }
+    if (msg.nb > 0) {
+        spi_stat += lgw_spi_msg_submit(lgw_spi_target, &msg);
+    }
+
+    return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* write a configuration register through the shadow, skip unchanged bytes */
+static int reg_w_cached(struct lgw_reg_s r, int32_t reg_value) {
+    int spi_stat = LGW_SPI_SUCCESS;
+    uint8_t buf[4];
+    uint8_t mask;
+    bool changed = false;
+    int i, size_byte;
+
+    if ((r.offs + r.leng) <= 8) {
+        size_byte = 1;
+        if ((r.leng == 8) && (r.offs == 0)) {
+            buf[0] = (uint8_t)reg_value;
+        } else {
+            /* read-modify-write, the read is only needed once */
+            if (reg_shadow_valid[r.page][r.addr] == false) {
+                if (r.page != lgw_regpage) {
+                    spi_stat += page_switch(r.page);
+                }
+                spi_stat += lgw_spi_r(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r.addr, &reg_shadow[r.page][r.addr]);
+                reg_shadow_valid[r.page][r.addr] = true;
+            }
+            mask = ((1 << r.leng) - 1) << r.offs;
+            buf[0] = (~mask & reg_shadow[r.page][r.addr]) | (mask & (((uint8_t)reg_value) << r.offs));
+        }
+    } else if ((r.offs == 0) && (r.leng > 0) && (r.leng <= 32)) {
+        size_byte = (r.leng + 7) / 8;
+        for (i = 0; i < size_byte; ++i) {
+            buf[i] = (uint8_t)(0x000000FF & reg_value);
+            reg_value = (reg_value >> 8);
+        }
+    } else {
+        DEBUG_MSG("ERROR: REGISTER SIZE AND OFFSET ARE NOT SUPPORTED\n");
+        return LGW_REG_ERROR;
+    }
+
+    for (i = 0; i < size_byte; ++i) {
+        if ((reg_shadow_valid[r.page][r.addr + i] == false) || (reg_shadow[r.page][r.addr + i] != buf[i])) {
+            reg_shadow[r.page][r.addr + i] = buf[i];
+            reg_shadow_valid[r.page][r.addr + i] = true;
+            changed = true;
+        }
+    }
+    if (changed == false) {
+        return spi_stat; /* concentrator already holds that value */
+    }
+
+    if (reg_batch == true) {
+        for (i = 0; i < size_byte; ++i) {
+            reg_shadow_dirty[r.page][r.addr + i] = true;
+        }
+        return spi_stat;
+    }
+
+    if (r.page != lgw_regpage) {
+        spi_stat += page_switch(r.page);
+    }
+    if (size_byte == 1) {
+        spi_stat += lgw_spi_w(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r.addr, buf[0]);
+    } else {
+        spi_stat += lgw_spi_wb(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r.addr, buf, size_byte);
+    }
+    return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* read a configuration register from the shadow, return false if unknown */
+static bool reg_r_cached(struct lgw_reg_s r, int32_t *reg_value) {
+    uint32_t u = 0;
+    int i, size_byte;
+
+    size_byte = ((r.offs + r.leng) <= 8) ? 1 : (r.leng + 7) / 8;
+    for (i = size_byte - 1; i >= 0; --i) {
+        if (reg_shadow_valid[r.page][r.addr + i] == false) {
+            return false;
+        }
+        u = (uint32_t)reg_shadow[r.page][r.addr + i] + (u << 8);
+    }
+    u = u >> r.offs;
+    if (r.sign == true) {
+        u = u << (32 - r.leng); /* left-align the data */
+        *reg_value = (int32_t)u >> (32 - r.leng); /* right-align the data with sign extension */
+    } else {
+        *reg_value = (int32_t)(u & (0xFFFFFFFF >> (32 - r.leng)));
+    }
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 bool check_fpga_version(uint8_t version) {
     int i;
 
@@ -565,6 +778,7 @@ int lgw_connect(bool spi_only, uint32_t tx_notch_freq) {
             lgw_regpage = 0;
         }
     }
+    reg_cache_clear();
 
     DEBUG_MSG("Note: success connecting the concentrator\n");
     return LGW_REG_SUCCESS;
@@ -577,6 +791,7 @@ int lgw_disconnect(void) {
     if (lgw_spi_target != NULL) {
         lgw_spi_close(lgw_spi_target);
         lgw_spi_target = NULL;
+        reg_cache_clear();
         DEBUG_MSG("Note: success disconnecting the concentrator\n");
         return LGW_REG_SUCCESS;
     } else {
@@ -596,6 +811,7 @@ int lgw_soft_reset(void) {
     }
     lgw_spi_w(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, 0, 0x80); /* 1 -> SOFT_RESET bit */
     lgw_regpage = 0; /* reset the paging static variable */
+    reg_cache_reset(); /* registers are back to their default values */
     return LGW_REG_SUCCESS;
 }
 
@@ -617,6 +833,12 @@ int lgw_reg_check(FILE *f) {
         return LGW_REG_ERROR;
     }
 
+    /* verify the concentrator itself, not the shadow */
+    if (reg_batch == true) {
+        reg_cache_flush();
+    }
+    reg_cache_clear();
+
     fprintf(f, "Start of register verification\n");
     for (i=0; i<LGW_TOTALREGS; ++i) {
         r = loregs[i];
@@ -651,6 +873,24 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
         return LGW_REG_ERROR;
     }
 
+    /* get register struct from the struct array */
+    r = loregs[register_id];
+
+    /* configuration registers go through the shadow */
+    if (reg_cacheable(&r) == true) {
+        spi_stat += reg_w_cached(r, reg_value);
+        if (spi_stat != LGW_SPI_SUCCESS) {
+            DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
+            return LGW_REG_ERROR;
+        }
+        return LGW_REG_SUCCESS;
+    }
+
+    /* keep ordering with deferred writes */
+    if (reg_batch == true) {
+        spi_stat += reg_cache_flush();
+    }
+
     /* intercept direct access to PAGE_REG & SOFT_RESET */
     if (register_id == LGW_PAGE_REG) {
         page_switch(reg_value);
@@ -662,15 +902,17 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
         return LGW_REG_SUCCESS;
     }
 
-    /* get register struct from the struct array */
-    r = loregs[register_id];
-
     /* reject write to read-only registers */
     if (r.rdon == 1){
         DEBUG_MSG("ERROR: TRYING TO WRITE A READ-ONLY REGISTER\n");
         return LGW_REG_ERROR;
     }
 
+    /* firmware gets or gives back access to the registers, shadow may be stale */
+    if ((register_id == LGW_EMERGENCY_FORCE_HOST_CTRL) || (register_id == LGW_MCU_RST_0) || (register_id == LGW_MCU_RST_1)) {
+        reg_cache_clear();
+    }
+
     /* select proper register page if needed */
     if ((r.page != -1) && (r.page != lgw_regpage)) {
         spi_stat += page_switch(r.page);
@@ -709,6 +951,16 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
     /* get register struct from the struct array */
     r = loregs[register_id];
 
+    /* configuration registers hold what the host wrote */
+    if ((reg_cacheable(&r) == true) && (reg_r_cached(r, reg_value) == true)) {
+        return LGW_REG_SUCCESS;
+    }
+
+    /* keep ordering with deferred writes */
+    if (reg_batch == true) {
+        spi_stat += reg_cache_flush();
+    }
+
     /* select proper register page if needed */
     if ((r.page != -1) && (r.page != lgw_regpage)) {
         spi_stat += page_switch(r.page);
@@ -757,6 +1009,14 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
         return LGW_REG_ERROR;
     }
 
+    /* keep ordering with deferred writes, burst bypasses the shadow */
+    if (reg_batch == true) {
+        spi_stat += reg_cache_flush();
+    }
+    if (r.page != -1) {
+        memset(&reg_shadow_valid[r.page][r.addr], 0, (size < 128 - r.addr) ? size : 128 - r.addr);
+    }
+
     /* select proper register page if needed */
     if ((r.page != -1) && (r.page != lgw_regpage)) {
         spi_stat += page_switch(r.page);
@@ -800,6 +1060,11 @@ int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
     /* get register struct from the struct array */
     r = loregs[register_id];
 
+    /* keep ordering with deferred writes */
+    if (reg_batch == true) {
+        spi_stat += reg_cache_flush();
+    }
+
     /* select proper register page if needed */
     if ((r.page != -1) && (r.page != lgw_regpage)) {
         spi_stat += page_switch(r.page);
@@ -816,4 +1081,124 @@ int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
     }
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Several burst reads and writes in one SPI transfer */
+int lgw_reg_xfer(const struct lgw_reg_seg *seg, int nb_seg) {
+    int spi_stat = LGW_SPI_SUCCESS;
+    struct lgw_spi_msg msg;
+    struct lgw_reg_s r;
+    int page = -1;
+    int i;
+
+    /* check input parameters */
+    CHECK_NULL(seg);
+    if ((nb_seg <= 0) || (nb_seg > LGW_SPI_MSG_MAX)) {
+        DEBUG_MSG("ERROR: INVALID NUMBER OF REGISTER ACCESSES\n");
+        return LGW_REG_ERROR;
+    }
+
+    /* check if SPI is initialised */
+    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+        DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+        return LGW_REG_ERROR;
+    }
+
+    /* check all accesses before touching the concentrator */
+    for (i = 0; i < nb_seg; ++i) {
+        if (seg[i].register_id >= LGW_TOTALREGS) {
+            DEBUG_MSG("ERROR: REGISTER NUMBER OUT OF DEFINED RANGE\n");
+            return LGW_REG_ERROR;
+        }
+        if ((seg[i].register_id == LGW_PAGE_REG) || (seg[i].register_id == LGW_SOFT_RESET)) {
+            DEBUG_MSG("ERROR: PAGE_REG AND SOFT_RESET CANNOT BE PART OF A TRANSFER\n");
+            return LGW_REG_ERROR;
+        }
+
+        /* get register struct from the struct array */
+        r = loregs[seg[i].register_id];
+        if ((seg[i].write != 0) && (r.rdon == 1)) {
+            DEBUG_MSG("ERROR: TRYING TO BURST WRITE A READ-ONLY REGISTER\n");
+            return LGW_REG_ERROR;
+        }
+        if (r.offs != 0) {
+            DEBUG_MSG("ERROR: REGISTER SIZE AND OFFSET ARE NOT SUPPORTED\n");
+            return LGW_REG_ERROR;
+        }
+        if (r.page != -1) {
+            if ((page != -1) && (page != r.page)) {
+                DEBUG_MSG("ERROR: REGISTERS OF A TRANSFER MUST BE ON THE SAME PAGE\n");
+                return LGW_REG_ERROR;
+            }
+            page = r.page;
+        }
+    }
+
+    /* keep ordering with deferred writes */
+    if (reg_batch == true) {
+        spi_stat += reg_cache_flush();
+    }
+
+    /* select proper register page if needed */
+    if ((page != -1) && (page != lgw_regpage)) {
+        spi_stat += page_switch(page);
+    }
+
+    lgw_spi_msg_init(&msg, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301);
+    for (i = 0; i < nb_seg; ++i) {
+        r = loregs[seg[i].register_id];
+        if (seg[i].write != 0) {
+            /* burst bypasses the shadow */
+            if (r.page != -1) {
+                memset(&reg_shadow_valid[r.page][r.addr], 0, (seg[i].size < 128 - r.addr) ? seg[i].size : 128 - r.addr);
+            }
+            spi_stat += lgw_spi_msg_wb(&msg, r.addr, seg[i].data, seg[i].size);
+        } else {
+            spi_stat += lgw_spi_msg_rb(&msg, r.addr, seg[i].data, seg[i].size);
+        }
+    }
+    spi_stat += lgw_spi_msg_submit(lgw_spi_target, &msg);
+
+    if (spi_stat != LGW_SPI_SUCCESS) {
+        DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER TRANSFER\n");
+        return LGW_REG_ERROR;
+    } else {
+        return LGW_REG_SUCCESS;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Defer configuration register writes */
+int lgw_reg_batch_begin(void) {
+    /* check if SPI is initialised */
+    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+        DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+        return LGW_REG_ERROR;
+    }
+
+    reg_batch = true;
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Write deferred configuration registers */
+int lgw_reg_batch_end(void) {
+    int spi_stat = LGW_SPI_SUCCESS;
+
+    if (reg_batch == false) {
+        return LGW_REG_SUCCESS;
+    }
+    spi_stat += reg_cache_flush();
+    reg_batch = false;
+
+    if (spi_stat != LGW_SPI_SUCCESS) {
+        DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BATCH WRITE\n");
+        return LGW_REG_ERROR;
+    } else {
+        return LGW_REG_SUCCESS;
+    }
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -26,7 +26,7 @@ Maintainer: Sylvain Miermont
 #include <stdlib.h>        /* malloc free */
 #include <unistd.h>        /* lseek, close */
 #include <fcntl.h>        /* open */
-#include <string.h>        /* memset */
+#include <string.h>        /* memset strlen strcpy */
 
 #include <sys/ioctl.h>
 #include <linux/spi/spidev.h>
@@ -56,6 +56,15 @@ Maintainer: Sylvain Miermont
 #define SPI_SPEED       8000000
 #define SPI_DEV_PATH    "/dev/spidev0.0"
 //#define SPI_DEV_PATH    "/dev/spidev32766.0"
+#define SPI_BUFSIZ_PATH "/sys/module/spidev/parameters/bufsiz"
+#define SPI_COMMAND_MAX 2       /* mux header + address byte */
+#define SPI_CHUNK_MIN   16
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static __thread uint16_t spi_chunk = LGW_BURST_CHUNK + SPI_COMMAND_MAX; /* largest message accepted by spidev, in bytes */
+static __thread char spi_path[LGW_SPI_PATH_MAX] = SPI_DEV_PATH; /* spidev opened by lgw_spi_open, per thread */
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
@@ -78,9 +87,10 @@ int lgw_spi_open(void **spi_target_ptr) {
     }
 
     /* open SPI device */
-    dev = open(SPI_DEV_PATH, O_RDWR);
+    dev = open(spi_path, O_RDWR);
     if (dev < 0) {
-        DEBUG_PRINTF("ERROR: failed to open SPI device %s\n", SPI_DEV_PATH);
+        DEBUG_PRINTF("ERROR: failed to open SPI device %s\n", spi_path);
+        free(spi_device);
         return LGW_SPI_ERROR;
     }
 
@@ -127,6 +137,9 @@ int lgw_spi_open(void **spi_target_ptr) {
         return LGW_SPI_ERROR;
     }
 
+    /* match burst chunks to the spidev buffer */
+    lgw_spi_set_chunk(0);
+
     *spi_device = dev;
     *spi_target_ptr = (void *)spi_device;
     DEBUG_MSG("Note: SPI port opened and configured ok\n");
@@ -135,6 +148,25 @@ int lgw_spi_open(void **spi_target_ptr) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_spi_set_path(const char *path) {
+    CHECK_NULL(path);
+
+    if (strlen(path) >= sizeof spi_path) {
+        DEBUG_PRINTF("ERROR: SPI device path %s too long\n", path);
+        return LGW_SPI_ERROR;
+    }
+    strcpy(spi_path, path);
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+const char *lgw_spi_get_path(void) {
+    return spi_path;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* SPI release */
 int lgw_spi_close(void *spi_target) {
     int spi_device;
@@ -301,8 +333,8 @@ int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
     k[0].cs_change = 0;
     k[1].cs_change = 0;
     for (i=0; size_to_do > 0; ++i) {
-        chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-        offset = i * LGW_BURST_CHUNK;
+        chunk_size = (size_to_do < spi_chunk - command_size) ? size_to_do : spi_chunk - command_size;
+        offset = size - size_to_do;
         k[1].tx_buf = (unsigned long)(data + offset);
         k[1].len = chunk_size;
         byte_transfered += (ioctl(spi_device, SPI_IOC_MESSAGE(2), &k) - k[0].len );
@@ -363,8 +395,8 @@ int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
     k[0].cs_change = 0;
     k[1].cs_change = 0;
     for (i=0; size_to_do > 0; ++i) {
-        chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-        offset = i * LGW_BURST_CHUNK;
+        chunk_size = (size_to_do < spi_chunk - command_size) ? size_to_do : spi_chunk - command_size;
+        offset = size - size_to_do;
         k[1].rx_buf = (unsigned long)(data + offset);
         k[1].len = chunk_size;
         byte_transfered += (ioctl(spi_device, SPI_IOC_MESSAGE(2), &k) - k[0].len );
@@ -382,4 +414,188 @@ int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
     }
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_set_chunk(uint16_t size) {
+    FILE *f;
+    unsigned bufsiz = 0;
+
+    if (size == 0) {
+        /* spidev rejects messages larger than its buffer */
+        f = fopen(SPI_BUFSIZ_PATH, "r");
+        if (f != NULL) {
+            if (fscanf(f, "%u", &bufsiz) != 1) {
+                bufsiz = 0;
+            }
+            fclose(f);
+        }
+        size = ((bufsiz > 0) && (bufsiz < 0xFFFF)) ? bufsiz : LGW_BURST_CHUNK + SPI_COMMAND_MAX;
+    }
+    if (size < SPI_CHUNK_MIN) {
+        DEBUG_PRINTF("ERROR: %u = INVALID SPI CHUNK SIZE\n", size);
+        return LGW_SPI_ERROR;
+    }
+    spi_chunk = size;
+    DEBUG_PRINTF("Note: SPI chunk size %u\n", spi_chunk);
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint16_t lgw_spi_get_chunk(void) {
+    return spi_chunk;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_spi_msg_init(struct lgw_spi_msg *msg, uint8_t spi_mux_mode, uint8_t spi_mux_target) {
+    msg->spi_mux_mode = spi_mux_mode;
+    msg->spi_mux_target = spi_mux_target;
+    msg->nb = 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* queue one transaction, data must fit in a chunk together with its command */
+static int spi_msg_add(struct lgw_spi_msg *msg, uint8_t access, uint8_t address, uint8_t *data, uint16_t size) {
+    int i;
+
+    if (msg->nb >= LGW_SPI_MSG_MAX) {
+        DEBUG_MSG("ERROR: SPI MESSAGE QUEUE FULL\n");
+        return LGW_SPI_ERROR;
+    }
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+
+    i = msg->nb++;
+    msg->acc[i].command[0] = msg->spi_mux_target;
+    msg->acc[i].command[1] = access | (address & 0x7F);
+    msg->acc[i].write = (access == WRITE_ACCESS) ? 1 : 0;
+    msg->acc[i].data = data;
+    msg->acc[i].size = size;
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* queue a burst, one transaction per chunk as lgw_spi_wb/rb do */
+static int spi_msg_add_burst(struct lgw_spi_msg *msg, uint8_t access, uint8_t address, uint8_t *data, uint16_t size) {
+    int chunk_size, offset;
+
+    CHECK_NULL(msg);
+    CHECK_NULL(data);
+    if (size == 0) {
+        DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+        return LGW_SPI_ERROR;
+    }
+    if (msg->nb + (size + spi_chunk - SPI_COMMAND_MAX - 1) / (spi_chunk - SPI_COMMAND_MAX) > LGW_SPI_MSG_MAX) {
+        DEBUG_MSG("ERROR: SPI MESSAGE QUEUE FULL\n");
+        return LGW_SPI_ERROR;
+    }
+    for (offset = 0; offset < size; offset += chunk_size) {
+        chunk_size = size - offset;
+        if (chunk_size > spi_chunk - SPI_COMMAND_MAX) {
+            chunk_size = spi_chunk - SPI_COMMAND_MAX;
+        }
+        spi_msg_add(msg, access, address, data + offset, chunk_size);
+    }
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_msg_w(struct lgw_spi_msg *msg, uint8_t address, uint8_t data) {
+    int i;
+
+    CHECK_NULL(msg);
+    i = msg->nb;
+    if (spi_msg_add(msg, WRITE_ACCESS, address, NULL, 1) != LGW_SPI_SUCCESS) {
+        return LGW_SPI_ERROR;
+    }
+    msg->acc[i].value = data;
+    msg->acc[i].data = &msg->acc[i].value;
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_msg_r(struct lgw_spi_msg *msg, uint8_t address, uint8_t *data) {
+    CHECK_NULL(msg);
+    CHECK_NULL(data);
+    return spi_msg_add(msg, READ_ACCESS, address, data, 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_msg_wb(struct lgw_spi_msg *msg, uint8_t address, uint8_t *data, uint16_t size) {
+    return spi_msg_add_burst(msg, WRITE_ACCESS, address, data, size);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_msg_rb(struct lgw_spi_msg *msg, uint8_t address, uint8_t *data, uint16_t size) {
+    return spi_msg_add_burst(msg, READ_ACCESS, address, data, size);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_msg_submit(void *spi_target, struct lgw_spi_msg *msg) {
+    int spi_device;
+    struct spi_ioc_transfer k[2 * LGW_SPI_MSG_MAX];
+    uint8_t command_size;
+    int first, i, n;
+    int expected, total, a;
+    int spi_stat = LGW_SPI_SUCCESS;
+
+    /* check input parameters */
+    CHECK_NULL(spi_target);
+    CHECK_NULL(msg);
+
+    spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
+    command_size = (msg->spi_mux_mode == LGW_SPI_MUX_MODE1) ? 2 : 1;
+
+    /* as many transactions per ioctl as the spidev buffer holds */
+    for (first = 0; first < msg->nb; first += n) {
+        memset(&k, 0, sizeof(k)); /* clear k */
+        total = 0;
+        for (n = 0; first + n < msg->nb; ++n) {
+            i = first + n;
+            if ((n > 0) && (total + command_size + msg->acc[i].size > spi_chunk)) {
+                break;
+            }
+            k[2*n].tx_buf = (unsigned long) &msg->acc[i].command[2 - command_size];
+            k[2*n].len = command_size;
+            if (msg->acc[i].write) {
+                k[2*n+1].tx_buf = (unsigned long) msg->acc[i].data;
+            } else {
+                k[2*n+1].rx_buf = (unsigned long) msg->acc[i].data;
+            }
+            k[2*n+1].len = msg->acc[i].size;
+            k[2*n+1].cs_change = 1; /* end of transaction, release chip select */
+            total += command_size + msg->acc[i].size;
+        }
+        k[2*n-1].cs_change = 0; /* chip select released at end of message anyway */
+        expected = total;
+
+        /* I/O transaction */
+        a = ioctl(spi_device, SPI_IOC_MESSAGE(2 * n), &k);
+        if (a != expected) {
+            spi_stat = LGW_SPI_ERROR;
+            break;
+        }
+        DEBUG_PRINTF("SPI MESSAGE: %d transactions, %d bytes\n", n, total);
+    }
+    msg->nb = 0;
+
+    /* determine return code */
+    if (spi_stat != LGW_SPI_SUCCESS) {
+        DEBUG_MSG("ERROR: SPI MESSAGE FAILURE\n");
+        return LGW_SPI_ERROR;
+    } else {
+        DEBUG_MSG("Note: SPI message success\n");
+        return LGW_SPI_SUCCESS;
+    }
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,312 @@
+/**
+ * \file log_rotate.c
+ * \brief Background log rotation of LoRaWAN packet logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE /* SCHED_IDLE */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "log_rotate.h"
+
+#define MSG(args...) fprintf(stderr,"cesnet_pkt_analyzer: " args)
+
+/** 
+ * LogRotate
+ * Caller thread only swaps pointer to current files. LO_PREOPEN_S seconds 
+ * before rotation the worker opens files of next period and writes their 
+ * header, at rotation time the ready slot becomes current one and previous 
+ * slot is handed back. Worker closes it (flushing its writer), queues file 
+ * names for compression and runs the compressor as idle priority child 
+ * process. When the next file is not ready in time, rows go on to the 
+ * current file until it is, fetch loop never waits.
+ */
+
+static int lo_state(const struct lo_file *f) {
+    return __atomic_load_n(&f->state, __ATOMIC_ACQUIRE);
+}
+
+static void lo_set_state(struct lo_file *f, int state) {
+    __atomic_store_n(&f->state, state, __ATOMIC_RELEASE);
+}
+
+/** Queue closed file for compression, called with lock held */
+static void lo_enqueue(struct lo_rotator *r, const char *name) {
+    if (r->compress == LO_COMPRESS_NONE || name[0] == '\0')
+        return;
+    if (r->q_head - r->q_tail >= LO_QUEUE) {
+        MSG("WARNING: compression queue full, %s stays uncompressed\n", name);
+        return;
+    }
+    strcpy(r->queue[r->q_head % LO_QUEUE], name);
+    r->q_head++;
+}
+
+/** Compress file by external tool in idle priority child, original is removed by the tool */
+static void lo_compress(int compress, const char *name) {
+    pid_t pid;
+    int status;
+
+    pid = fork();
+    if (pid == 0) {
+        setpriority(PRIO_PROCESS, 0, 19);
+        if (compress == LO_COMPRESS_ZSTD)
+            execlp("zstd", "zstd", "-q", "-f", "--rm", name, (char *) NULL);
+        else
+            execlp("gzip", "gzip", "-q", "-f", name, (char *) NULL);
+        _exit(127);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        MSG("WARNING: failed to compress %s\n", name);
+}
+
+/** Close files of slot, called without lock, slot is owned by worker */
+static void lo_close(struct lo_rotator *r, struct lo_file *f) {
+    if (cw_close(&f->log) != 0)
+        MSG("WARNING: failed to write log file %s\n", f->log_name);
+    if (f->cap_on && pc_close(&f->cap) != 0)
+        MSG("WARNING: failed to write capture file %s\n", f->cap_name);
+    MSG("INFO: log file %s closed, %lu packet(s) recorded\n", f->log_name, f->rows);
+    pthread_mutex_lock(&r->lock);
+    lo_enqueue(r, f->log_name);
+    if (f->cap_on)
+        lo_enqueue(r, f->cap_name);
+    lo_set_state(f, LO_FREE);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void *lo_thread(void *arg) {
+    struct lo_rotator *r = (struct lo_rotator *) arg;
+    struct sched_param sp;
+    char name[LO_NAME_MAX];
+    bool busy;
+    int i;
+
+    /* rotation work must never compete with fetch loop */
+    memset(&sp, 0, sizeof sp);
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+
+    pthread_mutex_lock(&r->lock);
+    while (1) {
+        busy = false;
+        for (i = 0; i < LO_SLOTS; i++) {
+            struct lo_file *f = &r->slot[i];
+
+            if (lo_state(f) == LO_OPENING) {
+                pthread_mutex_unlock(&r->lock);
+                f->rows = 0;
+                f->cap_on = r->cap_on;
+                lo_set_state(f, (r->open_file(f) == 0) ? LO_READY : LO_FAILED);
+                pthread_mutex_lock(&r->lock);
+                busy = true;
+            } else if (lo_state(f) == LO_CLOSING) {
+                pthread_mutex_unlock(&r->lock);
+                lo_close(r, f);
+                pthread_mutex_lock(&r->lock);
+                busy = true;
+            }
+        }
+        if (busy)
+            continue;
+        if (r->q_tail != r->q_head) {
+            strcpy(name, r->queue[r->q_tail % LO_QUEUE]);
+            r->q_tail++;
+            pthread_mutex_unlock(&r->lock);
+            lo_compress(r->compress, name);
+            pthread_mutex_lock(&r->lock);
+            continue;
+        }
+        if (r->stop)
+            break;
+        pthread_cond_wait(&r->cond, &r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+static void lo_wake(struct lo_rotator *r) {
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/**
+ * Return compression mode of name (none, gzip, zstd), -1 if unknown.
+ * name - Compression name
+ */
+int lo_parse_compress(const char *name) {
+    if (!strcmp(name, "none"))
+        return LO_COMPRESS_NONE;
+    if (!strcmp(name, "gzip"))
+        return LO_COMPRESS_GZIP;
+    if (!strcmp(name, "zstd"))
+        return LO_COMPRESS_ZSTD;
+    return -1;
+}
+
+/**
+ * Open first files in caller thread and start worker. Return 0 on success, 
+ * -1 if files could not be opened or worker started.
+ * r         - An pointer to rotator
+ * interval  - Rotation period in seconds, -1 disables rotation
+ * compress  - LO_COMPRESS_NONE, LO_COMPRESS_GZIP or LO_COMPRESS_ZSTD
+ * cap_on    - Open capture file with log file
+ * open_file - Callback opening files of slot
+ * now       - Current time, start of first period
+ */
+int lo_start(struct lo_rotator *r, int interval, int compress, bool cap_on, lo_open_fn open_file, time_t now) {
+    memset(r, 0, sizeof *r);
+    r->interval = interval;
+    r->compress = compress;
+    r->cap_on = cap_on;
+    r->open_file = open_file;
+
+    r->cur = &r->slot[0];
+    r->cur->start = now;
+    r->cur->cap_on = cap_on;
+    if (open_file(r->cur) != 0)
+        return -1;
+    lo_set_state(r->cur, LO_ACTIVE);
+
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (pthread_create(&r->tid, NULL, lo_thread, r) != 0) {
+        cw_close(&r->cur->log);
+        if (cap_on)
+            pc_close(&r->cur->cap);
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->cond);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Rotate files when period is over, never blocks on file operations. 
+ * Return files rows are written to.
+ * r   - An pointer to rotator
+ * now - Current time
+ */
+struct lo_file *lo_tick(struct lo_rotator *r, time_t now) {
+    struct lo_file *old;
+    time_t end;
+    int i;
+
+    if (r->interval < 0)
+        return r->cur;
+    end = r->cur->start + r->interval;
+    if (now < end - LO_PREOPEN_S)
+        return r->cur;
+
+    /* request next files ahead of rotation */
+    if (r->next != NULL && lo_state(r->next) == LO_FAILED) {
+        lo_set_state(r->next, LO_FREE);
+        r->next = NULL;
+        r->retry_at = now + 1;
+    }
+    if (r->next == NULL && now >= r->retry_at) {
+        for (i = 0; i < LO_SLOTS; i++) {
+            if (lo_state(&r->slot[i]) == LO_FREE) {
+                r->next = &r->slot[i];
+                r->next->start = (now > end) ? now : end;
+                lo_set_state(r->next, LO_OPENING);
+                lo_wake(r);
+                break;
+            }
+        }
+    }
+
+    /* swap at rotation time once next files are ready */
+    if (now > end && r->next != NULL && lo_state(r->next) == LO_READY) {
+        old = r->cur;
+        r->cur = r->next;
+        r->next = NULL;
+        lo_set_state(r->cur, LO_ACTIVE);
+        lo_set_state(old, LO_CLOSING);
+        lo_wake(r);
+    }
+    return r->cur;
+}
+
+/**
+ * Close all files and stop worker once closed files are compressed. 
+ * Return 0 on success, -1 if current log file could not be written.
+ * r - An pointer to rotator
+ */
+int lo_stop(struct lo_rotator *r) {
+    int i, ret;
+
+    pthread_mutex_lock(&r->lock);
+    r->stop = true;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+
+    /* worker drains queue, then pre-opened files are dropped and current is closed here */
+    pthread_join(r->tid, NULL);
+    for (i = 0; i < LO_SLOTS; i++) {
+        struct lo_file *f = &r->slot[i];
+
+        if (lo_state(f) == LO_READY) {
+            cw_close(&f->log);
+            unlink(f->log_name);
+            if (f->cap_on) {
+                pc_close(&f->cap);
+                unlink(f->cap_name);
+            }
+            lo_set_state(f, LO_FREE);
+        }
+    }
+    ret = cw_close(&r->cur->log);
+    if (ret != 0)
+        MSG("WARNING: failed to write log file %s\n", r->cur->log_name);
+    if (r->cur->cap_on && pc_close(&r->cur->cap) != 0)
+        MSG("WARNING: failed to write capture file %s\n", r->cur->cap_name);
+    MSG("INFO: log file %s closed, %lu packet(s) recorded\n", r->cur->log_name, r->cur->rows);
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+    return ret;
+}
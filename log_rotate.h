@@ -0,0 +1,143 @@
+/**
+ * \file log_rotate.h
+ * \brief Background log rotation of LoRaWAN packet logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "csv_writer.h"
+#include "pkt_capture.h"
+
+#ifndef LOG_ROTATE_H
+#define LOG_ROTATE_H
+
+/** Files of one period: active, pre-opened next and closing previous */
+#define LO_SLOTS 3
+
+/** Closed files waiting for compression */
+#define LO_QUEUE 8
+
+/** Next file is opened this many seconds before rotation */
+#define LO_PREOPEN_S 5
+
+#define LO_NAME_MAX 64
+
+/** 
+ * Define compression of rotated files:
+ *   0 - None   files are kept as written
+ *   1 - Gzip   gzip -f
+ *   2 - Zstd   zstd --rm -f
+ */
+#define LO_COMPRESS_NONE 0
+#define LO_COMPRESS_GZIP 1
+#define LO_COMPRESS_ZSTD 2
+
+/** File slot states, FAILED slot is opened again after one second */
+#define LO_FREE 0
+#define LO_OPENING 1
+#define LO_READY 2
+#define LO_ACTIVE 3
+#define LO_CLOSING 4
+#define LO_FAILED 5
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** 
+     * Define structure for files of one rotation period. Open callback 
+     * names them after start, opens log (and capture when cap_on) and 
+     * writes header.
+     */
+    struct lo_file {
+        struct cw_writer log;
+        struct pc_writer cap;
+        bool cap_on;
+        time_t start;
+        unsigned long rows;
+        char log_name[LO_NAME_MAX];
+        char cap_name[LO_NAME_MAX];
+        int state;
+    };
+
+    typedef int (*lo_open_fn)(struct lo_file *f);
+
+    /** 
+     * Define structure for log rotator. Only cur is used by caller thread, 
+     * worker opens, closes and compresses files of other slots.
+     */
+    struct lo_rotator {
+        struct lo_file slot[LO_SLOTS];
+        struct lo_file *cur;
+        struct lo_file *next;
+        int interval;
+        int compress;
+        bool cap_on;
+        lo_open_fn open_file;
+        time_t retry_at;
+        char queue[LO_QUEUE][LO_NAME_MAX];
+        uint32_t q_head;
+        uint32_t q_tail;
+        bool stop;
+        pthread_t tid;
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+    };
+
+    int lo_parse_compress(const char *name);
+    int lo_start(struct lo_rotator *r, int interval, int compress, bool cap_on, lo_open_fn open_file, time_t now);
+    struct lo_file *lo_tick(struct lo_rotator *r, time_t now);
+    int lo_stop(struct lo_rotator *r);
+
+    /** 
+     * The lo_current() return files rows are written to.
+     */
+    static inline struct lo_file *lo_current(struct lo_rotator *r) {
+        return r->cur;
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOG_ROTATE_H */
@@ -62,12 +62,32 @@
 #include <stdlib.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <libtrap/trap.h>
 #include <unirec/unirec.h>
 #include "fields.h"
 #include "lora_packet.h"
 #include <string.h>
 #include "device_list.h"
+#include "duty_cycle.h"
+#include "rx_scheduler.h"
+#include "pkt_ring.h"
+#include "counter_store.h"
+#include "hex.h"
+#include "session_keys.h"
+#include "join_session.h"
+#include "gw_config.h"
+#include "gps_ref.h"
+#include "pkt_source.h"
+#include "latency.h"
+#include "metrics.h"
+#include "multi_board.h"
+#include "dedup.h"
+#include "pkt_filter.h"
+#include "shard.h"
+#include "rt_profile.h"
+#include "jit_queue.h"
+#include "downlink.h"
 
 #include "parson.h"
 #include "libloragw/inc/loragw_hal.h"
@@ -80,13 +100,11 @@
 #define MSG(args...) fprintf(stderr,"cesnet_pkt_analyzer: " args)
 
 /* signal handling variables */
-struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
+struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM&SIGHUP signal handling */
 static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
 static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
-
-struct counterLOG {
-    int cnt_pkt_log, cnt_bad_pkt_log, cnt_all_pkt_log;
-};
+static volatile sig_atomic_t reload_sig = 0; /* 1 -> configuration files are parsed again and changes applied */
+static volatile sig_atomic_t dump_sig = 0; /* 1 -> latency histograms are printed */
 
 /* configuration variables needed by the application  */
 uint64_t lgwm = 0; /* LoRa gateway MAC address */
@@ -99,20 +117,17 @@ FILE * log_file = NULL;
 char log_file_name[64];
 
 /* Default variables for count logger */
-FILE * log_count = NULL;
-struct counterLOG st_counter;
 int cl = 0;
+int cl_sync = CS_DEFAULT_SYNC;
+
+/* Default variables for receive scheduler */
+int rx_mode = RS_MODE_FIXED;
+int rx_gpio = -1;
 
 /** Private function declaration */
 static void sig_handler(int sigio);
-int parse_SX1301_configuration(const char * conf_file);
-int parse_gateway_configuration(const char * conf_file);
 void usage(void);
 
-/* Logger function declaration */
-void start_log(void);
-void change_log(void);
-
 /** Private function definition */
 static void sig_handler(int sigio) {
     if (sigio == SIGQUIT) {
@@ -120,300 +135,13 @@ static void sig_handler(int sigio) {
         ;
     } else if ((sigio == SIGINT) || (sigio == SIGTERM)) {
         exit_sig = 1;
+    } else if (sigio == SIGHUP) {
+        reload_sig = 1;
+    } else if (sigio == SIGUSR1) {
+        dump_sig = 1;
     }
 }
 
-int parse_SX1301_configuration(const char * conf_file) {
-    int i;
-    const char conf_obj[] = "SX1301_conf";
-    char param_name[32]; /* used to generate variable parameter names */
-    const char *str; /* used to store string value from JSON object */
-    struct lgw_conf_board_s boardconf;
-    struct lgw_conf_rxrf_s rfconf;
-    struct lgw_conf_rxif_s ifconf;
-    JSON_Value *root_val;
-    JSON_Object *root = NULL;
-    JSON_Object *conf = NULL;
-    JSON_Value *val;
-    uint32_t sf, bw;
-
-    /* try to parse JSON */
-    root_val = json_parse_file_with_comments(conf_file);
-    root = json_value_get_object(root_val);
-    if (root == NULL) {
-        MSG("ERROR: %s id not a valid JSON file\n", conf_file);
-        exit(EXIT_FAILURE);
-    }
-    conf = json_object_get_object(root, conf_obj);
-    if (conf == NULL) {
-        MSG("INFO: %s does not contain a JSON object named %s\n", conf_file, conf_obj);
-        return -1;
-    } else {
-        MSG("INFO: %s does contain a JSON object named %s, parsing SX1301 parameters\n", conf_file, conf_obj);
-    }
-
-    /* set board configuration */
-    memset(&boardconf, 0, sizeof boardconf); /* initialize configuration structure */
-    val = json_object_get_value(conf, "lorawan_public"); /* fetch value (if possible) */
-    if (json_value_get_type(val) == JSONBoolean) {
-        boardconf.lorawan_public = (bool) json_value_get_boolean(val);
-    } else {
-        MSG("WARNING: Data type for lorawan_public seems wrong, please check\n");
-        boardconf.lorawan_public = false;
-    }
-    val = json_object_get_value(conf, "clksrc"); /* fetch value (if possible) */
-    if (json_value_get_type(val) == JSONNumber) {
-        boardconf.clksrc = (uint8_t) json_value_get_number(val);
-    } else {
-        MSG("WARNING: Data type for clksrc seems wrong, please check\n");
-        boardconf.clksrc = 0;
-    }
-    MSG("INFO: lorawan_public %d, clksrc %d\n", boardconf.lorawan_public, boardconf.clksrc);
-    /* all parameters parsed, submitting configuration to the HAL */
-    if (lgw_board_setconf(boardconf) != LGW_HAL_SUCCESS) {
-        MSG("WARNING: Failed to configure board\n");
-    }
-
-    /* set configuration for RF chains */
-    for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
-        memset(&rfconf, 0, sizeof (rfconf)); /* initialize configuration structure */
-        sprintf(param_name, "radio_%i", i); /* compose parameter path inside JSON structure */
-        val = json_object_get_value(conf, param_name); /* fetch value (if possible) */
-        if (json_value_get_type(val) != JSONObject) {
-            MSG("INFO: no configuration for radio %i\n", i);
-            continue;
-        }
-        /* there is an object to configure that radio, let's parse it */
-        sprintf(param_name, "radio_%i.enable", i);
-        val = json_object_dotget_value(conf, param_name);
-        if (json_value_get_type(val) == JSONBoolean) {
-            rfconf.enable = (bool) json_value_get_boolean(val);
-        } else {
-            rfconf.enable = false;
-        }
-        if (rfconf.enable == false) { /* radio disabled, nothing else to parse */
-            MSG("INFO: radio %i disabled\n", i);
-        } else { /* radio enabled, will parse the other parameters */
-            snprintf(param_name, sizeof param_name, "radio_%i.freq", i);
-            rfconf.freq_hz = (uint32_t) json_object_dotget_number(conf, param_name);
-            snprintf(param_name, sizeof param_name, "radio_%i.rssi_offset", i);
-            rfconf.rssi_offset = (float) json_object_dotget_number(conf, param_name);
-            snprintf(param_name, sizeof param_name, "radio_%i.type", i);
-            str = json_object_dotget_string(conf, param_name);
-            if (!strncmp(str, "SX1255", 6)) {
-                rfconf.type = LGW_RADIO_TYPE_SX1255;
-            } else if (!strncmp(str, "SX1257", 6)) {
-                rfconf.type = LGW_RADIO_TYPE_SX1257;
-            } else {
-                MSG("WARNING: invalid radio type: %s (should be SX1255 or SX1257)\n", str);
-            }
-            snprintf(param_name, sizeof param_name, "radio_%i.tx_enable", i);
-            val = json_object_dotget_value(conf, param_name);
-            if (json_value_get_type(val) == JSONBoolean) {
-                rfconf.tx_enable = (bool) json_value_get_boolean(val);
-            } else {
-                rfconf.tx_enable = false;
-            }
-            MSG("INFO: radio %i enabled (type %s), center frequency %u, RSSI offset %f, tx enabled %d\n", i, str, rfconf.freq_hz, rfconf.rssi_offset, rfconf.tx_enable);
-        }
-        /* all parameters parsed, submitting configuration to the HAL */
-        if (lgw_rxrf_setconf(i, rfconf) != LGW_HAL_SUCCESS) {
-            MSG("WARNING: invalid configuration for radio %i\n", i);
-        }
-    }
-
-    /* set configuration for LoRa multi-SF channels (bandwidth cannot be set) */
-    for (i = 0; i < LGW_MULTI_NB; ++i) {
-        memset(&ifconf, 0, sizeof (ifconf)); /* initialize configuration structure */
-        sprintf(param_name, "chan_multiSF_%i", i); /* compose parameter path inside JSON structure */
-        val = json_object_get_value(conf, param_name); /* fetch value (if possible) */
-        if (json_value_get_type(val) != JSONObject) {
-            MSG("INFO: no configuration for LoRa multi-SF channel %i\n", i);
-            continue;
-        }
-        /* there is an object to configure that LoRa multi-SF channel, let's parse it */
-        sprintf(param_name, "chan_multiSF_%i.enable", i);
-        val = json_object_dotget_value(conf, param_name);
-        if (json_value_get_type(val) == JSONBoolean) {
-            ifconf.enable = (bool) json_value_get_boolean(val);
-        } else {
-            ifconf.enable = false;
-        }
-        if (ifconf.enable == false) { /* LoRa multi-SF channel disabled, nothing else to parse */
-            MSG("INFO: LoRa multi-SF channel %i disabled\n", i);
-        } else { /* LoRa multi-SF channel enabled, will parse the other parameters */
-            sprintf(param_name, "chan_multiSF_%i.radio", i);
-            ifconf.rf_chain = (uint32_t) json_object_dotget_number(conf, param_name);
-            sprintf(param_name, "chan_multiSF_%i.if", i);
-            ifconf.freq_hz = (int32_t) json_object_dotget_number(conf, param_name);
-            // TODO: handle individual SF enabling and disabling (spread_factor)
-            MSG("INFO: LoRa multi-SF channel %i enabled, radio %i selected, IF %i Hz, 125 kHz bandwidth, SF 7 to 12\n", i, ifconf.rf_chain, ifconf.freq_hz);
-        }
-        /* all parameters parsed, submitting configuration to the HAL */
-        if (lgw_rxif_setconf(i, ifconf) != LGW_HAL_SUCCESS) {
-            MSG("WARNING: invalid configuration for LoRa multi-SF channel %i\n", i);
-        }
-    }
-
-    /* set configuration for LoRa standard channel */
-    memset(&ifconf, 0, sizeof (ifconf)); /* initialize configuration structure */
-    val = json_object_get_value(conf, "chan_Lora_std"); /* fetch value (if possible) */
-    if (json_value_get_type(val) != JSONObject) {
-        MSG("INFO: no configuration for LoRa standard channel\n");
-    } else {
-        val = json_object_dotget_value(conf, "chan_Lora_std.enable");
-        if (json_value_get_type(val) == JSONBoolean) {
-            ifconf.enable = (bool) json_value_get_boolean(val);
-        } else {
-            ifconf.enable = false;
-        }
-        if (ifconf.enable == false) {
-            MSG("INFO: LoRa standard channel %i disabled\n", i);
-        } else {
-            ifconf.rf_chain = (uint32_t) json_object_dotget_number(conf, "chan_Lora_std.radio");
-            ifconf.freq_hz = (int32_t) json_object_dotget_number(conf, "chan_Lora_std.if");
-            bw = (uint32_t) json_object_dotget_number(conf, "chan_Lora_std.bandwidth");
-            switch (bw) {
-                case 500000: ifconf.bandwidth = BW_500KHZ;
-                    break;
-                case 250000: ifconf.bandwidth = BW_250KHZ;
-                    break;
-                case 125000: ifconf.bandwidth = BW_125KHZ;
-                    break;
-                default: ifconf.bandwidth = BW_UNDEFINED;
-            }
-            sf = (uint32_t) json_object_dotget_number(conf, "chan_Lora_std.spread_factor");
-            switch (sf) {
-                case 7: ifconf.datarate = DR_LORA_SF7;
-                    break;
-                case 8: ifconf.datarate = DR_LORA_SF8;
-                    break;
-                case 9: ifconf.datarate = DR_LORA_SF9;
-                    break;
-                case 10: ifconf.datarate = DR_LORA_SF10;
-                    break;
-                case 11: ifconf.datarate = DR_LORA_SF11;
-                    break;
-                case 12: ifconf.datarate = DR_LORA_SF12;
-                    break;
-                default: ifconf.datarate = DR_UNDEFINED;
-            }
-            MSG("INFO: LoRa standard channel enabled, radio %i selected, IF %i Hz, %u Hz bandwidth, SF %u\n", ifconf.rf_chain, ifconf.freq_hz, bw, sf);
-        }
-        if (lgw_rxif_setconf(8, ifconf) != LGW_HAL_SUCCESS) {
-            MSG("WARNING: invalid configuration for LoRa standard channel\n");
-        }
-    }
-
-    /* set configuration for FSK channel */
-    memset(&ifconf, 0, sizeof (ifconf)); /* initialize configuration structure */
-    val = json_object_get_value(conf, "chan_FSK"); /* fetch value (if possible) */
-    if (json_value_get_type(val) != JSONObject) {
-        MSG("INFO: no configuration for FSK channel\n");
-    } else {
-        val = json_object_dotget_value(conf, "chan_FSK.enable");
-        if (json_value_get_type(val) == JSONBoolean) {
-            ifconf.enable = (bool) json_value_get_boolean(val);
-        } else {
-            ifconf.enable = false;
-        }
-        if (ifconf.enable == false) {
-            MSG("INFO: FSK channel %i disabled\n", i);
-        } else {
-            ifconf.rf_chain = (uint32_t) json_object_dotget_number(conf, "chan_FSK.radio");
-            ifconf.freq_hz = (int32_t) json_object_dotget_number(conf, "chan_FSK.if");
-            bw = (uint32_t) json_object_dotget_number(conf, "chan_FSK.bandwidth");
-            if (bw <= 7800) ifconf.bandwidth = BW_7K8HZ;
-            else if (bw <= 15600) ifconf.bandwidth = BW_15K6HZ;
-            else if (bw <= 31200) ifconf.bandwidth = BW_31K2HZ;
-            else if (bw <= 62500) ifconf.bandwidth = BW_62K5HZ;
-            else if (bw <= 125000) ifconf.bandwidth = BW_125KHZ;
-            else if (bw <= 250000) ifconf.bandwidth = BW_250KHZ;
-            else if (bw <= 500000) ifconf.bandwidth = BW_500KHZ;
-            else ifconf.bandwidth = BW_UNDEFINED;
-            ifconf.datarate = (uint32_t) json_object_dotget_number(conf, "chan_FSK.datarate");
-            MSG("INFO: FSK channel enabled, radio %i selected, IF %i Hz, %u Hz bandwidth, %u bps datarate\n", ifconf.rf_chain, ifconf.freq_hz, bw, ifconf.datarate);
-        }
-        if (lgw_rxif_setconf(9, ifconf) != LGW_HAL_SUCCESS) {
-            MSG("WARNING: invalid configuration for FSK channel\n");
-        }
-    }
-    json_value_free(root_val);
-    return 0;
-}
-
-int parse_gateway_configuration(const char * conf_file) {
-    const char conf_obj[] = "gateway_conf";
-    JSON_Value *root_val;
-    JSON_Object *root = NULL;
-    JSON_Object *conf = NULL;
-    const char *str; /* pointer to sub-strings in the JSON data */
-    unsigned long long ull = 0;
-
-    /* try to parse JSON */
-    root_val = json_parse_file_with_comments(conf_file);
-    root = json_value_get_object(root_val);
-    if (root == NULL) {
-        MSG("ERROR: %s id not a valid JSON file\n", conf_file);
-        exit(EXIT_FAILURE);
-    }
-    conf = json_object_get_object(root, conf_obj);
-    if (conf == NULL) {
-        MSG("INFO: %s does not contain a JSON object named %s\n", conf_file, conf_obj);
-        return -1;
-    } else {
-        MSG("INFO: %s does contain a JSON object named %s, parsing gateway parameters\n", conf_file, conf_obj);
-    }
-
-    /* getting network parameters (only those necessary for the packet logger) */
-    str = json_object_get_string(conf, "gateway_ID");
-    if (str != NULL) {
-        sscanf(str, "%llx", &ull);
-        lgwm = ull;
-        MSG("INFO: gateway MAC address is configured to %016llX\n", ull);
-    }
-
-    json_value_free(root_val);
-    return 0;
-}
-
-void start_log(void){
-    /* Check module parameter argument for append count logger */
-    if (cl != 1)
-        return;
-    
-    /* Check exist count log file */
-    if ((log_count = fopen("count.log", "rb+")) == NULL) {
-        if ((log_count = fopen("count.log", "wb+")) == NULL) {
-            printf("ERROR: failed to create file 'count.log'\n");
-            exit(EXIT_FAILURE);
-        } else
-            printf("INFO: creating count log binary file 'count.log'\n");
-    }
-    
-    /* Read binary file */
-    fread(&st_counter, sizeof (struct counterLOG), 1, log_count);
-
-    printf("INFO: cnt_pkt_log: %d\tcnt_bad_pkt_log: %d\tcnt_all_pkt_log: %d\n", st_counter.cnt_pkt_log, st_counter.cnt_bad_pkt_log, st_counter.cnt_all_pkt_log);
-
-    /* Moves the cursor to the start of the file */
-    fseek(log_count, -sizeof (struct counterLOG), SEEK_CUR);
-    
-    return;
-}
-
-void change_log(void) {
-    /* Check module parameter argument for append count logger */
-    if (cl != 1)
-        return;
-    
-    /* Write data to binary file */
-    fwrite(&st_counter, sizeof (struct counterLOG), 1, log_count);
-    fflush(log_count);
-    
-    return;
-}
-
 /* describe command line options */
 void usage(void) {
     printf("*** Library version information ***\n%s\n\n", lgw_version_info());
@@ -422,13 +150,6 @@ void usage(void) {
     printf(" -r <int> rotate log file every N seconds (-1 disable log rotation)\n");
 }
 
-/** Define structure for DeviceList */
-struct dl_device {
-    uint64_t DEV_ADDR;
-    double BASE_RSSI;
-    struct dl_device *next;
-};
-
 /** 
  * Statically defined fields contain time stamp record TIMESTAMP, device address  
  * DEV_ADDR, received signal strength Indicator RSSI, base received signal strength 
@@ -442,11 +163,19 @@ UR_FIELDS(
         uint32 CODE_RATE,
         uint64 TIMESTAMP,
         string PHY_PAYLOAD,
-        double RSSI
-        //        string DEV_ADDR,
-        //        double BASE_RSSI,
-        //        double VARIANCE
-        //        string GW_ID,
+        bytes PHY_PAYLOAD_BIN,
+        time RX_TIME,
+        double RSSI,
+        uint8 MIC_STATUS,
+        string DEV_ADDR,
+        double BASE_RSSI,
+        double VARIANCE,
+        double DUTY_CYCLE,
+        double CH_UTIL,
+        uint8 DUTY_VIOLATION,
+        uint64 GW_ID,
+        string GW_LIST,
+        uint32 COPIES
         //        string NODE_MAC,
         //        uint32 US_COUNT,
         //        uint32 FRQ,
@@ -474,6 +203,114 @@ UR_FIELDS(
 
 trap_module_info_t *module_info = NULL;
 
+/** Output UniRec template and record */
+ur_template_t *out_tmplt = NULL;
+void *out_rec = NULL;
+
+/* count the number of exported packets */
+unsigned long pkt_in_log = 0;
+
+/** 
+ * Define payload output modes:
+ *   0 - PHY_PAYLOAD hex string only (default, compatible template)
+ *   1 - PHY_PAYLOAD hex string and PHY_PAYLOAD_BIN raw bytes
+ *   2 - PHY_PAYLOAD_BIN raw bytes only
+ */
+#define PAYLOAD_STRING 0
+#define PAYLOAD_BOTH 1
+#define PAYLOAD_BYTES 2
+
+int payload_mode = PAYLOAD_STRING;
+
+/** 
+ * Define MIC verification modes:
+ *   0 - no verification (default)
+ *   1 - verify and mark record by MIC_STATUS field
+ *   2 - verify and drop frames with invalid MIC before send
+ * MIC_STATUS values, frames of devices without known key are not checked.
+ */
+#define MIC_OFF 0
+#define MIC_MARK 1
+#define MIC_DROP 2
+
+#define MIC_STATUS_UNCHECKED 0
+#define MIC_STATUS_VALID 1
+#define MIC_STATUS_INVALID 2
+
+int mic_mode = MIC_OFF;
+char *key_file = SK_DEFAULT_FILE;
+uint64_t mic_invalid = 0;
+
+/* AppKey file of OTAA devices, sessions are learned from join exchanges, empty disables it */
+char *app_key_file = "";
+int join_on = 0;
+
+/* Per device RSSI statistics, add DEV_ADDR, BASE_RSSI and VARIANCE to output */
+int dev_stats = 0;
+
+/* Duty cycle limit in percent, 0 disables duty cycle accounting */
+double duty_limit = 0.0;
+
+/* Device registry is kept for statistics and duty cycle accounting */
+int track_devices = 0;
+
+/* Device table budget, idle timeout in minutes, 0 disables the limit */
+uint32_t dev_idle = 60;
+uint32_t dev_max = 0;
+uint32_t dev_mem = 0;
+
+/* Device table snapshot for warm restart, empty file name disables it */
+char *dev_snap = "";
+int dev_snap_sync = DL_SNAP_DEFAULT_SYNC;
+
+/* Default variables for batched send, -1 keep libtrap default buffering */
+int send_timeout[SH_MAX_SHARDS] = {[0 ... SH_MAX_SHARDS - 1] = -1};
+
+/* Output interfaces, records of one device always go to the same one */
+uint32_t out_shards = 1;
+
+/* Default variables for pipeline mode */
+uint32_t pipeline_size = 0;
+struct pr_ring rx_ring;
+struct pk_slab rx_slab;
+int fetch_done = 0;
+
+/* GPS serial device, empty name disables GPS time reference and RX_TIME */
+char *gps_tty = "";
+int gps_on = 0;
+
+/* Capture replayed instead of concentrator, empty file name disables replay */
+char *replay_file = "";
+double replay_speed = PS_DEFAULT_SPEED;
+
+/* Prometheus metrics endpoint, TCP port or Unix socket path, empty disables it */
+char *metrics_ep = "";
+
+/* Additional concentrators, spidev path and optional configuration file each, empty disables them */
+char *board_spec = "";
+int multi_board = 0;
+
+/* Packet filter compiled from filter_conf, applied right after fetch */
+struct pf_filter rx_filter;
+int filter_on = 0;
+
+/* Duplicate suppression window in milliseconds, 0 disables it and GW_LIST, COPIES */
+uint32_t dedup_window = 0;
+
+/* CPUs of receive threads, main concentrator first, empty leaves threads unpinned */
+char *rx_cpus = "";
+
+/* Latency histograms print interval in seconds, 0 on SIGUSR1 and at exit only */
+int latency_dump = 0;
+
+/* Unix datagram socket of txpk downlink requests, empty disables downlinks */
+char *downlink_path = "";
+int downlink_on = 0;
+struct jq_queue tx_queue;
+
+/* Set by configuration reload, session keys are swapped by thread exporting packets */
+int keys_reload = 0;
+
 
 /**
  * Definition of basic module information - module name, module description, number of input and output interfaces
@@ -492,7 +329,41 @@ trap_module_info_t *module_info = NULL;
  * Module parameter argument types: int8, int16, int32, int64, uint8, uint16, uint32, uint64, float, string
  */
 #define MODULE_PARAMS(PARAM) \
-    PARAM('l', "countl", "Defines start log count 1/0 (true/false), default value 0 (false).", required_argument, "int")
+    PARAM('l', "countl", "Defines start log count 1/0 (true/false), default value 0 (false).", required_argument, "int") \
+    PARAM('c', "countsync", "Defines count log flush interval in seconds, 0 flush at exit only, default value 10.", required_argument, "int") \
+    PARAM('s', "rxsched", "Defines receive scheduler 0/1 (fixed 3 ms polling/adaptive), default value 0 (fixed).", required_argument, "int") \
+    PARAM('g', "gpio", "Defines SX1301 interrupt GPIO used by adaptive receive scheduler, default value -1 (none).", required_argument, "int") \
+    PARAM('b', "binpayload", "Defines payload output 0/1/2 (hex string/hex string and bytes/bytes), default value 0 (hex string).", required_argument, "int") \
+    PARAM('t', "sendbatch", "Defines flush timeout in ms of batched send, 0 send every record at once, comma separated per output interface, default value -1 (libtrap default).", required_argument, "string") \
+    PARAM('o', "outputs", "Defines number of output interfaces, records are routed by consistent hash of DevAddr, default value 1.", required_argument, "uint32") \
+    PARAM('p', "pipeline", "Defines packet ring size, fetch and export run in separate threads, default value 0 (disabled).", required_argument, "uint32") \
+    PARAM('m', "micverify", "Defines MIC verification 0/1/2 (off/mark MIC_STATUS/drop invalid), default value 0 (off).", required_argument, "int") \
+    PARAM('d', "devstats", "Defines per device RSSI statistics 1/0 (true/false), adds DEV_ADDR, BASE_RSSI and VARIANCE, default value 0 (false).", required_argument, "int") \
+    PARAM('e', "devidle", "Defines minutes after which silent device is dropped from statistics, 0 never, default value 60.", required_argument, "uint32") \
+    PARAM('n', "devmax", "Defines maximum number of devices in statistics, least recently seen are replaced, default value 0 (unlimited).", required_argument, "uint32") \
+    PARAM('M', "devmem", "Defines memory limit of device statistics in MiB, default value 0 (unlimited).", required_argument, "uint32") \
+    PARAM('S', "devsnap", "Defines device statistics snapshot file loaded at start and written back, default value none (disabled).", required_argument, "string") \
+    PARAM('w', "devsnapsync", "Defines device snapshot write back interval in seconds, 0 at exit only, default value 300.", required_argument, "int") \
+    PARAM('u', "dutylimit", "Defines regulatory duty cycle limit in percent, enables DUTY_CYCLE, CH_UTIL and DUTY_VIOLATION, default value 0 (disabled).", required_argument, "float") \
+    PARAM('k', "keyfile", "Defines file with DevAddr NwkSKey AppSKey per line used by MIC verification, default value session_keys.txt.", required_argument, "string") \
+    PARAM('j', "appkeys", "Defines file with DevEUI AppKey per line, session keys of OTAA devices are learned from join exchanges, default value none (disabled).", required_argument, "string") \
+    PARAM('G', "gps", "Defines GPS serial device, packets are stamped from concentrator counter and add RX_TIME, default value none (disabled).", required_argument, "string") \
+    PARAM('R', "replay", "Defines CSV log or binary capture replayed instead of concentrator, default value none (disabled).", required_argument, "string") \
+    PARAM('P', "metrics", "Defines Prometheus metrics endpoint, TCP port or Unix socket path, default value none (disabled).", required_argument, "string") \
+    PARAM('B', "boards", "Defines additional concentrators as spidev[=config file] list separated by comma, adds GW_ID, default value none (disabled).", required_argument, "string") \
+    PARAM('A', "rxcpus", "Defines CPUs of receive threads separated by comma, main concentrator first, -1 unpinned, default value none (unpinned).", required_argument, "string") \
+    PARAM('D', "dedupwindow", "Defines window in ms collecting copies of uplink from all concentrators and channels, best one is exported with GW_LIST and COPIES, default value 0 (disabled).", required_argument, "uint32") \
+    PARAM('T', "downlink", "Defines Unix datagram socket receiving txpk downlink requests, sent from just-in-time queue by main concentrator, default value none (disabled).", required_argument, "string") \
+    PARAM('x', "replayspeed", "Defines replay timing multiplier, 0 as fast as possible, default value 1 (original timing).", required_argument, "float") \
+    LATENCY_PARAMS(PARAM)
+
+/** Latency option exists only in builds with latency histograms */
+#ifdef LATENCY_STATS
+#define LATENCY_PARAMS(PARAM) \
+    PARAM('L', "latencydump", "Defines latency histograms print interval in seconds, 0 on SIGUSR1 and at exit only, default value 0.", required_argument, "int")
+#else
+#define LATENCY_PARAMS(PARAM)
+#endif
 /**
  * To define positional parameter ("param" instead of "-m param" or "--mult param"), use the following definition:
  * PARAM('-', "", "Parameter description", required_argument, "string")
@@ -500,12 +371,13 @@ trap_module_info_t *module_info = NULL;
  * This parameter will be listed in Additional parameters in module help output
  */
 
+/* set by signal handler and export thread, read by fetch loop, accessed atomically */
 static int stop = 0;
 
 /**
  * Function to handle SIGTERM and SIGINT signals (used to stop the module)
  */
-TRAP_DEFAULT_SIGNAL_HANDLER(stop = 1)
+TRAP_DEFAULT_SIGNAL_HANDLER(__atomic_store_n(&stop, 1, __ATOMIC_RELEASE))
 
 /**
  * Function trap finalization and print error.
@@ -515,34 +387,433 @@ void trap_fin(char *arg) {
     TRAP_DEFAULT_FINALIZATION();
 }
 
+/** 
+ * Verify MIC of received frame by NwkSKey of joined session or key store.
+ */
+static uint8_t verify_packet(const struct lr_frame *frame) {
+    const struct sk_device *dev;
+
+    dev = join_on ? js_find(frame->dev_addr) : NULL;
+    if (dev == NULL)
+        dev = sk_find(frame->dev_addr);
+    if (dev == NULL)
+        return MIC_STATUS_UNCHECKED;
+    return lr_verify_mic(frame, &dev->nwk) ? MIC_STATUS_VALID : MIC_STATUS_INVALID;
+}
+
+#ifdef LATENCY_STATS
+/**
+ * Record time packets spent in concentrator FIFO, measured against current 
+ * counter of SX1301 so it does not depend on system clock.
+ */
+static void record_dwell(struct lgw_pkt_rx_s *const *pkt, int nb_pkt) {
+    uint32_t cnt;
+    int i;
+
+    if (lgw_get_instcnt(&cnt) == LGW_HAL_SUCCESS) {
+        for (i = 0; i < nb_pkt; i++)
+            lt_record(LT_STAGE_DWELL, (uint64_t) (cnt - pkt[i]->count_us) * 1000);
+    }
+}
+#endif
+
+/** 
+ * Read current concentrator counter. Counter register holds value latched 
+ * by last PPS as lgw_start() enables the latch, so it is briefly disabled 
+ * to read free running counter, with or without GPS time reference. Return 
+ * false when counter is not available.
+ * cnt - An pointer to store counter
+ */
+static bool tx_counter(uint32_t *cnt) {
+    return lgw_get_instcnt(cnt) == LGW_HAL_SUCCESS;
+}
+
+/** HAL send wrapper used by JIT queue */
+static int tx_send(const struct lgw_pkt_tx_s *pkt) {
+    return lgw_send(*pkt);
+}
+
+/** 
+ * Move waiting downlink requests to JIT queue and program the next one when 
+ * its slot is near, runs in fetch loop only. Counter is read only when 
+ * there is something to schedule. Scheduler is told when queue needs next 
+ * call, so empty fetches do not oversleep a slot.
+ * rs - An pointer to receive scheduler
+ */
+static void serve_downlinks(struct rs_scheduler *rs) {
+    struct lgw_pkt_tx_s pkt;
+    uint64_t now = time(NULL), sent = tx_queue.cnt.sent, missed = tx_queue.cnt.missed;
+    uint32_t cnt, wait;
+    bool have_cnt = false;
+    int ret;
+
+    while ((ret = dn_read(&pkt)) != DN_NONE) {
+        if (ret == DN_PACKET && (have_cnt || (have_cnt = tx_counter(&cnt)))
+                && jq_enqueue(&tx_queue, &pkt, cnt, now) == JQ_OK)
+            continue;
+        MT_INC(tx_rejected);
+    }
+    if (jq_count(&tx_queue) == 0 || (!have_cnt && !tx_counter(&cnt)))
+        return;
+
+    ret = jq_poll(&tx_queue, cnt, now, tx_send);
+    MT_ADD(tx_sent, tx_queue.cnt.sent - sent);
+    if (ret == LGW_LBT_ISSUE)
+        MT_INC(tx_lbt_busy);
+    else if (ret != LGW_HAL_SUCCESS)
+        MSG("WARNING: downlink could not be programmed\n");
+    MT_ADD(tx_missed, tx_queue.cnt.missed - missed);
+
+    wait = jq_wait_us(&tx_queue, cnt);
+    if (wait != UINT32_MAX)
+        rs->wake_us = (wait > 0) ? wait : 1;
+}
+
+/**
+ * Convert packet to UniRec record and send it to output interface.
+ * Return 0 on success or send timeout, -1 on send error.
+ * p     - An pointer to packet descriptor
+ * board - Concentrator index, 0 main and next ones additional boards
+ * dup   - An pointer to uplink collected by duplicate suppression, NULL when disabled
+ */
+int export_packet(const struct pk_pkt *p, int board, const struct dd_entry *dup) {
+    int ret;
+    char payload[2 * LR_MAX_PHY_PAYLOAD + 1];
+    uint8_t mic_status = MIC_STATUS_UNCHECKED;
+    struct lr_frame frame;
+    bool parsed = false, is_data;
+    struct dl_device *dev = NULL;
+    const struct sk_device *joined;
+    char dev_addr[9] = "";
+    uint64_t now = time(NULL);
+    uint32_t airtime = 0;
+    double duty = 0.0, ch_util = 0.0;
+    bool violation = false;
+    struct timespec rx_time;
+    char gw_list[DD_GW_LIST_LEN];
+    LT_STAMP(t_export);
+
+    LT_QUEUE(t_export);
+
+    /* log counter number */
+    cs_count(p->status == STAT_CRC_OK);
+    mt_count_packet(p);
+
+    /* key store is read only by this thread, swap it here on reload */
+    if (__atomic_exchange_n(&keys_reload, 0, __ATOMIC_ACQUIRE)) {
+        if (sk_load(key_file) < 0)
+            MSG("WARNING: session key file %s could not be reloaded, keeping %zu device keys\n", key_file, sk_count());
+        else
+            MSG("INFO: session keys reloaded, %zu device keys\n", sk_count());
+        if (join_on && js_load(app_key_file) < 0)
+            MSG("WARNING: AppKey file %s could not be reloaded, keeping %zu device keys\n", app_key_file, js_count());
+        else if (join_on)
+            MSG("INFO: AppKeys reloaded, %zu device keys\n", js_count());
+    }
+
+    /* parse frame only once for all stages needing header fields */
+    if ((mic_mode != MIC_OFF || join_on || track_devices || out_shards > 1) && p->status == STAT_CRC_OK)
+        parsed = (lr_parse_frame(p->payload, p->size, &frame) == 0);
+    is_data = parsed && frame.cls.kind == LR_KIND_DATA;
+
+    /* learn OTAA sessions before data frames of the device arrive */
+    if (join_on && parsed && frame.cls.kind == LR_KIND_JOIN_REQUEST)
+        js_join_request(&frame, now);
+    else if (join_on && parsed && frame.cls.kind == LR_KIND_JOIN_ACCEPT && (joined = js_join_accept(&frame, now)) != NULL)
+        MSG("INFO: session of joined device %08" PRIX32 " learned\n", joined->dev_addr);
+
+    /* reject spoofed or corrupted frames before any other work */
+    if (mic_mode != MIC_OFF && is_data) {
+        mic_status = verify_packet(&frame);
+        if (mic_status == MIC_STATUS_INVALID) {
+            ++mic_invalid;
+            MT_INC(mic_invalid);
+            if (mic_mode == MIC_DROP)
+                return 0;
+        }
+    }
+
+    /* running RSSI/SNR statistics of uplink device */
+    if (track_devices && is_data && frame.cls.direction == MTYPE_DIRECTIONS_UP) {
+        dev = dl_update_device(frame.dev_addr, p->rssi, p->snr, frame.fcnt, now);
+        snprintf(dev_addr, sizeof dev_addr, "%08" PRIX32, frame.dev_addr);
+    }
+
+    /* device table is owned by exporting thread, so is its snapshot */
+    if (track_devices)
+        dl_snapshot_sync();
+
+    /* writing bandwidth */
+    uint32_t band_width = -1;
+    switch (p->bandwidth) {
+        case BW_500KHZ: band_width = 500000;
+            break;
+        case BW_250KHZ: band_width = 250000;
+            break;
+        case BW_125KHZ: band_width = 125000;
+            break;
+        case BW_62K5HZ: band_width = 62500;
+            break;
+        case BW_31K2HZ: band_width = 31200;
+            break;
+        case BW_15K6HZ: band_width = 15600;
+            break;
+        case BW_7K8HZ: band_width = 7800;
+            break;
+        case BW_UNDEFINED: band_width = 0;
+            break;
+        default: band_width = -1;
+    }
+
+    /* writing datarate */
+    uint32_t sf = -1;
+    if (p->modulation == MOD_LORA) {
+        switch (p->datarate) {
+            case DR_LORA_SF7: sf = 7;
+                break;
+            case DR_LORA_SF8: sf = 8;
+                break;
+            case DR_LORA_SF9: sf = 9;
+                break;
+            case DR_LORA_SF10: sf = 10;
+                break;
+            case DR_LORA_SF11: sf = 11;
+                break;
+            case DR_LORA_SF12: sf = 12;
+                break;
+            default: sf = -1;
+        }
+    } else if (p->modulation == MOD_FSK) {
+        sf = p->datarate;
+    } else {
+        sf = -1;
+    }
+
+    /* channel, SF and device airtime in sliding window */
+    if (duty_limit > 0.0) {
+        airtime = rs_airtime_us(p->modulation, p->datarate, p->bandwidth, p->coderate, p->size);
+        ch_util = dc_count_channel(p->freq_hz, (sf >= 7 && sf <= 12) ? sf - 7 : (p->modulation == MOD_FSK) ? DC_SF_FSK : DC_SF_NB, airtime, now);
+        if (dev != NULL) {
+            duty = dc_count_device(&dev->airtime, airtime, now, &violation);
+            dev->duty_violation = violation;
+        }
+    }
+
+    /* writing coderate */
+    uint32_t code_rate = -1;
+    switch (p->coderate) {
+        case CR_LORA_4_5: code_rate = 5;
+            break;
+        case CR_LORA_4_6: code_rate = 6;
+            break;
+        case CR_LORA_4_7: code_rate = 7;
+            break;
+        case CR_LORA_4_8: code_rate = 8;
+            break;
+        case CR_UNDEFINED: code_rate = 0;
+            break;
+        default: code_rate = -1;
+    }
+
+    /* writing payload to char, raw bytes need no encoding */
+    if (payload_mode != PAYLOAD_BYTES)
+        hx_encode(payload, p->payload, p->size);
+
+    /* end of log file line */
+    ++pkt_in_log;
+
+    /* set RSSI */
+    ur_set(out_tmplt, out_rec, F_BAD_WIDTH, band_width);
+    ur_set(out_tmplt, out_rec, F_SIZE, p->size);
+    ur_set(out_tmplt, out_rec, F_RSSI, (double) p->rssi);
+    ur_set(out_tmplt, out_rec, F_CODE_RATE, code_rate);
+    ur_set(out_tmplt, out_rec, F_SF, sf);
+    if (gps_on) {
+        /* packet time from concentrator counter, system clock until GPS sync or on boards without PPS latch */
+        if (board != 0 || !gr_cnt2utc(p->count_us, &rx_time))
+            clock_gettime(CLOCK_REALTIME, &rx_time);
+        ur_set(out_tmplt, out_rec, F_TIMESTAMP, (uint64_t) rx_time.tv_sec);
+        ur_set(out_tmplt, out_rec, F_RX_TIME, ur_time_from_sec_usec(rx_time.tv_sec, rx_time.tv_nsec / 1000));
+    } else {
+        ur_set(out_tmplt, out_rec, F_TIMESTAMP, now);
+    }
+    if (payload_mode != PAYLOAD_BYTES)
+        ur_set_string(out_tmplt, out_rec, F_PHY_PAYLOAD, payload);
+    if (payload_mode != PAYLOAD_STRING)
+        ur_set_var(out_tmplt, out_rec, F_PHY_PAYLOAD_BIN, p->payload, p->size);
+    if (mic_mode == MIC_MARK)
+        ur_set(out_tmplt, out_rec, F_MIC_STATUS, mic_status);
+    if (dev_stats) {
+        ur_set_string(out_tmplt, out_rec, F_DEV_ADDR, dev_addr);
+        ur_set(out_tmplt, out_rec, F_BASE_RSSI, dev ? dev->BASE_RSSI : 0.0);
+        ur_set(out_tmplt, out_rec, F_VARIANCE, dev ? dl_stat_variance(&dev->rssi) : 0.0);
+    }
+    if (multi_board)
+        ur_set(out_tmplt, out_rec, F_GW_ID, (board == 0) ? lgwm : mb_gateway(board - 1));
+    if (dup != NULL) {
+        ur_set_string(out_tmplt, out_rec, F_GW_LIST, dd_gw_list(dup, gw_list));
+        ur_set(out_tmplt, out_rec, F_COPIES, dup->copies);
+    }
+    if (duty_limit > 0.0) {
+        ur_set(out_tmplt, out_rec, F_DUTY_CYCLE, duty);
+        ur_set(out_tmplt, out_rec, F_CH_UTIL, ch_util);
+        ur_set(out_tmplt, out_rec, F_DUTY_VIOLATION, violation);
+    }
+
+    /* send data, only record size instead of whole allocated record */
+    LT_RECORD(LT_STAGE_CONVERT, t_export);
+    LT_STAMP(t_send);
+    ret = trap_send(sh_select(p, parsed ? &frame : NULL, out_shards), out_rec, ur_rec_size(out_tmplt, out_rec));
+    LT_RECORD(LT_STAGE_SEND, t_send);
+    if (ret == TRAP_E_OK)
+        MT_INC(exported);
+    else
+        MT_INC(send_errors);
+    TRAP_DEFAULT_SEND_ERROR_HANDLING(ret, return 0, return -1);
+
+    return 0;
+}
+
+/**
+ * Parse flush timeouts of output interfaces, missing ones take the last
+ * value. Return 0 on success, -1 on malformed list.
+ * spec - Comma separated timeouts in ms
+ */
+static int parse_timeouts(const char *spec) {
+    char *end;
+    long v = -1;
+    int i = 0;
+
+    while (*spec != '\0' && i < SH_MAX_SHARDS) {
+        v = strtol(spec, &end, 10);
+        if (end == spec || v < -1 || v > INT32_MAX / 1000 || (*end != ',' && *end != '\0'))
+            return -1;
+        send_timeout[i++] = (int) v;
+        spec = (*end == ',') ? end + 1 : end;
+    }
+    if (*spec != '\0')
+        return -1;
+    while (i < SH_MAX_SHARDS)
+        send_timeout[i++] = (int) v;
+    return 0;
+}
+
+/**
+ * Export best copy of uplink once its duplicate window ended.
+ */
+static int export_unique(const struct dd_entry *e) {
+    return export_packet(e->pkt, e->board, e);
+}
+
+/**
+ * Export packet, through duplicate suppression when enabled. Packet may
+ * be freed on return.
+ * p     - An pointer to packet
+ * board - Concentrator index, 0 main and next ones additional boards
+ */
+int offer_packet(const struct pk_pkt *p, int board) {
+    struct timespec now;
+
+    if (dedup_window == 0)
+        return export_packet(p, board, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return dd_offer(p, board, (board == 0) ? lgwm : mb_gateway(board - 1),
+            (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000, export_unique);
+}
+
+/**
+ * Export uplinks whose duplicate window ended, called while no packet arrives.
+ */
+int expire_packets(void) {
+    struct timespec now;
+
+    if (dedup_window == 0)
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return dd_expire((uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000, export_unique);
+}
+
+/**
+ * Export thread for pipeline mode, drain packet rings to output interface
+ * until fetch loops finish and rings are empty. Rings of main concentrator
+ * and additional boards are served round robin, one packet each.
+ */
+void *export_thread(void *arg) {
+    struct pk_pkt *pkt;
+    struct timespec idle = {0, RS_MIN_POLL_US * 1000};
+    int err = 0;
+    int b, nb_pkt, done;
+
+    (void) arg;
+
+    while (1) {
+        /* read before popping, packets pushed until fetch loops stopped are still seen */
+        done = __atomic_load_n(&fetch_done, __ATOMIC_ACQUIRE);
+        nb_pkt = 0;
+        if (pr_pop(&rx_ring, &pkt)) {
+            nb_pkt++;
+            err = offer_packet(pkt, 0);
+            pk_free(pkt); /* back to slab of fetch loop */
+        }
+        for (b = 0; b < mb_count() && err == 0; b++) {
+            if (mb_pop(b, &pkt)) {
+                nb_pkt++;
+                err = offer_packet(pkt, b + 1);
+                pk_free(pkt);
+            }
+        }
+        if (err == 0 && nb_pkt == 0)
+            err = expire_packets();
+        if (err != 0) {
+            __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+            break;
+        } else if (nb_pkt == 0 && done) {
+            if (dedup_window > 0 && dd_flush(export_unique) != 0)
+                __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+            break;
+        } else if (nb_pkt == 0) {
+            clock_nanosleep(CLOCK_MONOTONIC, 0, &idle, NULL);
+        }
+    }
+
+    return NULL;
+}
+
 /** ---- MAIN ----- */
 int main(int argc, char **argv) {
     /** SectionFields LoRa logger */
-    int i, j, g; /* loop and temporary variables */
-    struct timespec sleep_time = {0, 3000000}; /* 3 ms */
-
-    char buff[3];
-    char payload[10000];
+    int i, j; /* loop and temporary variables */
+    pthread_t export_tid; /* export thread in pipeline mode */
+    struct rs_scheduler rx_sched; /* receive scheduler, replace fixed sleep between fetches */
+    const char *payload_fields; /* payload part of output template */
+    char tmplt_spec[256]; /* output template specification */
+    int main_cpu = -1; /* CPU of fetch loop, -1 unpinned */
+    int exit_code = EXIT_SUCCESS; /* set when fetch loop leaves on error */
 
     /* clock and log rotation management */
     int log_rotate_interval = 3600; /* by default, rotation every hour */
     int time_check = 0; /* variable used to limit the number of calls to time() function */
-    unsigned long pkt_in_log = 0; /* count the number of packet written in each log file */
 
     /* configuration file related */
     const char global_conf_fname[] = "global_conf.json"; /* contain global (typ. network-wide) configuration */
     const char local_conf_fname[] = "local_conf.json"; /* contain node specific configuration, overwrite global parameters for parameters that are defined in both */
     const char debug_conf_fname[] = "debug_conf.json"; /* if present, all other configuration files are ignored */
+    struct gc_config gw_conf; /* merged content of the configuration files */
+    struct gc_config gw_next; /* configuration parsed on reload */
 
     /* allocate memory for packet fetching and processing */
-    struct lgw_pkt_rx_s rxpkt[16]; /* array containing up to 16 inbound packets metadata */
+    struct lgw_pkt_rx_s *rxpkt[16]; /* array containing up to 16 inbound packets, descriptors owned by HAL */
     struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
+    struct pk_pkt view; /* packet exported in place without pipeline */
     int nb_pkt;
 
-    /* local timestamp variables until we get accurate GPS time */
-    struct timespec fetch_time;
-    char fetch_timestamp[30];
-    struct tm * x;
+    /* replay throughput measurement */
+    struct timespec run_start, run_end;
+    struct timespec ring_wait = {0, RS_MIN_POLL_US * 1000};
+    double run_s;
+#ifdef LATENCY_STATS
+    time_t latency_last = time(NULL); /* last print of latency histograms */
+#endif
 
     /** endSection */
 
@@ -553,46 +824,27 @@ int main(int argc, char **argv) {
     sigaction(SIGQUIT, &sigact, NULL);
     sigaction(SIGINT, &sigact, NULL);
     sigaction(SIGTERM, &sigact, NULL);
+    sigaction(SIGHUP, &sigact, NULL);
+    sigaction(SIGUSR1, &sigact, NULL);
 
-    /* configuration files management */
-    if (access(debug_conf_fname, R_OK) == 0) {
-        /* if there is a debug conf, parse only the debug conf */
-        MSG("INFO: found debug configuration file %s, other configuration files will be ignored\n", debug_conf_fname);
-        parse_SX1301_configuration(debug_conf_fname);
-        parse_gateway_configuration(debug_conf_fname);
-    } else if (access(global_conf_fname, R_OK) == 0) {
-        /* if there is a global conf, parse it and then try to parse local conf  */
-        MSG("INFO: found global configuration file %s, trying to parse it\n", global_conf_fname);
-        parse_SX1301_configuration(global_conf_fname);
-        parse_gateway_configuration(global_conf_fname);
-        if (access(local_conf_fname, R_OK) == 0) {
-            MSG("INFO: found local configuration file %s, trying to parse it\n", local_conf_fname);
-            parse_SX1301_configuration(local_conf_fname);
-            parse_gateway_configuration(local_conf_fname);
-        }
-    } else if (access(local_conf_fname, R_OK) == 0) {
-        /* if there is only a local conf, parse it and that's all */
-        MSG("INFO: found local configuration file %s, trying to parse it\n", local_conf_fname);
-        parse_SX1301_configuration(local_conf_fname);
-        parse_gateway_configuration(local_conf_fname);
-    } else {
+    /* configuration files management, each file is parsed once and merged */
+    gc_init(&gw_conf);
+    i = gc_load(&gw_conf, global_conf_fname, local_conf_fname, debug_conf_fname);
+    if (i < 0) {
+        return EXIT_FAILURE;
+    } else if (i == 0) {
         MSG("ERROR: failed to find any configuration file named %s, %s or %s\n", global_conf_fname, local_conf_fname, debug_conf_fname);
         return EXIT_FAILURE;
     }
-
-    /* starting the concentrator */
-    i = lgw_start();
-    if (i == LGW_HAL_SUCCESS) {
-        MSG("INFO: concentrator started, packet can now be received\n");
-    } else {
-        MSG("ERROR: failed to start the concentrator\n");
-        return EXIT_FAILURE;
+    gc_apply(&gw_conf);
+    if (gw_conf.gateway_set) {
+        lgwm = gw_conf.gateway_id;
+    }
+    if (gw_conf.filter_set) {
+        pf_compile(&gw_conf.filter, &rx_filter);
+        filter_on = 1;
     }
 
-    /* transform the MAC address into a string */
-    sprintf(lgwm_str, "%08X%08X", (uint32_t) (lgwm >> 32), (uint32_t) (lgwm & 0xFFFFFFFF));
-
-    int ret;
     signed char opt;
 
     /* **** TRAP initialization **** */
@@ -604,6 +856,12 @@ int main(int argc, char **argv) {
      */
     INIT_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
 
+    /*
+     * Interface specifier must list every output interface, their number is needed before it is parsed
+     */
+    out_shards = sh_scan_outputs(argc, argv, 'o', "outputs");
+    module_info->num_ifc_out = out_shards;
+
     /*
      * Let TRAP library parse program arguments, extract its parameters and initialize module interfaces
      */
@@ -627,6 +885,121 @@ int main(int argc, char **argv) {
                 trap_fin("Invalid arguments log count 0 - 1\n");
                 FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
                 return -1;
+            case 'c':
+                sscanf(optarg, "%d", &cl_sync);
+                break;
+            case 's':
+                sscanf(optarg, "%d", &rx_mode);
+                if ((rx_mode == RS_MODE_FIXED) || (rx_mode == RS_MODE_ADAPTIVE))
+                    break;
+                trap_fin("Invalid arguments receive scheduler 0 - 1\n");
+                FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+                return -1;
+            case 'g':
+                sscanf(optarg, "%d", &rx_gpio);
+                break;
+            case 'p':
+                sscanf(optarg, "%" SCNu32, &pipeline_size);
+                break;
+            case 't':
+                if (parse_timeouts(optarg) == 0)
+                    break;
+                trap_fin("Invalid arguments flush timeout list\n");
+                FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+                return -1;
+            case 'o':
+                /* already applied to interface count, only validated here */
+                if (sscanf(optarg, "%d", &j) == 1 && j >= 1 && j <= SH_MAX_SHARDS)
+                    break;
+                trap_fin("Invalid arguments number of output interfaces 1 - 32\n");
+                FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+                return -1;
+            case 'b':
+                sscanf(optarg, "%d", &payload_mode);
+                if ((payload_mode >= PAYLOAD_STRING) && (payload_mode <= PAYLOAD_BYTES))
+                    break;
+                trap_fin("Invalid arguments binary payload 0 - 2\n");
+                FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+                return -1;
+            case 'm':
+                sscanf(optarg, "%d", &mic_mode);
+                if ((mic_mode >= MIC_OFF) && (mic_mode <= MIC_DROP))
+                    break;
+                trap_fin("Invalid arguments MIC verification 0 - 2\n");
+                FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+                return -1;
+            case 'k':
+                key_file = optarg;
+                break;
+            case 'j':
+                app_key_file = optarg;
+                break;
+            case 'u':
+                sscanf(optarg, "%lf", &duty_limit);
+                if (duty_limit >= 0.0 && duty_limit <= 100.0)
+                    break;
+                trap_fin("Invalid arguments duty cycle limit 0 - 100\n");
+                FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+                return -1;
+            case 'd':
+                sscanf(optarg, "%d", &dev_stats);
+                if ((dev_stats == 0) || (dev_stats == 1))
+                    break;
+                trap_fin("Invalid arguments device statistics 0 - 1\n");
+                FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+                return -1;
+            case 'e':
+                sscanf(optarg, "%" SCNu32, &dev_idle);
+                break;
+            case 'n':
+                sscanf(optarg, "%" SCNu32, &dev_max);
+                break;
+            case 'M':
+                sscanf(optarg, "%" SCNu32, &dev_mem);
+                break;
+            case 'S':
+                dev_snap = optarg;
+                break;
+            case 'w':
+                sscanf(optarg, "%d", &dev_snap_sync);
+                break;
+            case 'G':
+                gps_tty = optarg;
+                break;
+            case 'R':
+                replay_file = optarg;
+                break;
+#ifdef LATENCY_STATS
+            case 'L':
+                sscanf(optarg, "%d", &latency_dump);
+                if (latency_dump >= 0)
+                    break;
+                trap_fin("Invalid arguments latency print interval must not be negative\n");
+                FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+                return -1;
+#endif
+            case 'P':
+                metrics_ep = optarg;
+                break;
+            case 'B':
+                board_spec = optarg;
+                break;
+            case 'A':
+                rx_cpus = optarg;
+                break;
+            case 'D':
+                sscanf(optarg, "%" SCNu32, &dedup_window);
+                break;
+            case 'T':
+                downlink_path = optarg;
+                break;
+            case 'x':
+                sscanf(optarg, "%lf", &replay_speed);
+                if (replay_speed >= 0.0)
+                    break;
+                trap_fin("Invalid arguments replay speed must not be negative\n");
+                FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+                return -1;
             default:
                 trap_fin("Invalid arguments.\n");
                 FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
@@ -634,8 +1007,145 @@ int main(int argc, char **argv) {
         }
     }
 
+    /** Packet source, concentrator unless capture replay is requested */
+    if (replay_file[0] != '\0' && ps_open_replay(replay_file, replay_speed) != 0) {
+        fprintf(stderr, "Error: Replay file %s could not be opened.\n", replay_file);
+        FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+        return -1;
+    }
+
+    /** Additional concentrators, their rings are drained by export thread */
+    if (board_spec[0] != '\0') {
+        if (ps_is_replay()) {
+            fprintf(stderr, "Error: Additional concentrators can not be used with replay.\n");
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+            return -1;
+        }
+        if (mb_parse(board_spec) <= 0) {
+            fprintf(stderr, "Error: Invalid list of additional concentrators %s.\n", board_spec);
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+            return -1;
+        }
+        multi_board = 1;
+        if (pipeline_size == 0) {
+            pipeline_size = LGW_RX_RING_SIZE;
+            MSG("INFO: additional concentrators enable pipeline mode\n");
+        }
+    }
+    if (rx_cpus[0] != '\0' && mb_parse_cpus(rx_cpus, &main_cpu) != 0) {
+        fprintf(stderr, "Error: Invalid list of receive thread CPUs %s.\n", rx_cpus);
+        FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+        return -1;
+    }
+
+    /* starting the concentrator */
+    i = ps_start();
+    if (i == LGW_HAL_SUCCESS) {
+        if (ps_is_replay())
+            MSG("INFO: replaying %s at speed %g, packet can now be received\n", replay_file, replay_speed);
+        else
+            MSG("INFO: concentrator started (%s), packet can now be received\n", lgw_cal_restored() ? "calibration restored from cache" : "calibrated");
+        MSG("INFO: AES backend %s\n", AES_backend_name());
+    } else {
+        MSG("ERROR: failed to start the concentrator\n");
+        FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
+
+    /* transform the MAC address into a string */
+    sprintf(lgwm_str, "%08X%08X", (uint32_t) (lgwm >> 32), (uint32_t) (lgwm & 0xFFFFFFFF));
+
+    /** Load session keys for MIC verification */
+    if (mic_mode != MIC_OFF) {
+        if (sk_load(key_file) < 0) {
+            fprintf(stderr, "Error: Session key file %s could not be loaded.\n", key_file);
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+            return -1;
+        }
+        MSG("INFO: MIC verification enabled, %zu device keys loaded\n", sk_count());
+    }
+
+    /** Load AppKeys of OTAA devices, their sessions are learned from join exchanges */
+    if (app_key_file[0] != '\0') {
+        if (js_load(app_key_file) < 0) {
+            fprintf(stderr, "Error: AppKey file %s could not be loaded.\n", app_key_file);
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+            return -1;
+        }
+        join_on = 1;
+        MSG("INFO: join learning enabled, %zu AppKeys loaded\n", js_count());
+    }
+
+    /** GPS time reference, system clock is used until first sync */
+    if (gps_tty[0] != '\0' && ps_is_replay())
+        MSG("WARNING: GPS time reference ignored during replay\n");
+    else if (gps_tty[0] != '\0')
+        gps_on = (gr_start(gps_tty) == 0);
+
+    /** Metrics endpoint runs in own thread, counters are summed on request */
+    if (metrics_ep[0] != '\0') {
+        if (mt_serve(metrics_ep) == 0)
+            MSG("INFO: metrics endpoint listening on %s\n", metrics_ep);
+        else
+            MSG("WARNING: metrics endpoint %s could not be opened\n", metrics_ep);
+    }
+
+    /** Downlink requests, queued and sent by fetch loop which drives main concentrator */
+    if (downlink_path[0] != '\0' && ps_is_replay()) {
+        MSG("WARNING: downlinks ignored during replay\n");
+    } else if (downlink_path[0] != '\0') {
+        jq_init(&tx_queue, duty_limit);
+        downlink_on = (dn_open(downlink_path) == 0);
+        if (downlink_on)
+            MSG("INFO: downlink requests accepted on %s\n", downlink_path);
+        else
+            MSG("WARNING: downlink socket %s could not be opened\n", downlink_path);
+    }
+
+    /** Precompute airtime table before first packet */
+    lr_airtime_init();
+
+    /** Duty cycle accounting needs device registry */
+    track_devices = dev_stats || duty_limit > 0.0;
+    if (duty_limit > 0.0)
+        dc_init(duty_limit);
+
+    /** Duplicate suppression, uplinks wait in window until every copy arrived */
+    if (dedup_window > 0) {
+        if (dd_init(dedup_window) != 0) {
+            fprintf(stderr, "Error: Memory allocation problem (duplicate suppression).\n");
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+            return -1;
+        }
+        MSG("INFO: duplicate suppression window %" PRIu32 " ms\n", dedup_window);
+    }
+
+    /** Bound memory of device statistics */
+    if (track_devices) {
+        dl_set_limits(dev_max, (uint64_t) dev_mem << 20, dev_idle * 60);
+        if (dev_snap[0] != '\0' && dl_snapshot_open(dev_snap, dev_snap_sync) < 0)
+            MSG("WARNING: device snapshot %s ignored, starting with empty device table\n", dev_snap);
+    }
+
     /** Create Output UniRec templates */
-    ur_template_t *out_tmplt = ur_create_output_template(0, "SIZE,SF,BAD_WIDTH,CODE_RATE,TIMESTAMP,PHY_PAYLOAD,RSSI", NULL);
+    switch (payload_mode) {
+        case PAYLOAD_BOTH:
+            payload_fields = "PHY_PAYLOAD,PHY_PAYLOAD_BIN";
+            break;
+        case PAYLOAD_BYTES:
+            payload_fields = "PHY_PAYLOAD_BIN";
+            break;
+        default:
+            payload_fields = "PHY_PAYLOAD";
+    }
+    snprintf(tmplt_spec, sizeof tmplt_spec, "SIZE,SF,BAD_WIDTH,CODE_RATE,TIMESTAMP,%s,RSSI%s%s%s%s%s%s",
+            payload_fields, gps_on ? ",RX_TIME" : "", multi_board ? ",GW_ID" : "",
+            (dedup_window > 0) ? ",GW_LIST,COPIES" : "",
+            (mic_mode == MIC_MARK) ? ",MIC_STATUS" : "",
+            dev_stats ? ",DEV_ADDR,BASE_RSSI,VARIANCE" : "",
+            (duty_limit > 0.0) ? ",DUTY_CYCLE,CH_UTIL,DUTY_VIOLATION" : "");
+    out_tmplt = ur_create_output_template(0, tmplt_spec, NULL);
     if (out_tmplt == NULL) {
         //        ur_free_template(in_tmplt);
         ur_free_template(out_tmplt);
@@ -644,7 +1154,7 @@ int main(int argc, char **argv) {
     }
 
     /** Allocate memory for output record */
-    void *out_rec = ur_create_record(out_tmplt, MAX_MSG_SIZE);
+    out_rec = ur_create_record(out_tmplt, MAX_MSG_SIZE);
     if (out_rec == NULL) {
         //        ur_free_template(in_tmplt);
         ur_free_template(out_tmplt);
@@ -653,125 +1163,267 @@ int main(int argc, char **argv) {
         return -1;
     }
 
+    /** Batched send, libtrap buffers several records per message until buffer is full or timeout, each interface on its own */
+    for (i = 0; i < (int) out_shards; i++) {
+        if (send_timeout[i] == 0) {
+            trap_ifcctl(TRAPIFC_OUTPUT, i, TRAPCTL_BUFFERSWITCH, 0);
+        } else if (send_timeout[i] > 0) {
+            trap_ifcctl(TRAPIFC_OUTPUT, i, TRAPCTL_BUFFERSWITCH, 1);
+            trap_ifcctl(TRAPIFC_OUTPUT, i, TRAPCTL_AUTOFLUSH_TIMEOUT, (uint64_t) send_timeout[i] * 1000);
+        }
+    }
+    if (out_shards > 1)
+        MSG("INFO: %" PRIu32 " output interfaces, records routed by DevAddr\n", out_shards);
+
+    /** Open count log, counters stay mapped for the whole run */
+    if (cl == 1 && cs_open(CS_DEFAULT_FILE, cl_sync) != 0) {
+        ur_free_template(out_tmplt);
+        ur_free_record(out_rec);
+        fprintf(stderr, "Error: Count log could not be opened.\n");
+        return -1;
+    }
+
+    /** Initialization receive scheduler */
+    rs_init(&rx_sched, rx_mode, rx_gpio);
+
+    /** Initialization pipeline, export thread drain ring filled by fetch loop */
+    memset(&rx_ring, 0, sizeof rx_ring);
+    if (pipeline_size > 0) {
+        /* packets are copied to slab, HAL descriptors go back right after fetch */
+        if (pr_init(&rx_ring, (pipeline_size < LGW_RX_RING_SIZE) ? LGW_RX_RING_SIZE : pipeline_size) != 0
+                || pk_init(&rx_slab, rx_ring.size) != 0) {
+            pr_free(&rx_ring);
+            ur_free_template(out_tmplt);
+            ur_free_record(out_rec);
+            fprintf(stderr, "Error: Memory allocation problem (packet ring).\n");
+            return -1;
+        }
+        /* boards run before export thread reads their count */
+        if (multi_board && mb_start(&gw_conf, pipeline_size, rx_mode) != 0) {
+            mb_stop();
+            mb_join();
+            ur_free_template(out_tmplt);
+            ur_free_record(out_rec);
+            pr_free(&rx_ring);
+            pk_destroy(&rx_slab);
+            fprintf(stderr, "Error: Failed to start additional concentrators.\n");
+            return -1;
+        }
+        if (pthread_create(&export_tid, NULL, export_thread, NULL) != 0) {
+            mb_stop();
+            mb_join();
+            ur_free_template(out_tmplt);
+            ur_free_record(out_rec);
+            pr_free(&rx_ring);
+            pk_destroy(&rx_slab);
+            fprintf(stderr, "Error: Failed to create export thread.\n");
+            return -1;
+        }
+        MSG("INFO: pipeline mode enabled, packet ring size %u, packet slab %zu bytes\n", rx_ring.size, pk_bytes(&rx_slab));
+        if (multi_board)
+            MSG("INFO: %d additional concentrators receiving\n", mb_count());
+    }
+
+    /** Pin fetch loop after creating other threads, they do not inherit its CPU or priority */
+    if (gw_conf.rt.enable && gw_conf.rt.cpu >= 0)
+        main_cpu = gw_conf.rt.cpu;
+    mb_pin(pthread_self(), main_cpu);
+    rt_apply(&gw_conf.rt);
+    rx_sched.track_late = gw_conf.rt.enable;
+
+    while ((quit_sig != 1) && (exit_sig != 1) && (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE))) {
+        /* reload configuration on SIGHUP, concentrator restarts only if RF setup changed */
+        if (reload_sig) {
+            reload_sig = 0;
+            gc_init(&gw_next);
+            MSG("INFO: reloading configuration\n");
+            if (gc_load(&gw_next, global_conf_fname, local_conf_fname, debug_conf_fname) <= 0) {
+                MSG("WARNING: configuration reload failed, keeping running configuration\n");
+            } else if (gc_update(&gw_conf, &gw_next) < 0) {
+                /* leave through normal shutdown, queued records are still exported */
+                MSG("ERROR: concentrator not running after configuration reload, exiting\n");
+                exit_code = EXIT_FAILURE;
+                __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+                continue;
+            } else {
+                if (gw_conf.gateway_set) {
+                    lgwm = gw_conf.gateway_id;
+                    sprintf(lgwm_str, "%08X%08X", (uint32_t) (lgwm >> 32), (uint32_t) (lgwm & 0xFFFFFFFF));
+                }
+                if (mic_mode != MIC_OFF || join_on)
+                    __atomic_store_n(&keys_reload, 1, __ATOMIC_RELEASE);
+            }
+        }
+
+        /* latch counter of last PPS when GPS delivered new time solution */
+        if (gps_on)
+            gr_sync();
+
+        /* queue downlink requests, program the next due one and wake up for it */
+        if (downlink_on)
+            serve_downlinks(&rx_sched);
 
-    while ((quit_sig != 1) && (exit_sig != 1) && (!stop)) {
         /* fetch packets */
-        nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+        LT_STAMP(t_fetch);
+        nb_pkt = ps_receive(ARRAY_SIZE(rxpkt), rxpkt);
+        LT_FETCH(t_fetch, nb_pkt);
+#ifdef LATENCY_STATS
+        if (nb_pkt > 0 && !ps_is_replay())
+            record_dwell(rxpkt, nb_pkt);
+#endif
+        rs_update(&rx_sched, nb_pkt, ARRAY_SIZE(rxpkt), rxpkt);
         if (nb_pkt == LGW_HAL_ERROR) {
+            /* leave through normal shutdown, queued records are still exported */
             MSG("ERROR: failed packet fetch, exiting\n");
-            return EXIT_FAILURE;
+            exit_code = EXIT_FAILURE;
+            __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+            break;
+        } else if (nb_pkt == 0 && ps_done()) {
+            MSG("INFO: end of replay\n");
+            break;
         } else if (nb_pkt == 0) {
-            clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
+            rs_wait(&rx_sched); /* wait until next fetch if no packets */
+            rt_observe(&gw_conf.rt, rx_sched.late_us);
         } else {
-            /* local timestamp generation until we get accurate GPS time */
-            clock_gettime(CLOCK_REALTIME, &fetch_time);
-            x = gmtime(&(fetch_time.tv_sec));
-            sprintf(fetch_timestamp, "%04i-%02i-%02i %02i:%02i:%02i.%03liZ", (x->tm_year) + 1900, (x->tm_mon) + 1, x->tm_mday, x->tm_hour, x->tm_min, x->tm_sec, (fetch_time.tv_nsec) / 1000000); /* ISO 8601 format */
+            MT_INC(fetches);
+            MT_ADD(fetched, nb_pkt);
         }
 
         /* log packets */
         for (i = 0; i < nb_pkt; ++i) {
-            p = &rxpkt[i];
-
-            /* log counter number */
-            start_log();
-            (p->status == 16) ? st_counter.cnt_pkt_log++ : st_counter.cnt_bad_pkt_log++;
-            st_counter.cnt_all_pkt_log = st_counter.cnt_pkt_log + st_counter.cnt_bad_pkt_log;
-            change_log();
-
-            /* writing bandwidth */
-            uint32_t band_width = -1;
-            switch (p->bandwidth) {
-                case BW_500KHZ: band_width = 500000;
-                    break;
-                case BW_250KHZ: band_width = 250000;
-                    break;
-                case BW_125KHZ: band_width = 125000;
-                    break;
-                case BW_62K5HZ: band_width = 62500;
-                    break;
-                case BW_31K2HZ: band_width = 31200;
-                    break;
-                case BW_15K6HZ: band_width = 15600;
-                    break;
-                case BW_7K8HZ: band_width = 7800;
-                    break;
-                case BW_UNDEFINED: band_width = 0;
-                    break;
-                default: band_width = -1;
-            }
+            p = rxpkt[i];
 
-            /* writing datarate */
-            uint32_t sf = -1;
-            if (p->modulation == MOD_LORA) {
-                switch (p->datarate) {
-                    case DR_LORA_SF7: sf = 7;
-                        break;
-                    case DR_LORA_SF8: sf = 8;
-                        break;
-                    case DR_LORA_SF9: sf = 9;
-                        break;
-                    case DR_LORA_SF10: sf = 10;
-                        break;
-                    case DR_LORA_SF11: sf = 11;
-                        break;
-                    case DR_LORA_SF12: sf = 12;
-                        break;
-                    default: sf = -1;
-                }
-            } else if (p->modulation == MOD_FSK) {
-                sf = p->datarate;
-            } else {
-                sf = -1;
+            /* drop unwanted packets before any conversion */
+            if (filter_on && !pf_pass(&rx_filter, p)) {
+                MT_INC(filtered);
+                continue;
             }
 
-            /* writing coderate */
-            uint32_t code_rate = -1;
-            switch (p->coderate) {
-                case CR_LORA_4_5: code_rate = 5;
-                    break;
-                case CR_LORA_4_6: code_rate = 6;
-                    break;
-                case CR_LORA_4_7: code_rate = 7;
-                    break;
-                case CR_LORA_4_8: code_rate = 8;
-                    break;
-                case CR_UNDEFINED: code_rate = 0;
+            if (rx_ring.size > 0) {
+                /* replay has no concentrator FIFO to overflow, it waits for export thread */
+                while (ps_is_replay() && pr_count(&rx_ring) >= rx_ring.size && !__atomic_load_n(&stop, __ATOMIC_ACQUIRE))
+                    clock_nanosleep(CLOCK_MONOTONIC, 0, &ring_wait, NULL);
+                /* hand over compact copy to export thread, freed there */
+                if (!pr_push_copy(&rx_ring, &rx_slab, p))
+                    MT_INC(ring_drops);
+            } else {
+                pk_view(&view, p);
+                if (offer_packet(&view, 0) != 0)
                     break;
-                default: code_rate = -1;
-            }
-
-            /* writing payload to char */
-            for (g = 0; g < p->size; ++g) {
-                sprintf(buff, "%02X", p->payload[g]);
-                buff[2] = '\0';
-                strcat(payload, buff);
             }
+        }
+        if ((rx_ring.size == 0) && (nb_pkt == 0))
+            expire_packets();
+        if (nb_pkt > 0) {
+            ps_release(nb_pkt);
+        }
 
-            /* end of log file line */
-            ++pkt_in_log;
-
-            /* set RSSI */
-            ur_set(out_tmplt, out_rec, F_BAD_WIDTH, band_width);
-            ur_set(out_tmplt, out_rec, F_SIZE, p->size);
-            ur_set(out_tmplt, out_rec, F_RSSI, (double) p->rssi);
-            ur_set(out_tmplt, out_rec, F_CODE_RATE, code_rate);
-            ur_set(out_tmplt, out_rec, F_SF, sf);
-            ur_set(out_tmplt, out_rec, F_TIMESTAMP, time(NULL));
-            ur_set_string(out_tmplt, out_rec, F_PHY_PAYLOAD, payload);
-
-            //free(payload);
-            //payload = NULL;
-            payload[0] = '\0';
-
-            /* send data */
-            ret = trap_send(0, out_rec, MAX_MSG_SIZE);
-            TRAP_DEFAULT_SEND_ERROR_HANDLING(ret, continue, break);
+        /* write back count log on flush interval */
+        cs_sync();
+
+#ifdef LATENCY_STATS
+        /* print latency histograms on SIGUSR1 or print interval */
+        if (latency_dump > 0 && time(NULL) - latency_last >= latency_dump)
+            dump_sig = 1;
+        if (dump_sig) {
+            dump_sig = 0;
+            latency_last = time(NULL);
+            lt_dump(stderr);
         }
+#endif
+    }
+
+    /** Stop export thread after draining packet ring */
+    if (rx_ring.size > 0) {
+        mb_stop();
+        __atomic_store_n(&fetch_done, 1, __ATOMIC_RELEASE);
+        pthread_join(export_tid, NULL);
+        MSG("INFO: packet ring high-water mark %u, overflow drops %" PRIu64 "\n", rx_ring.high_water, rx_ring.drops);
+        for (i = 0; i < mb_count(); i++)
+            MSG("INFO: packet ring of board %d high-water mark %u, overflow drops %" PRIu64 "\n", i + 1, mb_ring(i)->high_water, mb_ring(i)->drops);
+        mb_join();
+        pr_free(&rx_ring);
+        pk_destroy(&rx_slab);
+    } else if (dedup_window > 0) {
+        dd_flush(export_unique);
+    }
+    if (lgw_rx_invalid() > 0) {
+        MSG("WARNING: %" PRIu32 " packets with invalid IF chain dropped by concentrator fetch\n", lgw_rx_invalid());
+    }
+    if (dedup_window > 0) {
+        struct dd_counters dd;
+        dd_get_counters(&dd);
+        MSG("INFO: duplicate suppression offered %" PRIu64 ", suppressed %" PRIu64 ", exported %" PRIu64 " (%" PRIu64 " before end of window, %" PRIu64 " without window on full slab)\n",
+                dd.offered, dd.suppressed, dd.emitted, dd.forced, dd.slab_full);
+        dd_free();
+    }
+    if (gw_conf.rt.enable) {
+        struct mt_shard mt;
+        mt_sum(&mt);
+        MSG("INFO: scheduling latency outliers above %u us: %" PRIu64 ", longest %u us\n", gw_conf.rt.threshold_us, mt.sched_outliers, rt_late_max());
+    }
+
+#ifdef LATENCY_STATS
+    lt_dump(stderr);
+#endif
+
+    /** Replay throughput, measured until last packet is exported */
+    if (ps_is_replay()) {
+        clock_gettime(CLOCK_MONOTONIC, &run_end);
+        run_s = (double) (run_end.tv_sec - run_start.tv_sec) + (run_end.tv_nsec - run_start.tv_nsec) / 1e9;
+        MSG("INFO: replayed %" PRIu64 " packets in %.3f s, %.0f packets/s\n", ps_count(), run_s, (run_s > 0.0) ? ps_count() / run_s : 0.0);
+    }
+
+    mt_stop();
+
+    if (downlink_on) {
+        const struct dn_counters *dn = dn_get_counters();
+        MSG("INFO: downlinks received %" PRIu64 " (malformed %" PRIu64 "), sent %" PRIu64 ", missed %" PRIu64 ", LBT busy %" PRIu64 ", failed %" PRIu64 ", queue high-water mark %u\n",
+                dn->received, dn->malformed, tx_queue.cnt.sent, tx_queue.cnt.missed, tx_queue.cnt.lbt_busy, tx_queue.cnt.failed, tx_queue.cnt.high_water);
+        for (i = JQ_OK + 1; i < JQ_RESULTS; i++)
+            if (tx_queue.cnt.rejected[i] > 0)
+                MSG("INFO: downlinks rejected, %s: %" PRIu64 "\n", jq_result_name(i), tx_queue.cnt.rejected[i]);
+        dn_close();
+    }
+    if (gps_on) {
+        MSG("INFO: GPS time reference updates %" PRIu64 "\n", gr_sync_count());
+        gr_stop();
+    }
+    if (mic_mode != MIC_OFF) {
+        MSG("INFO: frames with invalid MIC %" PRIu64 "\n", mic_invalid);
+        sk_unload();
+    }
+    if (join_on) {
+        struct js_counters jc;
+        js_get_counters(&jc);
+        MSG("INFO: join requests %" PRIu64 " (unknown DevEUI %" PRIu64 ", invalid MIC %" PRIu64 "), join accepts %" PRIu64 " (unmatched %" PRIu64 "), sessions %" PRIu32 ", evicted %" PRIu64 "\n",
+                jc.requests, jc.unknown, jc.request_mic_invalid, jc.accepts, jc.unmatched, jc.sessions, jc.evicted);
+        js_unload();
+    }
+    if (duty_limit > 0.0) {
+        size_t ch_cnt, c;
+        struct dc_channel *ch = dc_get_channels(&ch_cnt);
+        for (c = 0; c < ch_cnt; c++)
+            MSG("INFO: channel %" PRIu32 " Hz, %" PRIu64 " packets, utilization %.3f %%\n", ch[c].freq_hz, ch[c].packets, dc_window_utilization(&ch[c].win, time(NULL)));
+        MSG("INFO: packets over duty cycle limit %.2f %%: %" PRIu64 "\n", duty_limit, dc_violations());
+    }
+    if (track_devices) {
+        struct dl_counters dc;
+        dl_get_counters(&dc);
+        MSG("INFO: tracked devices %" PRIu32 " (limit %" PRIu32 ", %" PRIu64 " bytes), evicted idle %" PRIu64 ", evicted by limit %" PRIu64 "\n",
+                dc.entries, dc.limit, dc.bytes, dc.evicted_idle, dc.evicted_cap);
+        dl_snapshot_close();
+        dl_free();
     }
 
     /* **** Cleanup **** */
 
+    /** 
+     * Send records waiting in output buffers
+     */
+    for (i = 0; i < (int) out_shards; i++)
+        trap_send_flush(i);
+
     /** 
      * Do all necessary cleanup in libtrap before exiting
      */
@@ -793,8 +1445,9 @@ int main(int argc, char **argv) {
     /**
      * Free logger 
      */
-    i = lgw_stop();
-    fclose(log_count);
+    i = ps_stop();
+    rs_close(&rx_sched);
+    cs_close();
 
-    return 0;
+    return exit_code;
 }
@@ -51,27 +51,8 @@
 
 #include "lora_packet.h"
 #include "aes/aes.h"
-
-/** 
- * Define message types:
- *   000 - 0    Join Request
- *   001 - 1    Join Accept
- *   010 - 2    Unconfirmed Data Up
- *   011 - 3    Unconfirmed Data Down
- *   100 - 4    Confirmed Data Up
- *   101 - 5    Confirmed Data Down
- *   000 - 0    Directions Up
- *   001 - 1    Directions Down
- *  */
-#define MTYPE_JOIN_REQUEST 0
-#define MTYPE_JOIN_ACCEPT 1
-#define MTYPE_UNCONFIRMED_DATA_UP 2
-#define MTYPE_UNCONFIRMED_DATA_DOWN 3
-#define MTYPE_CONFIRMED_DATA_UP 4
-#define MTYPE_CONFIRMED_DATA_DOWN 5
-
-#define MTYPE_DIRECTIONS_UP 0x00
-#define MTYPE_DIRECTIONS_DOWN 0x01
+#include "session_keys.h"
+#include "hex.h"
 
 /** 
  * The lr_slice() method selects the elements starting at the given start 
@@ -132,22 +113,10 @@ uint8_t *lr_arr_to_uint8(char* arr) {
     if (arr == NULL)
         return NULL;
 
-    int len = strlen(arr);
-    uint8_t *_array = (uint8_t*) malloc(len);
+    size_t len = strlen(arr);
+    uint8_t *_array = (uint8_t*) malloc(len / 2 + 1);
 
-    char tk[] = {'0', '0', '\0'};
-    unsigned int i, a, ple;
-    for (i = 0, a = 0, ple = 0; i < len; i++) {
-        if ((i % 2) == 0) {
-            tk[0] = arr[i];
-            tk[1] = arr[i + 1];
-            ple = lr_get_int(tk);
-            _array[a] = (uint8_t) (ple);
-            a++;
-        }
-    }
-
-    _array[len] = '\0';
+    _array[hx_decode(_array, arr, len)] = '\0';
 
     return _array;
 }
@@ -157,7 +126,13 @@ uint8_t *lr_arr_to_uint8(char* arr) {
  * arr - An pointer to char array
  */
 uint16_t lr_arr_to_uint16(char* arr) {
-    return ntohs(*(uint16_t*) lr_arr_to_uint8(arr));
+    uint8_t _array[2] = {0, 0};
+    size_t len = strnlen(arr, 4);
+
+    hx_decode(_array, arr, len);
+
+    /* first octet is most significant, same as network byte order */
+    return (uint16_t) ((_array[0] << 8) | _array[1]);
 }
 
 /** 
@@ -214,99 +189,209 @@ char *lr_uint8_to_string(uint8_t* arr) {
  * arr - An pointer to char array
  */
 int lr_get_int(char *arr) {
-    char hexDigits[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-    char *_i = (char*) malloc(strlen(arr));
-    int len = strlen(arr);
-    int j, decimal = 0;
+    unsigned int decimal = 0;
 
-    int i;
-    for (i = 0; i < len; i++) {
-        _i[i] = arr[i];
+    /* characters other than hex digits count as 0 */
+    while (*arr != '\0') {
+        decimal = (decimal << 4) | hx_digit[(uint8_t) * arr++];
     }
 
-    for (i = 0; i < len; i++) {
-        for (j = 0; j < 16; j++) {
-            if (_i[i] == hexDigits[j]) {
-                decimal += j * (int) pow(16, (len - 1) - i);
+    return (int) decimal;
+}
+
+/** Storage of string fields filled by lr_initialization() */
+static struct lr_frame lr_compat_frame;
+static uint8_t lr_compat_phy[LR_MAX_PHY_PAYLOAD];
+static char lr_s_mhdr[2 * LR_MHDR_SIZE + 1];
+static char lr_s_mic[2 * LR_MIC_SIZE + 1];
+static char lr_s_app_eui[17];
+static char lr_s_dev_eui[17];
+static char lr_s_dev_nonce[5];
+static char lr_s_app_nonce[7];
+static char lr_s_net_id[7];
+static char lr_s_dev_addr[9];
+static char lr_s_cflist[2 * LR_CFLIST_SIZE + 1];
+static char lr_s_mac_payload[2 * LR_MAX_PHY_PAYLOAD + 1];
+static char lr_s_fctrl[3];
+static char lr_s_fopts[31];
+static char lr_s_fhdr[45];
+static char lr_s_fcnt[5];
+static char lr_s_fport[3];
+static char lr_s_frm_payload[2 * LR_MAX_PHY_PAYLOAD + 1];
+
+static uint16_t lr_le16(const uint8_t *b) {
+    return (uint16_t) (b[0] | (b[1] << 8));
+}
+
+static uint32_t lr_le24(const uint8_t *b) {
+    return (uint32_t) b[0] | ((uint32_t) b[1] << 8) | ((uint32_t) b[2] << 16);
+}
+
+static uint32_t lr_le32(const uint8_t *b) {
+    return lr_le24(b) | ((uint32_t) b[3] << 24);
+}
+
+static uint64_t lr_le64(const uint8_t *b) {
+    return (uint64_t) lr_le32(b) | ((uint64_t) lr_le32(b + 4) << 32);
+}
+
+static struct lr_view lr_view_make(uint16_t off, uint16_t len) {
+    struct lr_view v;
+    v.off = off;
+    v.len = len;
+    return v;
+}
+
+/** 
+ * Classification of message types indexed by MType, direction of not 
+ * defined types is up as before.
+ */
+static const struct lr_class lr_class_table[8] = {
+    {MTYPE_JOIN_REQUEST, 0, MTYPE_DIRECTIONS_UP, LR_KIND_JOIN_REQUEST, false},
+    {MTYPE_JOIN_ACCEPT, 0, MTYPE_DIRECTIONS_DOWN, LR_KIND_JOIN_ACCEPT, false},
+    {MTYPE_UNCONFIRMED_DATA_UP, 0, MTYPE_DIRECTIONS_UP, LR_KIND_DATA, false},
+    {MTYPE_UNCONFIRMED_DATA_DOWN, 0, MTYPE_DIRECTIONS_DOWN, LR_KIND_DATA, false},
+    {MTYPE_CONFIRMED_DATA_UP, 0, MTYPE_DIRECTIONS_UP, LR_KIND_DATA, true},
+    {MTYPE_CONFIRMED_DATA_DOWN, 0, MTYPE_DIRECTIONS_DOWN, LR_KIND_DATA, true},
+    {MTYPE_RFU, 0, MTYPE_DIRECTIONS_UP, LR_KIND_OTHER, false},
+    {MTYPE_PROPRIETARY, 0, MTYPE_DIRECTIONS_UP, LR_KIND_OTHER, false}
+};
+
+/** 
+ * Decode MType, Major and direction from MHDR octet.
+ * mhdr - MAC header octet
+ * cls  - An pointer to classification for result
+ */
+void lr_classify(uint8_t mhdr, struct lr_class *cls) {
+    *cls = lr_class_table[mhdr >> 5];
+    cls->major = mhdr & 0x03;
+}
+
+/** 
+ * Parse binary physical payload to caller owned frame without allocation.
+ * Return 0 on success, -1 if frame is too short or message type unknown.
+ * phy   - An pointer to physical payload
+ * size  - Size of physical payload in bytes
+ * frame - An pointer to frame for result
+ */
+int lr_parse_frame(const uint8_t *phy, size_t size, struct lr_frame *frame) {
+    uint16_t fhdr_len, mac_len;
+
+    memset(frame, 0, sizeof (struct lr_frame));
+    frame->phy = phy;
+    frame->size = (uint16_t) size;
+
+    frame->cls.kind = LR_KIND_OTHER;
+
+    if (phy == NULL || size < LR_MHDR_SIZE || size > LR_MAX_PHY_PAYLOAD)
+        return -1;
+
+    /* classification happens once here, accessors only read it */
+    frame->mhdr = phy[0];
+    lr_classify(phy[0], &frame->cls);
+    if (size < LR_MHDR_SIZE + LR_MIC_SIZE)
+        return -1;
+
+    frame->mic = lr_le32(phy + size - LR_MIC_SIZE);
+
+    switch (frame->cls.kind) {
+        case LR_KIND_JOIN_REQUEST:
+            if (size < LR_JOIN_REQUEST_SIZE)
+                return -1;
+            frame->app_eui = lr_le64(phy + 1);
+            frame->dev_eui = lr_le64(phy + 9);
+            frame->dev_nonce = lr_le16(phy + 17);
+            return 0;
+
+        case LR_KIND_JOIN_ACCEPT:
+            if (size < LR_JOIN_ACCEPT_SIZE)
+                return -1;
+            frame->app_nonce = lr_le24(phy + 1);
+            frame->net_id = lr_le24(phy + 4);
+            frame->dev_addr = lr_le32(phy + 7);
+            frame->dl_settings = phy[11];
+            frame->rx_delay = phy[12];
+            if (size == LR_JOIN_ACCEPT_CFLIST_SIZE)
+                frame->cflist = lr_view_make(13, LR_CFLIST_SIZE);
+            return 0;
+
+        case LR_KIND_DATA:
+            if (size < LR_DATA_MIN_SIZE)
+                return -1;
+            mac_len = (uint16_t) (size - LR_MHDR_SIZE - LR_MIC_SIZE);
+            frame->mac_payload = lr_view_make(LR_MHDR_SIZE, mac_len);
+            frame->dev_addr = lr_le32(phy + 1);
+            frame->fctrl = phy[5];
+            frame->fcnt = lr_le16(phy + 6);
+            frame->fopts_len = phy[5] & 0x0f;
+
+            fhdr_len = 7 + frame->fopts_len;
+            if (fhdr_len > mac_len)
+                return -1;
+            frame->fhdr = lr_view_make(LR_MHDR_SIZE, fhdr_len);
+            frame->fopts = lr_view_make(LR_MHDR_SIZE + 7, frame->fopts_len);
+
+            if (fhdr_len < mac_len) {
+                frame->has_fport = true;
+                frame->fport = phy[LR_MHDR_SIZE + fhdr_len];
+                frame->frm_payload = lr_view_make(LR_MHDR_SIZE + fhdr_len + 1, mac_len - fhdr_len - 1);
             }
-        }
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
+/** Hexadecimal string of octets in reversed order */
+static char *lr_hex_reversed(char *out, const uint8_t *in, size_t len) {
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hx_encode(out + 2 * i, in + len - 1 - i, 1);
     }
+    out[2 * len] = '\0';
 
-    free(_i);
-    _i = NULL;
+    return out;
+}
 
-    return decimal;
+/** Hexadecimal string of view */
+static char *lr_hex_view(char *out, const struct lr_frame *frame, struct lr_view view) {
+    hx_encode(out, LR_VIEW_PTR(frame, view), view.len);
+    return out;
 }
 
 /** 
  * The lr_get_int() return message type integer.
  */
 int lr_get_message_type() {
-    return (lr_get_int(MHDR) & 0xff) >> 5;
+    return lr_compat_frame.cls.mtype;
 }
 
 /** 
  * The lr_get_direction() return define message type.
  */
 uint8_t lr_get_direction() {
-    switch (lr_get_message_type()) {
-        case MTYPE_JOIN_REQUEST:
-            return MTYPE_DIRECTIONS_UP;
-        case MTYPE_JOIN_ACCEPT:
-            return MTYPE_DIRECTIONS_DOWN;
-        case MTYPE_UNCONFIRMED_DATA_UP:
-            return MTYPE_DIRECTIONS_UP;
-        case MTYPE_UNCONFIRMED_DATA_DOWN:
-            return MTYPE_DIRECTIONS_DOWN;
-        case MTYPE_CONFIRMED_DATA_UP:
-            return MTYPE_DIRECTIONS_UP;
-        case MTYPE_CONFIRMED_DATA_DOWN:
-            return MTYPE_DIRECTIONS_DOWN;
-        default:
-            return 0x00;
-    }
+    return lr_compat_frame.cls.direction;
 }
 
 bool lr_is_data_message() {
-    switch (lr_get_message_type()) {
-        case MTYPE_UNCONFIRMED_DATA_UP:
-        case MTYPE_UNCONFIRMED_DATA_DOWN:
-        case MTYPE_CONFIRMED_DATA_UP:
-        case MTYPE_CONFIRMED_DATA_DOWN:
-            return true;
-        default:
-            return false;
-    }
+    return (lr_compat_frame.cls.kind == LR_KIND_DATA);
 }
 
 bool lr_is_join_request_message() {
-    return (lr_get_message_type() == MTYPE_JOIN_REQUEST);
+    return (lr_compat_frame.cls.kind == LR_KIND_JOIN_REQUEST);
 }
 
 bool lr_is_join_accept_message() {
-    return (lr_get_message_type() == MTYPE_JOIN_ACCEPT);
+    return (lr_compat_frame.cls.kind == LR_KIND_JOIN_ACCEPT);
 }
 
 /**
- * The lr_free() free lora_packet and fields.
+ * The lr_free() release lora_packet fields. Fields are backed by static 
+ * storage of lr_initialization(), so only pointers are cleared.
  */
 void lr_free() {
-    free(MHDR);
-    free(FCtrl);
-    free(FCnt);
-    free(FRMPayload);
-    free(FPort);
-    free(AppEUI);
-    free(DevEUI);
-    free(DevNonce);
-    free(MIC);
-    free(AppNonce);
-    free(NetID);
-    free(CFList);
-    free(MACPayload);
-    free(FOpts);
-    free(FHDR);
-
     MHDR = NULL;
     FCtrl = NULL;
     FCnt = NULL;
@@ -322,141 +407,252 @@ void lr_free() {
     MACPayload = NULL;
     FOpts = NULL;
     FHDR = NULL;
+    DevAddr = NULL;
 }
 
 /** 
  * Initialization physical payload for parsing and reversing octet fields.
+ * Compatibility wrapper over lr_parse_frame(), fills global string fields 
+ * from static storage, so result is valid until next call.
  * packet - physical payload
  */
 void lr_initialization(char* packet) {
-    size_t _strl = strlen(packet);
-    char *_packet = packet;
-
-    // Allocation
-    MHDR = (char*) malloc(2);
-    MIC = (char*) malloc(8);
-    FCtrl = (char*) malloc(2);
-    DevAddr = (char*) malloc(8);
-    FCnt = (char*) malloc(4);
-    FRMPayload = (char*) malloc(0);
-    FPort = (char*) malloc(0);
-
-    AppEUI = (char*) malloc(16);
-    DevEUI = (char*) malloc(16);
-    DevNonce = (char*) malloc(4);
-    MIC = (char*) malloc(8);
-
-    AppNonce = (char*) malloc(6);
-    NetID = (char*) malloc(6);
-    DevAddr = (char*) malloc(8);
-    CFList = (char*) malloc(0);
+    const struct lr_frame *f = &lr_compat_frame;
+    size_t size = strnlen(packet, 2 * LR_MAX_PHY_PAYLOAD);
+    int ret;
 
+    size = hx_decode(lr_compat_phy, packet, size);
+
+    ret = lr_parse_frame(lr_compat_phy, size, &lr_compat_frame);
+
+    /* every field is defined, empty when not present in message */
     PHYPayload = packet;
-    MHDR = lr_slice(_packet, 0, 2);
+    MHDR = lr_s_mhdr;
+    MIC = lr_s_mic;
+    AppEUI = lr_s_app_eui;
+    DevEUI = lr_s_dev_eui;
+    DevNonce = lr_s_dev_nonce;
+    AppNonce = lr_s_app_nonce;
+    NetID = lr_s_net_id;
+    DevAddr = lr_s_dev_addr;
+    CFList = lr_s_cflist;
+    MACPayload = lr_s_mac_payload;
+    FCtrl = lr_s_fctrl;
+    FOpts = lr_s_fopts;
+    FHDR = lr_s_fhdr;
+    FCnt = lr_s_fcnt;
+    FPort = lr_s_fport;
+    FRMPayload = lr_s_frm_payload;
+
+    lr_s_mhdr[0] = lr_s_mic[0] = '\0';
+    lr_s_app_eui[0] = lr_s_dev_eui[0] = lr_s_dev_nonce[0] = '\0';
+    lr_s_app_nonce[0] = lr_s_net_id[0] = lr_s_dev_addr[0] = lr_s_cflist[0] = '\0';
+    lr_s_mac_payload[0] = lr_s_fctrl[0] = lr_s_fopts[0] = lr_s_fhdr[0] = '\0';
+    lr_s_fcnt[0] = lr_s_fport[0] = lr_s_frm_payload[0] = '\0';
+    DLSettings = 0;
+    RxDelay = 0;
+
+    if (size >= LR_MHDR_SIZE)
+        hx_encode(lr_s_mhdr, lr_compat_phy, LR_MHDR_SIZE);
+    if (ret != 0)
+        return;
+
+    hx_encode(lr_s_mic, lr_compat_phy + size - LR_MIC_SIZE, LR_MIC_SIZE);
 
     if (lr_is_join_request_message()) {
-        AppEUI = lr_revers_array(lr_slice(_packet, 2, 16));
-        DevEUI = lr_revers_array(lr_slice(_packet, 18, 16));
-        DevNonce = lr_revers_array(lr_slice(_packet, 34, 4));
-        MIC = lr_slice(_packet, _strl - 8, 8);
+        lr_hex_reversed(lr_s_app_eui, lr_compat_phy + 1, 8);
+        lr_hex_reversed(lr_s_dev_eui, lr_compat_phy + 9, 8);
+        lr_hex_reversed(lr_s_dev_nonce, lr_compat_phy + 17, 2);
     } else if (lr_is_join_accept_message()) {
-        AppNonce = lr_revers_array(lr_slice(_packet, 2, 6));
-        NetID = lr_revers_array(lr_slice(_packet, 8, 6));
-        DevAddr = lr_revers_array(lr_slice(_packet, 14, 8));
-        DLSettings = lr_get_int(_packet);
-        RxDelay = lr_get_int(_packet);
-        if (_strl == 66) {
-            CFList = (char*) malloc(32);
-            CFList = lr_slice(_packet, 26, 32);
-        }
-        MIC = lr_slice(_packet, _strl - 8, 8);
+        lr_hex_reversed(lr_s_app_nonce, lr_compat_phy + 1, 3);
+        lr_hex_reversed(lr_s_net_id, lr_compat_phy + 4, 3);
+        lr_hex_reversed(lr_s_dev_addr, lr_compat_phy + 7, 4);
+        DLSettings = f->dl_settings;
+        RxDelay = f->rx_delay;
+        lr_hex_view(lr_s_cflist, f, f->cflist);
     } else if (lr_is_data_message()) {
+        lr_hex_view(lr_s_mac_payload, f, f->mac_payload);
+        lr_hex_view(lr_s_fhdr, f, f->fhdr);
+        lr_hex_view(lr_s_fopts, f, f->fopts);
+        lr_hex_reversed(lr_s_dev_addr, lr_compat_phy + 1, 4);
+        hx_encode(lr_s_fctrl, &f->fctrl, 1);
+        lr_hex_reversed(lr_s_fcnt, lr_compat_phy + 6, 2);
+        if (f->has_fport) {
+            hx_encode(lr_s_fport, &f->fport, 1);
+            lr_hex_view(lr_s_frm_payload, f, f->frm_payload);
+        }
+    }
+}
 
-        MACPayload = (char*) malloc(_strl - 10);
-        MACPayload = lr_slice(_packet, 2, (_strl - 10));
-        MIC = lr_slice(_packet, (_strl - 8), 8);
 
-        FCtrl = lr_slice(MACPayload, 8, 2);
+/** 
+ * Fill counter block A_i of FRMPayload encryption, LoRaWAN 1.0 4.3.3.1.
+ */
+static void lr_ctr_block(uint8_t *a, const struct lr_ctr_job *job, uint8_t i) {
+    a[0] = 0x01;
+    a[1] = a[2] = a[3] = a[4] = 0x00;
+    a[5] = job->direction;
+    a[6] = (uint8_t) job->dev_addr;
+    a[7] = (uint8_t) (job->dev_addr >> 8);
+    a[8] = (uint8_t) (job->dev_addr >> 16);
+    a[9] = (uint8_t) (job->dev_addr >> 24);
+    a[10] = (uint8_t) job->fcnt;
+    a[11] = (uint8_t) (job->fcnt >> 8);
+    a[12] = (uint8_t) (job->fcnt >> 16);
+    a[13] = (uint8_t) (job->fcnt >> 24);
+    a[14] = 0x00;
+    a[15] = i;
+}
+
+/** 
+ * XOR data with keystream eight bytes at a time, byte loop for the tail.
+ */
+static void lr_xor(uint8_t *out, const uint8_t *in, const uint8_t *ks, size_t len) {
+    size_t i = 0;
+    uint64_t a, b;
+
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&a, in + i, 8);
+        memcpy(&b, ks + i, 8);
+        a ^= b;
+        memcpy(out + i, &a, 8);
+    }
+    for (; i < len; i++)
+        out[i] = in[i] ^ ks[i];
+}
+
+/** Part of frame whose keystream lies in current batch */
+struct lr_ctr_piece {
+    const uint8_t *in;
+    uint8_t *out;
+    size_t len;
+    size_t ks_off;
+};
 
-        int _FCtrl = lr_get_int(FCtrl);
-        int FOptsLen = (_FCtrl & 0x0f) *2;
+/** 
+ * Encrypt counter blocks of batch and XOR keystream into its pieces.
+ */
+static void lr_ctr_flush(const struct AES_ctx **ctx, uint8_t *ks, size_t blocks, const struct lr_ctr_piece *piece, size_t pieces) {
+    size_t p;
 
-        if (FOptsLen != 0) {
-            FOpts = (char*) malloc(FOptsLen);
-            FOpts = lr_slice(MACPayload, 14, FOptsLen);
-        }
+    AES_ECB_encrypt_multi_ctx(ctx, ks, blocks);
+    for (p = 0; p < pieces; p++)
+        lr_xor(piece[p].out, piece[p].in, ks + piece[p].ks_off, piece[p].len);
+}
 
-        int FHDR_length = 14 + FOptsLen;
-        FHDR = (char*) malloc(FHDR_length);
-        FHDR = lr_slice(MACPayload, 0, 0 + FHDR_length);
-        DevAddr = lr_revers_array(lr_slice(FHDR, 0, 8));
+/** 
+ * Encrypt or decrypt FRMPayload of several frames in one pass. Counter blocks 
+ * of all jobs are collected into batches of LR_CTR_BATCH_BLOCKS and encrypted 
+ * together, so the AES backend can interleave independent blocks even when 
+ * they belong to different frames and keys. in and out may be the same buffer.
+ */
+void lr_ctr_crypt(const struct lr_ctr_job *jobs, size_t count) {
+    uint8_t ks[LR_CTR_BATCH_BLOCKS * AES_BLOCKLEN];
+    const struct AES_ctx * ctx[LR_CTR_BATCH_BLOCKS];
+    struct lr_ctr_piece piece[LR_CTR_BATCH_BLOCKS];
+    size_t blocks = 0, pieces = 0, j, b;
+
+    for (j = 0; j < count; j++) {
+        const struct lr_ctr_job *job = &jobs[j];
+        size_t done = 0;
+
+        while (done < job->len) {
+            size_t len = job->len - done;
+            size_t nb = (len + AES_BLOCKLEN - 1) / AES_BLOCKLEN;
+
+            /* split frame if it does not fit into current batch */
+            if (nb > LR_CTR_BATCH_BLOCKS - blocks) {
+                nb = LR_CTR_BATCH_BLOCKS - blocks;
+                len = nb * AES_BLOCKLEN;
+            }
 
-        FCnt = lr_slice(FHDR, 10, 4);
-        FCnt = lr_revers_array(FCnt);
+            piece[pieces].in = job->in + done;
+            piece[pieces].out = job->out + done;
+            piece[pieces].len = len;
+            piece[pieces].ks_off = blocks * AES_BLOCKLEN;
+            pieces++;
 
-        if (FHDR_length != strlen(MACPayload)) {
-            FPort = (char*) malloc(2);
-            FPort = lr_slice(MACPayload, FHDR_length, 2);
+            for (b = 0; b < nb; b++) {
+                lr_ctr_block(ks + (blocks + b) * AES_BLOCKLEN, job, (uint8_t) (done / AES_BLOCKLEN + b + 1));
+                ctx[blocks + b] = job->ctx;
+            }
+            blocks += nb;
+            done += len;
 
-            if (FHDR_length < strlen(MACPayload)) {
-                FRMPayload = (char*) malloc(strlen(MACPayload)-(FHDR_length + 2));
-                FRMPayload = lr_slice(MACPayload, FHDR_length + 2, strlen(MACPayload) - (FHDR_length + 2));
+            if (blocks == LR_CTR_BATCH_BLOCKS) {
+                lr_ctr_flush(ctx, ks, blocks, piece, pieces);
+                blocks = pieces = 0;
             }
         }
-
     }
 
+    /* partial last batch, also when trailing jobs are empty */
+    if (blocks > 0)
+        lr_ctr_flush(ctx, ks, blocks, piece, pieces);
 }
 
+/** 
+ * Verify MIC of data frame, LoRaWAN 1.0 4.4. CMAC is computed by NwkSKey over 
+ * block B0 followed by MHDR..FRMPayload, first four bytes must equal MIC. 
+ * Only lower 16 bits of FCnt are transmitted, upper bits are taken as zero.
+ * Return false for invalid MIC or frame which is not a data message.
+ */
+bool lr_verify_mic(const struct lr_frame *frame, const struct AES_CMAC_ctx *nwk) {
+    uint8_t msg[AES_BLOCKLEN + LR_MAX_PHY_PAYLOAD];
+    uint8_t mac[AES_BLOCKLEN];
+    size_t len;
+
+    if (frame->cls.kind != LR_KIND_DATA)
+        return false;
+    len = frame->size - LR_MIC_SIZE;
+
+    msg[0] = 0x49;
+    msg[1] = msg[2] = msg[3] = msg[4] = 0x00;
+    msg[5] = frame->cls.direction;
+    msg[6] = (uint8_t) frame->dev_addr;
+    msg[7] = (uint8_t) (frame->dev_addr >> 8);
+    msg[8] = (uint8_t) (frame->dev_addr >> 16);
+    msg[9] = (uint8_t) (frame->dev_addr >> 24);
+    msg[10] = (uint8_t) frame->fcnt;
+    msg[11] = (uint8_t) (frame->fcnt >> 8);
+    msg[12] = msg[13] = 0x00;
+    msg[14] = 0x00;
+    msg[15] = (uint8_t) len;
+    memcpy(msg + AES_BLOCKLEN, frame->phy, len);
+
+    AES_CMAC(nwk, msg, AES_BLOCKLEN + len, mac);
+    return memcmp(mac, frame->phy + len, LR_MIC_SIZE) == 0;
+}
 
 /** 
- * LoRaWAN ABP packet decode
+ * LoRaWAN ABP packet decode of frame passed to lr_initialization(). FPort 0 
+ * carries MAC commands encrypted by NwkSKey, other ports use AppSKey. Only 
+ * lower 16 bits of FCnt are transmitted, upper bits are taken as zero.
+ * Returned buffer of FRMPayload length is owned by caller.
  * nwkSkey - An pointer to uint8_t array
  * appSkey - An pointer to uint8_t array
  */ 
 uint8_t *lr_decode(uint8_t* nwkSKey, uint8_t* appSKey) {
+    const struct lr_frame *f = &lr_compat_frame;
+    struct lr_ctr_job job;
+    uint8_t *dec;
 
-    int block = 0, len = 0;
-    len = (strlen(FRMPayload) / 2);
-    block = ceil(len / 16.0);
-
-    uint8_t *payload = lr_arr_to_uint8(FRMPayload);
-    uint8_t *devAddr = lr_arr_to_uint8(DevAddr);
-    uint8_t *S = (uint8_t*) malloc(16 * block);
-    uint8_t *Si = (uint8_t*) malloc(16);
-    uint8_t *dec = (uint8_t*) malloc(16 * block);
+    if (f->cls.kind != LR_KIND_DATA)
+        return NULL;
 
-    int i;
-    for (i = 0; i < block; i++) {
-
-        // construct A blocks (Ai)
-        uint8_t ai_buf[] = {// plain_s
-            0x01, // Def
-            0x00,
-            0x00,
-            0x00,
-            0x00,
-            lr_get_direction(), // Direction up/down
-            devAddr[3], // DevAddr
-            devAddr[2],
-            devAddr[1],
-            devAddr[0],
-            0x00, // FCnt BigEndian
-            0x00,
-            0x00, // upper 2 bytes of FCnt (zeroes)
-            0x00,
-            0x00, // 0x00
-            (uint8_t) (i + 1) // Block number +1     
-        };
-
-        AES_ECB_encrypt(ai_buf, appSKey, Si, 16);
-
-        memcpy(S + (16 * i), Si, 16);
-    }
+    dec = (uint8_t*) malloc(f->frm_payload.len + 1);
+    if (dec == NULL)
+        return NULL;
 
-    for (i = 0; i < len; i++) {
-        dec[i] = (payload[i] | 0x00) ^ S[i];
-    }
+    /* session key is expanded once per device, not once per block */
+    job.ctx = sk_get(f->dev_addr, (f->has_fport && f->fport == 0) ? nwkSKey : appSKey);
+    job.dev_addr = f->dev_addr;
+    job.fcnt = f->fcnt;
+    job.direction = f->cls.direction;
+    job.in = LR_VIEW_PTR(f, f->frm_payload);
+    job.out = dec;
+    job.len = f->frm_payload.len;
+    lr_ctr_crypt(&job, 1);
 
     return dec;
 }
@@ -485,4 +681,55 @@ double lr_airtime_calculate(uint32_t pay_size, uint8_t header, uint8_t dr, uint3
     t_packet = t_premble + t_payload;
 
     return t_packet / (duty_cycle / 100);
-}
\ No newline at end of file
+}
+/** 
+ * AirtimeTable
+ * Number of payload symbols depends only on payload size, SF, coding rate, 
+ * header mode and low data rate optimization, bandwidth just scales symbol 
+ * time. Symbols are precomputed by integer version of the formula above for 
+ * all combinations, symbol time 2^SF / BW is an exact number of microseconds 
+ * for 125, 250 and 500 kHz, so airtime is one table read and a multiply. 
+ * Other bandwidths fall back to lr_airtime_calculate().
+ */
+static uint16_t lr_at_symbols[LR_SF_NB][LR_CR_NB][2][2][LR_MAX_PHY_PAYLOAD];
+static bool lr_at_ready = false;
+
+/** 
+ * Fill airtime table, safe to call repeatedly.
+ */
+void lr_airtime_init() {
+    int sf, cr, header, ldro, size, num, den;
+
+    if (lr_at_ready)
+        return;
+    for (sf = LR_SF_MIN; sf <= LR_SF_MAX; sf++)
+        for (cr = 0; cr < LR_CR_NB; cr++)
+            for (header = 0; header < 2; header++)
+                for (ldro = 0; ldro < 2; ldro++)
+                    for (size = 0; size < LR_MAX_PHY_PAYLOAD; size++) {
+                        num = 8 * size - 4 * sf + 28 + 16 - 20 * (1 - header);
+                        den = 4 * (sf - 2 * ldro);
+                        lr_at_symbols[sf - LR_SF_MIN][cr][header][ldro][size] =
+                                8 + ((num > 0) ? ((num + den - 1) / den) * (cr + 5) : 0);
+                    }
+    lr_at_ready = true;
+}
+
+/** 
+ * Table driven packet airtime in microseconds, 100 % duty cycle.
+ * Parameters have the same meaning as in lr_airtime_calculate().
+ */
+uint32_t lr_airtime_us(uint32_t pay_size, uint8_t header, uint8_t dr, uint32_t sf, uint32_t cd_rate, uint32_t prem_sym, uint32_t band) {
+    uint32_t t_sym;
+
+    if (sf < LR_SF_MIN || sf > LR_SF_MAX || cd_rate < 5 || cd_rate > 8 || pay_size >= LR_MAX_PHY_PAYLOAD
+            || header > 1 || dr > 1 || (band != 125 && band != 250 && band != 500))
+        return (uint32_t) (lr_airtime_calculate(pay_size, header, dr, sf, cd_rate, prem_sym, band, 100.0) * 1000.0 + 0.5);
+
+    if (!lr_at_ready)
+        lr_airtime_init();
+
+    /* preamble takes prem_sym + 4.25 symbols, t_sym is divisible by 4 for SF7+ */
+    t_sym = (1000u << sf) / band;
+    return lr_at_symbols[sf - LR_SF_MIN][cd_rate - 5][header][dr][pay_size] * t_sym + (4 * prem_sym + 17) * (t_sym / 4);
+}
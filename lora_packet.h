@@ -12,6 +12,7 @@
 #include <stdbool.h>
 #include <math.h>
 #include "aes/aes.h"
+#include "aes/cmac.h"
 
 #ifndef LORA_PACKET_H
 #define LORA_PACKET_H
@@ -22,6 +23,130 @@
 extern "C" {
 #endif
 
+/** 
+ * Define message types:
+ *   000 - 0    Join Request
+ *   001 - 1    Join Accept
+ *   010 - 2    Unconfirmed Data Up
+ *   011 - 3    Unconfirmed Data Down
+ *   100 - 4    Confirmed Data Up
+ *   101 - 5    Confirmed Data Down
+ *   110 - 6    RFU
+ *   111 - 7    Proprietary
+ *   000 - 0    Directions Up
+ *   001 - 1    Directions Down
+ *  */
+#define MTYPE_JOIN_REQUEST 0
+#define MTYPE_JOIN_ACCEPT 1
+#define MTYPE_UNCONFIRMED_DATA_UP 2
+#define MTYPE_UNCONFIRMED_DATA_DOWN 3
+#define MTYPE_CONFIRMED_DATA_UP 4
+#define MTYPE_CONFIRMED_DATA_DOWN 5
+#define MTYPE_RFU 6
+#define MTYPE_PROPRIETARY 7
+
+#define MTYPE_DIRECTIONS_UP 0x00
+#define MTYPE_DIRECTIONS_DOWN 0x01
+
+/** Kinds of messages */
+#define LR_KIND_JOIN_REQUEST 0
+#define LR_KIND_JOIN_ACCEPT 1
+#define LR_KIND_DATA 2
+#define LR_KIND_OTHER 3
+
+/** Size limits of LoRaWAN frame in bytes */
+#define LR_MAX_PHY_PAYLOAD 256
+#define LR_MHDR_SIZE 1
+#define LR_MIC_SIZE 4
+#define LR_JOIN_REQUEST_SIZE 23
+#define LR_JOIN_ACCEPT_SIZE 17
+#define LR_JOIN_ACCEPT_CFLIST_SIZE 33
+#define LR_CFLIST_SIZE 16
+#define LR_DATA_MIN_SIZE 12
+
+/** Range of airtime table, SF7 - SF12 and coding rate 4/5 - 4/8 */
+#define LR_SF_MIN 7
+#define LR_SF_MAX 12
+#define LR_SF_NB (LR_SF_MAX - LR_SF_MIN + 1)
+#define LR_CR_NB 4
+
+/** Number of keystream blocks encrypted together by lr_ctr_crypt() */
+#define LR_CTR_BATCH_BLOCKS 64
+
+/** Return pointer to first byte of view inside frame */
+#define LR_VIEW_PTR(frame, view) ((frame)->phy + (view).off)
+
+    /** Define structure for view into PHYPayload, offset and length in bytes */
+    struct lr_view {
+        uint16_t off;
+        uint16_t len;
+    };
+
+    /** Define structure for message classification decoded from MHDR */
+    struct lr_class {
+        uint8_t mtype;
+        uint8_t major;
+        uint8_t direction;
+        uint8_t kind;
+        bool confirmed;
+    };
+
+    /** 
+     * Define structure for parsed LoRaWAN frame. Multi-byte fields are 
+     * converted from little endian octets, variable fields are views into 
+     * caller owned PHYPayload, which must outlive the frame.
+     */
+    struct lr_frame {
+        const uint8_t *phy;
+        uint16_t size;
+        uint8_t mhdr;
+        struct lr_class cls;
+        uint32_t mic;
+
+        /* Join Request */
+        uint64_t app_eui;
+        uint64_t dev_eui;
+        uint16_t dev_nonce;
+
+        /* Join Accept */
+        uint32_t app_nonce;
+        uint32_t net_id;
+        uint8_t dl_settings;
+        uint8_t rx_delay;
+        struct lr_view cflist;
+
+        /* Join Accept and Data */
+        uint32_t dev_addr;
+
+        /* Data */
+        uint8_t fctrl;
+        uint8_t fopts_len;
+        uint16_t fcnt;
+        bool has_fport;
+        uint8_t fport;
+        struct lr_view mac_payload;
+        struct lr_view fhdr;
+        struct lr_view fopts;
+        struct lr_view frm_payload;
+    };
+
+    /** 
+     * Define structure for FRMPayload encryption of one frame. FCnt is full 
+     * 32 bit frame counter, DevAddr in host order.
+     */
+    struct lr_ctr_job {
+        const struct AES_ctx *ctx;
+        uint32_t dev_addr;
+        uint32_t fcnt;
+        uint8_t direction;
+        const uint8_t *in;
+        uint8_t *out;
+        size_t len;
+    };
+
+    void lr_classify(uint8_t mhdr, struct lr_class *cls);
+    int lr_parse_frame(const uint8_t *phy, size_t size, struct lr_frame *frame);
+
     char *AppEUI;
     char *DevEUI;
     char *DevNonce;
@@ -57,6 +182,8 @@ extern "C" {
     bool lr_is_join_request_message();
     bool lr_is_join_accept_message();
     
+    void lr_airtime_init();
+    uint32_t lr_airtime_us(uint32_t pay_size, uint8_t header, uint8_t dr, uint32_t sf, uint32_t cd_rate, uint32_t prem_sym, uint32_t band);
     double lr_airtime_calculate(unsigned int pay_size, uint8_t header, uint8_t dr, unsigned int sf, unsigned int cd_rate, unsigned int prem_sym, unsigned int band, double duty_cycle);
 
     char *lr_revers_array(char *arr);
@@ -67,6 +194,8 @@ extern "C" {
     void lr_print_uint8(uint8_t* str);
     char *lr_uint8_to_string(uint8_t* arr);
 
+    void lr_ctr_crypt(const struct lr_ctr_job *jobs, size_t count);
+    bool lr_verify_mic(const struct lr_frame *frame, const struct AES_CMAC_ctx *nwk);
     uint8_t *lr_decode(uint8_t* nwkSKey, uint8_t* appSKey);
 
 #ifdef __cplusplus
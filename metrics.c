@@ -0,0 +1,433 @@
+/**
+ * \file metrics.c
+ * \brief Runtime metrics and Prometheus endpoint of LoRaWAN logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include "latency.h"
+#include "metrics.h"
+
+/** 
+ * Metrics
+ * Every thread counts into own cache line aligned shard, so hot path 
+ * performs plain stores without atomic read-modify-write or false sharing. 
+ * Endpoint thread sums shards on each request and answers in Prometheus 
+ * text format over TCP port or Unix socket. Channel table is filled by 
+ * compare and swap on first packet of frequency. Threads over 
+ * MT_MAX_THREADS share last shard and may lose increments.
+ */
+
+static struct mt_shard mt_shards[MT_MAX_THREADS];
+static uint32_t mt_nb_shards = 0;
+static uint32_t mt_freq[MT_CHANNELS];
+
+__thread struct mt_shard *mt_local = NULL;
+
+static int mt_listen_fd = -1;
+static int mt_stop_pipe[2] = {-1, -1};
+static pthread_t mt_tid;
+static bool mt_running = false;
+
+/** 
+ * The mt_register() assign shard to calling thread.
+ */
+struct mt_shard *mt_register(void) {
+    uint32_t idx = __atomic_fetch_add(&mt_nb_shards, 1, __ATOMIC_RELAXED);
+
+    mt_local = &mt_shards[(idx < MT_MAX_THREADS) ? idx : MT_MAX_THREADS - 1];
+    return mt_local;
+}
+
+static int mt_channel(uint32_t freq_hz) {
+    uint32_t cur;
+    int i;
+
+    for (i = 0; i < MT_CHANNELS; i++) {
+        cur = __atomic_load_n(&mt_freq[i], __ATOMIC_ACQUIRE);
+        if (cur == freq_hz)
+            return i;
+        if (cur == 0) {
+            if (__atomic_compare_exchange_n(&mt_freq[i], &cur, freq_hz, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) || cur == freq_hz)
+                return i;
+        }
+    }
+    return MT_CHANNELS;
+}
+
+/** 
+ * Count received packet by SF, BW, CR, CRC status and channel.
+ * p - An pointer to received packet
+ */
+void mt_count_packet(const struct pk_pkt *p) {
+    struct mt_shard *s = mt_shard();
+    int sf, bw, cr, crc;
+
+    switch (p->datarate) {
+        case DR_LORA_SF7: sf = 0;
+            break;
+        case DR_LORA_SF8: sf = 1;
+            break;
+        case DR_LORA_SF9: sf = 2;
+            break;
+        case DR_LORA_SF10: sf = 3;
+            break;
+        case DR_LORA_SF11: sf = 4;
+            break;
+        case DR_LORA_SF12: sf = 5;
+            break;
+        default: sf = 6;
+    }
+    if (p->modulation != MOD_LORA)
+        sf = 6;
+    switch (p->bandwidth) {
+        case BW_125KHZ: bw = 0;
+            break;
+        case BW_250KHZ: bw = 1;
+            break;
+        case BW_500KHZ: bw = 2;
+            break;
+        default: bw = 3;
+    }
+    switch (p->coderate) {
+        case CR_LORA_4_5: cr = 0;
+            break;
+        case CR_LORA_4_6: cr = 1;
+            break;
+        case CR_LORA_4_7: cr = 2;
+            break;
+        case CR_LORA_4_8: cr = 3;
+            break;
+        default: cr = 4;
+    }
+    switch (p->status) {
+        case STAT_CRC_OK: crc = 0;
+            break;
+        case STAT_CRC_BAD: crc = 1;
+            break;
+        case STAT_NO_CRC: crc = 2;
+            break;
+        default: crc = 3;
+    }
+
+    mt_add(&s->sf[sf], 1);
+    mt_add(&s->bw[bw], 1);
+    mt_add(&s->cr[cr], 1);
+    mt_add(&s->crc[crc], 1);
+    mt_add(&s->channel[mt_channel(p->freq_hz)], 1);
+}
+
+/** 
+ * Sum counters of all shards.
+ * total - An pointer to result
+ */
+void mt_sum(struct mt_shard *total) {
+    uint64_t *dst = (uint64_t *) total;
+    const uint64_t *src;
+    uint32_t nb = __atomic_load_n(&mt_nb_shards, __ATOMIC_RELAXED);
+    size_t s, i;
+
+    memset(total, 0, sizeof (struct mt_shard));
+    for (s = 0; s < nb && s < MT_MAX_THREADS; s++) {
+        src = (const uint64_t *) &mt_shards[s];
+        for (i = 0; i < sizeof (struct mt_shard) / sizeof (uint64_t); i++)
+            dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+}
+
+/** 
+ * The mt_channel_freq() return frequency of tracked channel, 0 if unused.
+ * ch - Channel index
+ */
+uint32_t mt_channel_freq(int ch) {
+    return __atomic_load_n(&mt_freq[ch], __ATOMIC_ACQUIRE);
+}
+
+static void mt_family(FILE *f, const char *name, const char *type, const char *help) {
+    fprintf(f, "# HELP lora_logger_%s %s\n# TYPE lora_logger_%s %s\n", name, help, name, type);
+}
+
+static void mt_counter(FILE *f, const char *name, const char *help, uint64_t v) {
+    mt_family(f, name, "counter", help);
+    fprintf(f, "lora_logger_%s %llu\n", name, (unsigned long long) v);
+}
+
+#ifdef LATENCY_STATS
+/** Latency histograms with bucket bound at every power of two */
+static void mt_write_latency(FILE *f) {
+    const struct lt_hist *h;
+    uint64_t cum;
+    uint32_t b;
+    int s;
+
+    mt_family(f, "latency_seconds", "histogram", "Latency of packet path stages.");
+    for (s = 0; s < LT_STAGES; s++) {
+        h = lt_get(s);
+        cum = 0;
+        for (b = 0; b < LT_BUCKETS; b++) {
+            cum += __atomic_load_n(&h->bucket[b], __ATOMIC_RELAXED);
+            if ((b & ((1u << LT_SUB_BITS) - 1)) == (1u << LT_SUB_BITS) - 1 && b + 1 < LT_BUCKETS)
+                fprintf(f, "lora_logger_latency_seconds_bucket{stage=\"%s\",le=\"%.9g\"} %llu\n", lt_name(s), (lt_bucket_high(b) + 1) / 1e9, (unsigned long long) cum);
+        }
+        fprintf(f, "lora_logger_latency_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n", lt_name(s), (unsigned long long) cum);
+        fprintf(f, "lora_logger_latency_seconds_sum{stage=\"%s\"} %.9f\n", lt_name(s), __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED) / 1e9);
+        fprintf(f, "lora_logger_latency_seconds_count{stage=\"%s\"} %llu\n", lt_name(s), (unsigned long long) __atomic_load_n(&h->count, __ATOMIC_RELAXED));
+    }
+}
+#endif
+
+/** 
+ * Write all metrics in Prometheus text format.
+ * f - An pointer to output stream
+ */
+void mt_write(FILE *f) {
+    static const char *sf_names[] = {"SF7", "SF8", "SF9", "SF10", "SF11", "SF12", "other"};
+    static const char *bw_names[] = {"125000", "250000", "500000", "other"};
+    static const char *cr_names[] = {"4/5", "4/6", "4/7", "4/8", "other"};
+    static const char *crc_names[] = {"crc_ok", "crc_bad", "no_crc", "undefined"};
+    struct mt_shard t;
+    uint32_t freq;
+    int i;
+
+    mt_sum(&t);
+
+    mt_family(f, "packets_sf_total", "counter", "Received packets by spreading factor.");
+    for (i = 0; i < 7; i++)
+        fprintf(f, "lora_logger_packets_sf_total{sf=\"%s\"} %llu\n", sf_names[i], (unsigned long long) t.sf[i]);
+    mt_family(f, "packets_bw_total", "counter", "Received packets by bandwidth in Hz.");
+    for (i = 0; i < 4; i++)
+        fprintf(f, "lora_logger_packets_bw_total{bw=\"%s\"} %llu\n", bw_names[i], (unsigned long long) t.bw[i]);
+    mt_family(f, "packets_cr_total", "counter", "Received packets by coding rate.");
+    for (i = 0; i < 5; i++)
+        fprintf(f, "lora_logger_packets_cr_total{cr=\"%s\"} %llu\n", cr_names[i], (unsigned long long) t.cr[i]);
+    mt_family(f, "packets_crc_total", "counter", "Received packets by CRC status.");
+    for (i = 0; i < 4; i++)
+        fprintf(f, "lora_logger_packets_crc_total{status=\"%s\"} %llu\n", crc_names[i], (unsigned long long) t.crc[i]);
+    mt_family(f, "packets_channel_total", "counter", "Received packets by channel frequency in Hz.");
+    for (i = 0; i < MT_CHANNELS; i++) {
+        freq = mt_channel_freq(i);
+        if (freq != 0)
+            fprintf(f, "lora_logger_packets_channel_total{freq=\"%u\"} %llu\n", freq, (unsigned long long) t.channel[i]);
+    }
+    fprintf(f, "lora_logger_packets_channel_total{freq=\"other\"} %llu\n", (unsigned long long) t.channel[MT_CHANNELS]);
+
+    mt_counter(f, "fetches_total", "Non-empty packet fetches.", t.fetches);
+    mt_counter(f, "fetched_packets_total", "Packets fetched from packet source.", t.fetched);
+    mt_counter(f, "ring_drops_total", "Packets dropped on full pipeline ring.", t.ring_drops);
+    mt_counter(f, "exported_total", "Records sent to output interface.", t.exported);
+    mt_counter(f, "send_errors_total", "Failed or timed out trap_send calls.", t.send_errors);
+    mt_counter(f, "mic_invalid_total", "Frames with invalid MIC.", t.mic_invalid);
+    mt_counter(f, "filtered_total", "Packets dropped by filter before conversion.", t.filtered);
+    mt_counter(f, "sched_outliers_total", "Fetch thread wake-ups later than realtime profile threshold.", t.sched_outliers);
+    mt_counter(f, "sched_outlier_late_microseconds_total", "Summed wake-up delay of scheduling latency outliers.", t.sched_late_us);
+    mt_counter(f, "tx_sent_total", "Downlinks programmed into the concentrator.", t.tx_sent);
+    mt_counter(f, "tx_rejected_total", "Downlinks refused by JIT queue on arrival.", t.tx_rejected);
+    mt_counter(f, "tx_missed_total", "Queued downlinks dropped because their slot passed.", t.tx_missed);
+    mt_counter(f, "tx_lbt_busy_total", "Downlinks not sent because LBT found the channel busy.", t.tx_lbt_busy);
+    mt_counter(f, "dedup_forced_total", "Uplinks emitted before end of duplicate window on full pending ring.", t.dedup_forced);
+    mt_counter(f, "dedup_slab_full_total", "Uplinks emitted without duplicate window, no slab buffer left.", t.dedup_slab_full);
+#ifdef LATENCY_STATS
+    mt_write_latency(f);
+#endif
+}
+
+/** Read request and answer it, runs in endpoint thread only */
+static void mt_answer(int fd) {
+    static const char not_found[] = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    char req[MT_REQUEST_MAX];
+    char head[160];
+    char *body = NULL;
+    size_t body_len = 0;
+    FILE *f;
+    ssize_t nb;
+    size_t len = 0;
+    int hlen;
+
+    while (len < sizeof req - 1) {
+        nb = read(fd, req + len, sizeof req - 1 - len);
+        if (nb < 0 && errno == EINTR)
+            continue;
+        if (nb <= 0)
+            break;
+        len += nb;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") != NULL || strstr(req, "\n\n") != NULL)
+            break;
+    }
+    req[len] = '\0';
+
+    if (strncmp(req, "GET /metrics", 12) != 0 && strncmp(req, "GET / ", 6) != 0) {
+        nb = write(fd, not_found, sizeof not_found - 1);
+        return;
+    }
+    f = open_memstream(&body, &body_len);
+    if (f == NULL)
+        return;
+    mt_write(f);
+    fclose(f);
+
+    hlen = snprintf(head, sizeof head, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", body_len);
+    if (write(fd, head, hlen) == hlen)
+        nb = write(fd, body, body_len);
+    free(body);
+}
+
+static void *mt_thread(void *arg) {
+    struct pollfd fds[2];
+    struct timeval tmo = {1, 0};
+    int fd;
+
+    (void) arg;
+
+    fds[0].fd = mt_listen_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = mt_stop_pipe[0];
+    fds[1].events = POLLIN;
+    while (1) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents != 0)
+            break;
+        if ((fds[0].revents & POLLIN) == 0)
+            continue;
+        fd = accept(mt_listen_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        /* slow client delays only endpoint thread */
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof tmo);
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tmo, sizeof tmo);
+        mt_answer(fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+/** Open listening socket, return descriptor or -1 on error */
+static int mt_listen(const char *endpoint) {
+    struct sockaddr_un sun;
+    struct sockaddr_in sin;
+    int fd, one = 1, ret;
+
+    if (strchr(endpoint, '/') != NULL) {
+        if (strlen(endpoint) >= sizeof sun.sun_path)
+            return -1;
+        memset(&sun, 0, sizeof sun);
+        sun.sun_family = AF_UNIX;
+        strcpy(sun.sun_path, endpoint);
+        unlink(endpoint);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        ret = bind(fd, (struct sockaddr *) &sun, sizeof sun);
+    } else {
+        memset(&sin, 0, sizeof sin);
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_ANY);
+        sin.sin_port = htons((uint16_t) atoi(endpoint));
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+        ret = bind(fd, (struct sockaddr *) &sin, sizeof sin);
+    }
+    if (ret != 0 || listen(fd, MT_BACKLOG) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/** 
+ * Start endpoint thread. Return 0 on success, -1 on error.
+ * endpoint - TCP port number, or path of Unix socket when it contains '/'
+ */
+int mt_serve(const char *endpoint) {
+    mt_listen_fd = mt_listen(endpoint);
+    if (mt_listen_fd < 0)
+        return -1;
+    if (pipe(mt_stop_pipe) != 0) {
+        close(mt_listen_fd);
+        return -1;
+    }
+    if (pthread_create(&mt_tid, NULL, mt_thread, NULL) != 0) {
+        close(mt_stop_pipe[0]);
+        close(mt_stop_pipe[1]);
+        close(mt_listen_fd);
+        return -1;
+    }
+    mt_running = true;
+    return 0;
+}
+
+/** 
+ * Stop endpoint thread and close its socket.
+ */
+void mt_stop(void) {
+    char c = 0;
+
+    if (!mt_running)
+        return;
+    if (write(mt_stop_pipe[1], &c, 1) != 1)
+        pthread_cancel(mt_tid);
+    pthread_join(mt_tid, NULL);
+    close(mt_stop_pipe[0]);
+    close(mt_stop_pipe[1]);
+    close(mt_listen_fd);
+    mt_listen_fd = -1;
+    mt_running = false;
+}
@@ -0,0 +1,129 @@
+/**
+ * \file metrics.h
+ * \brief Runtime metrics and Prometheus endpoint of LoRaWAN logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "libloragw/inc/loragw_hal.h"
+#include "pkt_slab.h"
+
+#ifndef METRICS_H
+#define METRICS_H
+
+/** Threads with own counter shard, fetch and export thread need two */
+#define MT_MAX_THREADS 8
+
+/** Channels tracked by frequency, packets of further channels count as other */
+#define MT_CHANNELS 16
+
+/** Pending endpoint connections, request size limit in bytes */
+#define MT_BACKLOG 4
+#define MT_REQUEST_MAX 1024
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** 
+     * Define structure for counters of one thread. Shard is written only by 
+     * its thread and takes whole cache lines, readers sum all shards.
+     */
+    struct mt_shard {
+        uint64_t sf[7]; /* SF7 - SF12, other */
+        uint64_t bw[4]; /* 125, 250, 500 kHz, other */
+        uint64_t cr[5]; /* 4/5, 4/6, 4/7, 4/8, other */
+        uint64_t crc[4]; /* CRC_OK, CRC_BAD, NO_CRC, undefined */
+        uint64_t channel[MT_CHANNELS + 1];
+        uint64_t fetches;
+        uint64_t fetched;
+        uint64_t ring_drops;
+        uint64_t exported;
+        uint64_t send_errors;
+        uint64_t mic_invalid;
+        uint64_t filtered;
+        uint64_t sched_outliers;
+        uint64_t sched_late_us;
+        uint64_t tx_sent;
+        uint64_t tx_rejected;
+        uint64_t tx_missed;
+        uint64_t tx_lbt_busy;
+        uint64_t dedup_forced;
+        uint64_t dedup_slab_full;
+    } __attribute__((aligned(64)));
+
+    struct mt_shard *mt_register(void);
+
+    extern __thread struct mt_shard *mt_local;
+
+    /** 
+     * The mt_shard() return counter shard of calling thread.
+     */
+    static inline struct mt_shard *mt_shard(void) {
+        return (mt_local != NULL) ? mt_local : mt_register();
+    }
+
+    /** 
+     * Add to counter of own shard, single writer needs no read-modify-write.
+     */
+    static inline void mt_add(uint64_t *cnt, uint64_t v) {
+        __atomic_store_n(cnt, *cnt + v, __ATOMIC_RELAXED);
+    }
+
+#define MT_INC(field) mt_add(&mt_shard()->field, 1)
+#define MT_ADD(field, v) mt_add(&mt_shard()->field, (v))
+
+    void mt_count_packet(const struct pk_pkt *p);
+    void mt_sum(struct mt_shard *total);
+    uint32_t mt_channel_freq(int ch);
+    void mt_write(FILE *f);
+
+    int mt_serve(const char *endpoint);
+    void mt_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* METRICS_H */
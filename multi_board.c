@@ -0,0 +1,343 @@
+/**
+ * \file multi_board.c
+ * \brief Additional SX1301 concentrators of LoRaWAN logger, one receive thread per board.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE /* pthread_setaffinity_np */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "metrics.h"
+#include "rx_scheduler.h"
+#include "multi_board.h"
+
+#define MSG(args...) fprintf(stderr,"cesnet_pkt_analyzer: " args)
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/** Receive thread states, published to the starting and stopping thread */
+#define MB_STARTING 0
+#define MB_RUNNING 1
+#define MB_FAILED 2
+#define MB_STOPPED 3
+
+/** Sleep while waiting for receive threads */
+#define MB_WAIT_NS 1000000
+
+/**
+ * MultiBoard
+ * HAL state is thread-local, every additional concentrator is configured, 
+ * started and fetched by its own receive thread; the main concentrator 
+ * stays with the fetch loop of the logger. Each thread copies fetched 
+ * descriptors to slab of its board, pushes them to own packet ring and 
+ * releases HAL descriptors with lgw_rx_release() at once, so every ring 
+ * keeps one producer and one consumer. Only receive thread allocates from 
+ * board slab, export thread pops packets and pk_free() returns them to 
+ * returned list of the slab, taken over by receive thread on next empty 
+ * free list. Rings and slabs are freed by mb_join() after receive threads 
+ * and export thread finished, so popped packets stay valid until then.
+ */
+static struct mb_board boards[MB_MAX_BOARDS];
+static int board_cnt = 0;
+static uint8_t board_rx_mode = RS_MODE_FIXED;
+static int mb_stopping = 0;
+
+static void mb_sleep(void) {
+    struct timespec ts = {0, MB_WAIT_NS};
+
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+}
+
+/** Fetch loop of one additional concentrator */
+static void *mb_thread(void *arg) {
+    struct mb_board *b = (struct mb_board *) arg;
+    struct lgw_pkt_rx_s *pkt[16];
+    struct rs_scheduler sched;
+    int nb_pkt, i;
+
+    if (lgw_spi_set_path(b->spidev) != LGW_SPI_SUCCESS) {
+        MSG("ERROR: invalid SPI device %s\n", b->spidev);
+        __atomic_store_n(&b->state, MB_FAILED, __ATOMIC_RELEASE);
+    } else {
+        gc_apply(&b->conf);
+        if (lgw_start() != LGW_HAL_SUCCESS) {
+            MSG("ERROR: failed to start concentrator on %s\n", b->spidev);
+            __atomic_store_n(&b->state, MB_FAILED, __ATOMIC_RELEASE);
+        } else {
+            MSG("INFO: concentrator on %s started (%s), gateway %016" PRIX64 "\n", b->spidev, lgw_cal_restored() ? "calibration restored from cache" : "calibrated", b->conf.gateway_id);
+            __atomic_store_n(&b->state, MB_RUNNING, __ATOMIC_RELEASE);
+        }
+    }
+
+    if (__atomic_load_n(&b->state, __ATOMIC_ACQUIRE) == MB_RUNNING) {
+        rs_init(&sched, board_rx_mode, -1);
+        while (!__atomic_load_n(&mb_stopping, __ATOMIC_ACQUIRE)) {
+            nb_pkt = lgw_receive_ring(ARRAY_SIZE(pkt), pkt);
+            rs_update(&sched, nb_pkt, ARRAY_SIZE(pkt), pkt);
+            if (nb_pkt == LGW_HAL_ERROR) {
+                MSG("ERROR: failed packet fetch on %s, board stopped\n", b->spidev);
+                break;
+            } else if (nb_pkt == 0) {
+                rs_wait(&sched);
+                continue;
+            }
+            MT_INC(fetches);
+            MT_ADD(fetched, nb_pkt);
+            for (i = 0; i < nb_pkt; i++) {
+                if (b->filter_on && !pf_pass(&b->filter, pkt[i])) {
+                    MT_INC(filtered);
+                    continue;
+                }
+                /* copied to slab, export thread frees it */
+                if (!pr_push_copy(&b->ring, &b->slab, pkt[i]))
+                    MT_INC(ring_drops);
+            }
+            lgw_rx_release(nb_pkt);
+        }
+        rs_close(&sched);
+        if (lgw_rx_invalid() > 0)
+            MSG("WARNING: %" PRIu32 " packets with invalid IF chain dropped on %s\n", lgw_rx_invalid(), b->spidev);
+        lgw_stop();
+        __atomic_store_n(&b->state, MB_STOPPED, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+/** 
+ * Parse additional concentrators, comma separated list of spidev paths 
+ * each optionally followed by '=' and configuration file overlaid on the 
+ * main configuration. Return number of boards, -1 on malformed list.
+ * spec - Board list, e.g. "/dev/spidev1.0=board1.json,/dev/spidev2.0"
+ */
+int mb_parse(const char *spec) {
+    const char *p = spec, *end, *eq;
+    size_t len;
+
+    board_cnt = 0;
+    while (*p != '\0') {
+        end = strchr(p, ',');
+        if (end == NULL)
+            end = p + strlen(p);
+        eq = memchr(p, '=', end - p);
+        len = (size_t) (((eq != NULL) ? eq : end) - p);
+        if (board_cnt == MB_MAX_BOARDS || len == 0 || len >= LGW_SPI_PATH_MAX)
+            return -1;
+        if (eq != NULL && (size_t) (end - eq - 1) >= MB_CONF_MAX)
+            return -1;
+
+        memset(&boards[board_cnt], 0, sizeof (struct mb_board));
+        memcpy(boards[board_cnt].spidev, p, len);
+        if (eq != NULL)
+            memcpy(boards[board_cnt].conf_file, eq + 1, end - eq - 1);
+        boards[board_cnt].cpu = -1;
+        board_cnt++;
+
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return board_cnt;
+}
+
+/** 
+ * Parse CPU list of receive threads, first entry pins fetch loop of main 
+ * concentrator, next entries the boards in order, -1 leaves thread unpinned. 
+ * Return 0 on success, -1 on malformed list.
+ * spec     - Comma separated CPU numbers, e.g. "1,2,3"
+ * main_cpu - An pointer to CPU of main fetch loop
+ */
+int mb_parse_cpus(const char *spec, int *main_cpu) {
+    char *end;
+    long cpu;
+    int i = 0;
+
+    *main_cpu = -1;
+    while (*spec != '\0') {
+        cpu = strtol(spec, &end, 10);
+        if (end == spec || cpu < -1 || cpu >= CPU_SETSIZE || (*end != ',' && *end != '\0'))
+            return -1;
+        if (i == 0)
+            *main_cpu = (int) cpu;
+        else if (i <= board_cnt)
+            boards[i - 1].cpu = (int) cpu;
+        i++;
+        spec = (*end == ',') ? end + 1 : end;
+    }
+    return 0;
+}
+
+/** 
+ * Pin thread to one CPU. Return 0 on success, -1 on error.
+ * tid - Thread
+ * cpu - CPU number, -1 does nothing
+ */
+int mb_pin(pthread_t tid, int cpu) {
+    cpu_set_t set;
+
+    if (cpu < 0)
+        return 0;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(tid, sizeof set, &set) != 0) {
+        MSG("WARNING: receive thread could not be pinned to CPU %d\n", cpu);
+        return -1;
+    }
+    return 0;
+}
+
+/** 
+ * Start receive thread of every parsed board and wait until concentrators 
+ * run. Return 0 on success, -1 if a board failed, mb_stop() and mb_join() 
+ * must be called in both cases.
+ * base      - Main configuration, board files are overlaid on its copy
+ * ring_size - Packet ring size, at least LGW_RX_RING_SIZE
+ * rx_mode   - Receive scheduler mode of receive threads
+ */
+int mb_start(const struct gc_config *base, uint32_t ring_size, uint8_t rx_mode) {
+    struct mb_board *b;
+    int i, err = 0;
+
+    board_rx_mode = rx_mode;
+    __atomic_store_n(&mb_stopping, 0, __ATOMIC_RELEASE);
+    for (i = 0; i < board_cnt && err == 0; i++) {
+        b = &boards[i];
+        b->conf = *base;
+        if (b->conf_file[0] != '\0' && gc_load_file(&b->conf, b->conf_file) < 0) {
+            MSG("ERROR: configuration %s of %s could not be loaded\n", b->conf_file, b->spidev);
+            err = -1;
+            break;
+        }
+        b->filter_on = b->conf.filter_set;
+        if (b->filter_on)
+            pf_compile(&b->conf.filter, &b->filter);
+        if (b->conf.gateway_id == base->gateway_id)
+            MSG("WARNING: concentrator on %s shares gateway ID of main concentrator\n", b->spidev);
+        if (pr_init(&b->ring, (ring_size < LGW_RX_RING_SIZE) ? LGW_RX_RING_SIZE : ring_size) != 0
+                || pk_init(&b->slab, b->ring.size) != 0) {
+            MSG("ERROR: packet ring of %s could not be allocated\n", b->spidev);
+            pr_free(&b->ring);
+            err = -1;
+            break;
+        }
+        b->state = MB_STARTING;
+        if (pthread_create(&b->tid, NULL, mb_thread, b) != 0) {
+            MSG("ERROR: receive thread of %s could not be created\n", b->spidev);
+            pr_free(&b->ring);
+            pk_destroy(&b->slab);
+            err = -1;
+            break;
+        }
+        mb_pin(b->tid, b->cpu);
+        while (__atomic_load_n(&b->state, __ATOMIC_ACQUIRE) == MB_STARTING)
+            mb_sleep();
+        if (b->state == MB_FAILED)
+            err = -1;
+    }
+    board_cnt = i; /* boards with receive thread */
+
+    return err;
+}
+
+/** 
+ * Stop fetching on all boards and wait until no more packets are pushed, 
+ * packets in packet rings stay valid.
+ */
+void mb_stop(void) {
+    int i;
+
+    __atomic_store_n(&mb_stopping, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < board_cnt; i++) {
+        while (__atomic_load_n(&boards[i].state, __ATOMIC_ACQUIRE) == MB_RUNNING)
+            mb_sleep();
+    }
+}
+
+/** 
+ * Join receive threads and free packet rings with their slabs, called 
+ * after export thread stopped.
+ */
+void mb_join(void) {
+    int i;
+
+    for (i = 0; i < board_cnt; i++) {
+        pthread_join(boards[i].tid, NULL);
+        pr_free(&boards[i].ring);
+        pk_destroy(&boards[i].slab);
+    }
+    board_cnt = 0;
+}
+
+/** 
+ * The mb_count() return number of started additional boards.
+ */
+int mb_count(void) {
+    return board_cnt;
+}
+
+/** 
+ * The mb_gateway() return gateway ID of board.
+ * board - Board index
+ */
+uint64_t mb_gateway(int board) {
+    return boards[board].conf.gateway_id;
+}
+
+/** 
+ * Take oldest packet of board, export thread only. Caller frees packet by 
+ * pk_free().
+ * board - Board index
+ * pkt   - An pointer to packet
+ */
+bool mb_pop(int board, struct pk_pkt **pkt) {
+    return pr_pop(&boards[board].ring, pkt);
+}
+
+/** 
+ * The mb_ring() return packet ring of board for statistics.
+ * board - Board index
+ */
+const struct pr_ring *mb_ring(int board) {
+    return &boards[board].ring;
+}
@@ -0,0 +1,103 @@
+/**
+ * \file multi_board.h
+ * \brief Additional SX1301 concentrators of LoRaWAN logger, one receive thread per board.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "libloragw/inc/loragw_hal.h"
+#include "libloragw/inc/loragw_spi.h"
+#include "gw_config.h"
+#include "pkt_ring.h"
+#include "pkt_filter.h"
+
+#ifndef MULTI_BOARD_H
+#define MULTI_BOARD_H
+
+/** Maximum number of concentrators driven besides the main one */
+#define MB_MAX_BOARDS 8
+
+/** Maximum length of board configuration file name */
+#define MB_CONF_MAX 256
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** 
+     * Define structure for additional concentrator, configured by its own 
+     * receive thread and drained by export thread of the logger.
+     */
+    struct mb_board {
+        char spidev[LGW_SPI_PATH_MAX];
+        char conf_file[MB_CONF_MAX];
+        struct gc_config conf;
+        bool filter_on;
+        struct pf_filter filter;
+        int cpu;
+        struct pr_ring ring;
+        struct pk_slab slab;
+        pthread_t tid;
+        int state;
+    };
+
+    int mb_parse(const char *spec);
+    int mb_parse_cpus(const char *spec, int *main_cpu);
+    int mb_pin(pthread_t tid, int cpu);
+
+    int mb_start(const struct gc_config *base, uint32_t ring_size, uint8_t rx_mode);
+    void mb_stop(void);
+    void mb_join(void);
+
+    int mb_count(void);
+    uint64_t mb_gateway(int board);
+    bool mb_pop(int board, struct pk_pkt **pkt);
+    const struct pr_ring *mb_ring(int board);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MULTI_BOARD_H */
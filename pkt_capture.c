@@ -0,0 +1,386 @@
+/**
+ * \file pkt_capture.c
+ * \brief Columnar binary packet capture of LoRaWAN packet logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "pkt_capture.h"
+
+/** 
+ * PktCapture
+ * Capture file is file header followed by independent blocks of up to 
+ * PC_BLOCK_RECORDS packets. Each block starts with time range and DevAddr 
+ * bloom filter, so query skips block by reading its header only. Columns 
+ * are written straight from writer arrays by one writev and read in place 
+ * from mapped file.
+ */
+
+/** Element size of columns in block order */
+static const uint8_t pc_column_sizes[PC_COLUMNS] = {
+    8, /* time_us */
+    4, 4, 4, 4, 4, /* count_us, freq_hz, datarate, devaddr, payload_off */
+    4, 4, /* rssi, snr */
+    2, 2, /* crc, size */
+    1, 1, 1, 1, 1, 1 /* if_chain, rf_chain, status, modulation, bandwidth, coderate */
+};
+
+/** 
+ * The pc_column_size() return element size of column.
+ * col - Column index
+ */
+size_t pc_column_size(int col) {
+    return pc_column_sizes[col];
+}
+
+static uint32_t pc_block_length(uint32_t nb_rec, uint32_t payload_len) {
+    uint32_t len = sizeof (struct pc_block_header) + payload_len;
+    int i;
+
+    for (i = 0; i < PC_COLUMNS; i++)
+        len += nb_rec * pc_column_sizes[i];
+    return (len + 7) & ~7u;
+}
+
+static uint32_t pc_bloom_bit(uint32_t addr, int i) {
+    uint32_t h1 = addr * 0x9E3779B1u;
+    uint32_t h2 = ((addr ^ (addr >> 15)) * 0x85EBCA6Bu) | 1;
+    uint32_t h = h1 + i * h2;
+
+    h ^= h >> 16;
+    return h % PC_BLOOM_BITS;
+}
+
+/** 
+ * The pc_devaddr() extract DevAddr of LoRaWAN data frame. Return false 
+ * for other frames.
+ * payload - An pointer to PHY payload
+ * size    - Payload size
+ * addr    - An pointer to DevAddr
+ */
+bool pc_devaddr(const uint8_t *payload, uint16_t size, uint32_t *addr) {
+    uint8_t mtype;
+
+    /* MHDR, FHDR without options and MIC */
+    if (size < 12)
+        return false;
+    mtype = payload[0] >> 5;
+    if (mtype < 2 || mtype > 5)
+        return false;
+    *addr = (uint32_t) payload[1] | (uint32_t) payload[2] << 8 | (uint32_t) payload[3] << 16 | (uint32_t) payload[4] << 24;
+    return true;
+}
+
+/** 
+ * The pc_bloom_test() return false if block surely has no frame of DevAddr.
+ * hdr  - An pointer to block header
+ * addr - DevAddr
+ */
+bool pc_bloom_test(const struct pc_block_header *hdr, uint32_t addr) {
+    uint32_t bit;
+    int i;
+
+    for (i = 0; i < PC_BLOOM_HASHES; i++) {
+        bit = pc_bloom_bit(addr, i);
+        if ((hdr->bloom[bit / 8] & (1 << (bit % 8))) == 0)
+            return false;
+    }
+    return true;
+}
+
+/** 
+ * Write all vectors, continue after partial write. Return 0 on success, 
+ * -1 on error.
+ */
+static int pc_writev(int fd, struct iovec *iov, int cnt) {
+    int first = 0;
+    ssize_t nb;
+
+    while (first < cnt) {
+        nb = writev(fd, &iov[first], cnt - first);
+        if (nb < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        while (first < cnt && (size_t) nb >= iov[first].iov_len)
+            nb -= iov[first++].iov_len;
+        if (first < cnt) {
+            iov[first].iov_base = (char *) iov[first].iov_base + nb;
+            iov[first].iov_len -= nb;
+        }
+    }
+    return 0;
+}
+
+/** 
+ * Initialization writer and write file header when file is empty. Return 
+ * 0 on success, -1 on error.
+ * w       - An pointer to writer
+ * fd      - File descriptor open for appending, owned by writer until pc_close
+ * gateway - Gateway MAC address
+ */
+int pc_open(struct pc_writer *w, int fd, uint64_t gateway) {
+    struct pc_file_header fh;
+    struct iovec iov;
+    struct stat st;
+
+    w->fd = fd;
+    w->error = 0;
+    memset(&w->hdr, 0, sizeof (struct pc_block_header));
+    w->hdr.magic = PC_BLOCK_MAGIC;
+
+    if (fstat(fd, &st) != 0)
+        return -1;
+    if (st.st_size > 0)
+        return 0;
+
+    memset(&fh, 0, sizeof (struct pc_file_header));
+    memcpy(fh.magic, PC_MAGIC, sizeof (fh.magic));
+    fh.version = PC_VERSION;
+    fh.byte_order = PC_BYTE_ORDER;
+    fh.gateway = gateway;
+    iov.iov_base = &fh;
+    iov.iov_len = sizeof (struct pc_file_header);
+    return pc_writev(fd, &iov, 1);
+}
+
+/** 
+ * Append packet to current block, full block is written. Return 0 on 
+ * success, -1 on write error.
+ * w       - An pointer to writer
+ * pkt     - An pointer to received packet
+ * time_us - Receive time in microseconds since epoch
+ */
+int pc_append(struct pc_writer *w, const struct lgw_pkt_rx_s *pkt, uint64_t time_us) {
+    uint32_t n = w->hdr.nb_rec;
+    uint32_t addr = 0;
+    uint32_t bit;
+    int i;
+
+    if (pc_devaddr(pkt->payload, pkt->size, &addr)) {
+        for (i = 0; i < PC_BLOOM_HASHES; i++) {
+            bit = pc_bloom_bit(addr, i);
+            w->hdr.bloom[bit / 8] |= 1 << (bit % 8);
+        }
+    }
+    if (n == 0 || time_us < w->hdr.time_min)
+        w->hdr.time_min = time_us;
+    if (n == 0 || time_us > w->hdr.time_max)
+        w->hdr.time_max = time_us;
+
+    w->time_us[n] = time_us;
+    w->count_us[n] = pkt->count_us;
+    w->freq_hz[n] = pkt->freq_hz;
+    w->datarate[n] = pkt->datarate;
+    w->devaddr[n] = addr;
+    w->payload_off[n] = w->hdr.payload_len;
+    w->rssi[n] = pkt->rssi;
+    w->snr[n] = pkt->snr;
+    w->crc[n] = pkt->crc;
+    w->size[n] = pkt->size;
+    w->if_chain[n] = pkt->if_chain;
+    w->rf_chain[n] = pkt->rf_chain;
+    w->status[n] = pkt->status;
+    w->modulation[n] = pkt->modulation;
+    w->bandwidth[n] = pkt->bandwidth;
+    w->coderate[n] = pkt->coderate;
+    memcpy(&w->payload[w->hdr.payload_len], pkt->payload, pkt->size);
+    w->hdr.payload_len += pkt->size;
+    w->hdr.nb_rec = n + 1;
+
+    if (w->hdr.nb_rec == PC_BLOCK_RECORDS)
+        return pc_flush(w);
+    return 0;
+}
+
+/** 
+ * Write current block if not empty. Return 0 on success, -1 on write error.
+ * w - An pointer to writer
+ */
+int pc_flush(struct pc_writer *w) {
+    static const uint8_t pad[8] = {0};
+    const void *col[PC_COLUMNS] = {
+        w->time_us, w->count_us, w->freq_hz, w->datarate, w->devaddr, w->payload_off,
+        w->rssi, w->snr, w->crc, w->size,
+        w->if_chain, w->rf_chain, w->status, w->modulation, w->bandwidth, w->coderate
+    };
+    struct iovec iov[PC_COLUMNS + 3];
+    uint32_t n = w->hdr.nb_rec;
+    uint32_t used;
+    int i, ret;
+
+    if (n == 0)
+        return 0;
+    w->hdr.length = pc_block_length(n, w->hdr.payload_len);
+
+    iov[0].iov_base = &w->hdr;
+    iov[0].iov_len = sizeof (struct pc_block_header);
+    used = iov[0].iov_len;
+    for (i = 0; i < PC_COLUMNS; i++) {
+        iov[i + 1].iov_base = (void *) col[i];
+        iov[i + 1].iov_len = n * pc_column_sizes[i];
+        used += iov[i + 1].iov_len;
+    }
+    iov[PC_COLUMNS + 1].iov_base = w->payload;
+    iov[PC_COLUMNS + 1].iov_len = w->hdr.payload_len;
+    used += w->hdr.payload_len;
+    iov[PC_COLUMNS + 2].iov_base = (void *) pad;
+    iov[PC_COLUMNS + 2].iov_len = w->hdr.length - used;
+
+    ret = pc_writev(w->fd, iov, PC_COLUMNS + 3);
+    if (ret != 0)
+        w->error = errno;
+
+    memset(&w->hdr, 0, sizeof (struct pc_block_header));
+    w->hdr.magic = PC_BLOCK_MAGIC;
+    return ret;
+}
+
+/** 
+ * Write current block and close file. Return 0 on success, -1 if any 
+ * write failed.
+ * w - An pointer to writer
+ */
+int pc_close(struct pc_writer *w) {
+    pc_flush(w);
+    close(w->fd);
+    return (w->error != 0) ? -1 : 0;
+}
+
+/** 
+ * Map capture file and check its header. Return 0 on success, -1 on error.
+ * r    - An pointer to reader
+ * path - Capture file name
+ */
+int pc_reader_open(struct pc_reader *r, const char *path) {
+    struct stat st;
+    void *base;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof (struct pc_file_header)) {
+        close(fd);
+        return -1;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return -1;
+
+    r->base = (const uint8_t *) base;
+    r->len = st.st_size;
+    r->pos = sizeof (struct pc_file_header);
+    r->hdr = (const struct pc_file_header *) base;
+    if (memcmp(r->hdr->magic, PC_MAGIC, sizeof (r->hdr->magic)) != 0 || r->hdr->version != PC_VERSION || r->hdr->byte_order != PC_BYTE_ORDER) {
+        pc_reader_close(r);
+        return -1;
+    }
+    return 0;
+}
+
+/** 
+ * The pc_reader_next() point columns of next block into mapped file. 
+ * Return 1 on block, 0 at end of file and -1 on damaged or truncated block.
+ * r - An pointer to reader
+ * b - An pointer to block columns
+ */
+int pc_reader_next(struct pc_reader *r, struct pc_block *b) {
+    const struct pc_block_header *hdr;
+    const uint8_t *col[PC_COLUMNS];
+    const uint8_t *p;
+    int i;
+
+    if (r->pos == r->len)
+        return 0;
+    if (r->len - r->pos < sizeof (struct pc_block_header))
+        return -1;
+    hdr = (const struct pc_block_header *) (r->base + r->pos);
+    if (hdr->magic != PC_BLOCK_MAGIC || hdr->nb_rec > PC_BLOCK_RECORDS || hdr->payload_len > PC_BLOCK_RECORDS * 256)
+        return -1;
+    if (hdr->length != pc_block_length(hdr->nb_rec, hdr->payload_len) || hdr->length > r->len - r->pos)
+        return -1;
+
+    p = (const uint8_t *) (hdr + 1);
+    for (i = 0; i < PC_COLUMNS; i++) {
+        col[i] = p;
+        p += hdr->nb_rec * pc_column_sizes[i];
+    }
+    b->hdr = hdr;
+    b->time_us = (const uint64_t *) col[0];
+    b->count_us = (const uint32_t *) col[1];
+    b->freq_hz = (const uint32_t *) col[2];
+    b->datarate = (const uint32_t *) col[3];
+    b->devaddr = (const uint32_t *) col[4];
+    b->payload_off = (const uint32_t *) col[5];
+    b->rssi = (const float *) col[6];
+    b->snr = (const float *) col[7];
+    b->crc = (const uint16_t *) col[8];
+    b->size = (const uint16_t *) col[9];
+    b->if_chain = col[10];
+    b->rf_chain = col[11];
+    b->status = col[12];
+    b->modulation = col[13];
+    b->bandwidth = col[14];
+    b->coderate = col[15];
+    b->payload = p;
+
+    r->pos += hdr->length;
+    return 1;
+}
+
+/** 
+ * Unmap capture file.
+ * r - An pointer to reader
+ */
+void pc_reader_close(struct pc_reader *r) {
+    munmap((void *) r->base, r->len);
+    r->base = NULL;
+}
@@ -0,0 +1,177 @@
+/**
+ * \file pkt_capture.h
+ * \brief Columnar binary packet capture of LoRaWAN packet logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "libloragw/inc/loragw_hal.h"
+
+#ifndef PKT_CAPTURE_H
+#define PKT_CAPTURE_H
+
+/** File and block identification, capture is stored in host byte order */
+#define PC_MAGIC "LGWCAP01"
+#define PC_VERSION 1
+#define PC_BLOCK_MAGIC 0x4B4C4250
+#define PC_BYTE_ORDER 0x01020304
+
+/** Records per block, a block is written when full or flushed */
+#define PC_BLOCK_RECORDS 1024
+
+/** DevAddr bloom filter of block, about 2% false positives at 200 devices */
+#define PC_BLOOM_BITS 2048
+#define PC_BLOOM_HASHES 3
+
+/** Number of columns in block */
+#define PC_COLUMNS 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** 
+     * Define structure for capture file header.
+     */
+    struct pc_file_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint64_t gateway;
+    };
+
+    /** 
+     * Define structure for block header. Header is followed by columns of 
+     * nb_rec values ordered by alignment (see pc_column_size) and payload 
+     * bytes, block is padded to 8 bytes. Time is in microseconds since epoch.
+     */
+    struct pc_block_header {
+        uint32_t magic;
+        uint32_t nb_rec;
+        uint32_t length;
+        uint32_t payload_len;
+        uint64_t time_min;
+        uint64_t time_max;
+        uint8_t bloom[PC_BLOOM_BITS / 8];
+    };
+
+    /** 
+     * Define structure for block columns. Writer owns full size columns, 
+     * reader points them into mapped file.
+     */
+    struct pc_block {
+        const struct pc_block_header *hdr;
+        const uint64_t *time_us;
+        const uint32_t *count_us;
+        const uint32_t *freq_hz;
+        const uint32_t *datarate;
+        const uint32_t *devaddr;
+        const uint32_t *payload_off;
+        const float *rssi;
+        const float *snr;
+        const uint16_t *crc;
+        const uint16_t *size;
+        const uint8_t *if_chain;
+        const uint8_t *rf_chain;
+        const uint8_t *status;
+        const uint8_t *modulation;
+        const uint8_t *bandwidth;
+        const uint8_t *coderate;
+        const uint8_t *payload;
+    };
+
+    /** 
+     * Define structure for capture writer, current block is kept as columns.
+     */
+    struct pc_writer {
+        int fd;
+        int error;
+        struct pc_block_header hdr;
+        uint64_t time_us[PC_BLOCK_RECORDS];
+        uint32_t count_us[PC_BLOCK_RECORDS];
+        uint32_t freq_hz[PC_BLOCK_RECORDS];
+        uint32_t datarate[PC_BLOCK_RECORDS];
+        uint32_t devaddr[PC_BLOCK_RECORDS];
+        uint32_t payload_off[PC_BLOCK_RECORDS];
+        float rssi[PC_BLOCK_RECORDS];
+        float snr[PC_BLOCK_RECORDS];
+        uint16_t crc[PC_BLOCK_RECORDS];
+        uint16_t size[PC_BLOCK_RECORDS];
+        uint8_t if_chain[PC_BLOCK_RECORDS];
+        uint8_t rf_chain[PC_BLOCK_RECORDS];
+        uint8_t status[PC_BLOCK_RECORDS];
+        uint8_t modulation[PC_BLOCK_RECORDS];
+        uint8_t bandwidth[PC_BLOCK_RECORDS];
+        uint8_t coderate[PC_BLOCK_RECORDS];
+        uint8_t payload[PC_BLOCK_RECORDS * 256];
+    };
+
+    /** 
+     * Define structure for capture reader over mapped file.
+     */
+    struct pc_reader {
+        const uint8_t *base;
+        size_t len;
+        size_t pos;
+        const struct pc_file_header *hdr;
+    };
+
+    size_t pc_column_size(int col);
+    bool pc_devaddr(const uint8_t *payload, uint16_t size, uint32_t *addr);
+    bool pc_bloom_test(const struct pc_block_header *hdr, uint32_t addr);
+
+    int pc_open(struct pc_writer *w, int fd, uint64_t gateway);
+    int pc_append(struct pc_writer *w, const struct lgw_pkt_rx_s *pkt, uint64_t time_us);
+    int pc_flush(struct pc_writer *w);
+    int pc_close(struct pc_writer *w);
+
+    int pc_reader_open(struct pc_reader *r, const char *path);
+    int pc_reader_next(struct pc_reader *r, struct pc_block *b);
+    void pc_reader_close(struct pc_reader *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PKT_CAPTURE_H */
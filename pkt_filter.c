@@ -0,0 +1,156 @@
+/**
+ * \file pkt_filter.c
+ * \brief Filter of received packets on raw payload and radio metadata.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <string.h>
+#include <math.h>
+#include "pkt_filter.h"
+
+/**
+ * PacketFilter
+ * Rules of filter_conf are compiled once into lookups, so packets of 
+ * foreign networks, unwanted MTypes, CRC errors or weak signal are dropped 
+ * right after fetch with a few instructions, before any conversion. 
+ * DevAddr prefixes are allow-list of own networks, NetIDs are turned into 
+ * their DevAddr prefix (LoRaWAN Backend Interfaces, DevAddr type prefix 
+ * followed by NwkID). Frames without DevAddr (join, proprietary) pass the 
+ * prefix rule.
+ */
+
+/** NwkID length in bits per NetID type */
+static const uint8_t pf_nwkid_bits[8] = {6, 6, 9, 11, 12, 13, 15, 17};
+
+/** 
+ * Set rules letting every packet pass.
+ * r - An pointer to rules
+ */
+void pf_rules_init(struct pf_rules *r) {
+    memset(r, 0, sizeof (struct pf_rules));
+    r->mtype_mask = 0xFF;
+}
+
+/** 
+ * Add DevAddr prefix to allow-list. Return 0 on success, -1 when list is 
+ * full or length invalid.
+ * r      - An pointer to rules
+ * prefix - DevAddr prefix, most significant bits
+ * len    - Prefix length in bits, 0 - 32
+ */
+int pf_add_prefix(struct pf_rules *r, uint32_t prefix, uint8_t len) {
+    if (r->nb_prefix == PF_MAX_PREFIXES || len > 32)
+        return -1;
+    r->prefix[r->nb_prefix] = (len == 0) ? 0 : prefix & (0xFFFFFFFFu << (32 - len));
+    r->prefix_len[r->nb_prefix] = len;
+    r->nb_prefix++;
+    return 0;
+}
+
+/** 
+ * Add DevAddr prefix of NetID to allow-list. Return 0 on success, -1 when 
+ * list is full.
+ * r     - An pointer to rules
+ * netid - 24 bit NetID
+ */
+int pf_add_netid(struct pf_rules *r, uint32_t netid) {
+    uint8_t type = (netid >> 21) & 7;
+    uint8_t bits = pf_nwkid_bits[type];
+    uint8_t len = type + 1 + bits;
+    uint32_t value = ((((uint32_t) 1 << type) - 1) << 1 << bits) | (netid & (((uint32_t) 1 << bits) - 1));
+
+    return pf_add_prefix(r, value << (32 - len), len);
+}
+
+/** 
+ * Compile rules to lookup tables.
+ * r - An pointer to rules
+ * f - An pointer to compiled filter
+ */
+void pf_compile(const struct pf_rules *r, struct pf_filter *f) {
+    uint32_t top_mask;
+    int i, b;
+
+    memset(f, 0, sizeof (struct pf_filter));
+    if (r->crc_ok_only)
+        f->status[STAT_CRC_OK >> 6] = (uint64_t) 1 << (STAT_CRC_OK & 63);
+    else
+        memset(f->status, 0xFF, sizeof f->status);
+    f->mtype = r->mtype_mask;
+    f->min_rssi = r->rssi_set ? r->min_rssi : -INFINITY;
+    f->min_snr = r->snr_set ? r->min_snr : -INFINITY;
+
+    if (r->nb_prefix == 0) {
+        memset(f->top, PF_ACCEPT, sizeof f->top);
+        return;
+    }
+    f->addr_mtype = PF_ADDR_MTYPES;
+    for (i = 0; i < r->nb_prefix; i++) {
+        if (r->prefix_len[i] <= 8) {
+            top_mask = (r->prefix_len[i] == 0) ? 0 : (0xFFu << (8 - r->prefix_len[i])) & 0xFF;
+            for (b = 0; b < 256; b++) {
+                if (((uint32_t) b & top_mask) == (r->prefix[i] >> 24))
+                    f->top[b] = PF_ACCEPT;
+            }
+        } else {
+            b = r->prefix[i] >> 24;
+            if (f->top[b] != PF_ACCEPT)
+                f->top[b] = PF_CHECK;
+            f->long_prefix[f->nb_long] = r->prefix[i];
+            f->long_mask[f->nb_long] = 0xFFFFFFFFu << (32 - r->prefix_len[i]);
+            f->nb_long++;
+        }
+    }
+}
+
+/** 
+ * Compare DevAddr with prefixes longer than 8 bits.
+ * f        - An pointer to compiled filter
+ * dev_addr - DevAddr
+ */
+bool pf_check_long(const struct pf_filter *f, uint32_t dev_addr) {
+    uint8_t i;
+
+    for (i = 0; i < f->nb_long; i++) {
+        if ((dev_addr & f->long_mask[i]) == f->long_prefix[i])
+            return true;
+    }
+    return false;
+}
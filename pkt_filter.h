@@ -0,0 +1,138 @@
+/**
+ * \file pkt_filter.h
+ * \brief Filter of received packets on raw payload and radio metadata.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "libloragw/inc/loragw_hal.h"
+
+#ifndef PKT_FILTER_H
+#define PKT_FILTER_H
+
+/** Maximum number of DevAddr prefixes, NetIDs included */
+#define PF_MAX_PREFIXES 16
+
+/** MTypes with DevAddr in bytes 1 - 4, unconfirmed and confirmed data up and down */
+#define PF_ADDR_MTYPES 0x3C
+
+/** Lookup result of DevAddr most significant byte */
+#define PF_REJECT 0
+#define PF_ACCEPT 1
+#define PF_CHECK 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** 
+     * Define structure for filter rules of filter_conf section, unset rules 
+     * let every packet pass.
+     */
+    struct pf_rules {
+        bool crc_ok_only;
+        uint8_t mtype_mask;
+        bool rssi_set;
+        float min_rssi;
+        bool snr_set;
+        float min_snr;
+        uint8_t nb_prefix;
+        uint32_t prefix[PF_MAX_PREFIXES];
+        uint8_t prefix_len[PF_MAX_PREFIXES];
+    };
+
+    /** 
+     * Define structure for compiled filter, every rule is a lookup or a 
+     * compare. DevAddr prefixes are resolved by lookup of its most 
+     * significant byte, only prefixes longer than 8 bits are compared.
+     */
+    struct pf_filter {
+        uint64_t status[4];
+        uint8_t mtype;
+        uint8_t addr_mtype;
+        float min_rssi;
+        float min_snr;
+        uint8_t top[256];
+        uint8_t nb_long;
+        uint32_t long_prefix[PF_MAX_PREFIXES];
+        uint32_t long_mask[PF_MAX_PREFIXES];
+    };
+
+    void pf_rules_init(struct pf_rules *r);
+    int pf_add_prefix(struct pf_rules *r, uint32_t prefix, uint8_t len);
+    int pf_add_netid(struct pf_rules *r, uint32_t netid);
+    void pf_compile(const struct pf_rules *r, struct pf_filter *f);
+    bool pf_check_long(const struct pf_filter *f, uint32_t dev_addr);
+
+    /** 
+     * The pf_pass() return true when packet passes filter, works on radio 
+     * metadata and raw MHDR and DevAddr bytes, no parsing.
+     * f - An pointer to compiled filter
+     * p - An pointer to received packet
+     */
+    static inline bool pf_pass(const struct pf_filter *f, const struct lgw_pkt_rx_s *p) {
+        const uint8_t *b = p->payload;
+        uint8_t mtype, top;
+
+        if (!((f->status[p->status >> 6] >> (p->status & 63)) & 1))
+            return false;
+        if (p->rssi < f->min_rssi || p->snr < f->min_snr)
+            return false;
+        if (p->size == 0)
+            return f->mtype == 0xFF;
+        mtype = b[0] >> 5;
+        if (!((f->mtype >> mtype) & 1))
+            return false;
+        if (!((f->addr_mtype >> mtype) & 1))
+            return true;
+        if (p->size < 5)
+            return false;
+        top = f->top[b[4]]; /* DevAddr is little endian */
+        if (top != PF_CHECK)
+            return top == PF_ACCEPT;
+        return pf_check_long(f, (uint32_t) b[1] | (uint32_t) b[2] << 8 | (uint32_t) b[3] << 16 | (uint32_t) b[4] << 24);
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PKT_FILTER_H */
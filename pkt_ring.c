@@ -0,0 +1,162 @@
+/**
+ * \file pkt_ring.c
+ * \brief Lock-free packet ring of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "pkt_ring.h"
+
+/** 
+ * PacketRing
+ * Preallocated ring of received packets between fetch thread (producer) 
+ * and export thread (consumer). Packets stay in slab of fetch thread, only 
+ * their address goes through and export thread frees them. Indexes run freely and are masked 
+ * on access, so the ring size must be power of two. Head is published with 
+ * release semantic after slot is written, tail after slot is read.
+ */
+
+/** 
+ * Initialization packet ring.
+ * ring - An pointer to ring
+ * size - Number of slots, rounded up to power of two
+ */
+int pr_init(struct pr_ring *ring, uint32_t size) {
+    uint32_t _size = 1;
+
+    while (_size < size && _size < (1u << 31))
+        _size <<= 1;
+
+    memset(ring, 0, sizeof (struct pr_ring));
+    ring->slots = (struct pk_pkt**) calloc(_size, sizeof (struct pk_pkt*));
+    if (ring->slots == NULL)
+        return -1;
+
+    ring->size = _size;
+    ring->mask = _size - 1;
+
+    return 0;
+}
+
+/** 
+ * Release packet ring.
+ * ring - An pointer to ring
+ */
+void pr_free(struct pr_ring *ring) {
+    free(ring->slots);
+    ring->slots = NULL;
+    ring->size = 0;
+    ring->mask = 0;
+}
+
+/** 
+ * Producer side, queue packet. Return false and count drop if full.
+ * ring - An pointer to ring
+ * pkt  - An pointer to received packet
+ */
+bool pr_push(struct pr_ring *ring, struct pk_pkt *pkt) {
+    uint32_t head = ring->head;
+    uint32_t used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if (used >= ring->size) {
+        ring->drops++;
+        return false;
+    }
+
+    ring->slots[head & ring->mask] = pkt;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    if (used + 1 > ring->high_water)
+        ring->high_water = used + 1;
+
+    return true;
+}
+
+/** 
+ * Consumer side, take oldest packet. Return false if empty.
+ * ring - An pointer to ring
+ * pkt  - An pointer to store packet
+ */
+bool pr_pop(struct pr_ring *ring, struct pk_pkt **pkt) {
+    uint32_t tail = ring->tail;
+
+    if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+        return false;
+
+    *pkt = ring->slots[tail & ring->mask];
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/** 
+ * The pr_count() return number of packets waiting in ring.
+ * ring - An pointer to ring
+ */
+uint32_t pr_count(struct pr_ring *ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/** 
+ * Producer side, copy HAL descriptor to slab of producer and queue it. 
+ * Producer never waits for consumer, it must keep serving downlinks and 
+ * concentrator FIFO. When ring or slab is full packet is dropped and counted 
+ * in ring drops, return false then.
+ * ring - An pointer to ring
+ * slab - An pointer to slab of producer
+ * p    - An pointer to packet descriptor, may be released on return
+ */
+bool pr_push_copy(struct pr_ring *ring, struct pk_slab *slab, const struct lgw_pkt_rx_s *p) {
+    struct pk_pkt *pkt;
+
+    if (pr_count(ring) >= ring->size) {
+        ring->drops++;
+        return false;
+    }
+    if ((pkt = pk_copy(slab, p)) == NULL) {
+        ring->drops++;
+        return false;
+    }
+    return pr_push(ring, pkt);
+}
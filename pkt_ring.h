@@ -0,0 +1,89 @@
+/**
+ * \file pkt_ring.h
+ * \brief Lock-free packet ring of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "pkt_slab.h"
+
+#ifndef PKT_RING_H
+#define PKT_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Cache line size, producer and consumer indexes never share one */
+#define PR_CACHE_LINE 64
+
+    /** 
+     * Define structure for single-producer/single-consumer ring of slab 
+     * packets. Only fetch thread writes head and only export thread 
+     * writes tail.
+     */
+    struct pr_ring {
+        struct pk_pkt **slots;
+        uint32_t size;
+        uint32_t mask;
+        uint32_t head __attribute__((aligned(PR_CACHE_LINE)));
+        uint32_t high_water;
+        uint64_t drops;
+        uint32_t tail __attribute__((aligned(PR_CACHE_LINE)));
+    };
+
+    int pr_init(struct pr_ring *ring, uint32_t size);
+    void pr_free(struct pr_ring *ring);
+
+    bool pr_push(struct pr_ring *ring, struct pk_pkt *pkt);
+    bool pr_pop(struct pr_ring *ring, struct pk_pkt **pkt);
+    bool pr_push_copy(struct pr_ring *ring, struct pk_slab *slab, const struct lgw_pkt_rx_s *p);
+    uint32_t pr_count(struct pr_ring *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PKT_RING_H */
+
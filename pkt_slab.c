@@ -0,0 +1,234 @@
+/**
+ * \file pkt_slab.c
+ * \brief Compact packets in size-classed slabs of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "pkt_slab.h"
+
+/** 
+ * PktSlab
+ * Packets queued inside the logger are stored as one cache line of 
+ * metadata followed by payload rounded up to whole cache lines, 64 to 256 
+ * bytes. Typical uplinks of 20 - 60 bytes take 128 bytes instead of a full 
+ * HAL descriptor, so rings and windows hold several times more packets in 
+ * the same cache footprint. Each size class is a free list of preallocated 
+ * objects, allocation and free are a few pointer operations.
+ */
+
+typedef char pk_line_check[(sizeof (struct pk_pkt) == PK_CACHE_LINE) ? 1 : -1];
+
+/** 
+ * Allocate slab for given number of queued packets. Half of them get own 
+ * object of the 64 and 128 byte classes each, a quarter of the 192 byte 
+ * class and all of them of the 256 byte class. Payload overflows to larger 
+ * class, so any mix of uplinks up to maximum size fits, small ones keep the 
+ * 256 byte objects free for bursts of large frames. Return 0 on success, -1 
+ * on allocation failure.
+ * slab    - An pointer to slab
+ * packets - Number of packets queued at once
+ */
+int pk_init(struct pk_slab *slab, uint32_t packets) {
+    static const uint32_t share[PK_CLASSES] = {2, 2, 4, 1};
+    struct pk_class *c;
+    struct pk_pkt *o;
+    uint32_t i, k;
+
+    memset(slab, 0, sizeof *slab);
+    for (k = 0; k < PK_CLASSES; k++) {
+        c = &slab->cls[k];
+        c->obj_size = PK_CACHE_LINE + (k + 1) * PK_CLASS_STEP;
+        c->count = (packets + share[k] - 1) / share[k];
+        if (posix_memalign((void**) &c->mem, PK_CACHE_LINE, (size_t) c->count * c->obj_size) != 0) {
+            c->mem = NULL;
+            pk_destroy(slab);
+            return -1;
+        }
+        for (i = c->count; i-- > 0;) {
+            o = (struct pk_pkt*) (c->mem + (size_t) i * c->obj_size);
+            o->payload = (uint8_t*) (o + 1);
+            o->slab = slab;
+            o->cls = (uint8_t) k;
+            o->next = c->free;
+            c->free = o;
+        }
+    }
+    return 0;
+}
+
+/** 
+ * Release slab memory, no packet of slab may be used afterwards.
+ */
+void pk_destroy(struct pk_slab *slab) {
+    int k;
+
+    for (k = 0; k < PK_CLASSES; k++) {
+        free(slab->cls[k].mem);
+        slab->cls[k].mem = NULL;
+        slab->cls[k].free = NULL;
+        slab->cls[k].returned = NULL;
+    }
+}
+
+/** 
+ * Take free object of smallest class holding size bytes, owning thread only.
+ */
+static struct pk_pkt *pk_alloc(struct pk_slab *slab, uint16_t size) {
+    struct pk_class *c;
+    struct pk_pkt *o;
+    int k;
+
+    for (k = 0; k < PK_CLASSES; k++) {
+        c = &slab->cls[k];
+        if ((uint32_t) (k + 1) * PK_CLASS_STEP < size)
+            continue;
+        if (c->free == NULL && __atomic_load_n(&c->returned, __ATOMIC_RELAXED) != NULL)
+            c->free = __atomic_exchange_n(&c->returned, NULL, __ATOMIC_ACQUIRE);
+        if (c->free != NULL) {
+            o = c->free;
+            c->free = o->next;
+            return o;
+        }
+    }
+    slab->failed++;
+    return NULL;
+}
+
+/** 
+ * Copy HAL descriptor to slab packet. Return NULL when no object is free.
+ * slab - An pointer to slab of calling thread
+ * p    - An pointer to packet descriptor
+ */
+struct pk_pkt *pk_copy(struct pk_slab *slab, const struct lgw_pkt_rx_s *p) {
+    struct pk_pkt *o = pk_alloc(slab, p->size);
+    uint8_t *payload, cls;
+
+    if (o == NULL)
+        return NULL;
+    payload = o->payload;
+    cls = o->cls;
+    pk_view(o, p);
+    o->payload = payload;
+    o->slab = slab;
+    o->cls = cls;
+    memcpy(o->payload, p->payload, p->size);
+    return o;
+}
+
+/** 
+ * Copy packet to slab of calling thread. Return NULL when no object is free.
+ * slab - An pointer to slab of calling thread
+ * p    - An pointer to packet
+ */
+struct pk_pkt *pk_dup(struct pk_slab *slab, const struct pk_pkt *p) {
+    struct pk_pkt *o = pk_alloc(slab, p->size);
+    uint8_t *payload, cls;
+
+    if (o == NULL)
+        return NULL;
+    payload = o->payload;
+    cls = o->cls;
+    *o = *p;
+    o->payload = payload;
+    o->slab = slab;
+    o->cls = cls;
+    memcpy(o->payload, p->payload, p->size);
+    return o;
+}
+
+/** 
+ * Give packet back to its slab, any thread may free. Views are ignored.
+ * pkt - An pointer to packet
+ */
+void pk_free(struct pk_pkt *pkt) {
+    struct pk_class *c;
+
+    if (pkt == NULL || pkt->slab == NULL)
+        return;
+    c = &pkt->slab->cls[pkt->cls];
+    pkt->next = __atomic_load_n(&c->returned, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&c->returned, &pkt->next, pkt, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+}
+
+/** 
+ * Fill packet referring to payload of HAL descriptor, no copy is made and 
+ * view is valid as long as the descriptor.
+ * v - An pointer to view
+ * p - An pointer to packet descriptor
+ */
+void pk_view(struct pk_pkt *v, const struct lgw_pkt_rx_s *p) {
+    v->payload = (uint8_t*) p->payload;
+    v->slab = NULL;
+    v->next = NULL;
+    v->freq_hz = p->freq_hz;
+    v->count_us = p->count_us;
+    v->datarate = p->datarate;
+    v->rssi = p->rssi;
+    v->snr = p->snr;
+    v->snr_min = p->snr_min;
+    v->snr_max = p->snr_max;
+    v->crc = p->crc;
+    v->size = p->size;
+    v->if_chain = p->if_chain;
+    v->status = p->status;
+    v->rf_chain = p->rf_chain;
+    v->modulation = p->modulation;
+    v->bandwidth = p->bandwidth;
+    v->coderate = p->coderate;
+    v->cls = 0;
+}
+
+/** 
+ * The pk_bytes() return memory held by slab.
+ */
+size_t pk_bytes(const struct pk_slab *slab) {
+    size_t bytes = 0;
+    int k;
+
+    for (k = 0; k < PK_CLASSES; k++)
+        bytes += (size_t) slab->cls[k].count * slab->cls[k].obj_size;
+    return bytes;
+}
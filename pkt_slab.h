@@ -0,0 +1,126 @@
+/**
+ * \file pkt_slab.h
+ * \brief Compact packets in size-classed slabs of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "libloragw/inc/loragw_hal.h"
+
+#ifndef PKT_SLAB_H
+#define PKT_SLAB_H
+
+/** Cache line holding packet metadata, payload starts on the next one */
+#define PK_CACHE_LINE 64
+
+/** Number of payload size classes, class c holds (c + 1) * PK_CLASS_STEP bytes */
+#define PK_CLASSES 4
+#define PK_CLASS_STEP PK_CACHE_LINE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    struct pk_slab;
+
+    /** 
+     * Define structure for packet of internal pipeline. Fields keep names 
+     * of struct lgw_pkt_rx_s, metadata fills one cache line and payload of 
+     * slab packet follows it directly.
+     */
+    struct pk_pkt {
+        uint8_t *payload;
+        struct pk_slab *slab; /* owner, NULL for view of HAL descriptor */
+        struct pk_pkt *next; /* free list link */
+        uint32_t freq_hz;
+        uint32_t count_us;
+        uint32_t datarate;
+        float rssi;
+        float snr;
+        float snr_min;
+        float snr_max;
+        uint16_t crc;
+        uint16_t size;
+        uint8_t if_chain;
+        uint8_t status;
+        uint8_t rf_chain;
+        uint8_t modulation;
+        uint8_t bandwidth;
+        uint8_t coderate;
+        uint8_t cls;
+    } __attribute__((aligned(PK_CACHE_LINE)));
+
+    /** 
+     * Define structure for one size class. Only owning thread allocates, 
+     * packets freed by other threads are pushed to returned list and taken 
+     * over as a whole when private list runs empty.
+     */
+    struct pk_class {
+        uint8_t *mem;
+        uint32_t obj_size;
+        uint32_t count;
+        struct pk_pkt *free;
+        struct pk_pkt *returned __attribute__((aligned(PK_CACHE_LINE)));
+    };
+
+    /** Define structure for slab of one allocating thread */
+    struct pk_slab {
+        struct pk_class cls[PK_CLASSES];
+        uint64_t failed;
+    };
+
+    int pk_init(struct pk_slab *slab, uint32_t packets);
+    void pk_destroy(struct pk_slab *slab);
+
+    struct pk_pkt *pk_copy(struct pk_slab *slab, const struct lgw_pkt_rx_s *p);
+    struct pk_pkt *pk_dup(struct pk_slab *slab, const struct pk_pkt *p);
+    void pk_free(struct pk_pkt *pkt);
+    void pk_view(struct pk_pkt *v, const struct lgw_pkt_rx_s *p);
+    size_t pk_bytes(const struct pk_slab *slab);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PKT_SLAB_H */
@@ -0,0 +1,409 @@
+/**
+ * \file pkt_source.c
+ * \brief Packet source of LoRaWAN logger, concentrator or capture replay.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hex.h"
+#include "pkt_capture.h"
+#include "pkt_source.h"
+
+/** 
+ * PacketSource
+ * Logger fetches packets through ps_receive() and gives descriptors back 
+ * by ps_release(), concentrator HAL is used unless replay was opened. 
+ * Replay reads CSV log of util_pkt_logger_cesnet or binary capture and 
+ * fills own descriptor ring with HAL semantic, oldest descriptors are 
+ * released first and from one thread. With speed > 0 packet is not 
+ * returned before its original receive time divided by speed elapsed, 
+ * with speed 0 every free descriptor is filled at once.
+ */
+
+/** Define structure for replay state */
+struct ps_replay {
+    FILE *csv;
+    char *line;
+    size_t line_cap;
+    bool binary;
+    struct pc_reader cap;
+    struct pc_block block;
+    uint32_t rec;
+    bool block_valid;
+    double speed;
+    bool eof;
+    bool has_next;
+    uint64_t next_us;
+    uint64_t first_us;
+    bool has_first;
+    struct timespec start;
+    uint64_t count;
+};
+
+static struct ps_replay rp;
+
+/* descriptor ring, slot at head holds read ahead packet until it is due */
+static struct lgw_pkt_rx_s rp_ring[LGW_RX_RING_SIZE];
+static uint32_t rp_head = 0;
+static uint32_t rp_tail = 0;
+
+/* descriptor ring of concentrator thread, export thread releases through it */
+static void *hal_ring = NULL;
+
+static int hal_start(void) {
+    hal_ring = lgw_rx_ring_get();
+    return lgw_start();
+}
+
+static int hal_release(uint8_t nb_pkt) {
+    return lgw_rx_release_ring(hal_ring, nb_pkt);
+}
+
+static bool hal_done(void) {
+    return false;
+}
+
+/** Strip spaces and quotes around CSV field */
+static char *rp_trim(char *s) {
+    char *end;
+
+    while (*s == ' ' || *s == '"')
+        s++;
+    end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '"' || end[-1] == '\n' || end[-1] == '\r'))
+        *--end = '\0';
+    return s;
+}
+
+/** 
+ * Parse CSV line of util_pkt_logger_cesnet log. Return false for header 
+ * and malformed lines.
+ */
+static bool rp_parse_csv(char *line, struct lgw_pkt_rx_s *p, uint64_t *time_us) {
+    char *f[17];
+    char *s = line;
+    struct tm tm;
+    int ms, n = 0;
+    long bw;
+
+    while (n < 17) {
+        f[n++] = s;
+        s = strchr(s, ',');
+        if (s == NULL)
+            break;
+        *s++ = '\0';
+    }
+    if (n < 16)
+        return false;
+    for (n = 0; n < 16; n++)
+        f[n] = rp_trim(f[n]);
+
+    memset(&tm, 0, sizeof tm);
+    if (sscanf(f[2], "%d-%d-%d %d:%d:%d.%dZ", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &ms) != 7)
+        return false;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    *time_us = (uint64_t) timegm(&tm) * 1000000 + (uint64_t) ms * 1000;
+
+    memset(p, 0, sizeof (struct lgw_pkt_rx_s));
+    p->count_us = strtoul(f[3], NULL, 10);
+    p->freq_hz = strtoul(f[4], NULL, 10);
+    p->rf_chain = atoi(f[5]);
+    p->if_chain = atoi(f[6]);
+
+    if (strcmp(f[7], "CRC_OK") == 0)
+        p->status = STAT_CRC_OK;
+    else if (strcmp(f[7], "CRC_BAD") == 0)
+        p->status = STAT_CRC_BAD;
+    else if (strcmp(f[7], "NO_CRC") == 0)
+        p->status = STAT_NO_CRC;
+    else
+        p->status = STAT_UNDEFINED;
+
+    if (strcmp(f[9], "LORA") == 0)
+        p->modulation = MOD_LORA;
+    else if (strcmp(f[9], "FSK") == 0)
+        p->modulation = MOD_FSK;
+    else
+        p->modulation = MOD_UNDEFINED;
+
+    bw = strtol(f[10], NULL, 10);
+    switch (bw) {
+        case 500000: p->bandwidth = BW_500KHZ;
+            break;
+        case 250000: p->bandwidth = BW_250KHZ;
+            break;
+        case 125000: p->bandwidth = BW_125KHZ;
+            break;
+        case 62500: p->bandwidth = BW_62K5HZ;
+            break;
+        case 31200: p->bandwidth = BW_31K2HZ;
+            break;
+        case 15600: p->bandwidth = BW_15K6HZ;
+            break;
+        case 7800: p->bandwidth = BW_7K8HZ;
+            break;
+        default: p->bandwidth = BW_UNDEFINED;
+    }
+
+    if (p->modulation == MOD_LORA && strncmp(f[11], "SF", 2) == 0) {
+        switch (atoi(f[11] + 2)) {
+            case 7: p->datarate = DR_LORA_SF7;
+                break;
+            case 8: p->datarate = DR_LORA_SF8;
+                break;
+            case 9: p->datarate = DR_LORA_SF9;
+                break;
+            case 10: p->datarate = DR_LORA_SF10;
+                break;
+            case 11: p->datarate = DR_LORA_SF11;
+                break;
+            case 12: p->datarate = DR_LORA_SF12;
+                break;
+            default: p->datarate = DR_UNDEFINED;
+        }
+    } else {
+        p->datarate = strtoul(f[11], NULL, 10);
+    }
+
+    if (strcmp(f[12], "4/5") == 0)
+        p->coderate = CR_LORA_4_5;
+    else if (strcmp(f[12], "2/3") == 0)
+        p->coderate = CR_LORA_4_6;
+    else if (strcmp(f[12], "4/7") == 0)
+        p->coderate = CR_LORA_4_7;
+    else if (strcmp(f[12], "1/2") == 0)
+        p->coderate = CR_LORA_4_8;
+    else
+        p->coderate = CR_UNDEFINED;
+
+    p->rssi = strtof(f[13], NULL);
+    p->snr = strtof(f[14], NULL);
+    if (strlen(f[15]) > 2 * sizeof (p->payload))
+        return false;
+    p->size = hx_decode(p->payload, f[15], strlen(f[15]));
+
+    return true;
+}
+
+/** Read next record of binary capture, damaged tail ends replay */
+static bool rp_read_binary(struct lgw_pkt_rx_s *p, uint64_t *time_us) {
+    const struct pc_block *b = &rp.block;
+    uint32_t i;
+
+    while (!rp.block_valid || rp.rec >= b->hdr->nb_rec) {
+        if (pc_reader_next(&rp.cap, &rp.block) != 1)
+            return false;
+        rp.block_valid = true;
+        rp.rec = 0;
+    }
+    i = rp.rec++;
+    if (b->payload_off[i] + b->size[i] > b->hdr->payload_len)
+        return false;
+
+    memset(p, 0, sizeof (struct lgw_pkt_rx_s));
+    *time_us = b->time_us[i];
+    p->count_us = b->count_us[i];
+    p->freq_hz = b->freq_hz[i];
+    p->datarate = b->datarate[i];
+    p->rssi = b->rssi[i];
+    p->snr = b->snr[i];
+    p->crc = b->crc[i];
+    p->size = b->size[i];
+    p->if_chain = b->if_chain[i];
+    p->rf_chain = b->rf_chain[i];
+    p->status = b->status[i];
+    p->modulation = b->modulation[i];
+    p->bandwidth = b->bandwidth[i];
+    p->coderate = b->coderate[i];
+    memcpy(p->payload, b->payload + b->payload_off[i], p->size);
+
+    return true;
+}
+
+static bool rp_read(struct lgw_pkt_rx_s *p, uint64_t *time_us) {
+    if (rp.binary)
+        return rp_read_binary(p, time_us);
+    while (getline(&rp.line, &rp.line_cap, rp.csv) >= 0) {
+        if (rp_parse_csv(rp.line, p, time_us))
+            return true;
+    }
+    return false;
+}
+
+static int replay_start(void) {
+    clock_gettime(CLOCK_MONOTONIC, &rp.start);
+    return LGW_HAL_SUCCESS;
+}
+
+static int replay_stop(void) {
+    if (rp.binary) {
+        pc_reader_close(&rp.cap);
+    } else {
+        fclose(rp.csv);
+        free(rp.line);
+    }
+    return LGW_HAL_SUCCESS;
+}
+
+static int replay_receive(uint8_t max_pkt, struct lgw_pkt_rx_s **pkt) {
+    struct lgw_pkt_rx_s *slot;
+    struct timespec now;
+    uint64_t elapsed_us = 0;
+    int nb_pkt = 0;
+
+    if (rp.speed > 0.0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_us = (uint64_t) (now.tv_sec - rp.start.tv_sec) * 1000000 + (now.tv_nsec - rp.start.tv_nsec) / 1000;
+    }
+
+    while (nb_pkt < max_pkt && rp_head - __atomic_load_n(&rp_tail, __ATOMIC_ACQUIRE) < LGW_RX_RING_SIZE) {
+        slot = &rp_ring[rp_head % LGW_RX_RING_SIZE];
+        if (!rp.has_next) {
+            if (rp.eof || !rp_read(slot, &rp.next_us)) {
+                rp.eof = true;
+                break;
+            }
+            rp.has_next = true;
+            if (!rp.has_first) {
+                rp.first_us = rp.next_us;
+                rp.has_first = true;
+            }
+        }
+        /* keep read ahead packet in slot until due, earlier timestamps go at once */
+        if (rp.speed > 0.0 && rp.next_us > rp.first_us && (double) (rp.next_us - rp.first_us) / rp.speed > (double) elapsed_us)
+            break;
+        rp.has_next = false;
+        pkt[nb_pkt++] = slot;
+        rp_head++;
+    }
+    rp.count += nb_pkt;
+
+    return nb_pkt;
+}
+
+static int replay_release(uint8_t nb_pkt) {
+    __atomic_add_fetch(&rp_tail, nb_pkt, __ATOMIC_RELEASE);
+    return LGW_HAL_SUCCESS;
+}
+
+static bool replay_done(void) {
+    return rp.eof && !rp.has_next;
+}
+
+static const struct ps_ops hal_ops = {"concentrator", hal_start, lgw_stop, lgw_receive_ring, hal_release, hal_done};
+static const struct ps_ops replay_ops = {"replay", replay_start, replay_stop, replay_receive, replay_release, replay_done};
+static const struct ps_ops *ops = &hal_ops;
+
+/** 
+ * Switch packet source to replay of capture, type is detected from file 
+ * header. Return 0 on success, -1 if file can not be opened.
+ * path  - CSV log or binary capture file name
+ * speed - Timing multiplier, 0 as fast as possible
+ */
+int ps_open_replay(const char *path, double speed) {
+    memset(&rp, 0, sizeof (struct ps_replay));
+    rp.speed = speed;
+    if (pc_reader_open(&rp.cap, path) == 0) {
+        rp.binary = true;
+    } else {
+        rp.csv = fopen(path, "r");
+        if (rp.csv == NULL)
+            return -1;
+    }
+    ops = &replay_ops;
+    return 0;
+}
+
+/** 
+ * The ps_name() return name of current packet source.
+ */
+const char *ps_name(void) {
+    return ops->name;
+}
+
+/** 
+ * The ps_is_replay() return true when packets do not come from concentrator.
+ */
+bool ps_is_replay(void) {
+    return ops == &replay_ops;
+}
+
+/** 
+ * The ps_count() return number of replayed packets.
+ */
+uint64_t ps_count(void) {
+    return rp.count;
+}
+
+int ps_start(void) {
+    return ops->start();
+}
+
+int ps_stop(void) {
+    return ops->stop();
+}
+
+/** 
+ * Fetch up to max_pkt packets, descriptors stay valid until ps_release().
+ * max_pkt - Maximum number of packets
+ * pkt     - An pointer to array of packet descriptors
+ */
+int ps_receive(uint8_t max_pkt, struct lgw_pkt_rx_s **pkt) {
+    return ops->receive(max_pkt, pkt);
+}
+
+/** 
+ * Give back nb_pkt oldest descriptors.
+ * nb_pkt - Number of descriptors
+ */
+int ps_release(uint8_t nb_pkt) {
+    return ops->release(nb_pkt);
+}
+
+/** 
+ * The ps_done() return true when source has no more packets.
+ */
+bool ps_done(void) {
+    return ops->done();
+}
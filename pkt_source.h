@@ -0,0 +1,89 @@
+/**
+ * \file pkt_source.h
+ * \brief Packet source of LoRaWAN logger, concentrator or capture replay.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "libloragw/inc/loragw_hal.h"
+
+#ifndef PKT_SOURCE_H
+#define PKT_SOURCE_H
+
+/** Default replay speed, 1 keeps original timing and 0 replays as fast as possible */
+#define PS_DEFAULT_SPEED 1.0
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** 
+     * Define structure for packet source operations, same contract as 
+     * lgw_receive_ring() and lgw_rx_release() of the HAL.
+     */
+    struct ps_ops {
+        const char *name;
+        int (*start)(void);
+        int (*stop)(void);
+        int (*receive)(uint8_t max_pkt, struct lgw_pkt_rx_s **pkt);
+        int (*release)(uint8_t nb_pkt);
+        bool (*done)(void);
+    };
+
+    int ps_open_replay(const char *path, double speed);
+    const char *ps_name(void);
+    bool ps_is_replay(void);
+    uint64_t ps_count(void);
+
+    int ps_start(void);
+    int ps_stop(void);
+    int ps_receive(uint8_t max_pkt, struct lgw_pkt_rx_s **pkt);
+    int ps_release(uint8_t nb_pkt);
+    bool ps_done(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PKT_SOURCE_H */
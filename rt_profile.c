@@ -0,0 +1,145 @@
+/**
+ * \file rt_profile.c
+ * \brief Realtime execution profile of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE /* mallopt */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "metrics.h"
+#include "rt_profile.h"
+
+#define MSG(args...) fprintf(stderr,"cesnet_pkt_analyzer: " args)
+
+/** 
+ * RtProfile
+ * Fetch thread runs SCHED_FIFO, pinning is done by mb_pin(). With 
+ * lock_memory the process is locked by mlockall(): pages mapped so far 
+ * (rings, UniRec records, key caches, HAL descriptors) are populated at 
+ * once and later mappings are populated when created. Heap is never trimmed 
+ * and large blocks do not use mmap, so memory freed and allocated again in 
+ * the hot path stays resident.
+ */
+
+static __thread uint32_t rt_max_us = 0;
+
+/**
+ * Initialize realtime profile with defaults, profile disabled.
+ * conf - An pointer to profile.
+ */
+void rt_init(struct rt_conf *conf) {
+    memset(conf, 0, sizeof *conf);
+    conf->cpu = -1;
+    conf->priority = RT_DEFAULT_PRIORITY;
+    conf->lock_memory = true;
+    conf->threshold_us = RT_DEFAULT_THRESHOLD_US;
+}
+
+/** Touch stack pages fetch loop may use, so they are mapped and locked */
+static void __attribute__((noinline)) rt_prefault_stack(void) {
+    volatile char stack[RT_PREFAULT_STACK];
+    long page = sysconf(_SC_PAGESIZE);
+    size_t i;
+
+    if (page <= 0)
+        page = 4096;
+    for (i = 0; i < sizeof stack; i += (size_t) page)
+        stack[i] = 0;
+}
+
+/**
+ * Apply profile to calling thread and process, must be called after all 
+ * buffers are allocated. Return number of steps that failed.
+ * conf - An pointer to profile.
+ */
+int rt_apply(const struct rt_conf *conf) {
+    struct sched_param sp;
+    int err, failed = 0;
+
+    if (!conf->enable)
+        return 0;
+
+    if (conf->lock_memory) {
+        mallopt(M_TRIM_THRESHOLD, -1);
+        mallopt(M_MMAP_MAX, 0);
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            MSG("WARNING: memory could not be locked (%s)\n", strerror(errno));
+            failed++;
+        }
+        rt_prefault_stack();
+    }
+    if (conf->priority > 0) {
+        memset(&sp, 0, sizeof sp);
+        sp.sched_priority = conf->priority;
+        err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+        if (err != 0) {
+            MSG("WARNING: fetch thread could not be set to SCHED_FIFO priority %d (%s)\n", conf->priority, strerror(err));
+            failed++;
+        }
+    }
+    MSG("INFO: realtime profile applied, CPU %d, priority %d, memory %s\n", conf->cpu, conf->priority, conf->lock_memory ? "locked" : "not locked");
+    return failed;
+}
+
+/**
+ * Count scheduling latency outlier of calling thread.
+ * late_us - Wake-up delay past deadline in microseconds.
+ */
+void rt_outlier(uint32_t late_us) {
+    MT_INC(sched_outliers);
+    MT_ADD(sched_late_us, late_us);
+    if (late_us > rt_max_us)
+        rt_max_us = late_us;
+}
+
+/**
+ * Return largest outlier of calling thread in microseconds.
+ */
+uint32_t rt_late_max(void) {
+    return rt_max_us;
+}
@@ -0,0 +1,94 @@
+/**
+ * \file rt_profile.h
+ * \brief Realtime execution profile of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef RT_PROFILE_H
+#define RT_PROFILE_H
+
+/** SCHED_FIFO priority of fetch thread, below threaded IRQ handlers (50) the SPI transfers depend on */
+#define RT_DEFAULT_PRIORITY 40
+
+/** Wake-up later than this counts as scheduling latency outlier */
+#define RT_DEFAULT_THRESHOLD_US 1000
+
+/** Stack prefaulted for fetch thread */
+#define RT_PREFAULT_STACK (256 * 1024)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** 
+     * Define structure for realtime profile, read from realtime object of 
+     * gateway_conf. Disabled profile leaves scheduling and memory untouched.
+     */
+    struct rt_conf {
+        bool enable;
+        int cpu;
+        int priority;
+        bool lock_memory;
+        uint32_t threshold_us;
+    };
+
+    void rt_init(struct rt_conf *conf);
+    int rt_apply(const struct rt_conf *conf);
+    void rt_outlier(uint32_t late_us);
+    uint32_t rt_late_max(void);
+
+    /** 
+     * The rt_observe() count wake-up latency of calling thread as outlier 
+     * when above threshold of enabled profile.
+     */
+    static inline void rt_observe(const struct rt_conf *conf, uint32_t late_us) {
+        if (conf->enable && late_us > conf->threshold_us)
+            rt_outlier(late_us);
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RT_PROFILE_H */
@@ -0,0 +1,333 @@
+/**
+ * \file rx_scheduler.c
+ * \brief Receive scheduler of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE /* ppoll */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include "rx_scheduler.h"
+#include "lora_packet.h"
+
+/** Polling interval used inside predicted arrival window */
+#define RS_WINDOW_POLL_US 500
+
+/** 
+ * RxScheduler
+ * Decide how long the main loop sleeps between two lgw_receive() calls. 
+ * Fixed mode keeps the historical 3 ms sleep. Adaptive mode polls again at 
+ * once while the FIFO is draining, backs off exponentially when it is empty 
+ * and never sleeps longer than it takes the current SF/BW mix to fill the 
+ * 16 entry SX1301 FIFO. It also wakes up at the predicted next arrival, or 
+ * on the SX1301 interrupt GPIO when the board has one.
+ */
+
+static int64_t rs_elapsed_us(const struct timespec *from, const struct timespec *to) {
+    return (int64_t) (to->tv_sec - from->tv_sec) * 1000000 + (to->tv_nsec - from->tv_nsec) / 1000;
+}
+
+static int rs_gpio_write(const char *path, const char *value) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        return -1;
+    fputs(value, f);
+    fclose(f);
+    return 0;
+}
+
+/** 
+ * Open sysfs value file of the interrupt GPIO and arm rising edge.
+ * gpio - GPIO number, negative value for none
+ */
+static int rs_gpio_open(int gpio) {
+    char path[64], value[16];
+    int fd;
+
+    if (gpio < 0)
+        return -1;
+
+    snprintf(path, sizeof path, "/sys/class/gpio/gpio%d/value", gpio);
+    if (access(path, F_OK) != 0) {
+        snprintf(value, sizeof value, "%d", gpio);
+        rs_gpio_write("/sys/class/gpio/export", value);
+    }
+
+    snprintf(path, sizeof path, "/sys/class/gpio/gpio%d/edge", gpio);
+    if (rs_gpio_write(path, "rising") != 0) {
+        fprintf(stderr, "WARNING: GPIO %d has no edge support, falling back to polling\n", gpio);
+        return -1;
+    }
+
+    snprintf(path, sizeof path, "/sys/class/gpio/gpio%d/value", gpio);
+    fd = open(path, O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+        fprintf(stderr, "WARNING: failed to open %s, falling back to polling\n", path);
+        return -1;
+    }
+
+    /* clear pending edge */
+    read(fd, value, sizeof value);
+
+    return fd;
+}
+
+/** 
+ * The rs_airtime_us() return airtime of packet with given modulation 
+ * parameters in microseconds.
+ */
+uint32_t rs_airtime_us(uint8_t modulation, uint32_t datarate, uint8_t bandwidth, uint8_t coderate, uint16_t size) {
+    uint32_t sf, bw, cr;
+
+    if (modulation == MOD_FSK) {
+        if (datarate == 0)
+            return RS_DEFAULT_AIRTIME_US;
+        /* preamble 5 B, sync word 3 B, length 1 B and CRC 2 B */
+        return (uint32_t) ((uint64_t) (size + 11) * 8 * 1000000 / datarate);
+    }
+
+    switch (datarate) {
+        case DR_LORA_SF7: sf = 7;
+            break;
+        case DR_LORA_SF8: sf = 8;
+            break;
+        case DR_LORA_SF9: sf = 9;
+            break;
+        case DR_LORA_SF10: sf = 10;
+            break;
+        case DR_LORA_SF11: sf = 11;
+            break;
+        case DR_LORA_SF12: sf = 12;
+            break;
+        default: return RS_DEFAULT_AIRTIME_US;
+    }
+
+    switch (bandwidth) {
+        case BW_500KHZ: bw = 500;
+            break;
+        case BW_250KHZ: bw = 250;
+            break;
+        case BW_125KHZ: bw = 125;
+            break;
+        default: return RS_DEFAULT_AIRTIME_US;
+    }
+
+    /* coding rate 4/5 - 4/8 is passed as denominator 5 - 8 */
+    cr = (coderate >= CR_LORA_4_5 && coderate <= CR_LORA_4_8) ? coderate + 4 : 5;
+
+    return lr_airtime_us(size, 1, (sf >= 11 && bw == 125), sf, cr, 8, bw);
+}
+
+/** 
+ * The rs_pkt_airtime_us() return airtime of received packet in microseconds.
+ * p - An pointer to received packet
+ */
+uint32_t rs_pkt_airtime_us(const struct lgw_pkt_rx_s *p) {
+    return rs_airtime_us(p->modulation, p->datarate, p->bandwidth, p->coderate, p->size);
+}
+
+/** 
+ * Sleep for sleep_us, with track_late set wake-up delay past the deadline 
+ * is kept in late_us (scheduling latency of the calling thread).
+ * rs       - An pointer to scheduler
+ * sleep_us - Sleep time in microseconds
+ */
+static void rs_sleep(struct rs_scheduler *rs, int64_t sleep_us) {
+    struct timespec delay, deadline, now;
+    int64_t late;
+
+    delay.tv_sec = sleep_us / 1000000;
+    delay.tv_nsec = (sleep_us % 1000000) * 1000;
+    if (!rs->track_late) {
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &delay, NULL);
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += delay.tv_sec;
+    deadline.tv_nsec += delay.tv_nsec;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+        ;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    late = rs_elapsed_us(&deadline, &now);
+    rs->late_us = (late > 0) ? (uint32_t) late : 0;
+}
+
+/** 
+ * Initialization receive scheduler.
+ * rs   - An pointer to scheduler
+ * mode - RS_MODE_FIXED or RS_MODE_ADAPTIVE
+ * gpio - SX1301 interrupt GPIO number, negative value for none
+ */
+void rs_init(struct rs_scheduler *rs, uint8_t mode, int gpio) {
+    memset(rs, 0, sizeof (struct rs_scheduler));
+
+    rs->mode = mode;
+    rs->gpio_fd = (mode == RS_MODE_ADAPTIVE) ? rs_gpio_open(gpio) : -1;
+    rs->min_airtime_us = RS_DEFAULT_AIRTIME_US;
+    rs->cap_us = RS_MAX_POLL_US;
+    rs->poll_us = (mode == RS_MODE_ADAPTIVE) ? RS_MIN_POLL_US : RS_FIXED_POLL_US;
+}
+
+/** 
+ * Update scheduler state with result of last lgw_receive_ring() call.
+ * rs      - An pointer to scheduler
+ * nb_pkt  - Number of fetched packets
+ * max_pkt - Size of fetch array
+ * pkt     - An pointer to fetched packet descriptors
+ */
+void rs_update(struct rs_scheduler *rs, int nb_pkt, int max_pkt, struct lgw_pkt_rx_s *const *pkt) {
+    struct timespec now;
+    uint32_t airtime, batch_min = UINT32_MAX;
+    uint64_t cap;
+    int i;
+
+    if (rs->mode != RS_MODE_ADAPTIVE)
+        return;
+
+    if (nb_pkt <= 0) {
+        /* FIFO empty, back off up to the fill time of the FIFO */
+        rs->poll_us = (rs->poll_us < RS_MIN_POLL_US) ? RS_MIN_POLL_US : rs->poll_us * 2;
+        if (rs->poll_us > rs->cap_us)
+            rs->poll_us = rs->cap_us;
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    /* shortest airtime of current SF/BW mix, falls quickly and rises slowly */
+    for (i = 0; i < nb_pkt; ++i) {
+        airtime = rs_pkt_airtime_us(pkt[i]);
+        if (airtime < batch_min)
+            batch_min = airtime;
+    }
+    if (batch_min < rs->min_airtime_us)
+        rs->min_airtime_us = batch_min;
+    else
+        rs->min_airtime_us += (batch_min - rs->min_airtime_us) / 8;
+
+    /* FIFO can not overflow if all IF chains deliver the shortest packets */
+    cap = (uint64_t) rs->min_airtime_us * LGW_PKT_FIFO_SIZE / LGW_IF_CHAIN_NB / 2;
+    rs->cap_us = (cap < RS_MIN_POLL_US) ? RS_MIN_POLL_US : (cap > RS_MAX_POLL_US) ? RS_MAX_POLL_US : (uint32_t) cap;
+
+    /* EWMA of batch inter-arrival time predicts the next one */
+    if (rs->has_rx)
+        rs->gap_us = (rs->gap_us == 0.0) ? rs_elapsed_us(&rs->last_rx, &now) : 0.875 * rs->gap_us + 0.125 * rs_elapsed_us(&rs->last_rx, &now);
+    rs->last_rx = now;
+    rs->has_rx = true;
+
+    /* full fetch array, FIFO may still hold packets */
+    rs->poll_us = (nb_pkt >= max_pkt) ? 0 : RS_MIN_POLL_US;
+}
+
+/** 
+ * Sleep until next lgw_receive() call, never past wake_us when it is set.
+ * rs - An pointer to scheduler
+ */
+void rs_wait(struct rs_scheduler *rs) {
+    struct timespec now, delay;
+    struct pollfd pfd;
+    int64_t until, sleep_us;
+    uint32_t wake_us = rs->wake_us, cap_us;
+    char value[16];
+
+    /* deadline of caller, e.g. queued downlink, holds for this wait only */
+    rs->wake_us = 0;
+    rs->late_us = 0;
+    if (rs->mode != RS_MODE_ADAPTIVE) {
+        rs_sleep(rs, (wake_us > 0 && wake_us < RS_FIXED_POLL_US) ? wake_us : RS_FIXED_POLL_US);
+        return;
+    }
+
+    if (rs->poll_us == 0)
+        return;
+
+    if (rs->gpio_fd >= 0) {
+        /* interrupt driven, timeout only guards against missed edges */
+        cap_us = (wake_us > 0 && wake_us < rs->cap_us) ? wake_us : rs->cap_us;
+        delay.tv_sec = cap_us / 1000000;
+        delay.tv_nsec = (cap_us % 1000000) * 1000;
+        pfd.fd = rs->gpio_fd;
+        pfd.events = POLLPRI | POLLERR;
+        if (ppoll(&pfd, 1, &delay, NULL) > 0) {
+            lseek(rs->gpio_fd, 0, SEEK_SET);
+            read(rs->gpio_fd, value, sizeof value);
+        }
+        return;
+    }
+
+    sleep_us = rs->poll_us;
+
+    /* wake up at predicted arrival and poll densely around it */
+    if (rs->has_rx && rs->gap_us > 0.0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        until = (int64_t) rs->gap_us - rs_elapsed_us(&rs->last_rx, &now);
+        if (until > 0 && until < sleep_us)
+            sleep_us = until;
+        else if (until <= 0 && -until < rs->min_airtime_us && sleep_us > RS_WINDOW_POLL_US)
+            sleep_us = RS_WINDOW_POLL_US;
+    }
+    if (wake_us > 0 && wake_us < sleep_us)
+        sleep_us = wake_us;
+
+    rs_sleep(rs, sleep_us);
+}
+
+/** 
+ * Release receive scheduler.
+ * rs - An pointer to scheduler
+ */
+void rs_close(struct rs_scheduler *rs) {
+    if (rs->gpio_fd >= 0)
+        close(rs->gpio_fd);
+    rs->gpio_fd = -1;
+}
@@ -0,0 +1,103 @@
+/**
+ * \file rx_scheduler.h
+ * \brief Receive scheduler of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "libloragw/inc/loragw_hal.h"
+
+#ifndef RX_SCHEDULER_H
+#define RX_SCHEDULER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** 
+ * Define receive scheduler modes:
+ *   0 - Fixed      sleep 3 ms after every empty fetch (legacy behaviour)
+ *   1 - Adaptive   poll interval follows FIFO occupancy, airtime and arrivals
+ */
+#define RS_MODE_FIXED 0
+#define RS_MODE_ADAPTIVE 1
+
+/** Poll interval bounds for adaptive mode in microseconds */
+#define RS_FIXED_POLL_US 3000
+#define RS_MIN_POLL_US 250
+#define RS_MAX_POLL_US 100000
+
+/** Default airtime (SF7, 125 kHz, 12 bytes) used before first packet */
+#define RS_DEFAULT_AIRTIME_US 41216
+
+    /** Define structure for receive scheduler */
+    struct rs_scheduler {
+        uint8_t mode;
+        int gpio_fd;
+        uint32_t poll_us;
+        uint32_t cap_us;
+        uint32_t min_airtime_us;
+        double gap_us;
+        struct timespec last_rx;
+        bool has_rx;
+        bool track_late;
+        uint32_t late_us;
+        uint32_t wake_us;
+    };
+
+    void rs_init(struct rs_scheduler *rs, uint8_t mode, int gpio);
+    void rs_update(struct rs_scheduler *rs, int nb_pkt, int max_pkt, struct lgw_pkt_rx_s *const *pkt);
+    void rs_wait(struct rs_scheduler *rs);
+    void rs_close(struct rs_scheduler *rs);
+
+    uint32_t rs_airtime_us(uint8_t modulation, uint32_t datarate, uint8_t bandwidth, uint8_t coderate, uint16_t size);
+    uint32_t rs_pkt_airtime_us(const struct lgw_pkt_rx_s *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RX_SCHEDULER_H */
+
@@ -0,0 +1,201 @@
+/**
+ * \file session_keys.c
+ * \brief Session key schedule cache of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "session_keys.h"
+#include "hex.h"
+
+/** 
+ * SessionKeys
+ * Direct mapped cache of AES-128 key schedules indexed by DevAddr. A session 
+ * key is expanded only when the device is seen for the first time or its key 
+ * changes, every following block reuses the cached round keys. The cache is 
+ * thread local, so decoding threads never share or lock an entry.
+ */
+static __thread struct sk_entry sk_cache[SK_CACHE_SIZE];
+
+/** 
+ * Fold DevAddr to cache slot. NwkID sits in the top bits, so both halves 
+ * are mixed in.
+ */
+static inline uint32_t sk_slot(uint32_t dev_addr) {
+    return ((dev_addr * 0x9E3779B1u) >> 24) & (SK_CACHE_SIZE - 1);
+}
+
+/** 
+ * Return key schedule for device, expanding key on cache miss. Pointer is 
+ * valid until next sk_get() call of the same thread for a colliding slot.
+ */
+const struct AES_ctx* sk_get(uint32_t dev_addr, const uint8_t *key) {
+    struct sk_entry *e = &sk_cache[sk_slot(dev_addr)];
+
+    if (!e->used || e->dev_addr != dev_addr || memcmp(e->key, key, SK_KEY_SIZE) != 0) {
+        AES_init_ctx(&e->ctx, key);
+        memcpy(e->key, key, SK_KEY_SIZE);
+        e->dev_addr = dev_addr;
+        e->used = true;
+    }
+    return &e->ctx;
+}
+
+/** 
+ * Drop all cached key schedules of calling thread.
+ */
+void sk_clear() {
+    memset(sk_cache, 0, sizeof sk_cache);
+}
+
+/** 
+ * Key store of provisioned devices sorted by DevAddr. It is filled by 
+ * sk_load() before packet processing starts and owned by the exporting 
+ * thread afterwards, which swaps it for a new one on SIGHUP reload between 
+ * two packets. Only that thread looks devices up, so lookups need no 
+ * locking; a failed reload keeps the previous store.
+ */
+static struct sk_device *sk_devices = NULL;
+static size_t sk_devices_cnt = 0;
+
+static int sk_cmp(const void *a, const void *b) {
+    uint32_t x = ((const struct sk_device*) a)->dev_addr;
+    uint32_t y = ((const struct sk_device*) b)->dev_addr;
+    return (x > y) - (x < y);
+}
+
+/** 
+ * Parse exactly len bytes of hex digits, return 0 on success.
+ */
+int sk_parse_hex(uint8_t *out, const char *str, size_t len) {
+    size_t i;
+
+    if (strlen(str) != 2 * len)
+        return -1;
+    for (i = 0; i < 2 * len; i++)
+        if (hx_digit[(uint8_t) str[i]] == 0 && str[i] != '0')
+            return -1;
+    hx_decode(out, str, 2 * len);
+    return 0;
+}
+
+/** 
+ * Load session keys of ABP devices from text file. Every non empty line not 
+ * starting by '#' holds DevAddr (8 hex digits, as printed in DEV_ADDR) 
+ * followed by NwkSKey and AppSKey (32 hex digits each). Return number of 
+ * loaded devices or -1 on error.
+ */
+int sk_load(const char *file) {
+    FILE *f;
+    char line[256], addr[16], nwk[48], app[48];
+    struct sk_device *devices = NULL, *tmp;
+    size_t cnt = 0, size = 0;
+    unsigned long nr = 0;
+    uint8_t a[4];
+
+    f = fopen(file, "r");
+    if (f == NULL)
+        return -1;
+
+    while (fgets(line, sizeof line, f) != NULL) {
+        nr++;
+        if (line[0] == '#' || sscanf(line, "%15s %47s %47s", addr, nwk, app) != 3)
+            continue;
+
+        if (cnt == size) {
+            size = size ? 2 * size : 64;
+            tmp = (struct sk_device*) realloc(devices, size * sizeof *devices);
+            if (tmp == NULL) {
+                free(devices);
+                fclose(f);
+                return -1;
+            }
+            devices = tmp;
+        }
+
+        struct sk_device *d = &devices[cnt];
+        if (sk_parse_hex(a, addr, 4) != 0 || sk_parse_hex(d->nwk_skey, nwk, SK_KEY_SIZE) != 0
+                || sk_parse_hex(d->app_skey, app, SK_KEY_SIZE) != 0) {
+            fprintf(stderr, "Warning: Invalid session key entry on line %lu of %s.\n", nr, file);
+            continue;
+        }
+        d->dev_addr = (uint32_t) a[0] << 24 | (uint32_t) a[1] << 16 | (uint32_t) a[2] << 8 | a[3];
+        AES_CMAC_init(&d->nwk, d->nwk_skey);
+        AES_init_ctx(&d->app, d->app_skey);
+        cnt++;
+    }
+    fclose(f);
+
+    qsort(devices, cnt, sizeof *devices, sk_cmp);
+
+    sk_unload();
+    sk_devices = devices;
+    sk_devices_cnt = cnt;
+    return (int) cnt;
+}
+
+/** 
+ * Return provisioned device by DevAddr or NULL if keys are unknown.
+ */
+const struct sk_device* sk_find(uint32_t dev_addr) {
+    struct sk_device key;
+
+    if (sk_devices_cnt == 0)
+        return NULL;
+    key.dev_addr = dev_addr;
+    return (const struct sk_device*) bsearch(&key, sk_devices, sk_devices_cnt, sizeof key, sk_cmp);
+}
+
+size_t sk_count() {
+    return sk_devices_cnt;
+}
+
+/** 
+ * Release key store.
+ */
+void sk_unload() {
+    free(sk_devices);
+    sk_devices = NULL;
+    sk_devices_cnt = 0;
+}
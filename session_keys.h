@@ -0,0 +1,96 @@
+/**
+ * \file session_keys.h
+ * \brief Session key schedule cache of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "aes/aes.h"
+#include "aes/cmac.h"
+
+#ifndef SESSION_KEYS_H
+#define SESSION_KEYS_H
+
+/** Number of cached key schedules per thread, power of two */
+#define SK_CACHE_SIZE 256
+#define SK_KEY_SIZE 16
+
+/** Default session key file, one "DevAddr NwkSKey AppSKey" hex triple per line */
+#define SK_DEFAULT_FILE "session_keys.txt"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** Cached expanded session key of one device */
+    struct sk_entry {
+        uint32_t dev_addr;
+        bool used;
+        uint8_t key[SK_KEY_SIZE];
+        struct AES_ctx ctx;
+    };
+
+    /** Provisioned ABP device with keys expanded at load time */
+    struct sk_device {
+        uint32_t dev_addr;
+        uint8_t nwk_skey[SK_KEY_SIZE];
+        uint8_t app_skey[SK_KEY_SIZE];
+        struct AES_CMAC_ctx nwk;
+        struct AES_ctx app;
+    };
+
+    const struct AES_ctx* sk_get(uint32_t dev_addr, const uint8_t *key);
+    void sk_clear();
+
+    int sk_parse_hex(uint8_t *out, const char *str, size_t len);
+    int sk_load(const char *file);
+    const struct sk_device* sk_find(uint32_t dev_addr);
+    size_t sk_count();
+    void sk_unload();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SESSION_KEYS_H */
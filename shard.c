@@ -0,0 +1,137 @@
+/**
+ * \file shard.c
+ * \brief Routing of output records to UniRec interfaces by consistent hash of device.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shard.h"
+
+/**
+ * Shard
+ * Records of one device always leave through the same output interface, 
+ * so per device state of downstream detectors stays on one instance. Key 
+ * is DevAddr of data frames and DevEUI of join requests, other frames 
+ * (join accept, CRC errors, unparsable) have no device and are spread by 
+ * hash of payload. Interface is chosen by jump consistent hash (Lamping, 
+ * Veach), growing from N to N + 1 interfaces moves only 1 / (N + 1) of 
+ * devices.
+ */
+
+static inline uint64_t sh_mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+/** 
+ * Jump consistent hash. Return shard in range 0 - shards - 1.
+ * key    - Hashed key
+ * shards - Number of shards
+ */
+int32_t sh_jump(uint64_t key, int32_t shards) {
+    int64_t b = -1, j = 0;
+
+    while (j < shards) {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = (int64_t) ((b + 1) * ((double) (1LL << 31) / (double) ((key >> 33) + 1)));
+    }
+    return (int32_t) b;
+}
+
+/** 
+ * Select output interface of packet.
+ * p      - An pointer to received packet
+ * frame  - An pointer to parsed frame, NULL when packet was not parsed
+ * shards - Number of output interfaces
+ */
+uint32_t sh_select(const struct pk_pkt *p, const struct lr_frame *frame, uint32_t shards) {
+    uint64_t key = 0xcbf29ce484222325ULL; /* FNV-1a */
+    uint16_t i;
+
+    if (shards <= 1)
+        return 0;
+    if (frame != NULL && frame->cls.kind == LR_KIND_DATA) {
+        key = frame->dev_addr;
+    } else if (frame != NULL && frame->cls.kind == LR_KIND_JOIN_REQUEST) {
+        key = frame->dev_eui;
+    } else {
+        for (i = 0; i < p->size; i++) {
+            key ^= p->payload[i];
+            key *= 0x100000001b3ULL;
+        }
+    }
+    return (uint32_t) sh_jump(sh_mix(key), (int32_t) shards);
+}
+
+/** 
+ * Find number of output interfaces in command line before libtrap parses 
+ * its interface specifier, which must list all of them. Return 1 when 
+ * option is missing or invalid.
+ * argc     - Number of arguments
+ * argv     - Arguments
+ * opt      - Short option
+ * long_opt - Long option
+ */
+uint32_t sh_scan_outputs(int argc, char **argv, char opt, const char *long_opt) {
+    const char *val = NULL;
+    size_t len = strlen(long_opt);
+    long n;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == opt) {
+            val = (argv[i][2] != '\0') ? argv[i] + 2 : (i + 1 < argc) ? argv[i + 1] : NULL;
+        } else if (strncmp(argv[i], "--", 2) == 0 && strncmp(argv[i] + 2, long_opt, len) == 0) {
+            if (argv[i][2 + len] == '=')
+                val = argv[i] + 3 + len;
+            else if (argv[i][2 + len] == '\0')
+                val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        }
+    }
+    n = (val != NULL) ? strtol(val, NULL, 10) : 1;
+    return (n >= 1 && n <= SH_MAX_SHARDS) ? (uint32_t) n : 1;
+}
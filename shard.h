@@ -0,0 +1,68 @@
+/**
+ * \file shard.h
+ * \brief Routing of output records to UniRec interfaces by consistent hash of device.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "libloragw/inc/loragw_hal.h"
+#include "pkt_slab.h"
+#include "lora_packet.h"
+
+#ifndef SHARD_H
+#define SHARD_H
+
+/** Maximum number of output interfaces */
+#define SH_MAX_SHARDS 32
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int32_t sh_jump(uint64_t key, int32_t shards);
+    uint32_t sh_select(const struct pk_pkt *p, const struct lr_frame *frame, uint32_t shards);
+    uint32_t sh_scan_outputs(int argc, char **argv, char opt, const char *long_opt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHARD_H */
@@ -0,0 +1,158 @@
+/**
+ * \file time_fmt.c
+ * \brief Cached ISO 8601 timestamp formatter of LoRaWAN packet logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <string.h>
+#include "time_fmt.h"
+
+/** 
+ * TimeFmt
+ * Date and time prefix is built once per second from day number without 
+ * gmtime, so no static buffer and no timezone lock is involved. Within 
+ * the same second only fraction digits are written.
+ */
+
+static void tf_put2(char *p, unsigned v) {
+    p[0] = (char) ('0' + v / 10);
+    p[1] = (char) ('0' + v % 10);
+}
+
+/**
+ * Build date and time prefix of second sec, civil date from days since epoch.
+ * c - An pointer to timestamp cache.
+ * sec - Seconds since epoch (UTC).
+ */
+static void tf_prefix(struct tf_cache *c, time_t sec) {
+    int64_t days = (int64_t) sec / 86400, era, y;
+    int64_t rem = (int64_t) sec % 86400;
+    unsigned doe, yoe, doy, mp, d, m;
+    char *p = c->buf;
+
+    if (rem < 0) {
+        rem += 86400;
+        days--;
+    }
+    days += 719468;
+    era = (days >= 0 ? days : days - 146096) / 146097;
+    doe = (unsigned) (days - era * 146097);
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    y = (int64_t) yoe + era * 400;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    if (m <= 2)
+        y++;
+
+    tf_put2(p, (unsigned) (y / 100 % 100));
+    tf_put2(p + 2, (unsigned) (y % 100));
+    p[4] = '-';
+    tf_put2(p + 5, m);
+    p[7] = '-';
+    tf_put2(p + 8, d);
+    p[10] = ' ';
+    tf_put2(p + 11, (unsigned) (rem / 3600));
+    p[13] = ':';
+    tf_put2(p + 14, (unsigned) (rem / 60 % 60));
+    p[16] = ':';
+    tf_put2(p + 17, (unsigned) (rem % 60));
+    p[19] = '.';
+    c->sec = sec;
+}
+
+/**
+ * Initialize timestamp cache. Coarse clock is chosen when its resolution 
+ * (one jiffy) does not exceed last fraction digit, which never holds for 
+ * microseconds.
+ * c - An pointer to timestamp cache.
+ * digits - Fraction digits, TF_MS or TF_US.
+ */
+void tf_init(struct tf_cache *c, int digits) {
+#ifdef CLOCK_REALTIME_COARSE
+    struct timespec res;
+#endif
+
+    memset(c, 0, sizeof *c);
+    c->digits = (digits == TF_US) ? TF_US : TF_MS;
+    c->clock = CLOCK_REALTIME;
+#ifdef CLOCK_REALTIME_COARSE
+    if (clock_getres(CLOCK_REALTIME_COARSE, &res) == 0 && res.tv_sec == 0
+            && res.tv_nsec <= (c->digits == TF_US ? 1000 : 1000000))
+        c->clock = CLOCK_REALTIME_COARSE;
+#endif
+    c->buf[TF_FRAC_POS + c->digits] = 'Z';
+    tf_prefix(c, 0);
+}
+
+/**
+ * Format time as "YYYY-MM-DD HH:MM:SS.mmmZ" (ISO 8601, UTC), prefix is 
+ * rebuilt only when second differs from cached one.
+ * c - An pointer to timestamp cache.
+ * t - An pointer to time.
+ * Returns pointer to cache buffer, valid until next call.
+ */
+const char *tf_format(struct tf_cache *c, const struct timespec *t) {
+    char *p = c->buf + TF_FRAC_POS;
+    uint32_t frac;
+    int i;
+
+    if (t->tv_sec != c->sec)
+        tf_prefix(c, t->tv_sec);
+
+    frac = (uint32_t) t->tv_nsec / (c->digits == TF_US ? 1000 : 1000000);
+    for (i = c->digits - 1; i >= 0; i--) {
+        p[i] = (char) ('0' + frac % 10);
+        frac /= 10;
+    }
+    return c->buf;
+}
+
+/**
+ * Read wall clock for log timestamps with clock chosen by tf_init(), coarse 
+ * clock is read from vDSO without touching clock source.
+ * c - An pointer to timestamp cache.
+ * t - An pointer to time.
+ */
+void tf_now(const struct tf_cache *c, struct timespec *t) {
+    if (clock_gettime(c->clock, t) != 0)
+        clock_gettime(CLOCK_REALTIME, t);
+}
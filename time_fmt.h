@@ -0,0 +1,83 @@
+/**
+ * \file time_fmt.h
+ * \brief Cached ISO 8601 timestamp formatter of LoRaWAN packet logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#ifndef TIME_FMT_H
+#define TIME_FMT_H
+
+/** Fraction digits, milliseconds as in CSV log or microseconds per packet */
+#define TF_MS 3
+#define TF_US 6
+
+/** Longest formatted string "YYYY-MM-DD HH:MM:SS.uuuuuuZ" with terminator */
+#define TF_BUF_SIZE 28
+
+/** Offset of fraction digits in formatted string */
+#define TF_FRAC_POS 20
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** 
+     * Define structure for timestamp cache. Buffer keeps date and time of 
+     * cached second, only fraction digits are rewritten within it.
+     */
+    struct tf_cache {
+        time_t sec;
+        int digits;
+        clockid_t clock; /* coarse clock only when it ticks within one fraction digit */
+        char buf[TF_BUF_SIZE];
+    };
+
+    void tf_init(struct tf_cache *c, int digits);
+    const char *tf_format(struct tf_cache *c, const struct timespec *t);
+    void tf_now(const struct tf_cache *c, struct timespec *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIME_FMT_H */
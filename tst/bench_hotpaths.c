@@ -0,0 +1,211 @@
+/**
+ * \file bench_hotpaths.c
+ * \brief Hot path benchmark of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "../lora_packet.h"
+#include "../hex.h"
+#include "../aes/aes.h"
+
+/** 
+ * Benchmark of parser, hex, AES and airtime hot paths. Every case runs in 
+ * growing batches until it takes at least the minimal time (first argument 
+ * in ms, default 200) and prints one JSON line with ns/op and allocations/op. 
+ * Allocations are counted by linker wrappers of malloc, calloc and realloc, 
+ * so only calls made by logger code are seen.
+ */
+
+#define BENCH_DEFAULT_MS 200
+
+/** Corpus of LoRaWAN frames, join request, join accept, data up and confirmed data up with FOpts */
+static const char *corpus[] = {
+    "00DC0000D07ED5B3701E6FEDF57CEEAF00C886030AF1D2",
+    "204DD85AE608B87FC4889970B7D2042C9E72959B0057AED6094B16003DF12DE145",
+    "40F17DBE4900020001954378762B11FF0D",
+    "80F17DBE490A0300030608001B2C3D4E5F60718293A4B5C6D7E8F9A1B2C3D4E5F6A7B8C9"
+};
+#define CORPUS_NB (sizeof corpus / sizeof corpus[0])
+
+/** Session keys of data frame */
+static uint8_t nwk_skey[16] = {0x44, 0x02, 0x42, 0x41, 0xed, 0x4c, 0xe9, 0xa6, 0x8c, 0x6a, 0x8b, 0xc0, 0x55, 0x23, 0x3f, 0xd3};
+static uint8_t app_skey[16] = {0xec, 0x92, 0x58, 0x02, 0xae, 0x43, 0x0c, 0xa7, 0x7f, 0xd3, 0xdd, 0x73, 0xcb, 0x2c, 0xc5, 0x88};
+
+static uint8_t corpus_phy[CORPUS_NB][LR_MAX_PHY_PAYLOAD];
+static size_t corpus_size[CORPUS_NB];
+static char hex_out[2 * LR_MAX_PHY_PAYLOAD + 1];
+static volatile uint64_t sink;
+static uint64_t allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    allocs++;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocs++;
+    return __real_realloc(ptr, size);
+}
+
+static void bench_lr_initialization(uint64_t i) {
+    lr_initialization((char *) corpus[i % CORPUS_NB]);
+    sink += lr_get_message_type();
+}
+
+static void bench_lr_parse_frame(uint64_t i) {
+    struct lr_frame frame;
+
+    sink += lr_parse_frame(corpus_phy[i % CORPUS_NB], corpus_size[i % CORPUS_NB], &frame);
+    sink += frame.mic;
+}
+
+static void bench_lr_get_int(uint64_t i) {
+    static char *values[] = {"F17DBE49", "0001", "60", "DC0000D07ED5B370"};
+
+    sink += lr_get_int(values[i & 3]);
+}
+
+static void bench_hx_encode(uint64_t i) {
+    sink += hx_encode(hex_out, corpus_phy[i % CORPUS_NB], corpus_size[i % CORPUS_NB]);
+}
+
+static void bench_hx_decode(uint64_t i) {
+    uint8_t out[LR_MAX_PHY_PAYLOAD];
+
+    sink += hx_decode(out, corpus[i % CORPUS_NB], strlen(corpus[i % CORPUS_NB]));
+}
+
+static void bench_aes_ecb_encrypt(uint64_t i) {
+    uint8_t block[16] = {0};
+    uint8_t out[16];
+
+    block[0] = (uint8_t) i;
+    AES_ECB_encrypt(block, app_skey, out, 16);
+    sink += out[0];
+}
+
+static void bench_lr_decode(uint64_t i) {
+    uint8_t *dec = lr_decode(nwk_skey, app_skey);
+
+    (void) i;
+    if (dec != NULL)
+        sink += dec[0];
+    free(dec);
+}
+
+static void bench_lr_airtime_calculate(uint64_t i) {
+    sink += (uint64_t) lr_airtime_calculate(i & 0xFF, 1, 0, LR_SF_MIN + i % LR_SF_NB, 5, 8, 125, 1.0);
+}
+
+static void bench_lr_airtime_us(uint64_t i) {
+    sink += lr_airtime_us(i & 0xFF, 1, 0, LR_SF_MIN + i % LR_SF_NB, 5, 8, 125);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/** Run case in doubling batches until minimal time is reached, print result */
+static void bench_run(const char *name, void (*fn)(uint64_t), uint64_t min_ns) {
+    uint64_t ops = 1, i, start, elapsed, a;
+
+    while (1) {
+        a = allocs;
+        start = now_ns();
+        for (i = 0; i < ops; i++)
+            fn(i);
+        elapsed = now_ns() - start;
+        a = allocs - a;
+        if (elapsed >= min_ns || ops >= (1ull << 40))
+            break;
+        ops *= 2;
+    }
+    printf("{\"name\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.2f,\"allocs_per_op\":%.3f}\n",
+        name, (unsigned long long) ops, (double) elapsed / ops, (double) a / ops);
+}
+
+int main(int argc, char **argv) {
+    uint64_t min_ns = (uint64_t) BENCH_DEFAULT_MS * 1000000;
+    struct lr_frame frame;
+    size_t i;
+
+    if (argc > 1)
+        min_ns = strtoull(argv[1], NULL, 10) * 1000000;
+
+    for (i = 0; i < CORPUS_NB; i++) {
+        corpus_size[i] = hx_decode(corpus_phy[i], corpus[i], strlen(corpus[i]));
+        if (lr_parse_frame(corpus_phy[i], corpus_size[i], &frame) != 0) {
+            fprintf(stderr, "corpus frame %zu is not valid LoRaWAN frame\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    lr_airtime_init();
+
+    bench_run("lr_initialization", bench_lr_initialization, min_ns);
+    bench_run("lr_parse_frame", bench_lr_parse_frame, min_ns);
+    bench_run("lr_get_int", bench_lr_get_int, min_ns);
+    bench_run("hx_encode", bench_hx_encode, min_ns);
+    bench_run("hx_decode", bench_hx_decode, min_ns);
+    bench_run("AES_ECB_encrypt", bench_aes_ecb_encrypt, min_ns);
+    /* data frame stays parsed for decode */
+    lr_initialization((char *) corpus[2]);
+    bench_run("lr_decode", bench_lr_decode, min_ns);
+    bench_run("lr_airtime_calculate", bench_lr_airtime_calculate, min_ns);
+    bench_run("lr_airtime_us", bench_lr_airtime_us, min_ns);
+
+    return EXIT_SUCCESS;
+}
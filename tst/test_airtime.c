@@ -0,0 +1,80 @@
+/**
+ * \file test_airtime.c
+ * \brief Airtime table test of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "../lora_packet.h"
+
+/** 
+ * Compare table driven lr_airtime_us() with reference formula 
+ * lr_airtime_calculate() for every table entry and a few fallback cases.
+ * Return 0 when all agree within rounding of one microsecond.
+ */
+int main() {
+    static const uint32_t bands[] = {125, 250, 500, 62};
+    uint32_t sf, cr, header, ldro, size, b, table;
+    unsigned long checked = 0, failed = 0;
+    double ref;
+
+    lr_airtime_init();
+    for (sf = LR_SF_MIN; sf <= LR_SF_MAX; sf++)
+        for (cr = 5; cr <= 8; cr++)
+            for (header = 0; header < 2; header++)
+                for (ldro = 0; ldro < 2; ldro++)
+                    for (b = 0; b < sizeof bands / sizeof bands[0]; b++)
+                        for (size = 0; size < LR_MAX_PHY_PAYLOAD; size++) {
+                            ref = lr_airtime_calculate(size, header, ldro, sf, cr, 8, bands[b], 100.0) * 1000.0;
+                            table = lr_airtime_us(size, header, ldro, sf, cr, 8, bands[b]);
+                            checked++;
+                            if (fabs(ref - table) > 1.0) {
+                                if (failed++ < 10)
+                                    printf("FAIL: SF%u CR4/%u H%u LDRO%u BW%u size %u: table %u us, formula %.1f us\n",
+                                        sf, cr, header, ldro, bands[b], size, table, ref);
+                            }
+                        }
+
+    printf("%lu airtime combinations checked, %lu failed\n", checked, failed);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+/**
+ * \file test_ctr.c
+ * \brief Batched FRMPayload CTR test of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../lora_packet.h"
+#include "../aes/aes.h"
+
+#define TC_MAX_JOBS 8
+#define TC_MAX_LEN 1100
+
+static uint8_t tc_in[TC_MAX_JOBS][TC_MAX_LEN];
+static uint8_t tc_out[TC_MAX_JOBS][TC_MAX_LEN];
+static uint8_t tc_ref[TC_MAX_JOBS][TC_MAX_LEN];
+
+/** 
+ * Reference CTR of LoRaWAN 1.0, one AES call per keystream block.
+ */
+static void tc_reference(const struct lr_ctr_job *job, uint8_t *out) {
+    uint8_t a[AES_BLOCKLEN];
+    size_t i;
+
+    for (i = 0; i < job->len; i++) {
+        if (i % AES_BLOCKLEN == 0) {
+            memset(a, 0, sizeof a);
+            a[0] = 0x01;
+            a[5] = job->direction;
+            a[6] = (uint8_t) job->dev_addr;
+            a[7] = (uint8_t) (job->dev_addr >> 8);
+            a[8] = (uint8_t) (job->dev_addr >> 16);
+            a[9] = (uint8_t) (job->dev_addr >> 24);
+            a[10] = (uint8_t) job->fcnt;
+            a[11] = (uint8_t) (job->fcnt >> 8);
+            a[12] = (uint8_t) (job->fcnt >> 16);
+            a[13] = (uint8_t) (job->fcnt >> 24);
+            a[15] = (uint8_t) (i / AES_BLOCKLEN + 1);
+            AES_ECB_encrypt_ctx(job->ctx, a);
+        }
+        out[i] = job->in[i] ^ a[i % AES_BLOCKLEN];
+    }
+}
+
+/** 
+ * Run one batch of jobs with given lengths through lr_ctr_crypt() and 
+ * compare every output with reference. Return number of failed jobs.
+ */
+static int tc_run(const char *name, const struct AES_ctx *ctx, const size_t *lens, size_t count) {
+    struct lr_ctr_job jobs[TC_MAX_JOBS];
+    size_t j, i;
+    int failed = 0;
+
+    for (j = 0; j < count; j++) {
+        for (i = 0; i < lens[j]; i++)
+            tc_in[j][i] = (uint8_t) (i * 7 + j);
+        memset(tc_out[j], 0, sizeof tc_out[j]);
+        jobs[j].ctx = ctx;
+        jobs[j].dev_addr = 0x26011000 + j;
+        jobs[j].fcnt = 100 + j;
+        jobs[j].direction = j & 1;
+        jobs[j].in = tc_in[j];
+        jobs[j].out = tc_out[j];
+        jobs[j].len = lens[j];
+        tc_reference(&jobs[j], tc_ref[j]);
+    }
+    lr_ctr_crypt(jobs, count);
+
+    for (j = 0; j < count; j++) {
+        if (memcmp(tc_out[j], tc_ref[j], lens[j]) != 0) {
+            printf("FAIL: %s: job %zu of %zu bytes differs from reference\n", name, j, lens[j]);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/** 
+ * Compare batched lr_ctr_crypt() with per block reference, including 
+ * empty jobs and frames split across batches. Return 0 when all agree.
+ */
+int main() {
+    static const uint8_t key[16] = {0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C};
+    static const size_t single[] = {20};
+    static const size_t trailing_empty[] = {20, 0};
+    static const size_t leading_empty[] = {0, 0, 33};
+    static const size_t middle_empty[] = {17, 0, 5};
+    static const size_t split[] = {250, 250, 250, 250, 250, 0};
+    static const size_t batch_exact[] = {LR_CTR_BATCH_BLOCKS * AES_BLOCKLEN, 0};
+    static const size_t oversize[] = {TC_MAX_LEN, 1};
+    struct AES_ctx ctx;
+    int failed = 0;
+
+    AES_init_ctx(&ctx, key);
+    failed += tc_run("single", &ctx, single, 1);
+    failed += tc_run("trailing empty", &ctx, trailing_empty, 2);
+    failed += tc_run("leading empty", &ctx, leading_empty, 3);
+    failed += tc_run("middle empty", &ctx, middle_empty, 3);
+    failed += tc_run("split across batches", &ctx, split, 6);
+    failed += tc_run("exact batch", &ctx, batch_exact, 2);
+    failed += tc_run("longer than batch", &ctx, oversize, 2);
+
+    printf("CTR batches checked, %d jobs failed\n", failed);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+/**
+ * \file test_time_fmt.c
+ * \brief Cached timestamp formatting test of LoRaWAN logger NEMEA module.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../time_fmt.h"
+
+/** 
+ * Reference formatting with gmtime_r() and strftime(), not cached.
+ */
+static void tt_reference(const struct timespec *t, int digits, char *out) {
+    struct tm tm;
+    size_t n;
+
+    gmtime_r(&t->tv_sec, &tm);
+    n = strftime(out, TF_BUF_SIZE, "%Y-%m-%d %H:%M:%S.", &tm);
+    sprintf(out + n, "%0*ldZ", digits, t->tv_nsec / (digits == TF_US ? 1000 : 1000000));
+}
+
+/** 
+ * Format times in given order through one cache and compare with reference. 
+ * Return number of mismatches.
+ */
+static int tt_run(const char *name, int digits, const struct timespec *t, size_t count) {
+    struct tf_cache c;
+    char ref[TF_BUF_SIZE];
+    const char *got;
+    size_t i;
+    int failed = 0;
+
+    tf_init(&c, digits);
+    for (i = 0; i < count; i++) {
+        tt_reference(&t[i], digits, ref);
+        got = tf_format(&c, &t[i]);
+        if (strcmp(got, ref) != 0) {
+            printf("FAIL: %s: got \"%s\", expected \"%s\"\n", name, got, ref);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/** 
+ * Compare cached formatter with gmtime() around calendar edges, within the 
+ * same second and with current clock. Return 0 when all agree.
+ */
+int main() {
+    static const struct timespec edges[] = {
+        {0, 0}, /* epoch, also the prefix cached by tf_init() */
+        {951782399, 999999999}, /* 2000-02-28 23:59:59, leap year */
+        {951782400, 1000}, /* 2000-02-29 */
+        {951868800, 0}, /* 2000-03-01 */
+        {1582934400, 500000000}, /* 2020-02-29 */
+        {1609459199, 123456789}, /* 2020-12-31 23:59:59 */
+        {1609459200, 1}, /* 2021-01-01 */
+        {4107542400, 999000}, /* 2100-03-01, not leap */
+    };
+    static const struct timespec same_second[] = {
+        {1700000000, 0}, {1700000000, 999}, {1700000000, 1000}, {1700000000, 999999},
+        {1700000000, 1000000}, {1700000000, 999999999}, {1700000001, 0}, {1700000000, 5},
+    };
+    struct timespec now[2];
+    struct tf_cache c;
+    int failed = 0;
+
+    failed += tt_run("calendar edges ms", TF_MS, edges, sizeof edges / sizeof edges[0]);
+    failed += tt_run("calendar edges us", TF_US, edges, sizeof edges / sizeof edges[0]);
+    failed += tt_run("same second ms", TF_MS, same_second, sizeof same_second / sizeof same_second[0]);
+    failed += tt_run("same second us", TF_US, same_second, sizeof same_second / sizeof same_second[0]);
+
+    /* microseconds never come from coarse clock */
+    tf_init(&c, TF_US);
+    if (c.clock != CLOCK_REALTIME) {
+        printf("FAIL: microsecond timestamps read coarse clock\n");
+        failed++;
+    }
+    tf_now(&c, &now[0]);
+    tf_now(&c, &now[1]);
+    failed += tt_run("current clock us", TF_US, now, 2);
+
+    printf("Timestamp formats checked, %d failed\n", failed);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
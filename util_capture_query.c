@@ -0,0 +1,170 @@
+/**
+ * \file util_capture_query.c
+ * \brief Query tool for binary packet captures of LoRaWAN packet logger.
+ * \author Erik Gresak <erik.gresak@vsb.cz>
+ * \date 2018
+ */
+/*
+ * Copyright (C) 2018 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* printf fprintf */
+#include <stdlib.h>		/* strtoul strtoull */
+#include <string.h>		/* memset */
+#include <time.h>		/* gmtime strftime */
+#include <unistd.h>		/* getopt */
+
+#include "hex.h"
+#include "pkt_capture.h"
+
+#define MSG(args...)	fprintf(stderr,"capture_query: " args) /* message that is destined to the user */
+
+/* describe command line options */
+static void usage(void) {
+	printf( "Usage: capture_query [options] file...\n");
+	printf( "Available options:\n");
+	printf( " -h print this help\n");
+	printf( " -d <hex> print frames of this DevAddr only\n");
+	printf( " -s <int> print frames received at or after unix time N\n");
+	printf( " -e <int> print frames received before unix time N\n");
+	printf( " -c count matching frames only\n");
+}
+
+/* print one packet of block as CSV line */
+static void print_packet(const struct pc_reader *r, const struct pc_block *b, uint32_t i) {
+	char payload[2 * 256 + 1];
+	char iso_date[24];
+	time_t t = b->time_us[i] / 1000000;
+	
+	strftime(iso_date, sizeof iso_date, "%Y-%m-%d %H:%M:%S", gmtime(&t));
+	hx_encode(payload, b->payload + b->payload_off[i], b->size[i]);
+	printf("\"%016llX\",\"%s.%06uZ\",%10u,%10u,%u,%2u,%u,%3u,%u,%u,%6u,%u,%+.0f,%+5.1f,\"%08X\",\"%s\"\n",
+		(unsigned long long)r->hdr->gateway, iso_date, (unsigned)(b->time_us[i] % 1000000),
+		b->count_us[i], b->freq_hz[i], b->rf_chain[i], b->if_chain[i], b->status[i], b->size[i],
+		b->modulation[i], b->bandwidth[i], b->datarate[i], b->coderate[i], b->rssi[i], b->snr[i],
+		b->devaddr[i], payload);
+}
+
+int main(int argc, char **argv)
+{
+	int i, ret;
+	uint32_t j;
+	bool by_addr = false;
+	bool count_only = false;
+	uint32_t addr = 0;
+	uint64_t time_from = 0;
+	uint64_t time_to = UINT64_MAX;
+	unsigned long blocks = 0, skipped = 0, matches = 0;
+	struct pc_reader reader;
+	struct pc_block block;
+	
+	while ((i = getopt (argc, argv, "hd:s:e:c")) != -1) {
+		switch (i) {
+			case 'h':
+				usage();
+				return EXIT_SUCCESS;
+			
+			case 'd':
+				addr = (uint32_t)strtoul(optarg, NULL, 16);
+				by_addr = true;
+				break;
+			
+			case 's':
+				time_from = strtoull(optarg, NULL, 10) * 1000000;
+				break;
+			
+			case 'e':
+				time_to = strtoull(optarg, NULL, 10) * 1000000;
+				break;
+			
+			case 'c':
+				count_only = true;
+				break;
+			
+			default:
+				MSG("ERROR: argument parsing use -h option for help\n");
+				usage();
+				return EXIT_FAILURE;
+		}
+	}
+	if (optind >= argc) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	
+	if (!count_only) {
+		printf("\"gateway ID\",\"UTC timestamp\",\"us count\",\"frequency\",\"RF chain\",\"RX chain\",\"status\",\"size\",\"modulation\",\"bandwidth\",\"datarate\",\"coderate\",\"RSSI\",\"SNR\",\"DevAddr\",\"payload\"\n");
+	}
+	for (i = optind; i < argc; ++i) {
+		if (pc_reader_open(&reader, argv[i]) != 0) {
+			MSG("WARNING: %s is not a packet capture, skipped\n", argv[i]);
+			continue;
+		}
+		while ((ret = pc_reader_next(&reader, &block)) == 1) {
+			++blocks;
+			/* decide from block header, columns are not touched for skipped blocks */
+			if (block.hdr->time_max < time_from || block.hdr->time_min >= time_to || (by_addr && !pc_bloom_test(block.hdr, addr))) {
+				++skipped;
+				continue;
+			}
+			for (j = 0; j < block.hdr->nb_rec; ++j) {
+				if (block.time_us[j] < time_from || block.time_us[j] >= time_to)
+					continue;
+				if (by_addr && block.devaddr[j] != addr)
+					continue;
+				if (block.payload_off[j] + block.size[j] > block.hdr->payload_len)
+					continue;
+				++matches;
+				if (!count_only)
+					print_packet(&reader, &block, j);
+			}
+		}
+		if (ret < 0) {
+			MSG("WARNING: %s has damaged or truncated block at offset %zu\n", argv[i], reader.pos);
+		}
+		pc_reader_close(&reader);
+	}
+	
+	MSG("INFO: %lu block(s) read, %lu skipped by index, %lu frame(s) matched\n", blocks, skipped, matches);
+	if (count_only) {
+		printf("%lu\n", matches);
+	}
+	return EXIT_SUCCESS;
+}
@@ -34,12 +34,18 @@ Maintainer: Sylvain Miermont
 #include <time.h>		/* time clock_gettime strftime gmtime clock_nanosleep*/
 #include <unistd.h>		/* getopt access */
 #include <stdlib.h>		/* atoi */
+#include <fcntl.h>		/* open */
 
 #include "parson.h"
 #include "libloragw/inc/loragw_hal.h"
+#include "hex.h"
+#include "csv_writer.h"
+#include "pkt_capture.h"
+#include "time_fmt.h"
+#include "log_rotate.h"
 
 
-//#include "packet.h"
+#include "packet.h"
 
 
 //include "Packet.h"
@@ -64,9 +70,16 @@ char lgwm_str[17];
 
 /* clock and log file management */
 time_t now_time;
-time_t log_start_time;
-FILE * log_file = NULL;
-char log_file_name[64];
+struct lo_rotator log_rotator; /* log and capture files, rotated and compressed in background */
+int log_compress = LO_COMPRESS_NONE;
+
+/* log durability, rows are flushed by count and/or age, optionally synced */
+uint32_t log_flush_rows = CW_DEFAULT_ROWS;
+uint32_t log_flush_ms = CW_DEFAULT_MS;
+bool log_sync = false;
+
+/* binary capture, rotated together with log file */
+bool cap_enabled = false;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
@@ -77,7 +90,9 @@ int parse_SX1301_configuration(const char * conf_file);
 
 int parse_gateway_configuration(const char * conf_file);
 
-void open_log(void);
+int open_log(struct lo_file *f);
+
+static char *put_field(char *p, const char *s);
 
 void usage (void);
 
@@ -116,6 +131,15 @@ static int clock_nanosleep(
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+/* quoted CSV field followed by separator, NULL is written as printf does */
+static char *put_field(char *p, const char *s) {
+	*p++ = '"';
+	p = cw_put_str(p, (s != NULL) ? s : "(null)");
+	*p++ = '"';
+	*p++ = ',';
+	return p;
+}
+
 static void sig_handler(int sigio) {
 	if (sigio == SIGQUIT) {
 		quit_sig = 1;;
@@ -369,28 +393,46 @@ int parse_gateway_configuration(const char * conf_file) {
 	return 0;
 }
 
-void open_log(void) {
-	int i;
+/* open files of rotation period starting at f->start, runs in rotation worker except for first period */
+int open_log(struct lo_file *f) {
+	int fd;
 	char iso_date[20];
+	char *row;
+	struct tm tm;
 	
-	strftime(iso_date,ARRAY_SIZE(iso_date),"%Y%m%dT%H%M%SZ",gmtime(&now_time)); /* format yyyymmddThhmmssZ */
-	log_start_time = now_time; /* keep track of when the log was started, for log rotation */
+	strftime(iso_date,ARRAY_SIZE(iso_date),"%Y%m%dT%H%M%SZ",gmtime_r(&f->start, &tm)); /* format yyyymmddThhmmssZ */
 	
-	sprintf(log_file_name, "pktlog_%s_%s.csv", lgwm_str, iso_date);
-	log_file = fopen(log_file_name, "a"); /* create log file, append if file already exist */
-	if (log_file == NULL) {
-		MSG("ERROR: impossible to create log file %s\n", log_file_name);
-		exit(EXIT_FAILURE);
+	sprintf(f->log_name, "pktlog_%s_%s.csv", lgwm_str, iso_date);
+	fd = open(f->log_name, O_WRONLY | O_CREAT | O_APPEND, 0644); /* create log file, append if file already exist */
+	if ((fd < 0) || (cw_open(&f->log, fd, log_flush_rows, log_flush_ms, log_sync) != 0)) {
+		MSG("ERROR: impossible to create log file %s\n", f->log_name);
+		if (fd >= 0)
+			close(fd);
+		return -1;
 	}
 	
-	i = fprintf(log_file, "\"gateway ID\",\"node MAC\",\"UTC timestamp\",\"us count\",\"frequency\",\"RF chain\",\"RX chain\",\"status\",\"size\",\"modulation\",\"bandwidth\",\"datarate\",\"coderate\",\"RSSI\",\"SNR\",\"payload\",\"messageType\",\"AppEUI\",\"DevEUI\",\"DevNonce\",\"MIC\",\"DevAddr\",\"AppNonce\",\"NetID\",\"DLSettings\",\"RxDelay\",\"CFList\",\"PHYPayload\",\"MHDR\",\"MACPayload\",\"FCtrl\",\"FHDR\",\"FCnt\",\"FPort\",\"FRMPayload\",\"FOpts\"\n");
-	if (i < 0) {
-		MSG("ERROR: impossible to write to log file %s\n", log_file_name);
-		exit(EXIT_FAILURE);
+	row = cw_row_begin(&f->log);
+	row = cw_put_str(row, "\"gateway ID\",\"node MAC\",\"UTC timestamp\",\"us count\",\"frequency\",\"RF chain\",\"RX chain\",\"status\",\"size\",\"modulation\",\"bandwidth\",\"datarate\",\"coderate\",\"RSSI\",\"SNR\",\"payload\",\"messageType\",\"AppEUI\",\"DevEUI\",\"DevNonce\",\"MIC\",\"DevAddr\",\"AppNonce\",\"NetID\",\"DLSettings\",\"RxDelay\",\"CFList\",\"PHYPayload\",\"MHDR\",\"MACPayload\",\"FCtrl\",\"FHDR\",\"FCnt\",\"FPort\",\"FRMPayload\",\"FOpts\"\n");
+	cw_row_end(&f->log, row);
+	cw_flush(&f->log);
+	
+	if (f->cap_on) {
+		sprintf(f->cap_name, "pktcap_%s_%s.lgc", lgwm_str, iso_date);
+		fd = open(f->cap_name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if ((fd < 0) || (pc_open(&f->cap, fd, lgwm) != 0)) {
+			MSG("ERROR: impossible to create capture file %s\n", f->cap_name);
+			if (fd >= 0)
+				close(fd);
+			cw_close(&f->log);
+			return -1;
+		}
 	}
 	
-	MSG("INFO: Now writing to log file %s\n", log_file_name);
-	return;
+	MSG("INFO: Now writing to log file %s\n", f->log_name);
+	if (f->cap_on) {
+		MSG("INFO: Now writing to capture file %s\n", f->cap_name);
+	}
+	return 0;
 }
 
 /* describe command line options */
@@ -399,6 +441,11 @@ void usage(void) {
 	printf( "Available options:\n");
 	printf( " -h print this help\n");
 	printf( " -r <int> rotate log file every N seconds (-1 disable log rotation)\n");
+	printf( " -f <int> write log file every N packets (0 disable, default %d)\n", CW_DEFAULT_ROWS);
+	printf( " -t <int> write buffered packets after N ms (0 disable, default %d)\n", CW_DEFAULT_MS);
+	printf( " -s sync log file to disk after each write\n");
+	printf( " -b also write binary capture file, read by capture_query\n");
+	printf( " -z <none|gzip|zstd> compress rotated files in background (default none)\n");
 }
 
 /* -------------------------------------------------------------------------- */
@@ -406,17 +453,16 @@ void usage(void) {
 
 int main(int argc, char **argv)
 {
-	int i, j, g; /* loop and temporary variables */
+	int i; /* loop and temporary variables */
 	struct timespec sleep_time = {0, 3000000}; /* 3 ms */
 	
 	/* TODO  */
 	char _payload[1000];// = (char*) malloc(1000); // [(2*p->size)+1]
-        char buff[3];
 
 	/* clock and log rotation management */
 	int log_rotate_interval = 3600; /* by default, rotation every hour */
 	int time_check = 0; /* variable used to limit the number of calls to time() function */
-	unsigned long pkt_in_log = 0; /* count the number of packet written in each log file */
+	struct lo_file *log_cur; /* files of current rotation period */
 	
 	/* configuration file related */
 	const char global_conf_fname[] = "global_conf.json"; /* contain global (typ. network-wide) configuration */
@@ -427,14 +473,15 @@ int main(int argc, char **argv)
 	struct lgw_pkt_rx_s rxpkt[16]; /* array containing up to 16 inbound packets metadata */
 	struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
 	int nb_pkt;
+	char *row; /* current row in the log buffer */
 	
 	/* local timestamp variables until we get accurate GPS time */
 	struct timespec fetch_time;
-	char fetch_timestamp[30];
-	struct tm * x;
+	struct tf_cache fetch_cache;
+	const char *fetch_timestamp = NULL;
 	
 	/* parse command line options */
-	while ((i = getopt (argc, argv, "hr:")) != -1) {
+	while ((i = getopt (argc, argv, "hr:f:t:sbz:")) != -1) {
 		switch (i) {
 			case 'h':
 				usage();
@@ -449,6 +496,30 @@ int main(int argc, char **argv)
 				}
 				break;
 			
+			case 'f':
+				log_flush_rows = (uint32_t)atoi(optarg);
+				break;
+			
+			case 't':
+				log_flush_ms = (uint32_t)atoi(optarg);
+				break;
+			
+			case 's':
+				log_sync = true;
+				break;
+			
+			case 'b':
+				cap_enabled = true;
+				break;
+			
+			case 'z':
+				log_compress = lo_parse_compress(optarg);
+				if (log_compress < 0) {
+					MSG( "ERROR: Invalid argument for -z option\n");
+					return EXIT_FAILURE;
+				}
+				break;
+			
 			default:
 				MSG("ERROR: argument parsing use -h option for help\n");
 				usage();
@@ -504,10 +575,15 @@ int main(int argc, char **argv)
 	
 	/* opening log file and writing CSV header*/
 	time(&now_time);
-	open_log();
+	if (lo_start(&log_rotator, log_rotate_interval, log_compress, cap_enabled, open_log, now_time) != 0) {
+		MSG("ERROR: impossible to start log rotation\n");
+		return EXIT_FAILURE;
+	}
+	log_cur = lo_current(&log_rotator);
 
 
 	/* main loop */
+	tf_init(&fetch_cache, TF_MS);
 	while ((quit_sig != 1) && (exit_sig != 1)) {
 		/* fetch packets */
 		nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
@@ -518,191 +594,187 @@ int main(int argc, char **argv)
 			clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
 		} else {
 			/* local timestamp generation until we get accurate GPS time */
-			clock_gettime(CLOCK_REALTIME, &fetch_time);
-			x = gmtime(&(fetch_time.tv_sec));
-			sprintf(fetch_timestamp,"%04i-%02i-%02i %02i:%02i:%02i.%03liZ",(x->tm_year)+1900,(x->tm_mon)+1,x->tm_mday,x->tm_hour,x->tm_min,x->tm_sec,(fetch_time.tv_nsec)/1000000); /* ISO 8601 format */
+			tf_now(&fetch_cache, &fetch_time);
+			fetch_timestamp = tf_format(&fetch_cache, &fetch_time); /* ISO 8601 format, date part cached per second */
 		}
 		
-		/* log packets */
+		/* log packets, each row is formatted in place in the log buffer */
 		for (i=0; i < nb_pkt; ++i) {
 			p = &rxpkt[i];
+			if (log_cur->cap_on && (pc_append(&log_cur->cap, p, (uint64_t)fetch_time.tv_sec * 1000000 + fetch_time.tv_nsec / 1000) != 0)) {
+				MSG("WARNING: failed to write capture file %s\n", log_cur->cap_name);
+			}
+			row = cw_row_begin(&log_cur->log);
 			
 			/* writing gateway ID */
-			fprintf(log_file, "\"%08X%08X\",", (uint32_t)(lgwm >> 32), (uint32_t)(lgwm & 0xFFFFFFFF));
+			*row++ = '"';
+			row = cw_put_hex32(row, (uint32_t)(lgwm >> 32));
+			row = cw_put_hex32(row, (uint32_t)(lgwm & 0xFFFFFFFF));
+			row = cw_put_str(row, "\",");
 			
 			/* writing node MAC address */
-			fputs("\"\",", log_file); // TODO: need to parse payload
+			row = cw_put_str(row, "\"\","); // TODO: need to parse payload
 			
 			/* writing UTC timestamp*/
-			fprintf(log_file, "\"%s\",", fetch_timestamp);
+			row = put_field(row, fetch_timestamp);
 			// TODO: replace with GPS time when available
 			
 			/* writing internal clock */
-			fprintf(log_file, "%10u,", p->count_us);
+			row = cw_put_uint(row, p->count_us, 10);
+			*row++ = ',';
 			
 			/* writing RX frequency */
-			fprintf(log_file, "%10u,", p->freq_hz);
+			row = cw_put_uint(row, p->freq_hz, 10);
+			*row++ = ',';
 			
 			/* writing RF chain */
-			fprintf(log_file, "%u,", p->rf_chain);
+			row = cw_put_uint(row, p->rf_chain, 0);
+			*row++ = ',';
 			
 			/* writing RX modem/IF chain */
-			fprintf(log_file, "%2d,", p->if_chain);
+			row = cw_put_uint(row, p->if_chain, 2);
+			*row++ = ',';
 			
 			/* writing status */
 			switch(p->status) {
-				case STAT_CRC_OK:	fputs("\"CRC_OK\" ,", log_file); break;
-				case STAT_CRC_BAD:	fputs("\"CRC_BAD\",", log_file); break;
-				case STAT_NO_CRC:	fputs("\"NO_CRC\" ,", log_file); break;
-				case STAT_UNDEFINED:fputs("\"UNDEF\"  ,", log_file); break;
-				default: fputs("\"ERR\"    ,", log_file);
+				case STAT_CRC_OK:	row = cw_put_str(row, "\"CRC_OK\" ,"); break;
+				case STAT_CRC_BAD:	row = cw_put_str(row, "\"CRC_BAD\","); break;
+				case STAT_NO_CRC:	row = cw_put_str(row, "\"NO_CRC\" ,"); break;
+				case STAT_UNDEFINED:row = cw_put_str(row, "\"UNDEF\"  ,"); break;
+				default: row = cw_put_str(row, "\"ERR\"    ,");
 			}
 			
 			/* writing payload size */
-			fprintf(log_file, "%3u,", p->size);
+			row = cw_put_uint(row, p->size, 3);
+			*row++ = ',';
 			
 			/* writing modulation */
 			switch(p->modulation) {
-				case MOD_LORA:	fputs("\"LORA\",", log_file); break;
-				case MOD_FSK:	fputs("\"FSK\" ,", log_file); break;
-				default: fputs("\"ERR\" ,", log_file);
+				case MOD_LORA:	row = cw_put_str(row, "\"LORA\","); break;
+				case MOD_FSK:	row = cw_put_str(row, "\"FSK\" ,"); break;
+				default: row = cw_put_str(row, "\"ERR\" ,");
 			}
 			
 			/* writing bandwidth */
 			switch(p->bandwidth) {
-				case BW_500KHZ:	fputs("500000,", log_file); break;
-				case BW_250KHZ:	fputs("250000,", log_file); break;
-				case BW_125KHZ:	fputs("125000,", log_file); break;
-				case BW_62K5HZ:	fputs("62500 ,", log_file); break;
-				case BW_31K2HZ:	fputs("31200 ,", log_file); break;
-				case BW_15K6HZ:	fputs("15600 ,", log_file); break;
-				case BW_7K8HZ:	fputs("7800  ,", log_file); break;
-				case BW_UNDEFINED: fputs("0     ,", log_file); break;
-				default: fputs("-1    ,", log_file);
+				case BW_500KHZ:	row = cw_put_str(row, "500000,"); break;
+				case BW_250KHZ:	row = cw_put_str(row, "250000,"); break;
+				case BW_125KHZ:	row = cw_put_str(row, "125000,"); break;
+				case BW_62K5HZ:	row = cw_put_str(row, "62500 ,"); break;
+				case BW_31K2HZ:	row = cw_put_str(row, "31200 ,"); break;
+				case BW_15K6HZ:	row = cw_put_str(row, "15600 ,"); break;
+				case BW_7K8HZ:	row = cw_put_str(row, "7800  ,"); break;
+				case BW_UNDEFINED: row = cw_put_str(row, "0     ,"); break;
+				default: row = cw_put_str(row, "-1    ,");
 			}
 			
 			/* writing datarate */
 			if (p->modulation == MOD_LORA) {
 				switch (p->datarate) {
-					case DR_LORA_SF7:	fputs("\"SF7\"   ,", log_file); break;
-					case DR_LORA_SF8:	fputs("\"SF8\"   ,", log_file); break;
-					case DR_LORA_SF9:	fputs("\"SF9\"   ,", log_file); break;
-					case DR_LORA_SF10:	fputs("\"SF10\"  ,", log_file); break;
-					case DR_LORA_SF11:	fputs("\"SF11\"  ,", log_file); break;
-					case DR_LORA_SF12:	fputs("\"SF12\"  ,", log_file); break;
-					default: fputs("\"ERR\"   ,", log_file);
+					case DR_LORA_SF7:	row = cw_put_str(row, "\"SF7\"   ,"); break;
+					case DR_LORA_SF8:	row = cw_put_str(row, "\"SF8\"   ,"); break;
+					case DR_LORA_SF9:	row = cw_put_str(row, "\"SF9\"   ,"); break;
+					case DR_LORA_SF10:	row = cw_put_str(row, "\"SF10\"  ,"); break;
+					case DR_LORA_SF11:	row = cw_put_str(row, "\"SF11\"  ,"); break;
+					case DR_LORA_SF12:	row = cw_put_str(row, "\"SF12\"  ,"); break;
+					default: row = cw_put_str(row, "\"ERR\"   ,");
 				}
 			} else if (p->modulation == MOD_FSK) {
-				fprintf(log_file, "\"%6u\",", p->datarate);
+				*row++ = '"';
+				row = cw_put_uint(row, p->datarate, 6);
+				row = cw_put_str(row, "\",");
 			} else {
-				fputs("\"ERR\"   ,", log_file);
+				row = cw_put_str(row, "\"ERR\"   ,");
 			}
 			
 			/* writing coderate */
 			switch (p->coderate) {
-				case CR_LORA_4_5:	fputs("\"4/5\",", log_file); break;
-				case CR_LORA_4_6:	fputs("\"2/3\",", log_file); break;
-				case CR_LORA_4_7:	fputs("\"4/7\",", log_file); break;
-				case CR_LORA_4_8:	fputs("\"1/2\",", log_file); break;
-				case CR_UNDEFINED:	fputs("\"\"   ,", log_file); break;
-				default: fputs("\"ERR\",", log_file);
+				case CR_LORA_4_5:	row = cw_put_str(row, "\"4/5\","); break;
+				case CR_LORA_4_6:	row = cw_put_str(row, "\"2/3\","); break;
+				case CR_LORA_4_7:	row = cw_put_str(row, "\"4/7\","); break;
+				case CR_LORA_4_8:	row = cw_put_str(row, "\"1/2\","); break;
+				case CR_UNDEFINED:	row = cw_put_str(row, "\"\"   ,"); break;
+				default: row = cw_put_str(row, "\"ERR\",");
 			}
 			
 			/* writing packet RSSI */
-			fprintf(log_file, "%+.0f,", p->rssi);
+			row = cw_put_fixed(row, p->rssi, 0, 0);
+			*row++ = ',';
 			
 			/* writing packet average SNR */
-			fprintf(log_file, "%+5.1f,", p->snr);
-			
-			/* writing hex-encoded payload (bundled in 32-bit words) */
-			fputs("\"", log_file);
-			for (j = 0; j < p->size; ++j) {
-				//if ((j > 0) && (j%4 == 0)) fputs("-", log_file);
-				fprintf(log_file, "%02X", p->payload[j]);
-			}
+			row = cw_put_fixed(row, p->snr, 1, 5);
+			*row++ = ',';
 			
-			/* writing cesnet decode lora packet */
-			for(g = 0; g < p->size; ++g){
-				sprintf(buff, "%02X", p->payload[g]);
-				buff[2] = '\0';
-				strcat(_payload, buff);
-			}
+			/* writing hex-encoded payload, encoded once for CSV and cesnet decoder */
+			hx_encode(_payload, p->payload, p->size);
+			*row++ = '"';
+			row = cw_put_str(row, _payload);
 
 			MSG(" INFO: Hex packet |%s|\n", _payload);
 
 			initialization(_payload);
 			_payload[0] = '\0';
 
-			fprintf(log_file, "\", %i,", getMessageType());
+			row = cw_put_str(row, "\", ");
+			row = cw_put_int(row, getMessageType());
+			*row++ = ',';
 
 			if(isJoinRequestMessage()){
-				fprintf(log_file, "\"%s\",", AppEUI);
-				fprintf(log_file, "\"%s\",", DevEUI);
-				fprintf(log_file, "\"%s\",", DevNonce);
+				row = put_field(row, AppEUI);
+				row = put_field(row, DevEUI);
+				row = put_field(row, DevNonce);
 			}else{
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
+				row = cw_put_str(row, "\"\",\"\",\"\",");
 			}
 
-			fprintf(log_file, "\"%s\",", MIC);
+			row = put_field(row, MIC);
 
 			if(isJoinAcceptMessage() || isDataMessage())
-				fprintf(log_file, "\"%s\",", DevAddr);
+				row = put_field(row, DevAddr);
 
 			if(isJoinAcceptMessage()){
-				fprintf(log_file, "\"%s\",", AppNonce);
-				fprintf(log_file, "\"%s\",", NetID);
-				fprintf(log_file, "\"%i\",", DLSettings);
-				fprintf(log_file, "\"%i\",", RxDelay);
-				fprintf(log_file, "\"%s\",", CFList);
+				row = put_field(row, AppNonce);
+				row = put_field(row, NetID);
+				*row++ = '"';
+				row = cw_put_int(row, DLSettings);
+				row = cw_put_str(row, "\",\"");
+				row = cw_put_int(row, RxDelay);
+				row = cw_put_str(row, "\",");
+				row = put_field(row, CFList);
 			}else{
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
+				row = cw_put_str(row, "\"\",\"\",\"\",\"\",\"\",");
 			}
 
 			if(isDataMessage()){
-				fprintf(log_file, "\"%s\",", PHYPayload);
-				fprintf(log_file, "\"%s\",", MHDR);
-				fprintf(log_file, "\"%s\",", MACPayload);
-				fprintf(log_file, "\"%s\",", FCtrl);
-				fprintf(log_file, "\"%s\",", FHDR);
-				fprintf(log_file, "\"%s\",", FCnt);
-				fprintf(log_file, "\"%s\",", FPort);
-				fprintf(log_file, "\"%s\",", FRMPayload);
-				fprintf(log_file, "\"%s\",", FOpts);
+				row = put_field(row, PHYPayload);
+				row = put_field(row, MHDR);
+				row = put_field(row, MACPayload);
+				row = put_field(row, FCtrl);
+				row = put_field(row, FHDR);
+				row = put_field(row, FCnt);
+				row = put_field(row, FPort);
+				row = put_field(row, FRMPayload);
+				row = put_field(row, FOpts);
 			}else{
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
-				fputs("\"\",", log_file);
+				row = cw_put_str(row, "\"\",\"\",\"\",\"\",\"\",\"\",\"\",\"\",\"\",");
 			}
 
 			/* end of log file line */
-			fputs("\"\n", log_file);
-			fflush(log_file);
-			++pkt_in_log;
+			row = cw_put_str(row, "\"\n");
+			cw_row_end(&log_cur->log, row);
+			++log_cur->rows;
 		}
 		
+		/* write buffered rows once they are old enough */
+		cw_tick(&log_cur->log);
+		
 		/* check time and rotate log file if necessary */
 		++time_check;
 		if (time_check >= 8) {
 			time_check = 0;
 			time(&now_time);
-			if (difftime(now_time, log_start_time) > log_rotate_interval) {
-				fclose(log_file);
-				MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
-				pkt_in_log = 0;
-				open_log();
-			}
+			/* next files are pre-opened and swapped in, old ones closed and compressed by worker */
+			log_cur = lo_tick(&log_rotator, now_time);
 		}
 	}
 	
@@ -714,8 +786,7 @@ int main(int argc, char **argv)
 		} else {
 			MSG("WARNING: failed to stop concentrator successfully\n");
 		}
-		fclose(log_file);
-		MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
+		lo_stop(&log_rotator);
 	}
 	
 